@@ -8,6 +8,8 @@ LOCAL_SRC_FILES	:= 									\
 	common/sparkle_connection.cpp					\
 	common/sparkle_server.cpp						\
 	common/sparkle_protocol.cpp						\
+	common/sparkle_codec.cpp						\
+	common/sparkle_capture.cpp					\
 	common/sparkle_surface_shm.cpp					\
 	common/sparkle_surface_ashmem.cpp				\
 	common/were_benchmark.cpp						\
@@ -37,7 +39,24 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/src $(SPARKLE_C_INCLUDES)
 LOCAL_SRC_FILES := \
 	platform/jni/platform_jni.cpp					\
 	compositor/gl/compositor_gl.cpp					\
-	compositor/gl/texture.cpp
+	compositor/gl/texture.cpp					\
+	compositor/gl/region.cpp					\
+	compositor/gl/frame_scheduler.cpp					\
+	compositor/gl/hit_grid.cpp					\
+	compositor/gl/program_cache.cpp					\
+	compositor/gl/upload_budget.cpp					\
+	compositor/gl/upload_tuner.cpp					\
+	compositor/gl/uploader.cpp					\
+	compositor/gl/readback.cpp					\
+	compositor/gl/atlas.cpp					\
+	compositor/sw/compositor_sw.cpp					\
+	compositor/sw/blitter.cpp					\
+	compositor/passthrough/compositor_passthrough.cpp					\
+	compositor/compositor_backend.cpp					\
+	compositor/frame_capture.cpp					\
+	compositor/scale_policy.cpp					\
+	compositor/surface_registry.cpp					\
+	compositor/performance_hud.cpp
 
 LOCAL_STATIC_LIBRARIES := libsparkle_common
 include $(BUILD_SHARED_LIBRARY)
@@ -1,6 +1,6 @@
 #include "were/were_event_loop.h"
 #include "platform/na/platform_na.h"
-#include "compositor/gl/compositor_gl.h"
+#include "compositor/compositor_backend.h"
 #include "common/were_benchmark.h"
 #include "sound/sles/sound_sles.h"
 #include <sys/stat.h>
@@ -18,7 +18,7 @@ void android_main(struct android_app *app)
     {
         WereEventLoop *loop = new WereEventLoop();
         Platform *platform = platform_na_create(loop, app);
-        Compositor *compositor = compositor_gl_create(loop, platform, internalDataPath + "/usr/tmp/sparkle.socket");
+        Compositor *compositor = compositor_create(loop, platform, internalDataPath + "/usr/tmp/sparkle.socket");
 
         platform->start();
         loop->run();
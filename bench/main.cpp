@@ -0,0 +1,189 @@
+#include "were/were_event_loop.h"
+#include "were/were_signal_handler.h"
+#include "were/were_timer.h"
+#include "common/sparkle_server.h"
+#include "common/sparkle_connection.h"
+#include "common/sparkle_protocol.h"
+#include "common/sparkle_codec.h"
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+/* ================================================================================================================== */
+
+/*
+ * Loopback benchmark of the TCP streaming mode: a client renders 1080p frames, sends the damaged tiles delta coded
+ * and a server in the same event loop decodes them into its mirror. Usage: test [tcp:host:port] [seconds]
+ */
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+const int BPP = 4;
+const int TILE = 128;
+const unsigned int BACKLOG = 2 * 1024 * 1024;
+
+class Bench
+{
+public:
+    Bench(WereEventLoop *loop, const std::string &address, int seconds);
+
+private:
+    void connected();
+    void frame();
+    void packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message);
+    void report();
+
+private:
+    WereEventLoop *_loop;
+    SparkleServer _server;
+    SparkleConnection _client;
+    WereTimer _frameTimer;
+    WereTimer _reportTimer;
+
+    std::vector<unsigned char> _frame;
+    std::vector<unsigned char> _reference;
+    std::vector<unsigned char> _mirror;
+    std::string _encoded;
+
+    int _seconds;
+    int _counter;
+    uint64_t _bytes;
+    uint64_t _frames;
+    uint64_t _rawBytes;
+    std::chrono::steady_clock::time_point _start;
+};
+
+Bench::Bench(WereEventLoop *loop, const std::string &address, int seconds) :
+    _loop(loop), _server(loop, address), _client(loop, address), _frameTimer(loop), _reportTimer(loop),
+    _frame(WIDTH * HEIGHT * BPP, 0), _reference(WIDTH * HEIGHT * BPP, 0), _mirror(WIDTH * HEIGHT * BPP, 0)
+{
+    _seconds = seconds;
+    _counter = 0;
+    _bytes = 0;
+    _frames = 0;
+    _rawBytes = 0;
+
+    _server.signal_packet.connect(WereSimpleQueuer(loop, &Bench::packet, this));
+    _client.signal_connected.connect(WereSimpleQueuer(loop, &Bench::connected, this));
+    _frameTimer.timeout.connect(WereSimpleQueuer(loop, &Bench::frame, this));
+    _reportTimer.timeout.connect(WereSimpleQueuer(loop, &Bench::report, this));
+}
+
+void Bench::connected()
+{
+    _client.send(RegisterSurfaceStreamRequest({"bench", WIDTH, HEIGHT, SurfaceFormatXRGB8888}));
+
+    _start = std::chrono::steady_clock::now();
+    _frameTimer.start(1, false);
+    _reportTimer.start(_seconds * 1000, true);
+}
+
+/* A moving box over a static background and a strip of noise, roughly a scrolling terminal next to a video */
+void Bench::frame()
+{
+    if (_client.bytesPending() > BACKLOG)
+        return;
+
+    _counter += 1;
+
+    int bx = (_counter * 8) % (WIDTH - 256);
+    int by = (_counter * 4) % (HEIGHT - 256);
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(_frame.data());
+
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+        for (int x = 0; x < WIDTH; ++x)
+        {
+            bool box = x >= bx && x < bx + 256 && y >= by && y < by + 256;
+            pixels[y * WIDTH + x] = box ? 0xFFFF8000 : 0xFF202020 + ((x / 64 + y / 64) & 1) * 0x101010;
+        }
+    }
+
+    for (int y = HEIGHT - 200; y < HEIGHT; ++y)
+        for (int x = 0; x < 640; ++x)
+            pixels[y * WIDTH + x] = 0xFF000000 | (rand() & 0xFFFFFF);
+
+    for (int ty = 0; ty < HEIGHT; ty += TILE)
+    {
+        for (int tx = 0; tx < WIDTH; tx += TILE)
+        {
+            int x2 = std::min(tx + TILE, WIDTH);
+            int y2 = std::min(ty + TILE, HEIGHT);
+
+            SparkleCodec::encodeDelta(_frame.data(), _reference.data(), WIDTH * BPP, tx, ty, x2, y2, BPP, &_encoded);
+            if (_encoded.empty())
+                continue;
+
+            int32_t codec = SurfaceCodecDelta;
+            if (_encoded.size() >= static_cast<size_t>((x2 - tx) * (y2 - ty) * BPP))
+            {
+                SparkleCodec::encodeRaw(_frame.data(), WIDTH * BPP, tx, ty, x2, y2, BPP, &_encoded);
+                codec = SurfaceCodecRaw;
+            }
+
+            _client.send(SurfaceDataRequest({"bench", tx, ty, x2, y2, codec, _encoded}));
+            _bytes += _encoded.size();
+        }
+    }
+
+    _client.send(AddSurfaceDamageRequest({"bench", 0, 0, WIDTH, HEIGHT}));
+}
+
+void Bench::packet(std::shared_ptr<SparkleConnection>, std::shared_ptr<WereSocketUnixMessage> message)
+{
+    uint32_t operation;
+
+    WereSocketUnixMessageStream stream(message.get());
+    stream >> operation;
+
+    if (operation == SurfaceDataRequestCode)
+    {
+        SurfaceDataRequest r1;
+        stream >> r1;
+
+        bool result;
+        if (r1.codec == SurfaceCodecRaw)
+            result = SparkleCodec::decodeRaw(r1.data, _mirror.data(), WIDTH * BPP, r1.x1, r1.y1, r1.x2, r1.y2, BPP);
+        else
+            result = SparkleCodec::decodeDelta(r1.data, _mirror.data(), WIDTH * BPP, r1.x1, r1.y1, r1.x2, r1.y2, BPP);
+
+        if (!result)
+            were_message("Malformed tile %d %d.\n", r1.x1, r1.y1);
+
+        _rawBytes += (r1.x2 - r1.x1) * (r1.y2 - r1.y1) * BPP;
+    }
+    else if (operation == AddSurfaceDamageRequestCode)
+        _frames += 1;
+}
+
+void Bench::report()
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+
+    were_message("%dx%d: %.1f fps, %.1f MB/s on the wire, %.1f MB/s of tiles.\n",
+        WIDTH, HEIGHT, _frames / elapsed, _bytes / elapsed / 1048576.0, _rawBytes / elapsed / 1048576.0);
+
+    _loop->exit();
+}
+
+/* ================================================================================================================== */
+
+int main(int argc, char *argv[])
+{
+    std::string address = (argc > 1) ? argv[1] : "tcp:127.0.0.1:5900";
+    int seconds = (argc > 2) ? atoi(argv[2]) : 10;
+
+    WereEventLoop *loop = new WereEventLoop();
+    WereSignalHandler *sig = new WereSignalHandler(loop);
+    sig->terminate.connect(WereSimpleQueuer(loop, &WereEventLoop::exit, loop));
+
+    Bench *bench = new Bench(loop, address, seconds);
+
+    loop->run();
+
+    /* Queued packets still reference both ends, leave the teardown to the process exit */
+    (void)bench;
+    (void)sig;
+
+    return 0;
+}
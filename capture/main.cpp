@@ -0,0 +1,407 @@
+#include "were/were_event_loop.h"
+#include "were/were_signal_handler.h"
+#include "were/were_timer.h"
+#include "common/sparkle_connection.h"
+#include "common/sparkle_protocol.h"
+#include "common/sparkle_capture.h"
+#include <zlib.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+/* ================================================================================================================== */
+
+/*
+ * Records the frames of the compositor from its capture ring.
+ * Usage: sparkle-capture [-s socket] [-n slots] [-d] [-r rate] [-t seconds] output.y4m|pattern%06d.png
+ * -d drops frames when the ring is full instead of holding up composition. Y4M output is 4:2:0 at a constant rate,
+ * frames are repeated to fill the time between changes; PNG output is one file per captured frame.
+ */
+
+class Capture
+{
+public:
+    ~Capture();
+    Capture(WereEventLoop *loop, const std::string &socket, const std::string &output, int slots, bool drop,
+        int rate);
+
+    void stop();
+
+private:
+    void connected();
+    void disconnected();
+    void message(std::shared_ptr<WereSocketUnixMessage> message);
+    void started(int fd, int width, int height);
+    void frame(int slot);
+
+    void convertY4M(const unsigned char *pixels, int stride);
+    void writeY4M();
+    void writePNG(const unsigned char *pixels, int stride, uint32_t sequence);
+    static void writeChunk(FILE *file, const char *type, const unsigned char *data, uint32_t size);
+
+private:
+    WereEventLoop *_loop;
+    SparkleConnection _connection;
+    std::string _output;
+    bool _png;
+    int _slots;
+    bool _drop;
+    int _rate;
+
+    SparkleCapture *_ring;
+    int _width;
+    int _height;
+    FILE *_file;
+
+    std::vector<unsigned char> _yuv;
+    bool _pending;
+    uint64_t _start;
+    uint64_t _written;
+    uint64_t _frames;
+    uint64_t _dropped;
+};
+
+Capture::~Capture()
+{
+    if (_file != nullptr)
+        fclose(_file);
+
+    delete _ring;
+}
+
+Capture::Capture(WereEventLoop *loop, const std::string &socket, const std::string &output, int slots, bool drop,
+    int rate) :
+    _loop(loop), _connection(loop, socket), _output(output)
+{
+    _png = _output.size() > 4 && _output.compare(_output.size() - 4, 4, ".png") == 0;
+    _slots = slots;
+    _drop = drop;
+    _rate = rate;
+
+    _ring = nullptr;
+    _width = 0;
+    _height = 0;
+    _file = nullptr;
+
+    _pending = false;
+    _start = 0;
+    _written = 0;
+    _frames = 0;
+    _dropped = 0;
+
+    _connection.signal_connected.connect(WereSimpleQueuer(loop, &Capture::connected, this));
+    _connection.signal_disconnected.connect(WereSimpleQueuer(loop, &Capture::disconnected, this));
+    _connection.signal_message.connect(WereSimpleQueuer(loop, &Capture::message, this));
+}
+
+void Capture::connected()
+{
+    _connection.send(StartCaptureRequest({static_cast<uint32_t>(_slots), _drop ? CaptureDropFrames : 0}));
+}
+
+void Capture::disconnected()
+{
+    were_message("Compositor gone.\n");
+    stop();
+}
+
+/* The last frame converted is still owed to the file */
+void Capture::stop()
+{
+    if (_connection.connected())
+        _connection.send(StopCaptureRequestCode);
+
+    if (!_png && _pending)
+        writeY4M();
+
+    were_message("%llu frames captured, %llu dropped by the compositor.\n",
+        static_cast<unsigned long long>(_frames), static_cast<unsigned long long>(_dropped));
+
+    _loop->exit();
+}
+
+void Capture::message(std::shared_ptr<WereSocketUnixMessage> message)
+{
+    uint32_t operation;
+
+    WereSocketUnixMessageStream stream(message.get());
+    stream >> operation;
+
+    if (operation == CaptureStartedNotificationCode)
+    {
+        CaptureStartedNotification n1;
+        stream >> n1;
+        started(n1.fd, n1.width, n1.height);
+    }
+    else if (operation == CaptureFrameNotificationCode)
+    {
+        CaptureFrameNotification n1;
+        stream >> n1;
+        frame(n1.slot);
+    }
+}
+
+void Capture::started(int fd, int width, int height)
+{
+    if (!_png && _file != nullptr && (width != _width || height != _height))
+    {
+        close(fd);
+        were_message("Display size changed to %dx%d, a Y4M stream cannot follow.\n", width, height);
+        stop();
+        return;
+    }
+
+    delete _ring;
+    _ring = nullptr;
+
+    try
+    {
+        _ring = new SparkleCapture(fd);
+    }
+    catch (const std::exception &e)
+    {
+        were_error("%s\n", e.what());
+        stop();
+        return;
+    }
+
+    _width = width;
+    _height = height;
+
+    if (!_png && _file == nullptr)
+    {
+        _file = (_output == "-") ? stdout : fopen(_output.c_str(), "wb");
+        if (_file == nullptr)
+        {
+            were_error("Failed to open %s.\n", _output.c_str());
+            stop();
+            return;
+        }
+
+        fprintf(_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", _width, _height, _rate);
+        _yuv.resize(_width * _height + 2 * ((_width + 1) / 2) * ((_height + 1) / 2));
+    }
+
+    were_message("Capturing %dx%d, %d slots.\n", _width, _height, _ring->slots());
+}
+
+void Capture::frame(int slot)
+{
+    if (_ring == nullptr || slot < 0 || slot >= _ring->slots())
+        return;
+
+    SparkleCaptureSlot *header = _ring->slot(slot);
+    const unsigned char *pixels = _ring->pixels(slot);
+
+    _frames += 1;
+    _dropped += header->dropped;
+
+    if (_png)
+        writePNG(pixels, _ring->stride(), header->sequence);
+    else
+    {
+        if (_written == 0 && !_pending)
+            _start = header->time;
+
+        /* Frames due before this one repeat the previous picture */
+        uint64_t index = (header->time - _start) * _rate / 1000000000ULL;
+        while (_pending && _written < index)
+            writeY4M();
+
+        convertY4M(pixels, _ring->stride());
+        _pending = true;
+
+        if (_written <= index)
+            writeY4M();
+    }
+
+    _ring->release(slot);
+}
+
+/* ================================================================================================================== */
+
+/* Full range BT.601, chroma averaged over 2x2 pixels */
+void Capture::convertY4M(const unsigned char *pixels, int stride)
+{
+    int cw = (_width + 1) / 2;
+    int ch = (_height + 1) / 2;
+    unsigned char *py = _yuv.data();
+    unsigned char *pu = py + _width * _height;
+    unsigned char *pv = pu + cw * ch;
+
+    for (int y = 0; y < _height; ++y)
+    {
+        const unsigned char *row = &pixels[y * stride];
+        for (int x = 0; x < _width; ++x)
+        {
+            int b = row[x * 4 + 0];
+            int g = row[x * 4 + 1];
+            int r = row[x * 4 + 2];
+            py[y * _width + x] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+        }
+    }
+
+    for (int y = 0; y < ch; ++y)
+    {
+        for (int x = 0; x < cw; ++x)
+        {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+
+            for (int k = 0; k < 4; ++k)
+            {
+                int sx = std::min(x * 2 + (k & 1), _width - 1);
+                int sy = std::min(y * 2 + (k >> 1), _height - 1);
+                const unsigned char *p = &pixels[sy * stride + sx * 4];
+                b += p[0];
+                g += p[1];
+                r += p[2];
+            }
+
+            pu[y * cw + x] = ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128;
+            pv[y * cw + x] = ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128;
+        }
+    }
+}
+
+void Capture::writeY4M()
+{
+    fputs("FRAME\n", _file);
+    fwrite(_yuv.data(), 1, _yuv.size(), _file);
+    _written += 1;
+    _pending = false;
+}
+
+void Capture::writePNG(const unsigned char *pixels, int stride, uint32_t sequence)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), _output.c_str(), sequence);
+
+    std::vector<unsigned char> raw((_width * 3 + 1) * _height);
+    for (int y = 0; y < _height; ++y)
+    {
+        unsigned char *out = &raw[y * (_width * 3 + 1)];
+        const unsigned char *row = &pixels[y * stride];
+
+        out[0] = 0;
+        for (int x = 0; x < _width; ++x)
+        {
+            out[1 + x * 3 + 0] = row[x * 4 + 2];
+            out[1 + x * 3 + 1] = row[x * 4 + 1];
+            out[1 + x * 3 + 2] = row[x * 4 + 0];
+        }
+    }
+
+    uLongf size = compressBound(raw.size());
+    std::vector<unsigned char> compressed(size);
+    if (compress2(compressed.data(), &size, raw.data(), raw.size(), 1) != Z_OK)
+    {
+        were_error("Failed to compress frame %u.\n", sequence);
+        return;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        were_error("Failed to open %s.\n", path);
+        return;
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+
+    /* Width, height, 8 bits, RGB, default compression, filter and no interlace */
+    unsigned char ihdr[13] = {
+        static_cast<unsigned char>(_width >> 24), static_cast<unsigned char>(_width >> 16),
+        static_cast<unsigned char>(_width >> 8), static_cast<unsigned char>(_width),
+        static_cast<unsigned char>(_height >> 24), static_cast<unsigned char>(_height >> 16),
+        static_cast<unsigned char>(_height >> 8), static_cast<unsigned char>(_height),
+        8, 2, 0, 0, 0};
+
+    writeChunk(file, "IHDR", ihdr, sizeof(ihdr));
+    writeChunk(file, "IDAT", compressed.data(), size);
+    writeChunk(file, "IEND", nullptr, 0);
+
+    fclose(file);
+}
+
+void Capture::writeChunk(FILE *file, const char *type, const unsigned char *data, uint32_t size)
+{
+    unsigned char length[4] = {static_cast<unsigned char>(size >> 24), static_cast<unsigned char>(size >> 16),
+        static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size)};
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(type), 4);
+    if (size > 0)
+        crc = crc32(crc, data, size);
+
+    unsigned char checksum[4] = {static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+        static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc)};
+
+    fwrite(length, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    if (size > 0)
+        fwrite(data, 1, size, file);
+    fwrite(checksum, 1, 4, file);
+}
+
+/* ================================================================================================================== */
+
+int main(int argc, char *argv[])
+{
+    std::string socket = "/tmp/sparkle.socket";
+    int slots = 4;
+    bool drop = false;
+    int rate = 30;
+    int seconds = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:n:dr:t:")) != -1)
+    {
+        if (option == 's')
+            socket = optarg;
+        else if (option == 'n')
+            slots = atoi(optarg);
+        else if (option == 'd')
+            drop = true;
+        else if (option == 'r')
+            rate = atoi(optarg);
+        else if (option == 't')
+            seconds = atoi(optarg);
+        else
+            return 1;
+    }
+
+    if (optind >= argc || rate <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-s socket] [-n slots] [-d] [-r rate] [-t seconds] output.y4m|pattern%%06d.png\n",
+            argv[0]);
+        return 1;
+    }
+
+    WereEventLoop *loop = new WereEventLoop();
+    WereSignalHandler *sig = new WereSignalHandler(loop);
+    Capture *capture = new Capture(loop, socket, argv[optind], slots, drop, rate);
+
+    sig->terminate.connect(WereSimpleQueuer(loop, &Capture::stop, capture));
+
+    WereTimer *timer = new WereTimer(loop);
+    timer->timeout.connect(WereSimpleQueuer(loop, &Capture::stop, capture));
+    if (seconds > 0)
+        timer->start(seconds * 1000, true);
+
+    loop->run();
+
+    delete timer;
+    delete capture;
+    delete sig;
+    delete loop;
+
+    return 0;
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,155 @@
+#include "sparkle_capture.h"
+#include "were/were_exception.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <cstring>
+
+#ifdef __ANDROID__
+#include <linux/ashmem.h>
+#endif
+
+/* ================================================================================================================== */
+
+static int create_region(const char *name, size_t size)
+{
+#ifdef __NR_memfd_create
+    int fd = syscall(__NR_memfd_create, name, 0);
+    if (fd != -1)
+    {
+        if (ftruncate(fd, size) == 0)
+            return fd;
+
+        close(fd);
+        return -1;
+    }
+#endif
+
+#ifdef __ANDROID__
+    int ashmem = open("/dev/ashmem", O_RDWR);
+    if (ashmem == -1)
+        return -1;
+
+    char buffer[ASHMEM_NAME_LEN] = {0};
+    strncpy(buffer, name, sizeof(buffer) - 1);
+
+    if (ioctl(ashmem, ASHMEM_SET_NAME, buffer) < 0 || ioctl(ashmem, ASHMEM_SET_SIZE, size) < 0)
+    {
+        close(ashmem);
+        return -1;
+    }
+
+    return ashmem;
+#else
+    return -1;
+#endif
+}
+
+/* ================================================================================================================== */
+
+SparkleCapture::~SparkleCapture()
+{
+    munmap(_data, _size);
+    close(_fd);
+}
+
+SparkleCapture::SparkleCapture(int width, int height, int slots)
+{
+    size_t page = pageSize();
+    size_t stride = width * 4;
+    size_t slotSize = page + (stride * height + page - 1) / page * page;
+    size_t size = page + slotSize * slots;
+
+    _fd = create_region("sparkle_capture", size);
+    if (_fd == -1)
+        throw WereException("[%p][%s] Failed to create shared memory.", this, __PRETTY_FUNCTION__);
+
+    map(size);
+
+    _header->magic = SparkleCaptureMagic;
+    _header->width = width;
+    _header->height = height;
+    _header->stride = stride;
+    _header->slots = slots;
+    _header->slotSize = slotSize;
+
+    for (int i = 0; i < slots; ++i)
+        slot(i)->state.store(SparkleCaptureFree);
+}
+
+SparkleCapture::SparkleCapture(int fd)
+{
+    _fd = fd;
+
+    /* Ashmem regions have no size to stat, the header says how much to map */
+    map(pageSize());
+
+    if (_header->magic != SparkleCaptureMagic)
+    {
+        munmap(_data, _size);
+        close(_fd);
+        throw WereException("[%p][%s] Not a capture ring.", this, __PRETTY_FUNCTION__);
+    }
+
+    size_t size = pageSize() + static_cast<size_t>(_header->slotSize) * _header->slots;
+    munmap(_data, _size);
+    map(size);
+}
+
+size_t SparkleCapture::pageSize()
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+void SparkleCapture::map(size_t size)
+{
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(_fd);
+        throw WereException("[%p][%s] Failed to mmap file.", this, __PRETTY_FUNCTION__);
+    }
+
+    _size = size;
+    _data = reinterpret_cast<unsigned char *>(data);
+    _header = reinterpret_cast<SparkleCaptureHeader *>(_data);
+}
+
+/* ================================================================================================================== */
+
+SparkleCaptureSlot *SparkleCapture::slot(int index)
+{
+    return reinterpret_cast<SparkleCaptureSlot *>(_data + pageSize() + static_cast<size_t>(_header->slotSize) * index);
+}
+
+unsigned char *SparkleCapture::pixels(int index)
+{
+    return reinterpret_cast<unsigned char *>(slot(index)) + pageSize();
+}
+
+int SparkleCapture::acquire()
+{
+    for (int i = 0; i < slots(); ++i)
+    {
+        uint32_t expected = SparkleCaptureFree;
+        if (slot(i)->state.compare_exchange_strong(expected, SparkleCaptureWriting))
+            return i;
+    }
+
+    return -1;
+}
+
+void SparkleCapture::commit(int index)
+{
+    slot(index)->state.store(SparkleCaptureReady, std::memory_order_release);
+}
+
+void SparkleCapture::release(int index)
+{
+    slot(index)->state.store(SparkleCaptureFree, std::memory_order_release);
+}
+
+/* ================================================================================================================== */
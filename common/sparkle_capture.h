@@ -0,0 +1,84 @@
+#ifndef SPARKLE_CAPTURE_H
+#define SPARKLE_CAPTURE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+/* ================================================================================================================== */
+
+const uint32_t SparkleCaptureMagic = 0x53504343;
+
+/* Slot states, the compositor writes free slots and the consumer frees ready ones */
+const uint32_t SparkleCaptureFree = 0;
+const uint32_t SparkleCaptureWriting = 1;
+const uint32_t SparkleCaptureReady = 2;
+
+struct SparkleCaptureHeader
+{
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    /* Bytes per row, pixels are BGRX */
+    uint32_t stride;
+    uint32_t slots;
+    /* Offset of one slot to the next, the pixels of a slot start one page after it */
+    uint32_t slotSize;
+};
+
+struct SparkleCaptureSlot
+{
+    std::atomic<uint32_t> state;
+    uint32_t sequence;
+    /* Monotonic clock, nanoseconds */
+    uint64_t time;
+    /* What changed since the previous frame written to the ring */
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+    /* Frames dropped since the previous one */
+    uint32_t dropped;
+};
+
+/*
+ * Ring of composed frames in shared memory (memfd, ashmem where there is none). Every slot holds a whole frame, the
+ * compositor only copies into a slot what changed since it was last written.
+ */
+class SparkleCapture
+{
+public:
+    ~SparkleCapture();
+    /* Creates the ring */
+    SparkleCapture(int width, int height, int slots);
+    /* Maps the ring of another process, takes the descriptor */
+    explicit SparkleCapture(int fd);
+
+    int fd() {return _fd;}
+    int width() {return _header->width;}
+    int height() {return _header->height;}
+    int stride() {return _header->stride;}
+    int slots() {return _header->slots;}
+
+    SparkleCaptureSlot *slot(int index);
+    unsigned char *pixels(int index);
+
+    /* A free slot marked as being written, -1 when the consumer holds all of them */
+    int acquire();
+    void commit(int index);
+    void release(int index);
+
+private:
+    static size_t pageSize();
+    void map(size_t size);
+
+private:
+    int _fd;
+    size_t _size;
+    unsigned char *_data;
+    SparkleCaptureHeader *_header;
+};
+
+/* ================================================================================================================== */
+
+#endif /* SPARKLE_CAPTURE_H */
@@ -0,0 +1,270 @@
+#include "sparkle_codec.h"
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* ================================================================================================================== */
+
+enum
+{
+    TokenSkip = 0,
+    TokenLiteral = 1,
+    TokenFill = 2,
+};
+
+/* Number of leading bytes that are equal in a and b */
+static int equal_prefix(const unsigned char *a, const unsigned char *b, int n)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        uint8x8_t r = vand_u8(vget_low_u8(eq), vget_high_u8(eq));
+
+        if (vget_lane_u64(vreinterpret_u64_u8(r), 0) != UINT64_MAX)
+            break;
+    }
+#endif
+
+    while (i < n && a[i] == b[i])
+        ++i;
+
+    return i;
+}
+
+static inline bool pixel_equal(const unsigned char *a, const unsigned char *b, int bytesPerPixel)
+{
+    return memcmp(a, b, bytesPerPixel) == 0;
+}
+
+static void put_varint(std::string *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+
+    out->push_back(static_cast<char>(value));
+}
+
+static bool get_varint(const unsigned char **p, const unsigned char *end, uint32_t *value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (*p >= end)
+            return false;
+
+        unsigned char byte = *(*p)++;
+        *value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void put_token(std::string *out, int type, uint32_t length)
+{
+    put_varint(out, (length << 2) | type);
+}
+
+/* ================================================================================================================== */
+
+void SparkleCodec::encodeRaw(const unsigned char *data, int stride, int x1, int y1, int x2, int y2, int bytesPerPixel,
+    std::string *out)
+{
+    int length = (x2 - x1) * bytesPerPixel;
+
+    out->clear();
+    out->reserve(length * (y2 - y1));
+
+    for (int y = y1; y < y2; ++y)
+        out->append(reinterpret_cast<const char *>(&data[y * stride + x1 * bytesPerPixel]), length);
+}
+
+bool SparkleCodec::decodeRaw(const std::string &in, unsigned char *data, int stride, int x1, int y1, int x2, int y2,
+    int bytesPerPixel)
+{
+    int length = (x2 - x1) * bytesPerPixel;
+
+    if (in.size() != static_cast<size_t>(length) * (y2 - y1))
+        return false;
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(in.data());
+
+    for (int y = y1; y < y2; ++y, p += length)
+        memcpy(&data[y * stride + x1 * bytesPerPixel], p, length);
+
+    return true;
+}
+
+/* ================================================================================================================== */
+
+void SparkleCodec::encodeDelta(const unsigned char *data, unsigned char *reference, int stride,
+    int x1, int y1, int x2, int y2, int bytesPerPixel, std::string *out)
+{
+    const int bpp = bytesPerPixel;
+    const int width = x2 - x1;
+    uint32_t skip = 0;
+
+    out->clear();
+
+    for (int y = y1; y < y2; ++y)
+    {
+        const unsigned char *current = &data[y * stride + x1 * bpp];
+        unsigned char *previous = &reference[y * stride + x1 * bpp];
+        int i = 0;
+
+        while (i < width)
+        {
+            int equal = equal_prefix(&current[i * bpp], &previous[i * bpp], (width - i) * bpp) / bpp;
+            if (equal > 0)
+            {
+                skip += equal;
+                i += equal;
+                continue;
+            }
+
+            if (skip > 0)
+            {
+                put_token(out, TokenSkip, skip);
+                skip = 0;
+            }
+
+            const unsigned char *pixel = &current[i * bpp];
+
+            int repeat = 1;
+            while (i + repeat < width && pixel_equal(&current[(i + repeat) * bpp], pixel, bpp))
+                ++repeat;
+
+            if (repeat >= 4)
+            {
+                put_token(out, TokenFill, repeat);
+                out->append(reinterpret_cast<const char *>(pixel), bpp);
+                i += repeat;
+                continue;
+            }
+
+            /* Literal run until two unchanged pixels or the start of a fill */
+            int j = i + 1;
+            while (j < width)
+            {
+                const unsigned char *c = &current[j * bpp];
+
+                if (pixel_equal(c, &previous[j * bpp], bpp) &&
+                    (j + 1 >= width || pixel_equal(c + bpp, &previous[(j + 1) * bpp], bpp)))
+                    break;
+
+                if (j + 3 < width && pixel_equal(c, c + bpp, bpp) && pixel_equal(c, c + 2 * bpp, bpp) &&
+                    pixel_equal(c, c + 3 * bpp, bpp))
+                    break;
+
+                ++j;
+            }
+
+            put_token(out, TokenLiteral, j - i);
+            out->append(reinterpret_cast<const char *>(pixel), (j - i) * bpp);
+            i = j;
+        }
+
+        memcpy(previous, current, width * bpp);
+    }
+}
+
+bool SparkleCodec::decodeDelta(const std::string &in, unsigned char *data, int stride, int x1, int y1, int x2, int y2,
+    int bytesPerPixel)
+{
+    const int bpp = bytesPerPixel;
+    const int width = x2 - x1;
+    const uint32_t total = width * (y2 - y1);
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(in.data());
+    const unsigned char *end = p + in.size();
+    uint32_t position = 0;
+
+    while (p < end)
+    {
+        uint32_t token;
+        if (!get_varint(&p, end, &token))
+            return false;
+
+        int type = token & 0x3;
+        uint32_t length = token >> 2;
+
+        if (length > total - position)
+            return false;
+
+        if (type == TokenSkip)
+        {
+            position += length;
+            continue;
+        }
+
+        const unsigned char *source = p;
+
+        if (type == TokenLiteral)
+        {
+            if (static_cast<size_t>(end - p) < static_cast<size_t>(length) * bpp)
+                return false;
+            p += length * bpp;
+        }
+        else if (type == TokenFill)
+        {
+            if (end - p < bpp)
+                return false;
+            p += bpp;
+        }
+        else
+            return false;
+
+        while (length > 0)
+        {
+            int row = position / width;
+            int column = position % width;
+            uint32_t count = width - column;
+            if (count > length)
+                count = length;
+
+            unsigned char *target = &data[(y1 + row) * stride + (x1 + column) * bpp];
+
+            if (type == TokenLiteral)
+            {
+                memcpy(target, source, count * bpp);
+                source += count * bpp;
+            }
+            else
+            {
+                for (uint32_t k = 0; k < count; ++k)
+                    memcpy(&target[k * bpp], source, bpp);
+            }
+
+            position += count;
+            length -= count;
+        }
+    }
+
+    return true;
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,29 @@
+#ifndef SPARKLE_CODEC_H
+#define SPARKLE_CODEC_H
+
+#include <string>
+
+/* ================================================================================================================== */
+
+/*
+ * Codecs for in-band surface updates. The delta codec compares a rectangle with the contents the receiver already
+ * has (the reference) and codes it as runs of unchanged, literal and repeated pixels. Strides are in bytes.
+ */
+class SparkleCodec
+{
+public:
+    static void encodeRaw(const unsigned char *data, int stride, int x1, int y1, int x2, int y2, int bytesPerPixel,
+        std::string *out);
+    static bool decodeRaw(const std::string &in, unsigned char *data, int stride, int x1, int y1, int x2, int y2,
+        int bytesPerPixel);
+
+    /* Leaves out empty when nothing changed, updates the reference */
+    static void encodeDelta(const unsigned char *data, unsigned char *reference, int stride,
+        int x1, int y1, int x2, int y2, int bytesPerPixel, std::string *out);
+    static bool decodeDelta(const std::string &in, unsigned char *data, int stride, int x1, int y1, int x2, int y2,
+        int bytesPerPixel);
+};
+
+/* ================================================================================================================== */
+
+#endif /* SPARKLE_CODEC_H */
@@ -46,6 +46,16 @@ bool SparkleConnection::connected()
     return _socket->state() == WereSocketUnix::ConnectedState;
 }
 
+bool SparkleConnection::stream()
+{
+    return _socket->stream();
+}
+
+unsigned int SparkleConnection::bytesPending()
+{
+    return _socket->bytesPending();
+}
+
 /* ================================================================================================================== */
 
 void SparkleConnection::connect()
@@ -55,11 +65,18 @@ void SparkleConnection::connect()
 
 void SparkleConnection::handleConnection()
 {
+    /* Retries only while there is no connection */
+    if (_connectTimer)
+        _connectTimer->stop();
+
     signal_connected();
 }
 
 void SparkleConnection::handleDisconnection()
 {
+    if (_connectTimer)
+        _connectTimer->start(1000, false);
+
     signal_disconnected();
 }
 
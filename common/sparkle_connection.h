@@ -22,6 +22,8 @@ public:
     SparkleConnection(WereEventLoop *loop, WereSocketUnix *socket);
 
     bool connected();
+    bool stream();
+    unsigned int bytesPending();
 
     void send(WereSocketUnixMessage *message);
 
@@ -1,4 +1,5 @@
 #include "sparkle_protocol.h"
+#include <algorithm>
 
 /* ================================================================================================================== */
 
@@ -11,6 +12,7 @@ WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, con
     stream.writeFD(data.fd);
     stream << data.width;
     stream << data.height;
+    stream << data.format;
     return stream;
 }
 
@@ -20,6 +22,7 @@ WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, Reg
     stream.readFD(&data.fd);
     stream >> data.width;
     stream >> data.height;
+    stream >> data.format;
     return stream;
 }
 #else
@@ -50,6 +53,8 @@ WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, con
     stream.writeFD(data.fd);
     stream << data.width;
     stream << data.height;
+    stream << data.stride;
+    stream << data.format;
     return stream;
 }
 WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, RegisterSurfaceAshmemRequest &data)
@@ -58,6 +63,8 @@ WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, Reg
     stream.readFD(&data.fd);
     stream >> data.width;
     stream >> data.height;
+    stream >> data.stride;
+    stream >> data.format;
     return stream;
 }
 #endif
@@ -147,11 +154,195 @@ WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, Add
     return stream;
 }
 
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const RegisterSurfaceStreamRequest &data)
+{
+    stream << RegisterSurfaceStreamRequestCode;
+    stream << data.name;
+    stream << data.width;
+    stream << data.height;
+    stream << data.format;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, RegisterSurfaceStreamRequest &data)
+{
+    stream >> data.name;
+    stream >> data.width;
+    stream >> data.height;
+    stream >> data.format;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfaceDataRequest &data)
+{
+    stream << SurfaceDataRequestCode;
+    stream << data.name;
+    stream << data.x1;
+    stream << data.y1;
+    stream << data.x2;
+    stream << data.y2;
+    stream << data.codec;
+    stream << data.data;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfaceDataRequest &data)
+{
+    stream >> data.name;
+    stream >> data.x1;
+    stream >> data.y1;
+    stream >> data.x2;
+    stream >> data.y2;
+    stream >> data.codec;
+    stream >> data.data;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SetEventMaskRequest &data)
+{
+    stream << SetEventMaskRequestCode;
+    stream << data.surface;
+    stream << data.mask;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SetEventMaskRequest &data)
+{
+    stream >> data.surface;
+    stream >> data.mask;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const FrameNotification &data)
+{
+    stream << FrameNotificationCode;
+    stream << data.sequence;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, FrameNotification &data)
+{
+    stream >> data.sequence;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const StartCaptureRequest &data)
+{
+    stream << StartCaptureRequestCode;
+    stream << data.slots;
+    stream << data.flags;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, StartCaptureRequest &data)
+{
+    stream >> data.slots;
+    stream >> data.flags;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const CaptureStartedNotification &data)
+{
+    stream << CaptureStartedNotificationCode;
+    stream.writeFD(data.fd);
+    stream << data.width;
+    stream << data.height;
+    stream << data.slots;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, CaptureStartedNotification &data)
+{
+    stream.readFD(&data.fd);
+    stream >> data.width;
+    stream >> data.height;
+    stream >> data.slots;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const CaptureFrameNotification &data)
+{
+    stream << CaptureFrameNotificationCode;
+    stream << data.slot;
+    stream << data.sequence;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, CaptureFrameNotification &data)
+{
+    stream >> data.slot;
+    stream >> data.sequence;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SetPerformanceHudRequest &data)
+{
+    stream << SetPerformanceHudRequestCode;
+    stream << data.enabled;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SetPerformanceHudRequest &data)
+{
+    stream >> data.enabled;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfacePurgeableNotification &data)
+{
+    stream << SurfacePurgeableNotificationCode;
+    stream << data.name;
+    stream << data.purgeable;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfacePurgeableNotification &data)
+{
+    stream >> data.name;
+    stream >> data.purgeable;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const TrimMemoryRequest &data)
+{
+    stream << TrimMemoryRequestCode;
+    stream << data.level;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, TrimMemoryRequest &data)
+{
+    stream >> data.level;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfaceStatsNotification &data)
+{
+    stream << SurfaceStatsNotificationCode;
+    stream << data.name;
+    stream << data.shared;
+    stream << data.resident;
+    stream << data.texture;
+    stream << data.flags;
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfaceStatsNotification &data)
+{
+    stream >> data.name;
+    stream >> data.shared;
+    stream >> data.resident;
+    stream >> data.texture;
+    stream >> data.flags;
+    return stream;
+}
+
 WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const DisplaySizeNotification &data)
 {
     stream << DisplaySizeNotificationCode;
     stream << data.width;
     stream << data.height;
+    stream << data.scale;
     return stream;
 }
 
@@ -159,6 +350,7 @@ WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, Dis
 {
     stream >> data.width;
     stream >> data.height;
+    stream >> data.scale;
     return stream;
 }
 
@@ -219,6 +411,42 @@ WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, Poi
     return stream;
 }
 
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const PointerMotionBatchNotification &data)
+{
+    stream << PointerMotionBatchNotificationCode;
+    stream << data.surface;
+    stream << data.slot;
+    stream << data.x;
+    stream << data.y;
+    stream << static_cast<uint32_t>(data.history.size());
+    for (auto it = data.history.begin(); it != data.history.end(); ++it)
+    {
+        stream << it->time;
+        stream << it->x;
+        stream << it->y;
+    }
+    return stream;
+}
+
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, PointerMotionBatchNotification &data)
+{
+    uint32_t size;
+
+    stream >> data.surface;
+    stream >> data.slot;
+    stream >> data.x;
+    stream >> data.y;
+    stream >> size;
+    data.history.resize(std::min(size, PointerMotionHistoryMax));
+    for (auto it = data.history.begin(); it != data.history.end(); ++it)
+    {
+        stream >> it->time;
+        stream >> it->x;
+        stream >> it->y;
+    }
+    return stream;
+}
+
 WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const KeyDownNotification &data)
 {
     stream << KeyDownNotificationCode;
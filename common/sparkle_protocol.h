@@ -2,6 +2,32 @@
 #define SPARKLE_PROTOCOL_H
 
 #include "were/were_socket_unix_message_stream.h"
+#include <vector>
+
+/* ================================================================================================================== */
+
+/* Surface pixel formats, named after the little-endian pixel value layout */
+const int32_t SurfaceFormatBGRA8888 = 0;
+const int32_t SurfaceFormatRGB565 = 1;
+const int32_t SurfaceFormatXRGB8888 = 2;
+
+inline int surfaceFormatBytesPerPixel(int32_t format)
+{
+    return (format == SurfaceFormatRGB565) ? 2 : 4;
+}
+
+/* Surfaces are allocated or mapped from the peer's dimensions, anything larger is refused */
+const int32_t SurfaceMaxDimension = 8192;
+
+inline bool surfaceSizeValid(int32_t width, int32_t height)
+{
+    return width > 0 && height > 0 && width <= SurfaceMaxDimension && height <= SurfaceMaxDimension;
+}
+
+inline bool surfaceSizeValid(int32_t width, int32_t height, int32_t stride)
+{
+    return surfaceSizeValid(width, height) && stride >= width && stride <= SurfaceMaxDimension;
+}
 
 /* ================================================================================================================== */
 
@@ -36,6 +62,9 @@ struct RegisterSurfaceAshmemRequest
     key_t fd;
     int32_t width;
     int32_t height;
+    /* Pixels from one row to the next, at least the width */
+    int32_t stride;
+    int32_t format;
 };
 WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const RegisterSurfaceAshmemRequest &data);
 WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, RegisterSurfaceAshmemRequest &data);
@@ -91,10 +120,173 @@ WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, con
 WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, AddSurfaceDamageRequest &data);
 const uint32_t AddSurfaceDamageRequestCode = 0x06;
 
+/*
+ * Events a connection wants. Connections that never send a mask get input and display size events. Input of the
+ * named surface (and of its subsurfaces, "surface.<anything>") goes to the connections subscribed to it, otherwise
+ * to the connection that registered the surface; an empty name subscribes to no particular surface.
+ */
+const uint32_t EventMaskInput = 0x1;
+const uint32_t EventMaskDisplaySize = 0x2;
+const uint32_t EventMaskFrame = 0x4;
+const uint32_t EventMaskAudio = 0x8;
+const uint32_t EventMaskSurfacePurgeable = 0x10;
+const uint32_t EventMaskDefault = EventMaskInput | EventMaskDisplaySize;
+
+struct SetEventMaskRequest
+{
+    std::string surface;
+    uint32_t mask;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SetEventMaskRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SetEventMaskRequest &data);
+const uint32_t SetEventMaskRequestCode = 0x08;
+
+/* Sent after a frame has been presented */
+struct FrameNotification
+{
+    uint32_t sequence;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const FrameNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, FrameNotification &data);
+const uint32_t FrameNotificationCode = 0x09;
+
+/*
+ * Composed frames written to a ring of slots in shared memory (see SparkleCapture), one connection at a time and
+ * only over local sockets. Each written slot is announced with a CaptureFrameNotification, the consumer frees it in
+ * the shared memory. With CaptureDropFrames composition never waits for a free slot, frames are dropped instead.
+ */
+const uint32_t CaptureDropFrames = 0x1;
+
+struct StartCaptureRequest
+{
+    uint32_t slots;
+    uint32_t flags;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const StartCaptureRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, StartCaptureRequest &data);
+const uint32_t StartCaptureRequestCode = 0x0A;
+
+const uint32_t StopCaptureRequestCode = 0x0B;
+
+/* Also sent again with a new ring when the display size changes */
+struct CaptureStartedNotification
+{
+    int fd;
+    int32_t width;
+    int32_t height;
+    uint32_t slots;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const CaptureStartedNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, CaptureStartedNotification &data);
+const uint32_t CaptureStartedNotificationCode = 0x0C;
+
+struct CaptureFrameNotification
+{
+    uint32_t slot;
+    uint32_t sequence;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const CaptureFrameNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, CaptureFrameNotification &data);
+const uint32_t CaptureFrameNotificationCode = 0x0D;
+
+/* Shows or hides the frame statistics overlay of the compositor */
+struct SetPerformanceHudRequest
+{
+    uint32_t enabled;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SetPerformanceHudRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SetPerformanceHudRequest &data);
+const uint32_t SetPerformanceHudRequestCode = 0x0E;
+
+/*
+ * Sent under memory pressure to the owner of a surface in shared memory that is hidden, when the owner subscribed
+ * with EventMaskSurfacePurgeable: it may unpin the memory (ASHMEM_UNPIN, MADV_FREE). Once purgeable is 0 again the
+ * owner pins it, redraws what was purged and answers with damage of the whole surface, the compositor does not read
+ * the surface until that damage arrives.
+ */
+struct SurfacePurgeableNotification
+{
+    std::string name;
+    uint32_t purgeable;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfacePurgeableNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfacePurgeableNotification &data);
+const uint32_t SurfacePurgeableNotificationCode = 0x0F;
+
+/* Android onTrimMemory() levels */
+const uint32_t TrimMemoryRunningModerate = 5;
+const uint32_t TrimMemoryRunningLow = 10;
+const uint32_t TrimMemoryRunningCritical = 15;
+const uint32_t TrimMemoryUiHidden = 20;
+const uint32_t TrimMemoryBackground = 40;
+const uint32_t TrimMemoryModerate = 60;
+const uint32_t TrimMemoryComplete = 80;
+
+/* The platform passes its memory signals on, this is for the others */
+struct TrimMemoryRequest
+{
+    uint32_t level;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const TrimMemoryRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, TrimMemoryRequest &data);
+const uint32_t TrimMemoryRequestCode = 0x10;
+
+/* Answered with a SurfaceStatsNotification per surface and one with an empty name after the last */
+const uint32_t GetSurfaceStatsRequestCode = 0x13;
+
+const uint32_t SurfaceStatsPurgeable = 0x1;
+const uint32_t SurfaceStatsHidden = 0x2;
+
+/* Sizes in KB: the shared memory, the part of it resident, the texture */
+struct SurfaceStatsNotification
+{
+    std::string name;
+    uint32_t shared;
+    uint32_t resident;
+    uint32_t texture;
+    uint32_t flags;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfaceStatsNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfaceStatsNotification &data);
+const uint32_t SurfaceStatsNotificationCode = 0x14;
+
+/* In-band surfaces for stream connections, which cannot pass file descriptors */
+struct RegisterSurfaceStreamRequest
+{
+    std::string name;
+    int32_t width;
+    int32_t height;
+    int32_t format;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const RegisterSurfaceStreamRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, RegisterSurfaceStreamRequest &data);
+const uint32_t RegisterSurfaceStreamRequestCode = 0x11;
+
+const int32_t SurfaceCodecRaw = 0;
+const int32_t SurfaceCodecDelta = 1;
+
+struct SurfaceDataRequest
+{
+    std::string name;
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+    int32_t codec;
+    std::string data;
+};
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const SurfaceDataRequest &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, SurfaceDataRequest &data);
+const uint32_t SurfaceDataRequestCode = 0x12;
+
+/* Clients able to render smaller than the display (the X server) should render at scale thousandths of its size */
+const int32_t DisplayScaleUnit = 1000;
+
 struct DisplaySizeNotification
 {
     int32_t width;
     int32_t height;
+    int32_t scale;
 };
 WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const DisplaySizeNotification &data);
 WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, DisplaySizeNotification &data);
@@ -133,6 +325,28 @@ WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, con
 WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, PointerMotionNotification &data);
 const uint32_t PointerMotionNotificationCode = 0x23;
 
+/* Earlier position of a batch, time is in microseconds before the latest position */
+struct PointerMotionSample
+{
+    int32_t time;
+    int32_t x;
+    int32_t y;
+};
+
+/* Motion of a slot during one frame: the latest position and the samples before it, oldest first */
+struct PointerMotionBatchNotification
+{
+    std::string surface;
+    int32_t slot;
+    int32_t x;
+    int32_t y;
+    std::vector<PointerMotionSample> history;
+};
+const uint32_t PointerMotionHistoryMax = 64;
+WereSocketUnixMessageStream &operator<<(WereSocketUnixMessageStream &stream, const PointerMotionBatchNotification &data);
+WereSocketUnixMessageStream &operator>>(WereSocketUnixMessageStream &stream, PointerMotionBatchNotification &data);
+const uint32_t PointerMotionBatchNotificationCode = 0x29;
+
 struct KeyDownNotification
 {
     int32_t code;
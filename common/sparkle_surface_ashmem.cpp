@@ -59,19 +59,23 @@ SparkleSurfaceAshmem::~SparkleSurfaceAshmem()
 	fd_ = 0;
 }
 
-SparkleSurfaceAshmem::SparkleSurfaceAshmem(int width, int height) {
+SparkleSurfaceAshmem::SparkleSurfaceAshmem(int width, int height, int stride, int bytesPerPixel) {
     width_ = width;
     height_ = height;
+    stride_ = stride;
+    bytesPerPixel_ = bytesPerPixel;
     owner_ = false;
     data_ = nullptr;
     
-    fd_ = ashmem_create_region("sparkle_region", width_ * height_ * 4);
+    fd_ = ashmem_create_region("sparkle_region", size());
     map();
 }
-SparkleSurfaceAshmem::SparkleSurfaceAshmem(int fd, int width, int height)
+SparkleSurfaceAshmem::SparkleSurfaceAshmem(int fd, int width, int height, int stride, int bytesPerPixel)
 {
     width_ = width;
     height_ = height;
+    stride_ = stride;
+    bytesPerPixel_ = bytesPerPixel;
     owner_ = false;
     data_ = nullptr;
 	fd_ = fd;
@@ -86,7 +90,7 @@ void SparkleSurfaceAshmem::map()
     if (data_ != nullptr)
         return;
 
-    void *data = mmap(NULL, width_ * height_ * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    void *data = mmap(NULL, size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
     if (data == MAP_FAILED)
         throw WereException("[%p][%s] Failed to mmap file.", this, __PRETTY_FUNCTION__);
 
@@ -98,9 +102,23 @@ void SparkleSurfaceAshmem::unmap()
     if (data_ == nullptr)
         return;
 
-    munmap(data_, width_ * height_ * 4);
+    munmap(data_, size());
 
     data_ = nullptr;
 }
 
 /* ================================================================================================================== */
+
+void SparkleSurfaceAshmem::unpin()
+{
+    struct ashmem_pin pin = {0, 0};
+    ioctl(fd_, ASHMEM_UNPIN, &pin);
+}
+
+bool SparkleSurfaceAshmem::pin()
+{
+    struct ashmem_pin pin = {0, 0};
+    return ioctl(fd_, ASHMEM_PIN, &pin) != ASHMEM_WAS_PURGED;
+}
+
+/* ================================================================================================================== */
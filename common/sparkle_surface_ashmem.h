@@ -9,20 +9,30 @@ class SparkleSurfaceAshmem : public WereSurface
 {
 public:
     ~SparkleSurfaceAshmem();
-    SparkleSurfaceAshmem(int width, int height);
-    SparkleSurfaceAshmem(int fd, int width, int height);
+    /* Stride is in pixels and may exceed the width, e.g. for padded scanlines */
+    SparkleSurfaceAshmem(int width, int height, int stride, int bytesPerPixel);
+    SparkleSurfaceAshmem(int fd, int width, int height, int stride, int bytesPerPixel);
 
     unsigned char *data() {return data_;}
     int fd() { return fd_; }
     int width() {return width_;}
     int height() {return height_;}
-    int stride() {return width_;}
+    int stride() {return stride_;}
+    int bytesPerPixel() {return bytesPerPixel_;}
+
+    /* The kernel may purge unpinned pages under memory pressure, pin() returns false when it did */
+    void unpin();
+    bool pin();
 
 private:
 	void map();
 	void unmap();
+    size_t size() const {return static_cast<size_t>(stride_) * height_ * bytesPerPixel_;}
+
     int width_;
     int height_;
+    int stride_;
+    int bytesPerPixel_;
     bool owner_;
 
     int fd_;
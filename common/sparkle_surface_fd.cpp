@@ -16,11 +16,12 @@ SparkleSurfaceFd::~SparkleSurfaceFd()
         unlink(path_.c_str());
 }
 
-SparkleSurfaceFd::SparkleSurfaceFd(const std::string &path, int width, int height)
+SparkleSurfaceFd::SparkleSurfaceFd(const std::string &path, int width, int height, int bytesPerPixel)
 {
     path_ = path;
     width_ = width;
     height_ = height;
+    bytesPerPixel_ = bytesPerPixel;
     fd_ = -1;
     data_ = nullptr;
 
@@ -29,7 +30,7 @@ SparkleSurfaceFd::SparkleSurfaceFd(const std::string &path, int width, int heigh
     if (fd == -1)
         throw WereException("[%p][%s] Failed to open file.", this, __PRETTY_FUNCTION__);
 
-    if (ftruncate(fd, width_ * height_ * 4) == -1)
+    if (ftruncate(fd, width_ * height_ * bytesPerPixel_) == -1)
         throw WereException("[%p][%s] Failed to resize file.", this, __PRETTY_FUNCTION__);
 
     if (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) == -1)
@@ -40,10 +41,11 @@ SparkleSurfaceFd::SparkleSurfaceFd(const std::string &path, int width, int heigh
     map();
 }
 
-SparkleSurfaceFd::SparkleSurfaceFd(int fd, int width, int height)
+SparkleSurfaceFd::SparkleSurfaceFd(int fd, int width, int height, int bytesPerPixel)
 {
     width_ = width;
     height_ = height;
+    bytesPerPixel_ = bytesPerPixel;
     fd_ = -1;
     data_ = nullptr;
 
@@ -59,7 +61,7 @@ void SparkleSurfaceFd::map()
     if (data_ != nullptr)
         return;
 
-    void *data = mmap(NULL, width_ * height_ * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    void *data = mmap(NULL, width_ * height_ * bytesPerPixel_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
     if (data == MAP_FAILED)
         throw WereException("[%p][%s] Failed to mmap file.", this, __PRETTY_FUNCTION__);
 
@@ -71,7 +73,7 @@ void SparkleSurfaceFd::unmap()
     if (data_ == nullptr)
         return;
 
-    munmap(data_, width_ * height_ * 4);
+    munmap(data_, width_ * height_ * bytesPerPixel_);
 
     data_ = nullptr;
 }
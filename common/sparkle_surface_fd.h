@@ -10,14 +10,15 @@ class SparkleSurfaceFd : public WereSurface
 {
 public:
     ~SparkleSurfaceFd();
-    SparkleSurfaceFd(const std::string &path, int width, int height);
-    SparkleSurfaceFd(int fd, int width, int height);
+    SparkleSurfaceFd(const std::string &path, int width, int height, int bytesPerPixel);
+    SparkleSurfaceFd(int fd, int width, int height, int bytesPerPixel);
 
     const std::string &path() {return path_;}
     unsigned char *data() {return data_;}
     int width() {return width_;}
     int height() {return height_;}
     int stride() {return width_;}
+    int bytesPerPixel() {return bytesPerPixel_;}
     int fd() {return fd_;}
 
 private:
@@ -28,6 +29,7 @@ private:
     std::string path_;
     int width_;
     int height_;
+    int bytesPerPixel_;
 
     int fd_;
     unsigned char *data_;
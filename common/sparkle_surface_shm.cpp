@@ -19,19 +19,20 @@ SparkleSurfaceShm::~SparkleSurfaceShm()
             were_debug("[%p][%s] shmctl failed.\n", this, __PRETTY_FUNCTION__);
 }
 
-SparkleSurfaceShm::SparkleSurfaceShm(key_t key, int width, int height, bool owner)
+SparkleSurfaceShm::SparkleSurfaceShm(key_t key, int width, int height, bool owner, int bytesPerPixel)
 {
     width_ = width;
     height_ = height;
+    bytesPerPixel_ = bytesPerPixel;
     owner_ = owner;
     key_ = key;
     shmId_ = -1;
     data_ = nullptr;
 
     if (owner_)
-        shmId_ = shmget_(key_, width_ * height_ * 4, IPC_CREAT | 0666);
+        shmId_ = shmget_(key_, width_ * height_ * bytesPerPixel_, IPC_CREAT | 0666);
     else
-        shmId_ = shmget_(key_, width_ * height_ * 4, 0666);
+        shmId_ = shmget_(key_, width_ * height_ * bytesPerPixel_, 0666);
 
     if (shmId_ == -1)
         throw WereException("[%p][%s] shmget failed.", this, __PRETTY_FUNCTION__);
@@ -9,17 +9,19 @@ class SparkleSurfaceShm : public WereSurface
 {
 public:
     ~SparkleSurfaceShm();
-    SparkleSurfaceShm(key_t key, int width, int height, bool owner);
+    SparkleSurfaceShm(key_t key, int width, int height, bool owner, int bytesPerPixel);
 
     key_t key() {return key_;}
     unsigned char *data() {return data_;}
     int width() {return width_;}
     int height() {return height_;}
     int stride() {return width_;}
+    int bytesPerPixel() {return bytesPerPixel_;}
 
 private:
     int width_;
     int height_;
+    int bytesPerPixel_;
     bool owner_;
 
     key_t key_;
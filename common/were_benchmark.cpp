@@ -1,5 +1,6 @@
 #include "were_benchmark.h"
 #include "were/were_timer.h"
+#include "were/were_event_loop.h"
 #include <unistd.h>
 
 /* ================================================================================================================== */
@@ -13,6 +14,7 @@ WereBenchmark::WereBenchmark(WereEventLoop *loop)
 {
     _loop = loop;
     _events = 0;
+    _wakeups = _loop->wakeups();
 
     _timer = new WereTimer(_loop);
     _timer->timeout.connect(WereSimpleQueuer(loop, &WereBenchmark::timeout, this));
@@ -40,11 +42,17 @@ void WereBenchmark::timeout()
     float cpuLoad = 100.0 * (elapsed_cpu / 1000) / (elapsed_real / 1000);
 
 
-    were_message("Loop: %.2f, CPU: %.2f, Events: %d.\n", loopPerformance, cpuLoad, _events / 5);
+    /* Counts its own wakeup too, 0.2 per second when idle */
+    uint64_t wakeups = _loop->wakeups();
+    float wakeupRate = 1.0 * (wakeups - _wakeups) / 5;
+
+    were_message("Loop: %.2f, CPU: %.2f, Events: %d, Wakeups: %.1f/s.\n", loopPerformance, cpuLoad, _events / 5,
+        wakeupRate);
 
     _real1 = _real2;
     _cpu1 = _cpu2;
     _events = 0;
+    _wakeups = wakeups;
 }
 
 void WereBenchmark::event()
@@ -5,6 +5,7 @@
 
 #include "were/were.h"
 #include <ctime>
+#include <cstdint>
 
 class WereEventLoop;
 class WereTimer;
@@ -27,6 +28,7 @@ private:
     struct timespec _real1, _real2;
     struct timespec _cpu1, _cpu2;
     int _events;
+    uint64_t _wakeups;
 };
 
 /* ================================================================================================================== */
@@ -0,0 +1,46 @@
+#include "compositor_backend.h"
+#include "compositor/gl/compositor_gl.h"
+#include "compositor/sw/compositor_sw.h"
+#include "compositor/passthrough/compositor_passthrough.h"
+#include <cstdlib>
+#include <string>
+#include <cctype>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+/* ================================================================================================================== */
+
+std::string compositor_option(const std::string &name)
+{
+    std::string variable = "SPARKLE_";
+    for (auto it = name.begin(); it != name.end(); ++it)
+        variable += toupper(*it);
+
+    const char *value = getenv(variable.c_str());
+    if (value != nullptr)
+        return value;
+
+#ifdef __ANDROID__
+    char property[PROP_VALUE_MAX];
+    if (__system_property_get(("debug.sparkle." + name).c_str(), property) > 0)
+        return property;
+#endif
+
+    return std::string();
+}
+
+Compositor *compositor_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file)
+{
+    if (platform->passthrough() != nullptr)
+        return compositor_passthrough_create(loop, platform, file);
+
+    if (compositor_option("compositor") == "sw")
+        return compositor_sw_create(loop, platform, file);
+
+    return compositor_gl_create(loop, platform, file);
+}
+
+/* ================================================================================================================== */
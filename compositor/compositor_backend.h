@@ -0,0 +1,19 @@
+#ifndef COMPOSITOR_BACKEND_H
+#define COMPOSITOR_BACKEND_H
+
+#include "compositor/compositor.h"
+#include "were/were_event_loop.h"
+#include "platform/platform.h"
+#include <string>
+
+/*
+ * The GL compositor unless the software one is asked for: SPARKLE_COMPOSITOR=sw, or on Android the
+ * debug.sparkle.compositor property. Platforms that show the surfaces themselves get the passthrough one.
+ */
+Compositor *compositor_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file);
+
+/* A compositor setting: SPARKLE_<NAME> from the environment, or on Android the debug.sparkle.<name> property */
+std::string compositor_option(const std::string &name);
+
+#endif //COMPOSITOR_BACKEND_H
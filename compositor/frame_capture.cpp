@@ -0,0 +1,94 @@
+#include "frame_capture.h"
+#include "were/were_timer.h"
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+
+/* Granularity of the copies into slots */
+const int CAPTURE_TILE = 64;
+
+/* Longest wait for the consumer to free a slot before a frame is dropped anyway */
+const uint64_t CAPTURE_WAIT = 100000000;
+
+/* ================================================================================================================== */
+
+FrameCapture::FrameCapture(int width, int height, int slots, bool drop) :
+    _ring(width, height, slots), _frame(width * height, 0), _pending(slots)
+{
+    _width = width;
+    _height = height;
+    _drop = drop;
+    _sequence = 0;
+    _dropped = 0;
+
+    for (unsigned int i = 0; i < _pending.size(); ++i)
+        _pending[i].add(RectangleA(PointA(0, 0), PointA(width, height)));
+}
+
+int FrameCapture::publish(const Region &damage, uint64_t time)
+{
+    Region clipped = damage;
+    clipped.clip(_width, _height);
+
+    for (unsigned int i = 0; i < _pending.size(); ++i)
+        _pending[i].add(clipped);
+    _changed.add(clipped);
+
+    int slot = _ring.acquire();
+
+    /* Composition stalls until the consumer catches up, unless it asked for drops */
+    if (slot == -1 && !_drop)
+    {
+        uint64_t deadline = WereTimer::now() + CAPTURE_WAIT;
+        while ((slot = _ring.acquire()) == -1 && WereTimer::now() < deadline)
+            usleep(500);
+    }
+
+    if (slot == -1)
+    {
+        _dropped += 1;
+        return -1;
+    }
+
+    const std::vector<RectangleA> &rectangles = _pending[slot].rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+        copy(slot, *it);
+    _pending[slot].clear();
+
+    RectangleA bounds = _changed.bounds();
+
+    SparkleCaptureSlot *header = _ring.slot(slot);
+    header->sequence = _sequence++;
+    header->time = time;
+    header->x1 = bounds.from.x;
+    header->y1 = bounds.from.y;
+    header->x2 = bounds.to.x;
+    header->y2 = bounds.to.y;
+    header->dropped = _dropped;
+
+    _changed.clear();
+    _dropped = 0;
+
+    _ring.commit(slot);
+
+    return slot;
+}
+
+void FrameCapture::copy(int slot, const RectangleA &rectangle)
+{
+    int x1 = rectangle.from.x / CAPTURE_TILE * CAPTURE_TILE;
+    int y1 = rectangle.from.y / CAPTURE_TILE * CAPTURE_TILE;
+    int x2 = std::min((rectangle.to.x + CAPTURE_TILE - 1) / CAPTURE_TILE * CAPTURE_TILE, _width);
+    int y2 = std::min((rectangle.to.y + CAPTURE_TILE - 1) / CAPTURE_TILE * CAPTURE_TILE, _height);
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    unsigned char *pixels = _ring.pixels(slot);
+    int stride = _ring.stride();
+
+    for (int y = y1; y < y2; ++y)
+        memcpy(&pixels[y * stride + x1 * 4], &_frame[y * _width + x1], (x2 - x1) * 4);
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,49 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "common/sparkle_capture.h"
+#include "compositor/gl/region.h"
+#include <vector>
+#include <cstdint>
+
+/* ================================================================================================================== */
+
+/*
+ * Compositor side of a capture ring. The backend keeps frame() up to date with the damage of every composed frame,
+ * publish() then brings a free slot up to date with it, copying only the tiles that changed since that slot was
+ * last written.
+ */
+class FrameCapture
+{
+public:
+    FrameCapture(int width, int height, int slots, bool drop);
+
+    SparkleCapture *ring() {return &_ring;}
+    int width() {return _width;}
+    int height() {return _height;}
+
+    /* BGRX, width pixels per row */
+    uint32_t *frame() {return _frame.data();}
+
+    /* The slot written, -1 when the frame was dropped */
+    int publish(const Region &damage, uint64_t time);
+    uint32_t sequence() {return _sequence;}
+
+private:
+    void copy(int slot, const RectangleA &rectangle);
+
+private:
+    SparkleCapture _ring;
+    int _width;
+    int _height;
+    bool _drop;
+    std::vector<uint32_t> _frame;
+    std::vector<Region> _pending;
+    Region _changed;
+    uint32_t _sequence;
+    uint32_t _dropped;
+};
+
+/* ================================================================================================================== */
+
+#endif //FRAME_CAPTURE_H
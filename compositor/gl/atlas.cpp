@@ -0,0 +1,36 @@
+#include "atlas.h"
+
+/* ================================================================================================================== */
+
+CompositorGLAtlas::CompositorGLAtlas(GLenum format)
+{
+    _texture.resize(ATLAS_SIZE, ATLAS_SIZE, format, GL_UNSIGNED_BYTE);
+    _used.resize((ATLAS_SIZE / ATLAS_CELL) * (ATLAS_SIZE / ATLAS_CELL), false);
+}
+
+int CompositorGLAtlas::allocate()
+{
+    for (unsigned int i = 0; i < _used.size(); ++i)
+    {
+        if (!_used[i])
+        {
+            _used[i] = true;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void CompositorGLAtlas::release(int cell)
+{
+    _used[cell] = false;
+}
+
+PointA CompositorGLAtlas::origin(int cell)
+{
+    int columns = ATLAS_SIZE / ATLAS_CELL;
+    return PointA((cell % columns) * ATLAS_CELL, (cell / columns) * ATLAS_CELL);
+}
+
+/* ================================================================================================================== */
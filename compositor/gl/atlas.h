@@ -0,0 +1,33 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "texture.h"
+#include "common/utility.h"
+#include <GLES2/gl2.h>
+#include <vector>
+
+/* ================================================================================================================== */
+
+/* Surfaces up to one cell in size share a texture so neighbours can be drawn together */
+const int ATLAS_SIZE = 1024;
+const int ATLAS_CELL = 128;
+
+/* Cells of ATLAS_CELL pixels in one texture, taken in order */
+class CompositorGLAtlas
+{
+public:
+    CompositorGLAtlas(GLenum format);
+
+    Texture *texture() {return &_texture;}
+    int allocate();
+    void release(int cell);
+    PointA origin(int cell);
+
+private:
+    Texture _texture;
+    std::vector<bool> _used;
+};
+
+/* ================================================================================================================== */
+
+#endif //ATLAS_H
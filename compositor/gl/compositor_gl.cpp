@@ -1,7 +1,21 @@
 #include "compositor_gl.h"
 #include "texture.h"
+#include "region.h"
+#include "frame_scheduler.h"
+#include "program_cache.h"
+#include "upload_budget.h"
+#include "upload_tuner.h"
+#include "uploader.h"
+#include "readback.h"
+#include "atlas.h"
+#include "compositor/frame_capture.h"
+#include "compositor/scale_policy.h"
+#include "compositor/compositor_backend.h"
+#include "compositor/performance_hud.h"
+#include "compositor/surface_registry.h"
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #include <vector>
@@ -10,15 +24,37 @@
 #include <map>
 #include <string>
 #include <algorithm>
+#include <deque>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "common/utility.h"
 #include "common/sparkle_surface_ashmem.h"
 #include "common/sparkle_server.h"
 #include "common/sparkle_protocol.h"
 #include "common/sparkle_connection.h"
+#include "common/sparkle_codec.h"
 
-#define ALWAYS_UPLOAD 0
 #define USE_BLENDING
+#define USE_ATLAS 1
+
+#ifndef EGL_BUFFER_AGE_EXT
+#define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
+/* Frames of damage kept for buffer age, older back buffers are redrawn in full */
+const unsigned int MAX_BUFFER_AGE = 4;
+
+/* Bytes of textures rebuilt per frame after a context loss, at least one surface goes each frame */
+const uint64_t RESTORE_BUDGET = 16 * 1024 * 1024;
+
+/* Memory pressure lasts this long after the last trim, in milliseconds */
+const int PRESSURE_TIME = 30000;
 
 /* ================================================================================================================== */
 
@@ -31,23 +67,40 @@ static const char simpleVS[] =
         "    gl_Position = position;\n"
         "}\n\n";
 
-static const char simpleFS[] =
+/* Variants are specialized at compile time, opaque surfaces pay for no alpha */
+static const char opaqueFS[] =
+        "precision mediump float;\n\n"
+        "varying vec2 outTexCoords;\n"
+        "uniform sampler2D texture;\n"
+        "\nvoid main(void) {\n"
+        "    gl_FragColor = vec4(texture2D(texture, outTexCoords).rgb, 1.0);\n"
+        "}\n\n";
+
+static const char blendedFS[] =
         "precision mediump float;\n\n"
         "varying vec2 outTexCoords;\n"
         "uniform sampler2D texture;\n"
-#ifdef USE_BLENDING
         "uniform float alpha;\n"
-#endif
         "\nvoid main(void) {\n"
-        "    gl_FragColor = texture2D(texture, outTexCoords);\n"
-#ifdef USE_BLENDING
-        "    gl_FragColor.a = alpha;\n"
-#endif
+        "    gl_FragColor = vec4(texture2D(texture, outTexCoords).rgb, alpha);\n"
         "}\n\n";
 
+/* Attribute locations are bound, every variant takes the same vertex buffer layout */
+const GLuint ATTRIBUTE_POSITION = 0;
+const GLuint ATTRIBUTE_TEXCOORDS = 1;
+
+enum
+{
+    ProgramOpaque = 0,
+    ProgramBlended = 1,
+    ProgramCount = 2,
+};
+
 
 const GLint FLOAT_SIZE_BYTES = sizeof(float);
 const GLint TRIANGLE_VERTICES_DATA_STRIDE_BYTES = 5 * FLOAT_SIZE_BYTES;
+const GLint QUAD_VERTICES = 6;
+const GLint QUAD_FLOATS = QUAD_VERTICES * 5;
 
 /* ================================================================================================================== */
 
@@ -58,6 +111,8 @@ public:
     CompositorGL_EGL(NativeDisplayType nativeDisplay);
 
     EGLint getVID();
+    bool hasExtension(const char *name);
+    void chooseConfig(EGLint surfaceType);
 
     EGLDisplay display_;
     EGLConfig config_;
@@ -85,21 +140,37 @@ CompositorGL_EGL::CompositorGL_EGL(NativeDisplayType nativeDisplay)
     were_message("EGL_CLIENT_APIS = %s\n",   eglQueryString(display_, EGL_CLIENT_APIS));
     were_message("EGL_EXTENSIONS = %s\n",    eglQueryString(display_, EGL_EXTENSIONS));
 
+    chooseConfig(EGL_WINDOW_BIT);
+
+    eglBindAPI(EGL_OPENGL_ES_API);
+}
+
+void CompositorGL_EGL::chooseConfig(EGLint surfaceType)
+{
     const EGLint configAttribs[] = {
-            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_SURFACE_TYPE, surfaceType,
             EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
             EGL_RED_SIZE, 8,
             EGL_GREEN_SIZE, 8,
             EGL_BLUE_SIZE, 8,
             EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 16,
             EGL_NONE};
 
     EGLint numConfigs;
 
-    if (eglChooseConfig(display_, configAttribs, &config_, 1, &numConfigs) != EGL_TRUE)
-        throw std::runtime_error("[CompositorGL_EGL::CompositorGL_EGL] Failed: eglChooseConfig.");
+    if (eglChooseConfig(display_, configAttribs, &config_, 1, &numConfigs) != EGL_TRUE || numConfigs < 1)
+        throw std::runtime_error("[CompositorGL_EGL::chooseConfig] Failed: eglChooseConfig.");
+}
 
-    eglBindAPI(EGL_OPENGL_ES_API);
+bool CompositorGL_EGL::hasExtension(const char *name)
+{
+    const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+    if (extensions == nullptr)
+        return false;
+
+    std::string list = std::string(" ") + extensions + " ";
+    return list.find(std::string(" ") + name + " ") != std::string::npos;
 }
 
 EGLint CompositorGL_EGL::getVID()
@@ -118,52 +189,101 @@ class CompositorGL_GL
 {
 public:
     ~CompositorGL_GL();
-    CompositorGL_GL(CompositorGL_EGL *egl, NativeWindowType window);
+    CompositorGL_GL(CompositorGL_EGL *egl, ProgramCache *programs, UploadTuner *tuner, NativeWindowType window);
+    /* Offscreen */
+    CompositorGL_GL(CompositorGL_EGL *egl, ProgramCache *programs, UploadTuner *tuner, int width, int height);
 
-    static GLuint loadShader(GLenum shaderType, const char *pSource);
+    void initialize(ProgramCache *programs, UploadTuner *tuner);
+    void surfaceBound();
+
+    /* The context and everything in it outlive the window, false when that is not possible */
+    bool detachWindow();
+    /* False when the context did not survive */
+    bool attachWindow(NativeWindowType window);
 
     CompositorGL_EGL *_egl;
     EGLSurface _surface;
+    EGLSurface _placeholder;
     EGLContext _context;
     int _surfaceWidth;
     int _surfaceHeight;
-    GLuint _vertexShader;
-    GLuint _pixelShader;
-    GLuint _textureProgram;
-    GLuint _texturePositionHandle;
-    GLuint _textureTexCoordsHandle;
-#ifdef USE_BLENDING
-    GLuint _textureAlphaHandle;
-#endif
-    //GLuint _textureSamplerHandle;
+    GLuint _programs[ProgramCount];
+    GLint _alphaHandle;
+
+    bool _bufferAge;
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC _swapBuffersWithDamage;
+
+    GLuint _vertexBuffer;
+
+    bool _gles3;
+    CompositorGLUploader *_uploader;
+    CompositorGLReadback *_readback;
 };
 
 CompositorGL_GL::~CompositorGL_GL()
 {
-    glDeleteProgram(_textureProgram);
-    glDeleteShader(_pixelShader);
-    glDeleteShader(_vertexShader);
+    delete _readback;
+    delete _uploader;
+    glDeleteBuffers(1, &_vertexBuffer);
+    for (int i = 0; i < ProgramCount; ++i)
+        glDeleteProgram(_programs[i]);
 
     eglMakeCurrent(_egl->display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglDestroyContext(_egl->display_, _context);
-    eglDestroySurface(_egl->display_, _surface);
+    if (_surface != EGL_NO_SURFACE)
+        eglDestroySurface(_egl->display_, _surface);
+    if (_placeholder != EGL_NO_SURFACE)
+        eglDestroySurface(_egl->display_, _placeholder);
 
     were_debug("GL destroyed.\n");
 }
 
-CompositorGL_GL::CompositorGL_GL(CompositorGL_EGL *egl, NativeWindowType window)
+CompositorGL_GL::CompositorGL_GL(CompositorGL_EGL *egl, ProgramCache *programs, UploadTuner *tuner, NativeWindowType window)
 {
     _egl = egl;
+    _placeholder = EGL_NO_SURFACE;
 
     _surface = eglCreateWindowSurface(_egl->display_, _egl->config_, window, NULL);
     if (_surface == EGL_NO_SURFACE)
         throw std::runtime_error("[CompositorGL_GL::CompositorGL_GL] Failed: eglCreateWindowSurface.");
 
+    initialize(programs, tuner);
+}
+
+CompositorGL_GL::CompositorGL_GL(CompositorGL_EGL *egl, ProgramCache *programs, UploadTuner *tuner, int width, int height)
+{
+    _egl = egl;
+    _placeholder = EGL_NO_SURFACE;
+
+    const EGLint surfaceAttribs[] = {
+            EGL_WIDTH, width,
+            EGL_HEIGHT, height,
+            EGL_NONE};
+
+    _surface = eglCreatePbufferSurface(_egl->display_, _egl->config_, surfaceAttribs);
+    if (_surface == EGL_NO_SURFACE)
+        throw std::runtime_error("[CompositorGL_GL::CompositorGL_GL] Failed: eglCreatePbufferSurface.");
+
+    initialize(programs, tuner);
+}
+
+void CompositorGL_GL::initialize(ProgramCache *programs, UploadTuner *tuner)
+{
+    const EGLint context3Attribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE};
+
     const EGLint contextAttribs[] = {
             EGL_CONTEXT_CLIENT_VERSION, 2,
             EGL_NONE};
 
-    _context = eglCreateContext(_egl->display_, _egl->config_, EGL_NO_CONTEXT, contextAttribs);
+    _gles3 = true;
+    _context = eglCreateContext(_egl->display_, _egl->config_, EGL_NO_CONTEXT, context3Attribs);
+    if (_context == EGL_NO_CONTEXT)
+    {
+        _gles3 = false;
+        _context = eglCreateContext(_egl->display_, _egl->config_, EGL_NO_CONTEXT, contextAttribs);
+    }
     if (_context == EGL_NO_CONTEXT)
         throw std::runtime_error("[CompositorGL_GL::CompositorGL_GL] Failed: eglCreateContext.");
 
@@ -175,83 +295,188 @@ CompositorGL_GL::CompositorGL_GL(CompositorGL_EGL *egl, NativeWindowType window)
     were_message("GL_RENDERER = %s\n",   (char *) glGetString(GL_RENDERER));
     were_message("GL_EXTENSIONS = %s\n", (char *) glGetString(GL_EXTENSIONS));
 
-    _vertexShader = loadShader(GL_VERTEX_SHADER, simpleVS);
-    _pixelShader = loadShader(GL_FRAGMENT_SHADER, simpleFS);
+    uint64_t start = WereTimer::now();
 
-    _textureProgram = glCreateProgram();
-    if (!_textureProgram)
-        throw std::runtime_error("[CompositorGL_GL::CompositorGL_GL] Failed: glCreateProgram.");
+    const std::vector<std::string> attributes = {"position", "texCoords"};
 
-    glAttachShader(_textureProgram, _vertexShader);
-    glAttachShader(_textureProgram, _pixelShader);
-    glLinkProgram(_textureProgram);
+    programs->initialize(_gles3);
+    _programs[ProgramOpaque] = programs->program(simpleVS, opaqueFS, attributes);
+    _programs[ProgramBlended] = programs->program(simpleVS, blendedFS, attributes);
+    _alphaHandle = glGetUniformLocation(_programs[ProgramBlended], "alpha");
+    programs->save();
 
-    GLint linkStatus = GL_FALSE;
-    glGetProgramiv(_textureProgram, GL_LINK_STATUS, &linkStatus);
-    if (linkStatus != GL_TRUE)
-        throw std::runtime_error("[CompositorGL_GL::CompositorGL_GL] Failed: glLinkProgram.");
+    were_message("Programs ready in %.1f ms, %u of %d from the cache.\n", (WereTimer::now() - start) / 1e6,
+        programs->hits(), ProgramCount);
 
-    _texturePositionHandle = glGetAttribLocation(_textureProgram, "position");
-    _textureTexCoordsHandle = glGetAttribLocation(_textureProgram, "texCoords");
-#ifdef USE_BLENDING
-    _textureAlphaHandle = glGetUniformLocation(_textureProgram, "alpha");
-#endif
-    //_textureSamplerHandle = glGetUniformLocation(_textureProgram, "texture");
+    surfaceBound();
+
+    glGenBuffers(1, &_vertexBuffer);
+
+    _uploader = new CompositorGLUploader(_gles3);
+    _uploader->setPath(tuner->choose(reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+        reinterpret_cast<const char *>(glGetString(GL_VERSION)),
+        [this](UploadPath path) {return _uploader->measure(path);}));
+    _readback = new CompositorGLReadback(_gles3);
 
+    _bufferAge = _egl->hasExtension("EGL_EXT_buffer_age");
+
+    _swapBuffersWithDamage = nullptr;
+    if (_egl->hasExtension("EGL_KHR_swap_buffers_with_damage"))
+        _swapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+    else if (_egl->hasExtension("EGL_EXT_swap_buffers_with_damage"))
+        _swapBuffersWithDamage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+
+    were_message("Buffer age: %s, swap with damage: %s\n", _bufferAge ? "yes" : "no",
+        _swapBuffersWithDamage != nullptr ? "yes" : "no");
+}
+
+void CompositorGL_GL::surfaceBound()
+{
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     eglQuerySurface(_egl->display_, _surface, EGL_WIDTH, &_surfaceWidth);
     eglQuerySurface(_egl->display_, _surface, EGL_HEIGHT, &_surfaceHeight);
     glViewport(0, 0, _surfaceWidth, _surfaceHeight);
 
-    eglSwapInterval(_egl->display_, 0);
+    /* Swaps block until vsync, the frame scheduler learns the refresh from them */
+    eglSwapInterval(_egl->display_, 1);
+}
+
+/* The context stays current without a surface, or with a 1x1 pbuffer where that is not supported */
+bool CompositorGL_GL::detachWindow()
+{
+    EGLSurface current = EGL_NO_SURFACE;
+
+    if (!_egl->hasExtension("EGL_KHR_surfaceless_context"))
+    {
+        EGLint type = 0;
+        eglGetConfigAttrib(_egl->display_, _egl->config_, EGL_SURFACE_TYPE, &type);
+        if ((type & EGL_PBUFFER_BIT) == 0)
+            return false;
+
+        const EGLint surfaceAttribs[] = {
+                EGL_WIDTH, 1,
+                EGL_HEIGHT, 1,
+                EGL_NONE};
+
+        _placeholder = eglCreatePbufferSurface(_egl->display_, _egl->config_, surfaceAttribs);
+        if (_placeholder == EGL_NO_SURFACE)
+            return false;
+
+        current = _placeholder;
+    }
+
+    if (eglMakeCurrent(_egl->display_, current, current, _context) != EGL_TRUE)
+    {
+        if (_placeholder != EGL_NO_SURFACE)
+            eglDestroySurface(_egl->display_, _placeholder);
+        _placeholder = EGL_NO_SURFACE;
+        return false;
+    }
+
+    eglDestroySurface(_egl->display_, _surface);
+    _surface = EGL_NO_SURFACE;
+
+    return true;
 }
 
-GLuint CompositorGL_GL::loadShader(GLenum shaderType, const char *pSource)
+bool CompositorGL_GL::attachWindow(NativeWindowType window)
 {
-    GLuint shader = glCreateShader(shaderType);
-    if (!shader)
-        throw std::runtime_error("[CompositorGL_GL::loadShader] Failed: glCreateShader.");
+    _surface = eglCreateWindowSurface(_egl->display_, _egl->config_, window, NULL);
+    if (_surface == EGL_NO_SURFACE)
+        throw std::runtime_error("[CompositorGL_GL::attachWindow] Failed: eglCreateWindowSurface.");
+
+    if (eglMakeCurrent(_egl->display_, _surface, _surface, _context) != EGL_TRUE)
+    {
+        if (eglGetError() == EGL_CONTEXT_LOST)
+            return false;
+        throw std::runtime_error("[CompositorGL_GL::attachWindow] Failed: eglMakeCurrent.");
+    }
 
-    glShaderSource(shader, 1, &pSource, NULL);
-    glCompileShader(shader);
+    if (_placeholder != EGL_NO_SURFACE)
+        eglDestroySurface(_egl->display_, _placeholder);
+    _placeholder = EGL_NO_SURFACE;
 
-    GLint compiled = GL_FALSE;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-    if (compiled != GL_TRUE)
-        throw std::runtime_error("[CompositorGL_GL::loadShader] Failed: glCompileShader.");
+    surfaceBound();
 
-    return shader;
+    return true;
 }
 
 /* ================================================================================================================== */
 
-class CompositorGLSurface
+class CompositorGLSurface : public CompositorSurface
 {
 public:
     virtual ~CompositorGLSurface();
     CompositorGLSurface(const std::string &name);
 
-    const std::string &name() {return _name;}
     Texture *texture();
     void destroyTexture(); //FIXME Temporary solution
-    const RectangleA &position();
-    int strata();
-    float alpha();
+    GLuint textureId();
+    void textureCoordinates(float *s1, float *t1, float *s2, float *t2);
+    bool hasTexture() {return _texture != 0 || _atlas != nullptr;}
+    void setAtlas(CompositorGLAtlas *atlas, int cell);
+
+    /* Index of the quad in the vertex buffer */
+    int index() {return _index;}
+    void setIndex(int index) {_index = index;}
+
+    bool opaqueFormat() {return _opaqueFormat;}
+    bool occluded() {return _occluded;}
+    void setOccluded(bool occluded) {_occluded = occluded;}
+
+    /* Render thread: occluded, off the screen or transparent, as of the last frame */
+    bool hiddenSeen() {return _hiddenSeen;}
+    void setHiddenSeen(bool hidden) {_hiddenSeen = hidden;}
+    /* Protocol thread: what the render thread last reported */
+    bool hidden() {return _hidden;}
+    void setHidden(bool hidden) {_hidden = hidden;}
+    /* The owner was told it may unpin the memory, or to pin it and the whole surface is not damaged yet */
+    bool purgeable() {return _purgeable;}
+    void setPurgeable(bool purgeable) {_purgeable = purgeable;}
+    bool repinning() {return _repinning;}
+    void setRepinning(bool repinning) {_repinning = repinning;}
+    bool held() {return _purgeable || _repinning;}
+
+    /* Memory the owner can unpin, its size and the part of it resident */
+    virtual bool purgeableMemory() {return false;}
+    virtual uint64_t sharedBytes() {return 0;}
+    virtual uint64_t residentBytes() {return 0;}
+    uint64_t textureBytes() {return _textureBytes;}
 
-    void setPosition(int x1, int y1, int x2, int y2);
-    void setStrata(int strata);
-    void setAlpha(float alpha);
     void addDamage(int x1, int y1, int x2, int y2);
+    RectangleA takeDamage();
+
+    /* Render thread side of the damage, handed over with the scene */
+    void addTextureDamage(RectangleA damage);
+
+    /* Texels changed by the last updateTexture(), and the bytes that took */
+    const RectangleA &uploaded() {return _uploaded;}
+    uint64_t uploadedBytes() {return _uploadedBytes;}
+    /* Bytes the next updateTexture() would upload, the whole surface while there is no texture */
+    uint64_t pendingUpload();
 
-    virtual bool updateTexture() = 0;
+    virtual int bytesPerPixel() = 0;
+    virtual bool atlasCompatible() = 0;
+    /* Uploads whole rows of the damage, limit bytes of them when it is not 0. New textures are filled at once. */
+    virtual bool updateTexture(CompositorGLUploader *uploader, uint64_t limit) = 0;
 
 protected:
-    std::string _name;
     Texture *_texture;
-    RectangleA _position;
-    int _strata;
-    float _alpha;
     RectangleA _damage;
+    RectangleA _textureDamage;
+    RectangleA _uploaded;
+    uint64_t _uploadedBytes;
+    bool _opaqueFormat;
+    bool _occluded;
+    bool _hiddenSeen;
+    bool _hidden;
+    bool _purgeable;
+    bool _repinning;
+    std::atomic<uint64_t> _textureBytes;
+    CompositorGLAtlas *_atlas;
+    int _cell;
+    bool _atlasFilled;
+    int _index;
 };
 
 CompositorGLSurface::~CompositorGLSurface()
@@ -259,12 +484,22 @@ CompositorGLSurface::~CompositorGLSurface()
     destroyTexture();
 }
 
-CompositorGLSurface::CompositorGLSurface(const std::string &name)
+CompositorGLSurface::CompositorGLSurface(const std::string &name) :
+    CompositorSurface(name)
 {
-    _name = name;
     _texture = 0;
-    _strata = 0;
-    _alpha = 1.0f;
+    _opaqueFormat = false;
+    _occluded = false;
+    _hiddenSeen = false;
+    _hidden = false;
+    _purgeable = false;
+    _repinning = false;
+    _textureBytes = 0;
+    _atlas = nullptr;
+    _cell = -1;
+    _atlasFilled = false;
+    _index = 0;
+    _uploadedBytes = 0;
 }
 
 Texture *CompositorGLSurface::texture()
@@ -281,36 +516,52 @@ void CompositorGLSurface::destroyTexture()
         delete _texture;
         _texture = 0;
     }
-}
 
-const RectangleA &CompositorGLSurface::position()
-{
-    return _position;
-}
+    if (_atlas != nullptr)
+    {
+        _atlas->release(_cell);
+        _atlas = nullptr;
+        _cell = -1;
+    }
 
-int CompositorGLSurface::strata()
-{
-    return _strata;
+    _textureBytes = 0;
 }
 
-float CompositorGLSurface::alpha()
+GLuint CompositorGLSurface::textureId()
 {
-    return _alpha;
-}
+    if (_atlas != nullptr)
+        return _atlas->texture()->id();
 
-void CompositorGLSurface::setPosition(int x1, int y1, int x2, int y2)
-{
-    _position = RectangleA(PointA(x1, y1), PointA(x2, y2));
+    return texture()->id();
 }
 
-void CompositorGLSurface::setStrata(int strata)
+void CompositorGLSurface::textureCoordinates(float *s1, float *t1, float *s2, float *t2)
 {
-    _strata = strata;
+    if (_atlas == nullptr)
+    {
+        *s1 = 0.0f;
+        *t1 = 0.0f;
+        *s2 = 1.0f;
+        *t2 = 1.0f;
+        return;
+    }
+
+    /* Half a texel inside so filtering never picks up the neighbouring cell */
+    PointA origin = _atlas->origin(_cell);
+    *s1 = (origin.x + 0.5f) / ATLAS_SIZE;
+    *t1 = (origin.y + 0.5f) / ATLAS_SIZE;
+    *s2 = (origin.x + width() - 0.5f) / ATLAS_SIZE;
+    *t2 = (origin.y + height() - 0.5f) / ATLAS_SIZE;
 }
 
-void CompositorGLSurface::setAlpha(float alpha)
+void CompositorGLSurface::setAtlas(CompositorGLAtlas *atlas, int cell)
 {
-    _alpha = alpha;
+    destroyTexture();
+
+    _atlas = atlas;
+    _cell = cell;
+    _atlasFilled = false;
+    _textureBytes = static_cast<uint64_t>(ATLAS_CELL) * ATLAS_CELL * 4;
 }
 
 void CompositorGLSurface::addDamage(int x1, int y1, int x2, int y2)
@@ -330,18 +581,71 @@ void CompositorGLSurface::addDamage(int x1, int y1, int x2, int y2)
         _damage = RectangleA(PointA(x1, y1), PointA(x2, y2));
 }
 
+RectangleA CompositorGLSurface::takeDamage()
+{
+    RectangleA damage = _damage;
+    _damage = RectangleA();
+    return damage;
+}
+
+/* Bounds of two rectangles, empty ones ignored */
+static RectangleA bounding_rectangle(RectangleA a, RectangleA b)
+{
+    if (b.width() <= 0 || b.height() <= 0)
+        return a;
+    if (a.width() <= 0 || a.height() <= 0)
+        return b;
+
+    return RectangleA(PointA(std::min(a.from.x, b.from.x), std::min(a.from.y, b.from.y)),
+        PointA(std::max(a.to.x, b.to.x), std::max(a.to.y, b.to.y)));
+}
+
+void CompositorGLSurface::addTextureDamage(RectangleA damage)
+{
+    _textureDamage = bounding_rectangle(_textureDamage, damage);
+}
+
+uint64_t CompositorGLSurface::pendingUpload()
+{
+    uint64_t row = static_cast<uint64_t>(width()) * bytesPerPixel();
+
+    if (!hasTexture())
+        return row * height();
+    if (_textureDamage.width() <= 0 || _textureDamage.height() <= 0)
+        return 0;
+
+    return row * _textureDamage.height();
+}
+
 /* ================================================================================================================== */
 
 class CompositorGLSurfaceFile : public CompositorGLSurface
 {
 public:
     ~CompositorGLSurfaceFile();
-    CompositorGLSurfaceFile(const std::string &name, int fd, int width, int height);
+    CompositorGLSurfaceFile(const std::string &name, int fd, int width, int height, int stride, int format);
+
+    int width() {return _surface->width();}
+    int height() {return _surface->height();}
+    int bytesPerPixel() {return _surface->bytesPerPixel();}
+    WereSurface *pixels() {return _surface;}
+    bool atlasCompatible();
+    bool updateTexture(CompositorGLUploader *uploader, uint64_t limit);
 
-    bool updateTexture();
+    bool purgeableMemory() {return _shared;}
+    uint64_t sharedBytes();
+    uint64_t residentBytes();
+
+protected:
+    CompositorGLSurfaceFile(const std::string &name, WereSurface *surface, int format);
+    void setFormat(int format);
+
+    WereSurface *_surface;
+    bool _shared;
 
 private:
-    SparkleSurfaceAshmem *_surface;
+    GLenum _glFormat;
+    GLenum _glType;
 };
 
 CompositorGLSurfaceFile::~CompositorGLSurfaceFile()
@@ -349,53 +653,246 @@ CompositorGLSurfaceFile::~CompositorGLSurfaceFile()
     delete _surface;
 }
 
-CompositorGLSurfaceFile::CompositorGLSurfaceFile(const std::string &name, int fd, int width, int height) :
+CompositorGLSurfaceFile::CompositorGLSurfaceFile(const std::string &name, int fd, int width, int height, int stride,
+    int format) :
+    CompositorGLSurface(name)
+{
+    _surface = new SparkleSurfaceAshmem(fd, width, height, stride, surfaceFormatBytesPerPixel(format));
+    _shared = true;
+    setFormat(format);
+}
+
+CompositorGLSurfaceFile::CompositorGLSurfaceFile(const std::string &name, WereSurface *surface, int format) :
     CompositorGLSurface(name)
 {
-    _surface = new SparkleSurfaceAshmem(fd, width, height);
+    _surface = surface;
+    _shared = false;
+    setFormat(format);
+}
+
+void CompositorGLSurfaceFile::setFormat(int format)
+{
+    _opaqueFormat = (format != SurfaceFormatBGRA8888);
+
+    if (format == SurfaceFormatRGB565)
+    {
+        _glFormat = GL_RGB;
+        _glType = GL_UNSIGNED_SHORT_5_6_5;
+    }
+    else
+    {
+        _glFormat = GL_BGRA_EXT;
+        _glType = GL_UNSIGNED_BYTE;
+    }
+}
+
+bool CompositorGLSurfaceFile::atlasCompatible()
+{
+    return _glFormat == GL_BGRA_EXT && _glType == GL_UNSIGNED_BYTE &&
+        _surface->width() <= ATLAS_CELL && _surface->height() <= ATLAS_CELL;
 }
 
-bool CompositorGLSurfaceFile::updateTexture()
+bool CompositorGLSurfaceFile::updateTexture(CompositorGLUploader *uploader, uint64_t limit)
 {
     bool result = false;
+    RectangleA full = RectangleA(PointA(0, 0), PointA(_surface->width(), _surface->height()));
 
-    if (texture()->width() != _surface->width() || texture()->height() != _surface->height())
+    if (_atlas != nullptr)
+    {
+        if (!_atlasFilled)
+        {
+            _atlasFilled = true;
+            _textureDamage = full;
+            limit = 0;
+        }
+    }
+    else if (texture()->width() != _surface->width() || texture()->height() != _surface->height() ||
+        texture()->format() != uploader->textureFormat(_glFormat))
     {
-        texture()->resize(_surface->width(), _surface->height());
-        _damage = RectangleA(PointA(0, 0), PointA(texture()->width(), texture()->height()));
+        texture()->resize(_surface->width(), _surface->height(), uploader->textureFormat(_glFormat), _glType);
+        _textureBytes = static_cast<uint64_t>(_surface->width()) * _surface->height() *
+            (_glType == GL_UNSIGNED_SHORT_5_6_5 ? 2 : 4);
+        _textureDamage = full;
+        limit = 0;
         result = true;
     }
 
-    if ((_damage.width() > 0 && _damage.height() > 0) || ALWAYS_UPLOAD)
-    {
-        unsigned char *data = _surface->data();
+    /* The whole path respecifies all of the texture, there are no bands */
+    bool whole = _atlas == nullptr;
+    if (whole && uploader->path() == UploadWhole)
+        limit = 0;
 
-        //were_debug("Uploading %d %d %d %d -> %d %d\n", _damage.from.x, _damage.from.y, _damage.to.x, _damage.to.y, texture()->width(), texture()->height());
+    _uploaded = RectangleA();
+    _uploadedBytes = 0;
 
+    if (_textureDamage.width() > 0 && _textureDamage.height() > 0)
+    {
+        PointA origin = (_atlas != nullptr) ? _atlas->origin(_cell) : PointA(0, 0);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture()->id());
+        /* A band from the top, the rows below stay damaged for the next frames */
+        RectangleA band = _textureDamage;
+        if (limit != 0)
+        {
+            uint64_t row = static_cast<uint64_t>(_surface->width()) * _surface->bytesPerPixel();
+            int rows = static_cast<int>(std::max(static_cast<uint64_t>(1), limit / row));
+            if (rows < band.height())
+                band.to.y = band.from.y + rows;
+        }
 
-#if 0 || ALWAYS_UPLOAD
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, texture()->width(), texture()->height(), 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
-#else
-        glTexSubImage2D(GL_TEXTURE_2D, 0,
-            0, _damage.from.y,
-            texture()->width(), _damage.height(),
-            GL_BGRA_EXT, GL_UNSIGNED_BYTE,
-            &data[_damage.from.y * texture()->width() * 4]);
-#endif
+        //were_debug("Uploading %d %d %d %d -> %d %d\n", band.from.x, band.from.y, band.to.x, band.to.y, texture()->width(), texture()->height());
+
+        _uploadedBytes = uploader->update(textureId(), origin, whole, _surface->width(), _surface->height(),
+            _surface->stride(), band, _glFormat, _glType, _surface->data(), _surface->bytesPerPixel());
 
-        _damage = RectangleA(PointA(0, 0), PointA(0, 0));
+        _uploaded = band;
+        if (band.to.y < _textureDamage.to.y)
+            _textureDamage.from.y = band.to.y;
+        else
+            _textureDamage = RectangleA(PointA(0, 0), PointA(0, 0));
         result = true;
     }
 
     return result;
 }
 
+uint64_t CompositorGLSurfaceFile::sharedBytes()
+{
+    if (!_shared)
+        return 0;
+
+    return static_cast<uint64_t>(_surface->stride()) * _surface->height() * _surface->bytesPerPixel();
+}
+
+/* Pages of the mapping in memory, purged ones are not */
+uint64_t CompositorGLSurfaceFile::residentBytes()
+{
+    uint64_t size = sharedBytes();
+    if (size == 0)
+        return 0;
+
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t from = reinterpret_cast<uintptr_t>(_surface->data()) & ~(page - 1);
+    uintptr_t to = reinterpret_cast<uintptr_t>(_surface->data()) + size;
+
+    std::vector<unsigned char> pages((to - from + page - 1) / page);
+    if (mincore(reinterpret_cast<void *>(from), to - from, pages.data()) != 0)
+        return 0;
+
+    uint64_t resident = 0;
+    for (auto it = pages.begin(); it != pages.end(); ++it)
+    {
+        if (*it & 1)
+            resident += page;
+    }
+
+    return std::min(resident, size);
+}
+
+/* ================================================================================================================== */
+
+class CompositorGLSurfaceMemory : public WereSurface
+{
+public:
+    CompositorGLSurfaceMemory(int width, int height, int bytesPerPixel) :
+        _data(static_cast<size_t>(width) * height * bytesPerPixel, 0), _width(width), _height(height), _bytesPerPixel(bytesPerPixel) {}
+
+    unsigned char *data() {return _data.data();}
+    int width() {return _width;}
+    int height() {return _height;}
+    int stride() {return _width;}
+    int bytesPerPixel() {return _bytesPerPixel;}
+
+private:
+    std::vector<unsigned char> _data;
+    int _width;
+    int _height;
+    int _bytesPerPixel;
+};
+
+/* Surface of a remote client, the pixels arrive in-band */
+class CompositorGLSurfaceStream : public CompositorGLSurfaceFile
+{
+public:
+    CompositorGLSurfaceStream(const std::string &name, int width, int height, int format);
+
+    bool decode(int x1, int y1, int x2, int y2, int codec, const std::string &data);
+};
+
+CompositorGLSurfaceStream::CompositorGLSurfaceStream(const std::string &name, int width, int height, int format) :
+    CompositorGLSurfaceFile(name, new CompositorGLSurfaceMemory(width, height, surfaceFormatBytesPerPixel(format)), format)
+{
+}
+
+bool CompositorGLSurfaceStream::decode(int x1, int y1, int x2, int y2, int codec, const std::string &data)
+{
+    if (x1 < 0 || y1 < 0 || x2 > _surface->width() || y2 > _surface->height() || x1 >= x2 || y1 >= y2)
+        return false;
+
+    int bpp = _surface->bytesPerPixel();
+    int stride = _surface->stride() * bpp;
+    bool result;
+
+    if (codec == SurfaceCodecRaw)
+        result = SparkleCodec::decodeRaw(data, _surface->data(), stride, x1, y1, x2, y2, bpp);
+    else if (codec == SurfaceCodecDelta)
+        result = SparkleCodec::decodeDelta(data, _surface->data(), stride, x1, y1, x2, y2, bpp);
+    else
+        result = false;
+
+    addDamage(x1, y1, x2, y2);
+
+    return result;
+}
+
+/* ================================================================================================================== */
+
+/* What the render thread draws, surfaces in stacking order as the protocol thread last saw them */
+struct CompositorGLSceneSurface
+{
+    std::shared_ptr<CompositorGLSurface> surface;
+    RectangleA position;
+    float alpha;
+    RectangleA damage;
+    /* Has the keyboard focus, its uploads go first */
+    bool focused;
+    /* The memory may be purged, nothing is uploaded from it */
+    bool held;
+
+    /* Covers everything under its position: alpha is 1 and the format has no alpha channel */
+    bool opaque() const {return surface->opaqueFormat() && alpha == 1.0f;}
+};
+
+struct CompositorGLScene
+{
+    CompositorGLScene() : geometry(false), input(0) {}
+
+    std::vector<CompositorGLSceneSurface> surfaces;
+    Region damage;
+    bool geometry;
+    /* First input that arrived before the scene was published, for the input to present latency */
+    uint64_t input;
+};
+
+/* Performance overlay, see PerformanceHud */
+const char HUD_SURFACE[] = "compositor.hud";
+const int HUD_MARGIN = 8;
+const int HUD_STRATA = 0x7FFFFFFF;
+const float HUD_ALPHA = 0.85f;
+const int HUD_INTERVAL = 250;
+
+/* X keycodes (evdev + 8) of the overlay shortcut */
+const int KEYCODE_CONTROL_L = 37;
+const int KEYCODE_CONTROL_R = 105;
+const int KEYCODE_ALT_L = 64;
+const int KEYCODE_ALT_R = 108;
+const int KEYCODE_H = 43;
+
+/* Triple buffered, the slot in the middle is swapped atomically and marked fresh until the render thread takes it */
+const int SCENE_FRESH = 4;
+
 /* ================================================================================================================== */
 
-class CompositorGL : public Compositor
+class CompositorGL : public Compositor, public SurfaceRegistryBackend
 {
 public:
     ~CompositorGL();
@@ -409,8 +906,11 @@ private:
     void finishForNativeDisplay();
     void initializeForNativeWindow(NativeWindowType window);
     void finishForNativeWindow();
+    void initializeForOffscreen(int width, int height);
 
     void draw();
+    void vsync(uint64_t time);
+    void dumpFrame(const std::string &path);
 
     void pointerDown(int slot, int x, int y);
     void pointerUp(int slot, int x, int y);
@@ -420,34 +920,146 @@ private:
     void buttonPress(int button, int x, int y);
     void buttonRelease(int button, int x, int y);
     void cursorMotion(int x, int y);
+    void flushMotion();
+    void inputArrived();
+    bool hudKey(int code, bool down);
 
     void connection(std::shared_ptr <SparkleConnection> client);
+    void disconnection(std::shared_ptr <SparkleConnection> client);
     void packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message);
-
-    void registerSurfaceFile(const std::string &name, int fd, int width, int height);
-    void unregisterSurface(const std::string &name);
-    void setSurfacePosition(const std::string &name, int x1, int y1, int x2, int y2);
-    void setSurfaceStrata(const std::string &name, int strata);
-    void setSurfaceAlpha(const std::string &name, float alpha);
-    void addSurfaceDamage(const std::string &name, int x1, int y1, int x2, int y2);
-
-    std::shared_ptr<CompositorGLSurface> findSurface(const std::string &name);
-    void transformCoordinates(int x, int y, std::shared_ptr<CompositorGLSurface> surface, int *_x, int *_y);
-
-    static bool sortFunction(std::shared_ptr<CompositorGLSurface> a1, std::shared_ptr<CompositorGLSurface> a2);
+    void startCapture(std::shared_ptr<SparkleConnection> client, int slots, uint32_t flags);
+    void stopCapture(std::shared_ptr<SparkleConnection> client);
+    void captureStarted(std::shared_ptr<FrameCapture> capture);
+    void captureFrame(int slot, uint32_t sequence);
+    void setPerformanceHud(bool enabled);
+    void updatePerformanceHud();
+    void hudFrame(uint64_t time, uint64_t cost, uint64_t uploadBytes, unsigned int uploadRectangles, uint64_t latency,
+        uint64_t budget, uint64_t carried);
+    void trimMemory(int level);
+    void pressureEnded();
+    void visibilityChanged(const std::vector<std::pair<std::shared_ptr<CompositorGLSurface>, bool>> &changes);
+    void updatePurgeable();
+    void surfaceStats(std::shared_ptr<SparkleConnection> client);
+
+    void frameDone();
+
+    std::shared_ptr<CompositorSurface> createSurface(const std::string &name, int fd, int width, int height,
+        int stride, int format);
+    void surfaceAdded(CompositorSurface *surface);
+    void surfaceRemoved(CompositorSurface *surface);
+    void surfaceMoved(CompositorSurface *surface, const RectangleA &previous);
+    void surfaceRestacked(CompositorSurface *surface);
+    void surfaceAlphaChanged(CompositorSurface *surface);
+    void surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2);
+    void surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec, const std::string &data);
+
+    void damageScreen(const RectangleA &rectangle);
+    void sceneChanged();
+    void publishScene();
+    void displaySizeChanged(int width, int height);
+    void scaleChanged(int scale);
+
+    /* Render thread */
+    void renderSync(const std::function<void ()> &f);
+    void createWindow(NativeWindowType window);
+    void createOffscreen(int width, int height);
+    void windowCreated();
+    void destroyWindow();
+    void releaseGL();
+    void requestDump(const std::string &path);
+    void writeDump();
+    void setCapture(int slots, bool drop);
+    void createCapture(int width, int height);
+    void finishCapture();
+    void requestFrame();
+    void redraw();
+    void trimTextures(bool all);
+    void render();
+    void acquireScene();
+    RectangleA screenRectangle(const CompositorGLSceneSurface &surface, const RectangleA &local);
+    void drawSurfaces(const RectangleA &clip);
+    void drawBatches(const std::vector<const CompositorGLSceneSurface *> &surfaces);
+    void updateGeometry();
+    static bool surfaceBlended(const CompositorGLSceneSurface *surface);
 
 private:
     WereEventLoop *_loop;
     Platform *_platform;
     CompositorGL_EGL *_egl;
-    CompositorGL_GL *_gl;
 
     SparkleServer *_server;
+    SurfaceRegistry *_registry;
+    uint32_t _frames;
+    int _scale;
 
-    std::vector< std::shared_ptr<CompositorGLSurface> > _surfaces;
+    /* Pointer motion of the current frame, per slot */
+    struct Motion
+    {
+        std::string surface;
+        std::vector<uint64_t> times;
+        std::vector<PointerMotionSample> samples;
+    };
+    std::map<int, Motion> _motion;
+    WereTimer *_motionTimer;
+    bool _motionPending;
+
+    std::shared_ptr<SparkleConnection> _captureClient;
+
+    PerformanceHud *_hud;
+    std::shared_ptr<CompositorGLSurfaceStream> _hudSurface;
+    WereTimer *_hudTimer;
+    std::atomic<bool> _hudEnabled;
+    unsigned int _hudModifiers;
+    uint64_t _inputTime;
+
+    /* Highest trim level within PRESSURE_TIME, 0 without pressure */
+    uint32_t _pressure;
+    WereTimer *_pressureTimer;
+    std::atomic<bool> _evictHidden;
+
+    CompositorGLScene _scenes[3];
+    std::atomic<int> _middle;
+    int _back;
+    bool _sceneChanged;
+
+    /* Render thread */
+    WereEventLoop *_render;
+    std::atomic<bool> _renderQueued;
+    FrameScheduler *_scheduler;
+    int _front;
+    std::vector< std::shared_ptr<CompositorGLSurface> > _drawn;
 
-    float _plane[20];
+    CompositorGL_GL *_gl;
     bool _redraw;
+    std::string _dumpPath;
+
+    /* The frame read back last is published when the next one starts, or half a period later */
+    std::shared_ptr<FrameCapture> _capture;
+    int _captureSlots;
+    bool _captureDrop;
+    WereTimer *_captureTimer;
+    uint64_t _captureTime;
+
+    ScalePolicy _scalePolicy;
+    UploadBudget _uploadBudget;
+
+    Region _damage;
+    std::deque<Region> _history;
+    std::vector<const CompositorGLSceneSurface *> _visible;
+    std::vector<const CompositorGLSceneSurface *> _uploads;
+
+    CompositorGLAtlas *_atlas;
+    ProgramCache *_programCache;
+    UploadTuner *_uploadTuner;
+    bool _restoring;
+    uint64_t _presentInput;
+    uint64_t _resumeTime;
+    unsigned int _resumeFrames;
+    std::vector<float> _vertices;
+    bool _geometryDirty;
+    std::vector<const CompositorGLSceneSurface *> _opaque;
+    std::vector<const CompositorGLSceneSurface *> _blended;
+    float _alpha;
 };
 
 /* ================================================================================================================== */
@@ -455,9 +1067,24 @@ private:
 CompositorGL::~CompositorGL()
 {
     delete _server;
+    delete _motionTimer;
+    delete _hudTimer;
+    delete _pressureTimer;
+    delete _hud;
+
+    renderSync(std::bind(&CompositorGL::releaseGL, this));
+    _render->exit();
+    delete _captureTimer;
+    delete _scheduler;
+    delete _render;
+    delete _uploadTuner;
+    delete _programCache;
+
+    _drawn.clear();
+    for (int i = 0; i < 3; ++i)
+        _scenes[i].surfaces.clear();
+    delete _registry;
 
-    if (_gl)
-        delete _gl;
     if (_egl)
         delete _egl;
 }
@@ -468,38 +1095,64 @@ CompositorGL::CompositorGL(WereEventLoop *loop, Platform *platform, const std::s
     _platform = platform;
 
     _egl = 0;
+    _registry = new SurfaceRegistry(this);
+    _frames = 0;
+    _motionPending = false;
+
+    _front = 0;
+    _middle = 1;
+    _back = 2;
+    _sceneChanged = false;
+
+    _renderQueued = false;
     _gl = 0;
+    _redraw = false;
+    _atlas = nullptr;
+    _restoring = false;
+    _presentInput = 0;
+    _resumeTime = 0;
+    _resumeFrames = 0;
+    _geometryDirty = true;
+    _alpha = 1.0f;
+
+    /* Binaries of the programs, next to the socket unless the program_cache option says otherwise */
+    std::string programCache = compositor_option("program_cache");
+    _programCache = new ProgramCache(programCache.empty() ? file + ".programs" : programCache);
+
+    /* Upload paths measured per driver, likewise with the upload_cache option */
+    std::string uploadCache = compositor_option("upload_cache");
+    _uploadTuner = new UploadTuner(uploadCache.empty() ? file + ".upload" : uploadCache);
+
+    /* GL calls block on the GPU, they get a thread and an event loop of their own */
+    _render = new WereEventLoop();
+
+    const char *mode = getenv("SPARKLE_FRAME_MODE");
+    if (mode != nullptr && std::string(mode) == "throughput")
+        _scheduler = new FrameScheduler(_render, FrameScheduler::Throughput);
+    else
+        _scheduler = new FrameScheduler(_render, FrameScheduler::Latency);
+    _scheduler->frame.connect(std::bind(&CompositorGL::render, this));
+    were_message("Frame scheduling: %s\n", _scheduler->mode() == FrameScheduler::Throughput ? "throughput" : "latency");
+
+    _captureSlots = 0;
+    _captureDrop = false;
+    _captureTime = 0;
+    _captureTimer = new WereTimer(_render);
+    _captureTimer->timeout.connect(WereSimpleQueuer(_render, &CompositorGL::finishCapture, this));
+
+    _scale = _scalePolicy.scale();
 
-    _plane[0] = -1.0f;
-    _plane[1] = -1.0f;
-    _plane[2] = 0.0f;
-    _plane[3] = 0.0f;
-    _plane[4] = 0.0f;
-
-    _plane[5] = 1.0f;
-    _plane[6] = -1.0f;
-    _plane[7] = 0.0f;
-    _plane[8] = 1.0f;
-    _plane[9] = 0.0f;
-
-    _plane[10] = -1.0f;
-    _plane[11] = 1.0f;
-    _plane[12] = 0.0;
-    _plane[13] = 0.0f;
-    _plane[14] = 1.0f;
-
-    _plane[15] = 1.0f;
-    _plane[16] = 1.0f;
-    _plane[17] = 0.0f;
-    _plane[18] = 1.0f;
-    _plane[19] = 1.0f;
+    _render->runThread();
 
     _platform->initializeForNativeDisplay.connect(WereSimpleQueuer(loop, &CompositorGL::initializeForNativeDisplay, this));
     _platform->initializeForNativeWindow.connect(WereSimpleQueuer(loop, &CompositorGL::initializeForNativeWindow, this));
     _platform->finishForNativeDisplay.connect(WereSimpleQueuer(loop, &CompositorGL::finishForNativeDisplay, this));
     _platform->finishForNativeWindow.connect(WereSimpleQueuer(loop, &CompositorGL::finishForNativeWindow, this));
+    _platform->initializeForOffscreen.connect(WereSimpleQueuer(loop, &CompositorGL::initializeForOffscreen, this));
 
     _platform->draw.connect(WereSimpleQueuer(loop, &CompositorGL::draw, this));
+    _platform->vsync.connect(WereSimpleQueuer(loop, &CompositorGL::vsync, this));
+    _platform->dumpFrame.connect(WereSimpleQueuer(loop, &CompositorGL::dumpFrame, this));
 
     _platform->pointerDown.connect(WereSimpleQueuer(loop, &CompositorGL::pointerDown, this));
     _platform->pointerUp.connect(WereSimpleQueuer(loop, &CompositorGL::pointerUp, this));
@@ -510,20 +1163,37 @@ CompositorGL::CompositorGL(WereEventLoop *loop, Platform *platform, const std::s
     _platform->buttonRelease.connect(WereSimpleQueuer(loop, &CompositorGL::buttonRelease, this));
     _platform->cursorMotion.connect(WereSimpleQueuer(loop, &CompositorGL::cursorMotion, this));
 
+    _motionTimer = new WereTimer(_loop);
+    _motionTimer->timeout.connect(WereSimpleQueuer(loop, &CompositorGL::flushMotion, this));
+
+    _hud = nullptr;
+    _hudEnabled = false;
+    _hudModifiers = 0;
+    _inputTime = 0;
+    _hudTimer = new WereTimer(_loop);
+    _hudTimer->timeout.connect(WereSimpleQueuer(loop, &CompositorGL::updatePerformanceHud, this));
+
+    _pressure = 0;
+    _evictHidden = false;
+    _pressureTimer = new WereTimer(_loop);
+    _pressureTimer->timeout.connect(WereSimpleQueuer(loop, &CompositorGL::pressureEnded, this));
+    _platform->trimMemory.connect(WereSimpleQueuer(loop, &CompositorGL::trimMemory, this));
+
     _server = new SparkleServer(_loop, file);
 
     _server->signal_connected.connect(WereSimpleQueuer(loop, &CompositorGL::connection, this));
+    _server->signal_disconnected.connect(WereSimpleQueuer(loop, &CompositorGL::disconnection, this));
     _server->signal_packet.connect(WereSimpleQueuer(loop, &CompositorGL::packet, this));
 }
 
 int CompositorGL::displayWidth()
 {
-    return _gl->_surfaceWidth;
+    return _registry->displayWidth();
 }
 
 int CompositorGL::displayHeight()
 {
-    return _gl->_surfaceHeight;
+    return _registry->displayHeight();
 }
 
 /* ================================================================================================================== */
@@ -538,6 +1208,9 @@ void CompositorGL::finishForNativeDisplay()
 {
     //XXX Disconnect getVID
 
+    /* A context kept over window loss goes with the display */
+    renderSync(std::bind(&CompositorGL::releaseGL, this));
+
     if (_egl != 0)
         delete _egl;
     _egl = 0;
@@ -545,409 +1218,1352 @@ void CompositorGL::finishForNativeDisplay()
 
 void CompositorGL::initializeForNativeWindow(NativeWindowType window)
 {
-    _gl = new CompositorGL_GL(_egl, window);
-
-    _server->broadcast(DisplaySizeNotification({_gl->_surfaceWidth, _gl->_surfaceHeight}));
+    _render->queue(std::bind(&CompositorGL::createWindow, this, window));
+}
 
-    _redraw = true;
+void CompositorGL::initializeForOffscreen(int width, int height)
+{
+    _render->queue(std::bind(&CompositorGL::createOffscreen, this, width, height));
 }
 
+/* The platform takes the window away once this returns */
 void CompositorGL::finishForNativeWindow()
 {
-    if (_gl != 0)
-    {
-        for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
-            (*it)->destroyTexture();
-
-        delete _gl;
-    }
-    _gl = 0;
+    renderSync(std::bind(&CompositorGL::destroyWindow, this));
 }
 
+/* The window was exposed or resized */
 void CompositorGL::draw()
 {
-    if (_gl == 0)
-        return;
+    _render->queue(std::bind(&CompositorGL::redraw, this));
+}
 
-#if 1
-    int width;
-    int height;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    eglQuerySurface(_egl->display_, _gl->_surface, EGL_WIDTH, &width);
-    eglQuerySurface(_egl->display_, _gl->_surface, EGL_HEIGHT, &height);
+void CompositorGL::vsync(uint64_t time)
+{
+    _render->queue(std::bind(&FrameScheduler::vsync, _scheduler, time));
+}
 
-    if (width != _gl->_surfaceWidth || height != _gl->_surfaceHeight)
-    {
-        _gl->_surfaceWidth = width;
-        _gl->_surfaceHeight = height;
-        glViewport(0, 0, _gl->_surfaceWidth, _gl->_surfaceHeight);
+void CompositorGL::dumpFrame(const std::string &path)
+{
+    _render->queue(std::bind(&CompositorGL::requestDump, this, path));
+}
 
-        _server->broadcast(DisplaySizeNotification({_gl->_surfaceWidth, _gl->_surfaceHeight}));
-    }
+void CompositorGL::sceneChanged()
+{
+    if (_sceneChanged)
+        return;
 
-#endif
+    _sceneChanged = true;
+    _loop->queue(std::bind(&CompositorGL::publishScene, this));
+}
 
-    for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
-    {
-        _redraw |= (*it)->updateTexture();
-    }
+/* Runs once after a batch of changes, the render thread picks the latest scene up when its frame starts */
+void CompositorGL::publishScene()
+{
+    if (!_sceneChanged)
+        return;
 
-    if (_redraw)
+    _sceneChanged = false;
+
+    CompositorGLScene &scene = _scenes[_back];
+    scene.surfaces.clear();
+
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+    for (auto it = surfaces.begin(); it != surfaces.end(); ++it)
     {
-        _redraw = false;
+        std::shared_ptr<CompositorGLSurface> surface = std::static_pointer_cast<CompositorGLSurface>(*it);
+        scene.surfaces.push_back({surface, surface->position(), surface->alpha(), surface->takeDamage(),
+            surface->name() == _registry->keyboardFocus(), surface->held()});
+    }
 
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    scene.input = _inputTime;
+    _inputTime = 0;
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glUseProgram(_gl->_textureProgram);
+    /*
+     * A scene the render thread has not taken yet is replaced, its changes go out with this one. The render thread
+     * only reads the slots, so reading it here is safe whether or not it is taken in the meantime.
+     */
+    int middle = _middle.load();
+    if (middle & SCENE_FRESH)
+    {
+        const CompositorGLScene &pending = _scenes[middle & ~SCENE_FRESH];
 
-        for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
+        for (auto it = pending.surfaces.begin(); it != pending.surfaces.end(); ++it)
         {
-            std::shared_ptr<CompositorGLSurface> surface = (*it);
+            for (auto jt = scene.surfaces.begin(); jt != scene.surfaces.end(); ++jt)
+            {
+                if (jt->surface == it->surface)
+                    jt->damage = bounding_rectangle(jt->damage, it->damage);
+            }
+        }
 
-            //XXX Ignore disabled layers
-            //XXX Only recalculate when changed
+        scene.damage.add(pending.damage);
+        scene.geometry = scene.geometry || pending.geometry;
+        if (pending.input != 0 && (scene.input == 0 || pending.input < scene.input))
+            scene.input = pending.input;
 
-            float x1r = 1.0 * surface->position().from.x / _gl->_surfaceWidth;
-            float y1r = 1.0 * surface->position().from.y / _gl->_surfaceHeight;
-            float x2r = 1.0 * surface->position().to.x / _gl->_surfaceWidth;
-            float y2r = 1.0 * surface->position().to.y / _gl->_surfaceHeight;
+        if (_hud != nullptr)
+            _hud->sceneMerged();
+    }
 
-            float x1 = x1r * 2 - 1.0;
-            float y1 = - y1r * 2 + 1.0;
-            float x2 = x2r * 2 - 1.0;
-            float y2 = - y2r * 2 + 1.0;
+    int previous = _middle.exchange(_back | SCENE_FRESH);
+    _back = previous & ~SCENE_FRESH;
 
+    CompositorGLScene &stale = _scenes[_back];
+    stale.surfaces.clear();
+    stale.damage.clear();
+    stale.geometry = false;
+    stale.input = 0;
 
-            _plane[0] = x1;
-            _plane[1] = y1;
+    if (!_renderQueued.exchange(true))
+        _render->queue(std::bind(&CompositorGL::requestFrame, this));
+}
 
-            _plane[5] = x2;
-            _plane[6] = y1;
+void CompositorGL::displaySizeChanged(int width, int height)
+{
+    _registry->setDisplaySize(width, height, _scale);
 
-            _plane[10] = x1;
-            _plane[11] = y2;
+    /* Without a window every surface is hidden */
+    updatePurgeable();
+}
 
-            _plane[15] = x2;
-            _plane[16] = y2;
+/* The X server follows with a new screen size, the surface keeps covering the display */
+void CompositorGL::scaleChanged(int scale)
+{
+    _scale = scale;
+    _registry->setDisplaySize(_registry->displayWidth(), _registry->displayHeight(), _scale);
+}
 
-            glVertexAttribPointer(_gl->_texturePositionHandle, 3, GL_FLOAT, GL_FALSE, TRIANGLE_VERTICES_DATA_STRIDE_BYTES, &_plane[0]);
-            glVertexAttribPointer(_gl->_textureTexCoordsHandle, 2, GL_FLOAT, GL_FALSE, TRIANGLE_VERTICES_DATA_STRIDE_BYTES, &_plane[3]);
+/* ================================================================================================================== */
 
-            glEnableVertexAttribArray(_gl->_texturePositionHandle);
-            glEnableVertexAttribArray(_gl->_textureTexCoordsHandle);
+void CompositorGL::renderSync(const std::function<void ()> &f)
+{
+    std::promise<void> done;
+    std::future<void> result = done.get_future();
 
+    _render->queue([&f, &done]() {f(); done.set_value();});
+    result.wait();
+}
 
-#ifdef USE_BLENDING
-            if (surface->alpha() != 1.0f)
-            {
-                glUniform1f(_gl->_textureAlphaHandle, surface->alpha());
+void CompositorGL::createWindow(NativeWindowType window)
+{
+    _resumeTime = WereTimer::now();
+    _resumeFrames = 0;
 
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            }
-#endif
+    try
+    {
+        if (_gl != 0 && !_gl->attachWindow(window))
+        {
+            were_message("GL context lost, rebuilding textures.\n");
+            releaseGL();
+        }
 
-            glBindTexture(GL_TEXTURE_2D, surface->texture()->id());
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        if (_gl == 0)
+            _gl = new CompositorGL_GL(_egl, _programCache, _uploadTuner, window);
+    }
+    catch (const std::exception &e)
+    {
+        were_error("%s\n", e.what());
+        return;
+    }
 
-#ifdef USE_BLENDING
-            if (surface->alpha() != 1.0f)
-            {
-                glDisable(GL_BLEND);
-            }
-#endif
+    windowCreated();
+}
 
-            glDisableVertexAttribArray(_gl->_texturePositionHandle);
-            glDisableVertexAttribArray(_gl->_textureTexCoordsHandle);
-        }
+void CompositorGL::createOffscreen(int width, int height)
+{
+    releaseGL();
 
-        if (1)
-            glFinish();
+    try
+    {
+        _egl->chooseConfig(EGL_PBUFFER_BIT);
+        _gl = new CompositorGL_GL(_egl, _programCache, _uploadTuner, width, height);
+    }
+    catch (const std::exception &e)
+    {
+        were_error("%s\n", e.what());
+        return;
+    }
 
-        eglSwapBuffers(_egl->display_, _gl->_surface);
+    windowCreated();
+}
+
+void CompositorGL::windowCreated()
+{
+    if (_atlas == nullptr)
+        _atlas = new CompositorGLAtlas(_gl->_uploader->textureFormat(GL_BGRA_EXT));
+    _restoring = true;
+    _geometryDirty = true;
+    _redraw = true;
+    _scheduler->request();
 
-        frame();
+    _loop->queue(std::bind(&CompositorGL::displaySizeChanged, this, _gl->_surfaceWidth, _gl->_surfaceHeight));
+}
+
+/* Textures survive when the context can stay without a window, the next window only needs a redraw */
+void CompositorGL::destroyWindow()
+{
+    if (_gl == 0 || _gl->_surface == EGL_NO_SURFACE)
+        return;
+
+    finishCapture();
+
+    if (_gl->detachWindow())
+    {
+        were_debug("GL context kept without a window.\n");
+        _history.clear();
+        _loop->queue(std::bind(&CompositorGL::displaySizeChanged, this, 0, 0));
+        return;
     }
+
+    releaseGL();
 }
 
-/* ================================================================================================================== */
+void CompositorGL::releaseGL()
+{
+    if (_gl != 0)
+    {
+        finishCapture();
 
-void CompositorGL::pointerDown(int slot, int x, int y)
+        for (auto it = _drawn.begin(); it != _drawn.end(); ++it)
+            (*it)->destroyTexture();
+
+        delete _atlas;
+        _atlas = nullptr;
+
+        delete _gl;
+
+        _loop->queue(std::bind(&CompositorGL::displaySizeChanged, this, 0, 0));
+    }
+    _gl = 0;
+}
+
+/* Takes the latest scene if there is one, surfaces that left it give their textures back on this thread */
+void CompositorGL::acquireScene()
 {
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    if ((_middle.load() & SCENE_FRESH) == 0)
+        return;
+
+    _front = _middle.exchange(_front) & ~SCENE_FRESH;
+    const CompositorGLScene &scene = _scenes[_front];
+
+    for (auto it = _drawn.begin(); it != _drawn.end(); ++it)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
-        {
-            _server->broadcast(PointerDownNotification({surface->name(), slot, _x, _y}));
-            return;
-        }
+        std::shared_ptr<CompositorGLSurface> surface = (*it);
+        auto found = std::find_if(scene.surfaces.begin(), scene.surfaces.end(),
+            [&surface](const CompositorGLSceneSurface &s) {return s.surface == surface;});
+
+        if (found == scene.surfaces.end())
+            surface->destroyTexture();
+    }
+
+    _drawn.clear();
+
+    for (auto it = scene.surfaces.begin(); it != scene.surfaces.end(); ++it)
+    {
+        _drawn.push_back(it->surface);
+        it->surface->addTextureDamage(it->damage);
     }
+
+    _damage.add(scene.damage);
+    if (scene.geometry)
+        _geometryDirty = true;
+    if (scene.input != 0 && (_presentInput == 0 || scene.input < _presentInput))
+        _presentInput = scene.input;
 }
 
-void CompositorGL::pointerUp(int slot, int x, int y)
+void CompositorGL::requestFrame()
+{
+    _renderQueued = false;
+    _scheduler->request();
+}
+
+void CompositorGL::redraw()
+{
+    _redraw = true;
+    _scheduler->request();
+}
+
+/* Textures of hidden surfaces, or all of them with the atlas, go until the surfaces are drawn again */
+void CompositorGL::trimTextures(bool all)
 {
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    if (_gl == 0)
+        return;
+
+    uint64_t bytes = 0;
+    unsigned int count = 0;
+
+    for (auto it = _drawn.begin(); it != _drawn.end(); ++it)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
+        if ((*it)->hasTexture() && (all || (*it)->hiddenSeen()))
         {
-            _server->broadcast(PointerUpNotification({surface->name(), slot, _x, _y}));
-            return;
+            bytes += (*it)->textureBytes();
+            count += 1;
+            (*it)->destroyTexture();
         }
     }
+
+    if (all && _atlas != nullptr)
+    {
+        bytes += static_cast<uint64_t>(ATLAS_SIZE) * ATLAS_SIZE * 4;
+        delete _atlas;
+        _atlas = nullptr;
+    }
+
+    _geometryDirty = true;
+    _redraw = true;
+    if (_gl->_surface != EGL_NO_SURFACE)
+        _scheduler->request();
+
+    were_message("Memory pressure: %u textures released, %llu KB.\n", count,
+        static_cast<unsigned long long>(bytes / 1024));
 }
 
-void CompositorGL::pointerMotion(int slot, int x, int y)
+/* The next frame is drawn whole and written out */
+void CompositorGL::requestDump(const std::string &path)
+{
+    _dumpPath = path;
+    redraw();
+}
+
+/* Binary PPM, top row first */
+void CompositorGL::writeDump()
 {
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    int width = _gl->_surfaceWidth;
+    int height = _gl->_surfaceHeight;
+    std::vector<unsigned char> rgba(width * height * 4);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+    FILE *file = fopen(_dumpPath.c_str(), "wb");
+    if (file == nullptr)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
+        were_error("Failed to write frame to %s.\n", _dumpPath.c_str());
+        _dumpPath.clear();
+        return;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+    std::vector<unsigned char> row(width * 3);
+    for (int y = height - 1; y >= 0; --y)
+    {
+        const unsigned char *p = &rgba[y * width * 4];
+        for (int x = 0; x < width; ++x)
         {
-            _server->broadcast(PointerMotionNotification({surface->name(), slot, _x, _y}));
-            return;
+            row[x * 3 + 0] = p[x * 4 + 0];
+            row[x * 3 + 1] = p[x * 4 + 1];
+            row[x * 3 + 2] = p[x * 4 + 2];
         }
+        fwrite(row.data(), 1, row.size(), file);
     }
+
+    fclose(file);
+
+    were_message("Frame written to %s.\n", _dumpPath.c_str());
+    _dumpPath.clear();
 }
 
-void CompositorGL::keyDown(int code)
+void CompositorGL::setCapture(int slots, bool drop)
 {
-    _server->broadcast(KeyDownNotification({code}));
+    _captureTimer->stop();
+    _capture.reset();
+    _captureSlots = slots;
+    _captureDrop = drop;
+
+    if (_captureSlots > 0)
+        _scheduler->request();
 }
 
-void CompositorGL::keyUp(int code)
+/* A new ring starts with a whole frame */
+void CompositorGL::createCapture(int width, int height)
+{
+    finishCapture();
+    _capture.reset();
+
+    try
+    {
+        _capture = std::make_shared<FrameCapture>(width, height, _captureSlots, _captureDrop);
+    }
+    catch (const std::exception &e)
+    {
+        were_error("%s\n", e.what());
+        _captureSlots = 0;
+        return;
+    }
+
+    _redraw = true;
+    _loop->queue(std::bind(&CompositorGL::captureStarted, this, _capture));
+}
+
+void CompositorGL::finishCapture()
 {
-    _server->broadcast(KeyUpNotification({code}));
+    _captureTimer->stop();
+
+    if (_capture == nullptr || _gl == 0)
+        return;
+
+    Region region;
+    if (!_gl->_readback->finish(_capture->frame(), _capture->width(), &region))
+        return;
+
+    int slot = _capture->publish(region, _captureTime);
+    if (slot != -1)
+        _loop->queue(std::bind(&CompositorGL::captureFrame, this, slot, _capture->sequence() - 1));
 }
 
-void CompositorGL::buttonPress(int button, int x, int y)
+void CompositorGL::render()
 {
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    acquireScene();
+
+    if (_gl == 0 || _gl->_surface == EGL_NO_SURFACE)
+        return;
+
+    _scheduler->begin();
+    uint64_t begin = WereTimer::now();
+
+    const CompositorGLScene &scene = _scenes[_front];
+
+#if 1
+    int width;
+    int height;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    eglQuerySurface(_egl->display_, _gl->_surface, EGL_WIDTH, &width);
+    eglQuerySurface(_egl->display_, _gl->_surface, EGL_HEIGHT, &height);
+
+    if (width != _gl->_surfaceWidth || height != _gl->_surfaceHeight)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
+        _gl->_surfaceWidth = width;
+        _gl->_surfaceHeight = height;
+        glViewport(0, 0, _gl->_surfaceWidth, _gl->_surfaceHeight);
+
+        _loop->queue(std::bind(&CompositorGL::displaySizeChanged, this, width, height));
+        _redraw = true;
+        _geometryDirty = true;
+    }
+
+#endif
+
+    if (_captureSlots > 0 && (_capture == nullptr || _capture->width() != width || _capture->height() != height))
+        createCapture(width, height);
+
+    /* Front to back, hidden surfaces keep their damage until they are uncovered */
+    std::vector<RectangleA> occluders;
+    for (auto rit = scene.surfaces.rbegin(); rit != scene.surfaces.rend(); ++rit)
+    {
+        rit->surface->setOccluded(Region::covered(rit->position, occluders));
+        if (rit->opaque())
+            occluders.push_back(rit->position);
+    }
+
+    /* Under memory pressure hidden surfaces give their textures up, they are uploaded again once they show */
+    RectangleA screen = RectangleA(PointA(0, 0), PointA(width, height));
+    std::vector<std::pair<std::shared_ptr<CompositorGLSurface>, bool>> visibility;
+    bool evict = _evictHidden;
+
+    for (auto it = scene.surfaces.begin(); it != scene.surfaces.end(); ++it)
+    {
+        bool hidden = it->surface->occluded() || it->alpha == 0.0f || !Region::intersects(it->position, screen);
+
+        if (hidden != it->surface->hiddenSeen())
+        {
+            it->surface->setHiddenSeen(hidden);
+            visibility.push_back({it->surface, hidden});
+        }
+
+        if (hidden && evict && it->surface->hasTexture())
         {
-            _server->broadcast(ButtonPressNotification({surface->name(), button, _x, _y}));
-            return;
+            it->surface->destroyTexture();
+            _geometryDirty = true;
         }
     }
-}
 
-void CompositorGL::buttonRelease(int button, int x, int y)
-{
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    if (!visibility.empty())
+        _loop->queue(std::bind(&CompositorGL::visibilityChanged, this, visibility));
+
+    uint64_t upload = WereTimer::now();
+    uint64_t restored = 0;
+    bool deferred = false;
+    uint64_t uploadBytes = 0;
+    unsigned int uploadRectangles = 0;
+
+    /*
+     * The focused surface first, then the smallest, so one large update does not hold up many small ones. Topmost
+     * first among equals, a rebuild after context loss gets to the surfaces in front before the budget runs out.
+     */
+    _uploads.clear();
+    for (auto it = scene.surfaces.rbegin(); it != scene.surfaces.rend(); ++it)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
+        if (!it->held && !it->surface->occluded() && !(evict && it->surface->hiddenSeen()))
+            _uploads.push_back(&(*it));
+    }
+
+    std::stable_sort(_uploads.begin(), _uploads.end(),
+        [](const CompositorGLSceneSurface *a, const CompositorGLSceneSurface *b)
         {
-            _server->broadcast(ButtonReleaseNotification({surface->name(), button, _x, _y}));
-            return;
+            if (a->focused != b->focused)
+                return a->focused;
+            return a->surface->pendingUpload() < b->surface->pendingUpload();
+        });
+
+    /* Past the budget damage waits for the next frames, a background surface gets at most half of it per frame */
+    uint64_t budget = _uploadBudget.budget(_scheduler->period());
+    uint64_t carried = 0;
+
+    for (auto it = _uploads.begin(); it != _uploads.end(); ++it)
+    {
+        const CompositorGLSceneSurface &entry = **it;
+        std::shared_ptr<CompositorGLSurface> surface = entry.surface;
+
+        uint64_t limit = 0;
+        if (budget != 0)
+        {
+            uint64_t pending = surface->pendingUpload();
+            if (pending == 0)
+                continue;
+
+            if (uploadBytes >= budget)
+            {
+                carried += pending;
+                continue;
+            }
+
+            limit = budget - uploadBytes;
+            if (!entry.focused)
+                limit = std::min(limit, budget / 2);
+        }
+
+        if (_restoring && !surface->hasTexture())
+        {
+            uint64_t bytes = static_cast<uint64_t>(surface->width()) * surface->height() * surface->bytesPerPixel();
+            if (restored > 0 && restored + bytes > RESTORE_BUDGET)
+            {
+                deferred = true;
+                continue;
+            }
+            restored += bytes;
+        }
+
+#if USE_ATLAS
+        if (!surface->hasTexture() && surface->atlasCompatible())
+        {
+            if (_atlas == nullptr)
+                _atlas = new CompositorGLAtlas(_gl->_uploader->textureFormat(GL_BGRA_EXT));
+
+            int cell = _atlas->allocate();
+            if (cell != -1)
+            {
+                surface->setAtlas(_atlas, cell);
+                _geometryDirty = true;
+            }
+        }
+#endif
+
+        if (surface->updateTexture(_gl->_uploader, limit))
+        {
+            RectangleA uploaded = surface->uploaded();
+            _damage.add(screenRectangle(entry, uploaded));
+
+            uploadBytes += surface->uploadedBytes();
+            uploadRectangles += 1;
         }
+
+        carried += surface->pendingUpload();
     }
-}
 
-void CompositorGL::cursorMotion(int x, int y)
-{
-    for (auto rit = _surfaces.rbegin(); rit != _surfaces.rend(); ++rit)
+    _gl->_uploader->finishFrame();
+    upload = WereTimer::now() - upload;
+
+    _uploadBudget.frame(uploadBytes, upload, carried);
+
+    if (deferred || carried > 0)
+        _scheduler->request();
+    if (!deferred)
+        _restoring = false;
+
+    if (_redraw)
+    {
+        _redraw = false;
+        _damage.clear();
+        _damage.add(screen);
+        _history.clear();
+    }
+
+    _damage.clip(width, height);
+    if (_damage.empty())
+        return;
+
+    /* The back buffer misses the damage of the frames drawn since it was last presented */
+    EGLint age = 0;
+    if (_gl->_bufferAge)
+        eglQuerySurface(_egl->display_, _gl->_surface, EGL_BUFFER_AGE_EXT, &age);
+
+    Region repaint;
+    if (age > 0 && static_cast<unsigned int>(age) <= _history.size() + 1)
+    {
+        repaint.add(_damage);
+        for (int i = 0; i < age - 1; ++i)
+            repaint.add(_history[i]);
+    }
+    else
+        repaint.add(screen);
+
+    _history.push_front(_damage);
+    if (_history.size() > MAX_BUFFER_AGE)
+        _history.pop_back();
+
+    updateGeometry();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glUseProgram(_gl->_programs[ProgramOpaque]);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glEnable(GL_SCISSOR_TEST);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _gl->_vertexBuffer);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, TRIANGLE_VERTICES_DATA_STRIDE_BYTES, reinterpret_cast<void *>(0));
+    glVertexAttribPointer(ATTRIBUTE_TEXCOORDS, 2, GL_FLOAT, GL_FALSE, TRIANGLE_VERTICES_DATA_STRIDE_BYTES, reinterpret_cast<void *>(3 * FLOAT_SIZE_BYTES));
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glEnableVertexAttribArray(ATTRIBUTE_TEXCOORDS);
+
+    /* Unknown until the first blended batch sets it */
+    _alpha = -1.0f;
+
+    const std::vector<RectangleA> &rectangles = repaint.rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+    {
+        glScissor(it->from.x, height - it->to.y, it->to.x - it->from.x, it->to.y - it->from.y);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        drawSurfaces(*it);
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+
+    glDisableVertexAttribArray(ATTRIBUTE_POSITION);
+    glDisableVertexAttribArray(ATTRIBUTE_TEXCOORDS);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    /* Waiting here measures the whole render time and keeps the driver from queueing frames ahead */
+    if (_scheduler->mode() == FrameScheduler::Latency)
+        glFinish();
+
+    _scheduler->submitted();
+
+    if (_scalePolicy.frame(upload, WereTimer::now() - begin, _scheduler->period()))
+        _loop->queue(std::bind(&CompositorGL::scaleChanged, this, _scalePolicy.scale()));
+
+    if (_capture != nullptr)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*rit);
-        int _x;
-        int _y;
-        transformCoordinates(x, y, surface, &_x, &_y);
-        if (_x != -1 && _y != -1)
+        finishCapture();
+        _gl->_readback->read(_damage, width, height);
+        _captureTime = WereTimer::now();
+        _captureTimer->startAt(_captureTime + _scheduler->period() / 2);
+    }
+
+    if (!_dumpPath.empty())
+        writeDump();
+
+    if (_gl->_swapBuffersWithDamage != nullptr)
+    {
+        std::vector<EGLint> rects;
+        const std::vector<RectangleA> &damage = _damage.rectangles();
+
+        for (auto it = damage.begin(); it != damage.end(); ++it)
         {
-            _server->broadcast(CursorMotionNotification({surface->name(), _x, _y}));
-            return;
+            rects.push_back(it->from.x);
+            rects.push_back(height - it->to.y);
+            rects.push_back(it->to.x - it->from.x);
+            rects.push_back(it->to.y - it->from.y);
         }
+
+        _gl->_swapBuffersWithDamage(_egl->display_, _gl->_surface, rects.data(), damage.size());
     }
-}
+    else
+        eglSwapBuffers(_egl->display_, _gl->_surface);
 
-/* ================================================================================================================== */
+    _scheduler->presented();
+    _damage.clear();
 
-void CompositorGL::connection(std::shared_ptr <SparkleConnection> client)
-{
-    if (_gl != 0)
+    if (_hudEnabled)
     {
-        client->send(DisplaySizeNotification({_gl->_surfaceWidth, _gl->_surfaceHeight}));
+        uint64_t now = WereTimer::now();
+        _loop->queue(std::bind(&CompositorGL::hudFrame, this, now, now - begin, uploadBytes, uploadRectangles,
+            _presentInput != 0 ? now - _presentInput : 0, budget, carried));
     }
+    _presentInput = 0;
+
+    if (_resumeTime != 0)
+    {
+        double elapsed = (WereTimer::now() - _resumeTime) / 1e6;
+
+        if (_resumeFrames == 0)
+            were_message("First frame %.1f ms after the window was created%s.\n", elapsed,
+                _restoring ? ", restoring textures" : "");
+        else if (!_restoring)
+            were_message("Textures restored %.1f ms after the window was created, in %u frames.\n", elapsed,
+                _resumeFrames + 1);
+
+        _resumeFrames += 1;
+        if (!_restoring)
+            _resumeTime = 0;
+    }
+
+    if (_registry->frameClients() > 0)
+        _loop->queue(std::bind(&CompositorGL::frameDone, this));
+
+    frame();
 }
 
-void CompositorGL::packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message)
+void CompositorGL::drawSurfaces(const RectangleA &clip)
 {
-    uint32_t operation;
+    const CompositorGLScene &scene = _scenes[_front];
 
-    WereSocketUnixMessageStream stream(message.get());
-    stream >> operation;
+    /* Only the surfaces that show through within the clip, collected front to back */
+    std::vector<RectangleA> occluders;
+    _visible.clear();
 
-    if (operation == RegisterSurfaceAshmemRequestCode)
+    for (auto rit = scene.surfaces.rbegin(); rit != scene.surfaces.rend(); ++rit)
     {
-        RegisterSurfaceAshmemRequest r1;
-        stream >> r1;
-        registerSurfaceFile(r1.name, r1.fd, r1.width, r1.height);
+        if (rit->surface->occluded() || !rit->surface->hasTexture() || !Region::intersects(rit->position, clip))
+            continue;
+
+        RectangleA part = Region::intersection(rit->position, clip);
+        if (Region::covered(part, occluders))
+            continue;
+
+        _visible.push_back(&(*rit));
+        if (rit->opaque())
+            occluders.push_back(part);
+
+        if (Region::covered(clip, occluders))
+            break;
     }
-    else if (operation == UnregisterSurfaceRequestCode)
+
+    /* Opaque surfaces front to back so the depth test rejects what is hidden, blended ones back to front over them */
+    _opaque.clear();
+    _blended.clear();
+
+    for (auto it = _visible.begin(); it != _visible.end(); ++it)
     {
-        UnregisterSurfaceRequest r1;
-        stream >> r1;
-        unregisterSurface(r1.name);
+        if (surfaceBlended(*it))
+            _blended.insert(_blended.begin(), *it);
+        else
+            _opaque.push_back(*it);
     }
-    else if (operation == SetSurfacePositionRequestCode)
+
+    glEnable(GL_DEPTH_TEST);
+
+    if (!_opaque.empty())
     {
-        SetSurfacePositionRequest r1;
-        stream >> r1;
-        setSurfacePosition(r1.name, r1.x1, r1.y1, r1.x2, r1.y2);
+        glDepthMask(GL_TRUE);
+        drawBatches(_opaque);
     }
-    else if (operation == SetSurfaceStrataRequestCode)
+
+    if (!_blended.empty())
     {
-        SetSurfaceStrataRequest r1;
-        stream >> r1;
-        setSurfaceStrata(r1.name, r1.strata);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glUseProgram(_gl->_programs[ProgramBlended]);
+        drawBatches(_blended);
+        glUseProgram(_gl->_programs[ProgramOpaque]);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
     }
-    else if (operation == SetSurfaceAlphaRequestCode)
+
+    glDisable(GL_DEPTH_TEST);
+}
+
+bool CompositorGL::surfaceBlended(const CompositorGLSceneSurface *surface)
+{
+#ifdef USE_BLENDING
+    return surface->alpha != 1.0f;
+#else
+    return false;
+#endif
+}
+
+/* Neighbours in the vertex buffer with the same texture and alpha go out in one call */
+void CompositorGL::drawBatches(const std::vector<const CompositorGLSceneSurface *> &surfaces)
+{
+    unsigned int i = 0;
+
+    while (i < surfaces.size())
     {
-        SetSurfaceAlphaRequest r1;
-        stream >> r1;
-        setSurfaceAlpha(r1.name, r1.alpha);
+        const CompositorGLSceneSurface *first = surfaces[i];
+        int from = first->surface->index();
+        int to = first->surface->index();
+        int step = 0;
+
+        unsigned int j = i + 1;
+        for (; j < surfaces.size(); ++j)
+        {
+            const CompositorGLSceneSurface *next = surfaces[j];
+            int delta = next->surface->index() - surfaces[j - 1]->surface->index();
+
+            if ((delta != 1 && delta != -1) || (step != 0 && delta != step))
+                break;
+            if (next->surface->textureId() != first->surface->textureId() || next->alpha != first->alpha)
+                break;
+
+            step = delta;
+            from = std::min(from, next->surface->index());
+            to = std::max(to, next->surface->index());
+        }
+
+        if (surfaceBlended(first) && first->alpha != _alpha)
+        {
+            _alpha = first->alpha;
+            glUniform1f(_gl->_alphaHandle, _alpha);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, first->surface->textureId());
+        glDrawArrays(GL_TRIANGLES, from * QUAD_VERTICES, (to - from + 1) * QUAD_VERTICES);
+
+        i = j;
     }
-    else if (operation == AddSurfaceDamageRequestCode)
+}
+
+/* Rebuilt only when surfaces move, come, go or change their order */
+void CompositorGL::updateGeometry()
+{
+    if (!_geometryDirty)
+        return;
+
+    const CompositorGLScene &scene = _scenes[_front];
+
+    _geometryDirty = false;
+    _vertices.resize(scene.surfaces.size() * QUAD_FLOATS);
+
+    float width = _gl->_surfaceWidth;
+    float height = _gl->_surfaceHeight;
+    int count = scene.surfaces.size();
+
+    for (int i = 0; i < count; ++i)
     {
-        AddSurfaceDamageRequest r1;
-        stream >> r1;
-        addSurfaceDamage(r1.name, r1.x1, r1.y1, r1.x2, r1.y2);
+        const CompositorGLSceneSurface &entry = scene.surfaces[i];
+        CompositorGLSurface *surface = entry.surface.get();
+        surface->setIndex(i);
+
+        float x1 = entry.position.from.x / width * 2 - 1.0;
+        float y1 = - entry.position.from.y / height * 2 + 1.0;
+        float x2 = entry.position.to.x / width * 2 - 1.0;
+        float y2 = - entry.position.to.y / height * 2 + 1.0;
+
+        /* Later surfaces are closer */
+        float z = 1.0 - 2.0 * (i + 1) / (count + 1);
+
+        float s1, t1, s2, t2;
+        surface->textureCoordinates(&s1, &t1, &s2, &t2);
+
+        const float quad[QUAD_FLOATS] = {
+            x1, y1, z, s1, t1,
+            x2, y1, z, s2, t1,
+            x1, y2, z, s1, t2,
+            x1, y2, z, s1, t2,
+            x2, y1, z, s2, t1,
+            x2, y2, z, s2, t2,
+        };
+
+        std::copy(quad, quad + QUAD_FLOATS, &_vertices[i * QUAD_FLOATS]);
     }
+
+    glBindBuffer(GL_ARRAY_BUFFER, _gl->_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * FLOAT_SIZE_BYTES, _vertices.data(), GL_STATIC_DRAW);
 }
 
-void CompositorGL::registerSurfaceFile(const std::string &name, int fd, int width, int height)
+/* ================================================================================================================== */
+
+void CompositorGL::pointerDown(int slot, int x, int y)
 {
-    unregisterSurface(name);
+    inputArrived();
+    flushMotion();
+    _registry->pointerDown(slot, x, y);
+}
 
-    std::shared_ptr<CompositorGLSurface> surface(new CompositorGLSurfaceFile(name, fd, width, height));
-    _surfaces.push_back(surface);
-    std::sort (_surfaces.begin(), _surfaces.end(), sortFunction);
+void CompositorGL::pointerUp(int slot, int x, int y)
+{
+    inputArrived();
+    flushMotion();
+    _motion.erase(slot);
+    _registry->pointerUp(slot, x, y);
+}
 
-    _redraw = true;
-    were_debug("Surface [%s] registered.\n", name.c_str());
+void CompositorGL::pointerMotion(int slot, int x, int y)
+{
+    inputArrived();
+    int _x;
+    int _y;
+    CompositorSurface *surface = _registry->pointerTarget(slot, x, y, &_x, &_y);
+    if (surface == nullptr)
+        return;
+
+    Motion &motion = _motion[slot];
+    if (!motion.samples.empty() && motion.surface != surface->name())
+        flushMotion();
+
+    motion.surface = surface->name();
+    motion.times.push_back(WereTimer::now());
+    motion.samples.push_back(PointerMotionSample({0, _x, _y}));
+
+    if (motion.samples.size() > PointerMotionHistoryMax + 1)
+    {
+        motion.times.erase(motion.times.begin());
+        motion.samples.erase(motion.samples.begin());
+    }
+
+    if (!_motionPending)
+    {
+        _motionPending = true;
+        _motionTimer->startAt(WereTimer::now() + _scheduler->period());
+    }
 }
 
-void CompositorGL::unregisterSurface(const std::string &name)
+/* One message per moving slot and frame, down and up events flush it first to stay in order */
+void CompositorGL::flushMotion()
 {
-    auto it = _surfaces.begin();
-    while (it != _surfaces.end())
+    _motionTimer->stop();
+    _motionPending = false;
+
+    for (auto it = _motion.begin(); it != _motion.end(); ++it)
     {
-        std::shared_ptr<CompositorGLSurface> surface = (*it);
-        if (surface->name() == name)
+        Motion &motion = it->second;
+        if (motion.samples.empty())
+            continue;
+
+        std::shared_ptr<CompositorSurface> surface = _registry->find(motion.surface);
+        if (surface != nullptr)
         {
-            it = _surfaces.erase(it);
-            were_debug("Surface [%s] unregistered.\n", name.c_str());
+            const PointerMotionSample &latest = motion.samples.back();
+            std::vector<PointerMotionSample> history(motion.samples.begin(), motion.samples.end() - 1);
+
+            for (unsigned int i = 0; i < history.size(); ++i)
+                history[i].time = (motion.times.back() - motion.times[i]) / 1000;
+
+            _registry->sendInput(surface.get(), PointerMotionBatchNotification({motion.surface, it->first, latest.x,
+                latest.y, history}));
         }
-        else
-            ++it;
+
+        motion.times.clear();
+        motion.samples.clear();
     }
+}
 
-    _redraw = true;
+void CompositorGL::keyDown(int code)
+{
+    inputArrived();
+    if (hudKey(code, true))
+        return;
+
+    _registry->keyDown(code);
+}
+
+void CompositorGL::keyUp(int code)
+{
+    inputArrived();
+    if (hudKey(code, false))
+        return;
+
+    _registry->keyUp(code);
+}
+
+void CompositorGL::buttonPress(int button, int x, int y)
+{
+    inputArrived();
+    _registry->buttonPress(button, x, y);
+}
+
+void CompositorGL::buttonRelease(int button, int x, int y)
+{
+    inputArrived();
+    _registry->buttonRelease(button, x, y);
+}
+
+void CompositorGL::cursorMotion(int x, int y)
+{
+    inputArrived();
+    _registry->cursorMotion(x, y);
+}
+
+/* Latency is measured from the first input after the previous scene */
+void CompositorGL::inputArrived()
+{
+    if (_hud != nullptr && _inputTime == 0)
+        _inputTime = WereTimer::now();
 }
 
-void CompositorGL::setSurfacePosition(const std::string &name, int x1, int y1, int x2, int y2)
+/* Control+Alt+H toggles the overlay, the H does not reach the clients */
+bool CompositorGL::hudKey(int code, bool down)
 {
-    std::shared_ptr<CompositorGLSurface> surface = findSurface(name);
-    if (surface != nullptr)
+    unsigned int modifier = 0;
+    if (code == KEYCODE_CONTROL_L || code == KEYCODE_CONTROL_R)
+        modifier = 1;
+    else if (code == KEYCODE_ALT_L || code == KEYCODE_ALT_R)
+        modifier = 2;
+
+    if (modifier != 0)
     {
-        surface->setPosition(x1, y1, x2, y2);
-        _redraw = true;
-        were_debug("Surface [%s]: position changed (%d %d %d %d).\n", name.c_str(), x1, y1, x2, y2);
+        _hudModifiers = down ? (_hudModifiers | modifier) : (_hudModifiers & ~modifier);
+        return false;
     }
+
+    if (code != KEYCODE_H || _hudModifiers != 3)
+        return false;
+
+    if (down)
+        setPerformanceHud(_hud == nullptr);
+
+    return true;
 }
 
-void CompositorGL::setSurfaceStrata(const std::string &name, int strata)
+/* ================================================================================================================== */
+
+void CompositorGL::connection(std::shared_ptr <SparkleConnection> client)
 {
-    std::shared_ptr<CompositorGLSurface> surface = findSurface(name);
-    if (surface != nullptr)
+    _registry->connection(client);
+}
+
+void CompositorGL::disconnection(std::shared_ptr <SparkleConnection> client)
+{
+    stopCapture(client);
+    _registry->disconnection(client);
+}
+
+void CompositorGL::frameDone()
+{
+    _registry->sendEvent(EventMaskFrame, FrameNotification({_frames++}));
+}
+
+/* The ring goes out once the render thread made it, for the size of the display at that time */
+void CompositorGL::startCapture(std::shared_ptr<SparkleConnection> client, int slots, uint32_t flags)
+{
+    if (client->stream())
     {
-        surface->setStrata(strata);
-        std::sort (_surfaces.begin(), _surfaces.end(), sortFunction);
-        _redraw = true;
-        were_debug("Surface [%s]: strata changed.\n", name.c_str());
+        were_message("Capture needs a local connection.\n");
+        return;
     }
+
+    _captureClient = client;
+    _render->queue(std::bind(&CompositorGL::setCapture, this, std::min(std::max(slots, 1), 16),
+        (flags & CaptureDropFrames) != 0));
+}
+
+void CompositorGL::stopCapture(std::shared_ptr<SparkleConnection> client)
+{
+    if (_captureClient == nullptr || _captureClient != client)
+        return;
+
+    _captureClient.reset();
+    _render->queue(std::bind(&CompositorGL::setCapture, this, 0, false));
 }
 
-void CompositorGL::setSurfaceAlpha(const std::string &name, float alpha)
+void CompositorGL::captureStarted(std::shared_ptr<FrameCapture> capture)
 {
-    std::shared_ptr<CompositorGLSurface> surface = findSurface(name);
-    if (surface != nullptr)
+    if (_captureClient != nullptr)
     {
-        surface->setAlpha(alpha);
-        _redraw = true;
-        were_debug("Surface [%s]: alpha changed.\n", name.c_str());
+        _captureClient->send(CaptureStartedNotification({capture->ring()->fd(), capture->width(), capture->height(),
+            static_cast<uint32_t>(capture->ring()->slots())}));
     }
 }
 
-void CompositorGL::addSurfaceDamage(const std::string &name, int x1, int y1, int x2, int y2)
+void CompositorGL::captureFrame(int slot, uint32_t sequence)
+{
+    if (_captureClient != nullptr)
+        _captureClient->send(CaptureFrameNotification({static_cast<uint32_t>(slot), sequence}));
+}
+
+/* The overlay is a surface of the compositor's own, on top of everything and left out of the hit grid */
+void CompositorGL::setPerformanceHud(bool enabled)
 {
-    std::shared_ptr<CompositorGLSurface> surface = findSurface(name);
-    if (surface != nullptr)
+    if (enabled == (_hud != nullptr))
+        return;
+
+    if (!enabled)
     {
-        surface->addDamage(x1, y1, x2, y2);
-        //were_debug("Surface [%s]: damage (%d %d %d %d).\n", name.c_str(), x1, y1, x2, y2);
+        _hudEnabled = false;
+        _hudTimer->stop();
+        _registry->remove(_hudSurface->name());
+        _hudSurface = nullptr;
+        delete _hud;
+        _hud = nullptr;
+        return;
     }
+
+    _hud = new PerformanceHud();
+    std::vector< std::shared_ptr<SparkleConnection> > clients = _registry->connections();
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+        _registry->takeMessages(*it);
+
+    _hudSurface = std::make_shared<CompositorGLSurfaceStream>(HUD_SURFACE, PerformanceHud::Width,
+        PerformanceHud::Height, SurfaceFormatXRGB8888);
+    _hudSurface->setPosition(HUD_MARGIN, HUD_MARGIN, HUD_MARGIN + PerformanceHud::Width,
+        HUD_MARGIN + PerformanceHud::Height);
+    _hudSurface->setStrata(HUD_STRATA);
+    _hudSurface->setAlpha(HUD_ALPHA);
+    _registry->add(_hudSurface, false);
+
+    _hudEnabled = true;
+    _hudTimer->start(HUD_INTERVAL, false);
+    updatePerformanceHud();
 }
 
-/* ================================================================================================================== */
+void CompositorGL::updatePerformanceHud()
+{
+    if (_hud == nullptr)
+        return;
+
+    std::vector<PerformanceHudClient> clients;
+    std::vector< std::shared_ptr<SparkleConnection> > connections = _registry->connections();
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+    for (auto it = connections.begin(); it != connections.end(); ++it)
+    {
+        std::string name = "(no surface)";
+        for (auto jt = surfaces.begin(); jt != surfaces.end(); ++jt)
+        {
+            if ((*jt)->owner() == *it)
+            {
+                name = (*jt)->name();
+                break;
+            }
+        }
+
+        clients.push_back({name, _registry->takeMessages(*it), (*it)->bytesPending()});
+    }
+
+    _hud->paint(_hudSurface->pixels(), WereTimer::now(), _scheduler->period(), clients);
+    _hudSurface->addDamage(0, 0, PerformanceHud::Width, PerformanceHud::Height);
+
+    /* Published on its own so pending input is measured against the frame a client draws for it */
+    uint64_t input = _inputTime;
+    _inputTime = 0;
+    sceneChanged();
+    publishScene();
+    _inputTime = input;
+}
+
+void CompositorGL::hudFrame(uint64_t time, uint64_t cost, uint64_t uploadBytes, unsigned int uploadRectangles,
+    uint64_t latency, uint64_t budget, uint64_t carried)
+{
+    if (_hud != nullptr)
+        _hud->frame(time, cost, uploadBytes, uploadRectangles, latency, budget, carried);
+}
+
+/*
+ * Levels from RunningModerate evict the textures of hidden surfaces, from RunningCritical their owners may also unpin
+ * the memory. From UiHidden, or without a window, all textures go.
+ */
+void CompositorGL::trimMemory(int level)
+{
+    if (level < static_cast<int>(TrimMemoryRunningModerate))
+        return;
+
+    were_message("Memory pressure, trim level %d.\n", level);
+
+    _pressure = std::max(_pressure, static_cast<uint32_t>(level));
+    _pressureTimer->start(PRESSURE_TIME, true);
+    _evictHidden = true;
+
+    bool all = level >= static_cast<int>(TrimMemoryUiHidden) || _registry->displayWidth() == 0;
+    _render->queue(std::bind(&CompositorGL::trimTextures, this, all));
+
+    updatePurgeable();
+}
+
+void CompositorGL::pressureEnded()
+{
+    were_message("Memory pressure over.\n");
+
+    _pressure = 0;
+    _evictHidden = false;
+    updatePurgeable();
+}
+
+void CompositorGL::visibilityChanged(const std::vector<std::pair<std::shared_ptr<CompositorGLSurface>, bool>> &changes)
+{
+    for (auto it = changes.begin(); it != changes.end(); ++it)
+        it->first->setHidden(it->second);
+
+    updatePurgeable();
+}
+
+/* Owners that subscribed are told when the memory of a surface may go and when it is needed again */
+void CompositorGL::updatePurgeable()
+{
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+    for (auto it = surfaces.begin(); it != surfaces.end(); ++it)
+    {
+        std::shared_ptr<CompositorGLSurface> surface = std::static_pointer_cast<CompositorGLSurface>(*it);
+
+        bool purgeable = surface->purgeableMemory() && _pressure >= TrimMemoryRunningCritical &&
+            (surface->hidden() || _registry->displayWidth() == 0);
+        if (purgeable == surface->purgeable())
+            continue;
 
-std::shared_ptr<CompositorGLSurface> CompositorGL::findSurface(const std::string &name)
+        std::shared_ptr<SparkleConnection> owner = surface->owner();
+        if (!_registry->connected(owner) ||
+            (purgeable && !(_registry->eventMask(owner) & EventMaskSurfacePurgeable)))
+            continue;
+
+        surface->setPurgeable(purgeable);
+        surface->setRepinning(!purgeable);
+        owner->send(SurfacePurgeableNotification({surface->name(), purgeable ? 1u : 0u}));
+        sceneChanged();
+
+        were_debug("Surface [%s]: %s.\n", surface->name().c_str(), purgeable ? "purgeable" : "needed again");
+    }
+}
+
+void CompositorGL::surfaceStats(std::shared_ptr<SparkleConnection> client)
 {
-    for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+    for (auto it = surfaces.begin(); it != surfaces.end(); ++it)
+    {
+        std::shared_ptr<CompositorGLSurface> surface = std::static_pointer_cast<CompositorGLSurface>(*it);
+
+        uint32_t flags = 0;
+        if (surface->purgeable())
+            flags |= SurfaceStatsPurgeable;
+        if (surface->hidden())
+            flags |= SurfaceStatsHidden;
+
+        client->send(SurfaceStatsNotification({surface->name(), static_cast<uint32_t>(surface->sharedBytes() / 1024),
+            static_cast<uint32_t>(surface->residentBytes() / 1024), static_cast<uint32_t>(surface->textureBytes() / 1024),
+            flags}));
+    }
+
+    client->send(SurfaceStatsNotification({std::string(), 0, 0, 0, 0}));
+}
+
+void CompositorGL::packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message)
+{
+    uint32_t operation;
+
+    WereSocketUnixMessageStream stream(message.get());
+    stream >> operation;
+
+    if (_registry->packet(client, operation, stream))
+        return;
+
+    if (operation == StartCaptureRequestCode)
     {
-        if ((*it)->name() == name)
-            return (*it);
+        StartCaptureRequest r1;
+        stream >> r1;
+        startCapture(client, r1.slots, r1.flags);
     }
+    else if (operation == StopCaptureRequestCode)
+        stopCapture(client);
+    else if (operation == SetPerformanceHudRequestCode)
+    {
+        SetPerformanceHudRequest r1;
+        stream >> r1;
+        setPerformanceHud(r1.enabled != 0);
+    }
+    else if (operation == TrimMemoryRequestCode)
+    {
+        TrimMemoryRequest r1;
+        stream >> r1;
+        trimMemory(r1.level);
+    }
+    else if (operation == GetSurfaceStatsRequestCode)
+        surfaceStats(client);
+}
+
+std::shared_ptr<CompositorSurface> CompositorGL::createSurface(const std::string &name, int fd, int width, int height,
+    int stride, int format)
+{
+    if (fd == -1)
+        return std::make_shared<CompositorGLSurfaceStream>(name, width, height, format);
+
+    return std::make_shared<CompositorGLSurfaceFile>(name, fd, width, height, stride, format);
+}
+
+void CompositorGL::surfaceAdded(CompositorSurface *surface)
+{
+    _scenes[_back].geometry = true;
+    damageScreen(surface->position());
+}
 
-    were_debug("Surface [%s]: not registered.\n", name.c_str());
+void CompositorGL::surfaceRemoved(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+    _scenes[_back].geometry = true;
+}
 
-    return nullptr;
+void CompositorGL::surfaceMoved(CompositorSurface *surface, const RectangleA &previous)
+{
+    damageScreen(previous);
+    damageScreen(surface->position());
+    _scenes[_back].geometry = true;
+}
+
+void CompositorGL::surfaceRestacked(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+    _scenes[_back].geometry = true;
+}
+
+void CompositorGL::surfaceAlphaChanged(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
 }
 
-void CompositorGL::transformCoordinates(int x, int y, std::shared_ptr<CompositorGLSurface> surface, int *_x, int *_y)
+void CompositorGL::surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2)
 {
-	*_x = x;
-	*_y = y;
-	return;
-	
-    *_x = -1;
-    *_y = -1;
+    CompositorGLSurface *glSurface = static_cast<CompositorGLSurface *>(surface);
+    glSurface->addDamage(x1, y1, x2, y2);
 
-    int x1a = surface->position().from.x;
-    int y1a = surface->position().from.y;
-    int x2a = surface->position().to.x;
-    int y2a = surface->position().to.y;
+    /* The owner pinned the memory again and redrew it */
+    if (glSurface->repinning() && x1 <= 0 && y1 <= 0 && x2 >= glSurface->width() && y2 >= glSurface->height())
+    {
+        glSurface->setRepinning(false);
+        were_debug("Surface [%s]: pinned.\n", glSurface->name().c_str());
+    }
+
+    sceneChanged();
+    //were_debug("Surface [%s]: damage (%d %d %d %d).\n", glSurface->name().c_str(), x1, y1, x2, y2);
+}
 
-    if (x < x1a || x > x2a || y < y1a || y > y2a)
+void CompositorGL::surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec,
+    const std::string &data)
+{
+    CompositorGLSurfaceStream *stream = dynamic_cast<CompositorGLSurfaceStream *>(surface);
+    if (stream == nullptr)
         return;
 
-    *_x = (x - x1a) * surface->texture()->width() / (x2a - x1a);
-    *_y = (y - y1a) * surface->texture()->height() / (y2a - y1a);
+    sceneChanged();
+
+    if (!stream->decode(x1, y1, x2, y2, codec, data))
+        were_message("Surface [%s]: malformed data (%d %d %d %d, codec %d).\n", surface->name().c_str(), x1, y1, x2,
+            y2, codec);
+}
+
+/* ================================================================================================================== */
+
+RectangleA CompositorGL::screenRectangle(const CompositorGLSceneSurface &surface, const RectangleA &local)
+{
+    const RectangleA &position = surface.position;
+    int tw = surface.surface->width();
+    int th = surface.surface->height();
+
+    if (tw == 0 || th == 0)
+        return position;
+
+    int pw = position.to.x - position.from.x;
+    int ph = position.to.y - position.from.y;
+
+    /* Round outwards, linear filtering also bleeds into the neighbouring pixel */
+    int x1 = position.from.x + local.from.x * pw / tw - 1;
+    int y1 = position.from.y + local.from.y * ph / th - 1;
+    int x2 = position.from.x + (local.to.x * pw + tw - 1) / tw + 1;
+    int y2 = position.from.y + (local.to.y * ph + th - 1) / th + 1;
+
+    return RectangleA(PointA(x1, y1), PointA(x2, y2));
 }
 
-bool CompositorGL::sortFunction(std::shared_ptr<CompositorGLSurface> a1, std::shared_ptr<CompositorGLSurface> a2)
+void CompositorGL::damageScreen(const RectangleA &rectangle)
 {
-    return a1->strata() < a2->strata();
+    _scenes[_back].damage.add(rectangle);
+    sceneChanged();
 }
 
 /* ================================================================================================================== */
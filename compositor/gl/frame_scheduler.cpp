@@ -0,0 +1,177 @@
+#include "frame_scheduler.h"
+#include <functional>
+
+/* ================================================================================================================== */
+
+const uint64_t DEFAULT_PERIOD = 16666667;
+const uint64_t MIN_PERIOD = 4000000;
+const uint64_t MAX_PERIOD = 50000000;
+
+/* Swaps may return a few vsyncs apart, longer gaps say nothing about the period */
+const uint64_t MAX_PERIODS = 4;
+
+/* Kept between the predicted end of a frame and the vsync */
+const uint64_t SAFETY_MARGIN = 1000000;
+
+const uint64_t REPORT_INTERVAL = 10000000000ULL;
+
+/* ================================================================================================================== */
+
+FrameScheduler::~FrameScheduler()
+{
+    delete _timer;
+}
+
+FrameScheduler::FrameScheduler(WereEventLoop *loop, Mode mode)
+{
+    _timer = new WereTimer(loop);
+    _timer->timeout.connect(std::bind(&FrameScheduler::timeout, this));
+
+    _mode = mode;
+    _scheduled = false;
+    _vsyncSource = false;
+
+    _period = DEFAULT_PERIOD;
+    _lastVsync = 0;
+    _renderTime = 0;
+    _renderDeviation = 0;
+    _begin = 0;
+    _deadline = 0;
+
+    _frames = 0;
+    _missed = 0;
+    _reportTime = WereTimer::now();
+}
+
+/* ================================================================================================================== */
+
+void FrameScheduler::request()
+{
+    if (_scheduled)
+        return;
+
+    _scheduled = true;
+
+    uint64_t now = WereTimer::now();
+    uint64_t start;
+
+    if (_mode == Throughput)
+    {
+        _deadline = nextVsync(now);
+        start = now;
+    }
+    else
+    {
+        uint64_t b = budget();
+        _deadline = nextVsync(now + b);
+        start = _deadline - b;
+    }
+
+    _timer->startAt(start);
+}
+
+void FrameScheduler::vsync(uint64_t time)
+{
+    _vsyncSource = true;
+    updatePhase(time);
+}
+
+void FrameScheduler::timeout()
+{
+    _scheduled = false;
+    frame();
+}
+
+/* ================================================================================================================== */
+
+void FrameScheduler::begin()
+{
+    _begin = WereTimer::now();
+}
+
+void FrameScheduler::submitted()
+{
+    uint64_t elapsed = WereTimer::now() - _begin;
+    uint64_t deviation = (elapsed > _renderTime) ? elapsed - _renderTime : _renderTime - elapsed;
+
+    if (_renderTime == 0)
+        _renderTime = elapsed;
+    else
+        _renderTime = (_renderTime * 7 + elapsed) / 8;
+
+    _renderDeviation = (_renderDeviation * 7 + deviation) / 8;
+}
+
+void FrameScheduler::presented()
+{
+    uint64_t now = WereTimer::now();
+
+    if (!_vsyncSource)
+        updatePhase(now);
+
+    _frames += 1;
+    if (now > _deadline + _period / 2)
+        _missed += 1;
+
+    report(now);
+}
+
+/* ================================================================================================================== */
+
+void FrameScheduler::updatePhase(uint64_t time)
+{
+    if (_lastVsync != 0 && time > _lastVsync)
+    {
+        uint64_t elapsed = time - _lastVsync;
+        uint64_t periods = (elapsed + _period / 2) / _period;
+
+        if (periods >= 1 && periods <= MAX_PERIODS)
+        {
+            uint64_t sample = elapsed / periods;
+            if (sample >= MIN_PERIOD && sample <= MAX_PERIOD)
+                _period = (_period * 15 + sample) / 16;
+        }
+    }
+
+    _lastVsync = time;
+}
+
+/* First vsync at or after the given time */
+uint64_t FrameScheduler::nextVsync(uint64_t after)
+{
+    if (_lastVsync == 0)
+        return after;
+
+    if (after <= _lastVsync)
+        return _lastVsync;
+
+    uint64_t periods = (after - _lastVsync + _period - 1) / _period;
+    return _lastVsync + periods * _period;
+}
+
+/* Predicted render time with room for its usual variation */
+uint64_t FrameScheduler::budget()
+{
+    uint64_t b = _renderTime + 2 * _renderDeviation + SAFETY_MARGIN;
+
+    if (b > _period)
+        b = _period;
+
+    return b;
+}
+
+void FrameScheduler::report(uint64_t now)
+{
+    if (now - _reportTime < REPORT_INTERVAL)
+        return;
+
+    were_debug("Frames %u, missed %u (%.1f%%), period %.2f ms, render %.2f ms (+- %.2f ms).\n",
+        _frames, _missed, 100.0 * _missed / _frames, _period / 1000000.0,
+        _renderTime / 1000000.0, _renderDeviation / 1000000.0);
+
+    _frames = 0;
+    _missed = 0;
+    _reportTime = now;
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,72 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include "were/were_event_loop.h"
+#include "were/were_timer.h"
+#include "were/were_signal.h"
+#include <cstdint>
+#include <atomic>
+
+/* ================================================================================================================== */
+
+/*
+ * Decides when the render thread composes. The refresh period and the vsync phase are learned from the platform
+ * vsync source when there is one, from the return of blocking swaps otherwise. In latency mode a frame starts as
+ * late as the predicted render time allows before the next vsync, in throughput mode it starts as soon as something
+ * changed and the swap does the pacing. Times are monotonic, in nanoseconds.
+ */
+class FrameScheduler
+{
+public:
+    enum Mode
+    {
+        Latency,
+        Throughput,
+    };
+
+    ~FrameScheduler();
+    FrameScheduler(WereEventLoop *loop, Mode mode);
+
+    Mode mode() {return _mode;}
+    /* Also read by the protocol thread */
+    uint64_t period() {return _period;}
+
+    /* Something changed, frame is emitted at the next opportunity */
+    void request();
+    void vsync(uint64_t time);
+
+    /* Around the composition of a frame: start, all commands done, swap returned */
+    void begin();
+    void submitted();
+    void presented();
+
+    WereSignal<void ()> frame;
+
+private:
+    void timeout();
+    void updatePhase(uint64_t time);
+    uint64_t nextVsync(uint64_t after);
+    uint64_t budget();
+    void report(uint64_t now);
+
+private:
+    WereTimer *_timer;
+    Mode _mode;
+    bool _scheduled;
+    bool _vsyncSource;
+
+    std::atomic<uint64_t> _period;
+    uint64_t _lastVsync;
+    uint64_t _renderTime;
+    uint64_t _renderDeviation;
+    uint64_t _begin;
+    uint64_t _deadline;
+
+    unsigned int _frames;
+    unsigned int _missed;
+    uint64_t _reportTime;
+};
+
+/* ================================================================================================================== */
+
+#endif //FRAME_SCHEDULER_H
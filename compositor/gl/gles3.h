@@ -0,0 +1,28 @@
+#ifndef GLES3_H
+#define GLES3_H
+
+#include <GLES2/gl2.h>
+#include <cstdint>
+
+/* GLES3 entry points are resolved at runtime so the GLES2 headers and library keep working */
+#define GL_PIXEL_UNPACK_BUFFER_ 0x88EC
+#define GL_MAP_WRITE_BIT_ 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT_ 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT_ 0x0020
+#define GL_SYNC_GPU_COMMANDS_COMPLETE_ 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT_ 0x00000001
+#define GL_TIMEOUT_EXPIRED_ 0x911B
+#define GL_WAIT_FAILED_ 0x911D
+#define GL_PIXEL_PACK_BUFFER_ 0x88EB
+#define GL_PACK_ROW_LENGTH_ 0x0D02
+#define GL_MAP_READ_BIT_ 0x0001
+#define GL_STREAM_READ_ 0x88E1
+
+typedef struct __GLsync *GLsync_;
+typedef void *(*PFNGLMAPBUFFERRANGE_)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (*PFNGLUNMAPBUFFER_)(GLenum target);
+typedef GLsync_ (*PFNGLFENCESYNC_)(GLenum condition, GLbitfield flags);
+typedef GLenum (*PFNGLCLIENTWAITSYNC_)(GLsync_ sync, GLbitfield flags, uint64_t timeout);
+typedef void (*PFNGLDELETESYNC_)(GLsync_ sync);
+
+#endif //GLES3_H
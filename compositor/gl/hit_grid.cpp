@@ -0,0 +1,137 @@
+#include "hit_grid.h"
+#include <algorithm>
+
+const int CELL_SIZE = 64;
+
+/* ================================================================================================================== */
+
+HitGrid::HitGrid()
+{
+    _width = 0;
+    _height = 0;
+    _columns = 0;
+    _rows = 0;
+}
+
+void HitGrid::resize(int width, int height)
+{
+    if (width == _width && height == _height)
+        return;
+
+    _width = width;
+    _height = height;
+    _columns = (width + CELL_SIZE - 1) / CELL_SIZE;
+    _rows = (height + CELL_SIZE - 1) / CELL_SIZE;
+
+    _cells.clear();
+    _cells.resize(_columns * _rows);
+
+    for (auto it = _items.begin(); it != _items.end(); ++it)
+        link(it->first, it->second);
+}
+
+void HitGrid::clear()
+{
+    _items.clear();
+
+    for (auto it = _cells.begin(); it != _cells.end(); ++it)
+        it->clear();
+}
+
+/* ================================================================================================================== */
+
+void HitGrid::insert(void *object, const RectangleA &rectangle, uint64_t order)
+{
+    remove(object);
+
+    Item item = {rectangle, order};
+    _items[object] = item;
+    link(object, item);
+}
+
+void HitGrid::remove(void *object)
+{
+    auto it = _items.find(object);
+    if (it == _items.end())
+        return;
+
+    unlink(object, it->second);
+    _items.erase(it);
+}
+
+void *HitGrid::find(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= _width || y >= _height)
+        return nullptr;
+
+    const std::vector<void *> &cell = _cells[(y / CELL_SIZE) * _columns + x / CELL_SIZE];
+
+    for (auto it = cell.begin(); it != cell.end(); ++it)
+    {
+        const RectangleA &r = _items.find(*it)->second.rectangle;
+
+        if (x >= r.from.x && x < r.to.x && y >= r.from.y && y < r.to.y)
+            return *it;
+    }
+
+    return nullptr;
+}
+
+/* ================================================================================================================== */
+
+/* Range of cells the rectangle overlaps, false when it is off the grid */
+bool HitGrid::cells(const RectangleA &rectangle, int *cx1, int *cy1, int *cx2, int *cy2) const
+{
+    int x1 = std::max(rectangle.from.x, 0);
+    int y1 = std::max(rectangle.from.y, 0);
+    int x2 = std::min(rectangle.to.x, _width);
+    int y2 = std::min(rectangle.to.y, _height);
+
+    if (x1 >= x2 || y1 >= y2)
+        return false;
+
+    *cx1 = x1 / CELL_SIZE;
+    *cy1 = y1 / CELL_SIZE;
+    *cx2 = (x2 - 1) / CELL_SIZE;
+    *cy2 = (y2 - 1) / CELL_SIZE;
+
+    return true;
+}
+
+void HitGrid::link(void *object, const Item &item)
+{
+    int cx1, cy1, cx2, cy2;
+    if (!cells(item.rectangle, &cx1, &cy1, &cx2, &cy2))
+        return;
+
+    for (int cy = cy1; cy <= cy2; ++cy)
+    {
+        for (int cx = cx1; cx <= cx2; ++cx)
+        {
+            std::vector<void *> &cell = _cells[cy * _columns + cx];
+
+            /* Keep the cell sorted from the top down */
+            auto position = std::upper_bound(cell.begin(), cell.end(), item.order,
+                [this](uint64_t order, void *other) {return order > _items.find(other)->second.order;});
+            cell.insert(position, object);
+        }
+    }
+}
+
+void HitGrid::unlink(void *object, const Item &item)
+{
+    int cx1, cy1, cx2, cy2;
+    if (!cells(item.rectangle, &cx1, &cy1, &cx2, &cy2))
+        return;
+
+    for (int cy = cy1; cy <= cy2; ++cy)
+    {
+        for (int cx = cx1; cx <= cx2; ++cx)
+        {
+            std::vector<void *> &cell = _cells[cy * _columns + cx];
+            cell.erase(std::remove(cell.begin(), cell.end(), object), cell.end());
+        }
+    }
+}
+
+/* ================================================================================================================== */
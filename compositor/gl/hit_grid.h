@@ -0,0 +1,52 @@
+#ifndef HIT_GRID_H
+#define HIT_GRID_H
+
+#include "common/utility.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/* ================================================================================================================== */
+
+/*
+ * Finds the topmost object under a point. The screen is split into cells, each cell lists the objects that overlap
+ * it from the top down, so a lookup only looks at the few objects in one cell. Objects with a higher order are on top.
+ */
+class HitGrid
+{
+public:
+    HitGrid();
+
+    void resize(int width, int height);
+    void clear();
+
+    /* Inserts the object or moves it to a new rectangle and order */
+    void insert(void *object, const RectangleA &rectangle, uint64_t order);
+    void remove(void *object);
+
+    void *find(int x, int y) const;
+
+private:
+    struct Item
+    {
+        RectangleA rectangle;
+        uint64_t order;
+    };
+
+    bool cells(const RectangleA &rectangle, int *cx1, int *cy1, int *cx2, int *cy2) const;
+    void link(void *object, const Item &item);
+    void unlink(void *object, const Item &item);
+
+private:
+    int _width;
+    int _height;
+    int _columns;
+    int _rows;
+
+    std::map<void *, Item> _items;
+    std::vector< std::vector<void *> > _cells;
+};
+
+/* ================================================================================================================== */
+
+#endif //HIT_GRID_H
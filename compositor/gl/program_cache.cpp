@@ -0,0 +1,299 @@
+#include "program_cache.h"
+#include "were/were.h"
+#include <EGL/egl.h>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+#define GL_PROGRAM_BINARY_LENGTH_ 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS_ 0x87FE
+
+const uint32_t CACHE_MAGIC = 0x504B5053;
+const uint32_t CACHE_VERSION = 1;
+
+/* Corrupt files do not get to allocate much */
+const uint32_t MAX_BINARY = 4 * 1024 * 1024;
+
+/* ================================================================================================================== */
+
+static bool read_u32(FILE *file, uint32_t *value)
+{
+    return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+static bool read_string(FILE *file, std::string *value, uint32_t limit)
+{
+    uint32_t length;
+    if (!read_u32(file, &length) || length > limit)
+        return false;
+
+    value->resize(length);
+    return length == 0 || fread(&(*value)[0], length, 1, file) == 1;
+}
+
+static void write_u32(FILE *file, uint32_t value)
+{
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void write_string(FILE *file, const std::string &value)
+{
+    write_u32(file, value.size());
+    fwrite(value.data(), value.size(), 1, file);
+}
+
+/* ================================================================================================================== */
+
+ProgramCache::ProgramCache(const std::string &path)
+{
+    _path = path;
+    _supported = false;
+    _getProgramBinary = nullptr;
+    _programBinary = nullptr;
+    _dirty = false;
+    _hits = 0;
+    _misses = 0;
+}
+
+void ProgramCache::initialize(bool gles3)
+{
+    _hits = 0;
+    _misses = 0;
+
+    GLint formats = 0;
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+
+    if (gles3)
+    {
+        _getProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARY_>(eglGetProcAddress("glGetProgramBinary"));
+        _programBinary = reinterpret_cast<PFNGLPROGRAMBINARY_>(eglGetProcAddress("glProgramBinary"));
+    }
+    else if (extensions != nullptr && strstr(extensions, "GL_OES_get_program_binary") != nullptr)
+    {
+        _getProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARY_>(eglGetProcAddress("glGetProgramBinaryOES"));
+        _programBinary = reinterpret_cast<PFNGLPROGRAMBINARY_>(eglGetProcAddress("glProgramBinaryOES"));
+    }
+
+    if (_getProgramBinary != nullptr && _programBinary != nullptr)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_, &formats);
+
+    _supported = !_path.empty() && formats > 0;
+    if (!_supported)
+        return;
+
+    std::string driver = std::string(reinterpret_cast<const char *>(glGetString(GL_VENDOR))) + "\n" +
+        reinterpret_cast<const char *>(glGetString(GL_RENDERER)) + "\n" +
+        reinterpret_cast<const char *>(glGetString(GL_VERSION));
+
+    if (driver != _driver)
+    {
+        _driver = driver;
+        load();
+    }
+}
+
+/* The file is trusted only as far as the driver accepts what is in it */
+void ProgramCache::load()
+{
+    _entries.clear();
+    _dirty = false;
+
+    FILE *file = fopen(_path.c_str(), "rb");
+    if (file == nullptr)
+        return;
+
+    uint32_t magic;
+    uint32_t version;
+    std::string driver;
+    uint32_t count;
+
+    if (read_u32(file, &magic) && magic == CACHE_MAGIC && read_u32(file, &version) && version == CACHE_VERSION &&
+        read_string(file, &driver, MAX_BINARY) && driver == _driver && read_u32(file, &count))
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint64_t key;
+            uint32_t format;
+            Entry entry;
+
+            if (fread(&key, sizeof(key), 1, file) != 1 || !read_u32(file, &format) ||
+                !read_string(file, &entry.binary, MAX_BINARY))
+            {
+                _entries.clear();
+                break;
+            }
+
+            entry.format = format;
+            _entries[key] = entry;
+        }
+    }
+
+    fclose(file);
+
+    were_debug("Program cache: %d binaries in %s.\n", static_cast<int>(_entries.size()), _path.c_str());
+}
+
+void ProgramCache::save()
+{
+    if (!_supported || !_dirty)
+        return;
+
+    std::string temporary = _path + ".tmp";
+
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        were_error("Failed to write program cache %s.\n", temporary.c_str());
+        _supported = false;
+        return;
+    }
+
+    write_u32(file, CACHE_MAGIC);
+    write_u32(file, CACHE_VERSION);
+    write_string(file, _driver);
+    write_u32(file, _entries.size());
+
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        fwrite(&it->first, sizeof(it->first), 1, file);
+        write_u32(file, it->second.format);
+        write_string(file, it->second.binary);
+    }
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed || rename(temporary.c_str(), _path.c_str()) != 0)
+    {
+        were_error("Failed to write program cache %s.\n", _path.c_str());
+        remove(temporary.c_str());
+        return;
+    }
+
+    _dirty = false;
+}
+
+/* ================================================================================================================== */
+
+/* FNV-1a over everything that goes into the program */
+uint64_t ProgramCache::key(const char *vertex, const char *fragment, const std::vector<std::string> &attributes)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    auto add = [&hash](const char *data, size_t length)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    add(vertex, strlen(vertex) + 1);
+    add(fragment, strlen(fragment) + 1);
+    for (auto it = attributes.begin(); it != attributes.end(); ++it)
+        add(it->c_str(), it->size() + 1);
+
+    return hash;
+}
+
+GLuint ProgramCache::program(const char *vertex, const char *fragment, const std::vector<std::string> &attributes)
+{
+    if (!_supported)
+    {
+        _misses += 1;
+        return link(vertex, fragment, attributes);
+    }
+
+    uint64_t k = key(vertex, fragment, attributes);
+
+    auto found = _entries.find(k);
+    if (found != _entries.end())
+    {
+        GLuint program = glCreateProgram();
+        _programBinary(program, found->second.format, found->second.binary.data(), found->second.binary.size());
+
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus == GL_TRUE)
+        {
+            _hits += 1;
+            return program;
+        }
+
+        /* Rejected after a driver update that kept the version string */
+        glDeleteProgram(program);
+        _entries.erase(found);
+        _dirty = true;
+    }
+
+    _misses += 1;
+    GLuint program = link(vertex, fragment, attributes);
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_, &length);
+
+    if (length > 0 && static_cast<uint32_t>(length) <= MAX_BINARY)
+    {
+        Entry entry;
+        entry.binary.resize(length);
+
+        GLsizei written = 0;
+        _getProgramBinary(program, length, &written, &entry.format, &entry.binary[0]);
+
+        if (written > 0)
+        {
+            entry.binary.resize(written);
+            _entries[k] = entry;
+            _dirty = true;
+        }
+    }
+
+    return program;
+}
+
+GLuint ProgramCache::link(const char *vertex, const char *fragment, const std::vector<std::string> &attributes)
+{
+    GLuint vertexShader = compile(GL_VERTEX_SHADER, vertex);
+    GLuint fragmentShader = compile(GL_FRAGMENT_SHADER, fragment);
+
+    GLuint program = glCreateProgram();
+    if (!program)
+        throw std::runtime_error("[ProgramCache::link] Failed: glCreateProgram.");
+
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+
+    for (unsigned int i = 0; i < attributes.size(); ++i)
+        glBindAttribLocation(program, i, attributes[i].c_str());
+
+    glLinkProgram(program);
+
+    /* The program keeps what it needs */
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (linkStatus != GL_TRUE)
+        throw std::runtime_error("[ProgramCache::link] Failed: glLinkProgram.");
+
+    return program;
+}
+
+GLuint ProgramCache::compile(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    if (!shader)
+        throw std::runtime_error("[ProgramCache::compile] Failed: glCreateShader.");
+
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled != GL_TRUE)
+        throw std::runtime_error("[ProgramCache::compile] Failed: glCompileShader.");
+
+    return shader;
+}
+
+/* ================================================================================================================== */
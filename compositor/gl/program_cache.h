@@ -0,0 +1,63 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef void (*PFNGLGETPROGRAMBINARY_)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat,
+    void *binary);
+typedef void (*PFNGLPROGRAMBINARY_)(GLuint program, GLenum binaryFormat, const void *binary, GLint length);
+
+/* ================================================================================================================== */
+
+/*
+ * Links programs and keeps their driver binaries in a file (GLES3 or GL_OES_get_program_binary), so later starts skip
+ * the shader compiler. The file belongs to one driver, another vendor, renderer or version starts it over.
+ */
+class ProgramCache
+{
+public:
+    ProgramCache(const std::string &path);
+
+    /* With the context current, before program() */
+    void initialize(bool gles3);
+    /* Attributes get the locations 0, 1, ... in order. Throws when the sources do not compile or link. */
+    GLuint program(const char *vertex, const char *fragment, const std::vector<std::string> &attributes);
+    /* Writes the file when programs were added */
+    void save();
+
+    unsigned int hits() {return _hits;}
+    unsigned int misses() {return _misses;}
+
+private:
+    struct Entry
+    {
+        GLenum format;
+        std::string binary;
+    };
+
+    static GLuint compile(GLenum type, const char *source);
+    static uint64_t key(const char *vertex, const char *fragment, const std::vector<std::string> &attributes);
+    GLuint link(const char *vertex, const char *fragment, const std::vector<std::string> &attributes);
+    void load();
+
+private:
+    std::string _path;
+    std::string _driver;
+    bool _supported;
+    PFNGLGETPROGRAMBINARY_ _getProgramBinary;
+    PFNGLPROGRAMBINARY_ _programBinary;
+
+    std::map<uint64_t, Entry> _entries;
+    bool _dirty;
+    unsigned int _hits;
+    unsigned int _misses;
+};
+
+/* ================================================================================================================== */
+
+#endif //PROGRAM_CACHE_H
@@ -0,0 +1,133 @@
+#include "readback.h"
+#include "compositor/sw/blitter.h"
+#include <EGL/egl.h>
+#include <cstring>
+
+/* ================================================================================================================== */
+
+CompositorGLReadback::~CompositorGLReadback()
+{
+    if (_asynchronous)
+        glDeleteBuffers(1, &_buffer);
+}
+
+CompositorGLReadback::CompositorGLReadback(bool gles3)
+{
+    _mapBufferRange = nullptr;
+    _unmapBuffer = nullptr;
+
+    if (gles3)
+    {
+        _mapBufferRange = reinterpret_cast<PFNGLMAPBUFFERRANGE_>(eglGetProcAddress("glMapBufferRange"));
+        _unmapBuffer = reinterpret_cast<PFNGLUNMAPBUFFER_>(eglGetProcAddress("glUnmapBuffer"));
+    }
+
+    _asynchronous = _mapBufferRange != nullptr && _unmapBuffer != nullptr;
+
+    _buffer = 0;
+    if (_asynchronous)
+        glGenBuffers(1, &_buffer);
+
+    _size = 0;
+    _width = 0;
+    _height = 0;
+    _pending = false;
+}
+
+void CompositorGLReadback::read(const Region &region, int width, int height)
+{
+    _region = region;
+    _region.clip(width, height);
+    _width = width;
+    _height = height;
+    _pending = !_region.empty();
+
+    if (!_pending)
+        return;
+
+    const std::vector<RectangleA> &rectangles = _region.rectangles();
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    if (_asynchronous)
+    {
+        size_t size = static_cast<size_t>(width) * height * 4;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER_, _buffer);
+        if (size != _size)
+        {
+            _size = size;
+            glBufferData(GL_PIXEL_PACK_BUFFER_, size, nullptr, GL_STREAM_READ_);
+        }
+
+        glPixelStorei(GL_PACK_ROW_LENGTH_, width);
+
+        for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+        {
+            size_t offset = (static_cast<size_t>(height - it->to.y) * width + it->from.x) * 4;
+            glReadPixels(it->from.x, height - it->to.y, it->to.x - it->from.x, it->to.y - it->from.y, GL_RGBA,
+                GL_UNSIGNED_BYTE, reinterpret_cast<void *>(offset));
+        }
+
+        glPixelStorei(GL_PACK_ROW_LENGTH_, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER_, 0);
+        return;
+    }
+
+    _pixels.resize(width * height);
+
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+    {
+        int w = it->to.x - it->from.x;
+        int h = it->to.y - it->from.y;
+
+        _rectangle.resize(w * h);
+        glReadPixels(it->from.x, height - it->to.y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, _rectangle.data());
+
+        for (int row = 0; row < h; ++row)
+            memcpy(&_pixels[(height - it->to.y + row) * width + it->from.x], &_rectangle[row * w], w * 4);
+    }
+}
+
+bool CompositorGLReadback::finish(uint32_t *frame, int stride, Region *region)
+{
+    if (!_pending)
+        return false;
+
+    _pending = false;
+
+    const uint32_t *pixels = _pixels.data();
+
+    if (_asynchronous)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER_, _buffer);
+        pixels = reinterpret_cast<const uint32_t *>(_mapBufferRange(GL_PIXEL_PACK_BUFFER_, 0, _size, GL_MAP_READ_BIT_));
+
+        if (pixels == nullptr)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER_, 0);
+            return false;
+        }
+    }
+
+    /* RGBA bytes are BGRA pixel values with red and blue swapped */
+    const std::vector<RectangleA> &rectangles = _region.rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+    {
+        for (int y = it->from.y; y < it->to.y; ++y)
+        {
+            Blitter::swapRB(&frame[y * stride + it->from.x], &pixels[(_height - 1 - y) * _width + it->from.x],
+                it->to.x - it->from.x);
+        }
+    }
+
+    if (_asynchronous)
+    {
+        _unmapBuffer(GL_PIXEL_PACK_BUFFER_);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER_, 0);
+    }
+
+    *region = _region;
+    return true;
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,48 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include "gles3.h"
+#include "region.h"
+#include <GLES2/gl2.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/* ================================================================================================================== */
+
+/*
+ * Reads composed frames back for capture. With GLES3 the pixels go into a pack buffer that is only mapped later,
+ * when the GPU is long done with it, otherwise glReadPixels blocks right away. Either way the pixels are kept in the
+ * layout of the framebuffer, bottom row first.
+ */
+class CompositorGLReadback
+{
+public:
+    ~CompositorGLReadback();
+    CompositorGLReadback(bool gles3);
+
+    /* The damage of the frame in the back buffer, in screen coordinates */
+    void read(const Region &region, int width, int height);
+    /* Writes what the last read got into a BGRX frame, false when nothing is pending */
+    bool finish(uint32_t *frame, int stride, Region *region);
+
+private:
+    bool _asynchronous;
+
+    PFNGLMAPBUFFERRANGE_ _mapBufferRange;
+    PFNGLUNMAPBUFFER_ _unmapBuffer;
+
+    GLuint _buffer;
+    size_t _size;
+    std::vector<uint32_t> _pixels;
+    std::vector<uint32_t> _rectangle;
+
+    Region _region;
+    int _width;
+    int _height;
+    bool _pending;
+};
+
+/* ================================================================================================================== */
+
+#endif //READBACK_H
@@ -0,0 +1,175 @@
+#include "region.h"
+#include <algorithm>
+
+const unsigned int MAX_RECTANGLES = 8;
+const unsigned int MAX_FRAGMENTS = 64;
+
+static bool rectangle_empty(const RectangleA &r)
+{
+    return r.to.x <= r.from.x || r.to.y <= r.from.y;
+}
+
+static int rectangle_area(const RectangleA &r)
+{
+    return (r.to.x - r.from.x) * (r.to.y - r.from.y);
+}
+
+static RectangleA rectangle_union(const RectangleA &a, const RectangleA &b)
+{
+    return RectangleA(PointA(std::min(a.from.x, b.from.x), std::min(a.from.y, b.from.y)),
+        PointA(std::max(a.to.x, b.to.x), std::max(a.to.y, b.to.y)));
+}
+
+/* ================================================================================================================== */
+
+Region::Region()
+{
+}
+
+bool Region::empty() const
+{
+    return _rectangles.empty();
+}
+
+int Region::area() const
+{
+    int area = 0;
+
+    for (auto it = _rectangles.begin(); it != _rectangles.end(); ++it)
+        area += rectangle_area(*it);
+
+    return area;
+}
+
+RectangleA Region::bounds() const
+{
+    if (_rectangles.empty())
+        return RectangleA();
+
+    RectangleA bounds = _rectangles.front();
+
+    for (auto it = _rectangles.begin(); it != _rectangles.end(); ++it)
+        bounds = rectangle_union(bounds, *it);
+
+    return bounds;
+}
+
+const std::vector<RectangleA> &Region::rectangles() const
+{
+    return _rectangles;
+}
+
+void Region::clear()
+{
+    _rectangles.clear();
+}
+
+void Region::add(const RectangleA &rectangle)
+{
+    if (rectangle_empty(rectangle))
+        return;
+
+    RectangleA r = rectangle;
+
+    /* Merge with everything it overlaps so the rectangles stay disjoint and no pixel is drawn twice */
+    auto it = _rectangles.begin();
+    while (it != _rectangles.end())
+    {
+        if (intersects(*it, r))
+        {
+            r = rectangle_union(*it, r);
+            _rectangles.erase(it);
+            it = _rectangles.begin();
+        }
+        else
+            ++it;
+    }
+
+    _rectangles.push_back(r);
+
+    if (_rectangles.size() > MAX_RECTANGLES)
+    {
+        RectangleA all = bounds();
+        _rectangles.clear();
+        _rectangles.push_back(all);
+    }
+}
+
+void Region::add(const Region &region)
+{
+    for (auto it = region._rectangles.begin(); it != region._rectangles.end(); ++it)
+        add(*it);
+}
+
+void Region::clip(int width, int height)
+{
+    auto it = _rectangles.begin();
+    while (it != _rectangles.end())
+    {
+        it->from.x = std::max(it->from.x, 0);
+        it->from.y = std::max(it->from.y, 0);
+        it->to.x = std::min(it->to.x, width);
+        it->to.y = std::min(it->to.y, height);
+
+        if (rectangle_empty(*it))
+            it = _rectangles.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool Region::intersects(const RectangleA &a, const RectangleA &b)
+{
+    return a.from.x < b.to.x && b.from.x < a.to.x && a.from.y < b.to.y && b.from.y < a.to.y;
+}
+
+RectangleA Region::intersection(const RectangleA &a, const RectangleA &b)
+{
+    return RectangleA(PointA(std::max(a.from.x, b.from.x), std::max(a.from.y, b.from.y)),
+        PointA(std::min(a.to.x, b.to.x), std::min(a.to.y, b.to.y)));
+}
+
+/* Whether the occluders leave nothing of the rectangle, answers false when the remainder gets too fragmented */
+bool Region::covered(const RectangleA &rectangle, const std::vector<RectangleA> &occluders)
+{
+    std::vector<RectangleA> remainder;
+    std::vector<RectangleA> next;
+
+    if (!rectangle_empty(rectangle))
+        remainder.push_back(rectangle);
+
+    for (auto o = occluders.begin(); o != occluders.end() && !remainder.empty(); ++o)
+    {
+        next.clear();
+
+        for (auto r = remainder.begin(); r != remainder.end(); ++r)
+        {
+            if (!intersects(*r, *o))
+            {
+                next.push_back(*r);
+                continue;
+            }
+
+            /* Up to four pieces: above, below, left and right of the occluder */
+            RectangleA i = intersection(*r, *o);
+
+            if (r->from.y < i.from.y)
+                next.push_back(RectangleA(r->from, PointA(r->to.x, i.from.y)));
+            if (i.to.y < r->to.y)
+                next.push_back(RectangleA(PointA(r->from.x, i.to.y), r->to));
+            if (r->from.x < i.from.x)
+                next.push_back(RectangleA(PointA(r->from.x, i.from.y), PointA(i.from.x, i.to.y)));
+            if (i.to.x < r->to.x)
+                next.push_back(RectangleA(PointA(i.to.x, i.from.y), PointA(r->to.x, i.to.y)));
+        }
+
+        if (next.size() > MAX_FRAGMENTS)
+            return false;
+
+        remainder.swap(next);
+    }
+
+    return remainder.empty();
+}
+
+/* ================================================================================================================== */
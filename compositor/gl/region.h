@@ -0,0 +1,35 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "common/utility.h"
+#include <vector>
+
+/* ================================================================================================================== */
+
+/* A small set of screen rectangles, collapsed into their bounds once it gets too fragmented */
+class Region
+{
+public:
+    Region();
+
+    bool empty() const;
+    int area() const;
+    RectangleA bounds() const;
+    const std::vector<RectangleA> &rectangles() const;
+
+    void clear();
+    void add(const RectangleA &rectangle);
+    void add(const Region &region);
+    void clip(int width, int height);
+
+    static bool intersects(const RectangleA &a, const RectangleA &b);
+    static RectangleA intersection(const RectangleA &a, const RectangleA &b);
+    static bool covered(const RectangleA &rectangle, const std::vector<RectangleA> &occluders);
+
+private:
+    std::vector<RectangleA> _rectangles;
+};
+
+/* ================================================================================================================== */
+
+#endif //REGION_H
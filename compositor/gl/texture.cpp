@@ -11,6 +11,8 @@ Texture::Texture()
     _texture = 0;
     _width = 0;
     _height = 0;
+    _format = GL_BGRA_EXT;
+    _type = GL_UNSIGNED_BYTE;
     
     glGenTextures(1, &_texture);
     glActiveTexture(GL_TEXTURE0);
@@ -36,19 +38,31 @@ int Texture::height()
     return _height;
 }
 
-void Texture::resize(int width, int height)
+GLenum Texture::format()
 {
-    if (_width == width && _height == height)
+    return _format;
+}
+
+GLenum Texture::type()
+{
+    return _type;
+}
+
+void Texture::resize(int width, int height, GLenum format, GLenum type)
+{
+    if (_width == width && _height == height && _format == format && _type == type)
         return;
 
     if (width > 0 && height > 0)
     {
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, _texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, width, height, 0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, type, NULL);
     }
 
     _width = width;
     _height = height;
+    _format = format;
+    _type = type;
 }
 
@@ -13,13 +13,17 @@ public:
     GLuint id();
     int width();
     int height();
+    GLenum format();
+    GLenum type();
     
-    void resize(int width, int height);
+    void resize(int width, int height, GLenum format = GL_BGRA_EXT, GLenum type = GL_UNSIGNED_BYTE);
 
 private:
     GLuint _texture;
     int _width;
     int _height;
+    GLenum _format;
+    GLenum _type;
 };
 
 #endif //TEXTURE_H
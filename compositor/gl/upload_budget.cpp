@@ -0,0 +1,76 @@
+#include "upload_budget.h"
+#include "compositor/compositor_backend.h"
+#include "were/were.h"
+#include <algorithm>
+#include <cstdlib>
+
+/* Part of the refresh period spent uploading, in percent */
+const uint64_t UPLOAD_SHARE = 40;
+
+/* Smaller frames are mostly call overhead and would understate the throughput */
+const uint64_t MEASURE_BYTES = 256 * 1024;
+const uint64_t MIN_BUDGET = 512 * 1024;
+
+/* Weight of a new measurement */
+const double SMOOTHING = 0.25;
+
+/* ================================================================================================================== */
+
+UploadBudget::UploadBudget()
+{
+    _fixed = false;
+    _budget = 0;
+    _throughput = 0.0;
+    _burstFrames = 0;
+    _burstBytes = 0;
+
+    std::string fixed = compositor_option("upload_budget");
+    if (!fixed.empty())
+    {
+        _fixed = true;
+        _budget = strtoull(fixed.c_str(), nullptr, 10) * 1024;
+
+        if (_budget != 0)
+            were_message("Upload budget %llu KB per frame.\n", static_cast<unsigned long long>(_budget / 1024));
+        else
+            were_message("Upload budget off.\n");
+    }
+}
+
+uint64_t UploadBudget::budget(uint64_t period)
+{
+    if (_fixed)
+        return _budget;
+
+    /* Unlimited until the first large frame is measured */
+    if (_throughput <= 0.0 || period == 0)
+        return 0;
+
+    uint64_t budget = static_cast<uint64_t>(_throughput * (period * UPLOAD_SHARE / 100) / 1e6);
+    return std::max(budget, MIN_BUDGET);
+}
+
+void UploadBudget::frame(uint64_t bytes, uint64_t time, uint64_t carried)
+{
+    if (bytes >= MEASURE_BYTES && time > 0)
+    {
+        double throughput = bytes / (time / 1e6);
+        _throughput = (_throughput > 0.0) ? _throughput + SMOOTHING * (throughput - _throughput) : throughput;
+    }
+
+    if (carried == 0 && _burstFrames == 0)
+        return;
+
+    _burstFrames += 1;
+    _burstBytes += bytes;
+
+    if (carried == 0)
+    {
+        were_debug("Upload burst of %.1f MB spread over %u frames, %.1f MB/ms.\n", _burstBytes / 1048576.0,
+            _burstFrames, _throughput / 1048576.0);
+        _burstFrames = 0;
+        _burstBytes = 0;
+    }
+}
+
+/* ================================================================================================================== */
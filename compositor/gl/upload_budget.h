@@ -0,0 +1,36 @@
+#ifndef UPLOAD_BUDGET_H
+#define UPLOAD_BUDGET_H
+
+#include <cstdint>
+
+/* ================================================================================================================== */
+
+/*
+ * Bytes of texture uploads a frame may spend, a share of the refresh period at the measured upload throughput. Damage
+ * past the budget is carried to the next frames. The upload_budget option fixes it in KB, 0 turns it off. Times in
+ * nanoseconds.
+ */
+class UploadBudget
+{
+public:
+    UploadBudget();
+
+    /* For the frame about to upload, 0 when unlimited */
+    uint64_t budget(uint64_t period);
+
+    /* What the frame uploaded, how long it took and what it left for later */
+    void frame(uint64_t bytes, uint64_t time, uint64_t carried);
+
+private:
+    bool _fixed;
+    uint64_t _budget;
+    /* Bytes per millisecond */
+    double _throughput;
+
+    unsigned int _burstFrames;
+    uint64_t _burstBytes;
+};
+
+/* ================================================================================================================== */
+
+#endif //UPLOAD_BUDGET_H
@@ -0,0 +1,129 @@
+#include "upload_tuner.h"
+#include "compositor/compositor_backend.h"
+#include "were/were.h"
+#include <fstream>
+#include <vector>
+#include <cstdio>
+
+static const char *PATH_NAMES[UploadPathCount] = {"rows", "swizzled", "whole", "rectangle"};
+
+/* ================================================================================================================== */
+
+UploadTuner::UploadTuner(const std::string &path)
+{
+    _path = path;
+}
+
+const char *UploadTuner::name(UploadPath path)
+{
+    return PATH_NAMES[path];
+}
+
+UploadPath UploadTuner::choose(const std::string &renderer, const std::string &version,
+    const std::function<uint64_t (UploadPath)> &measure)
+{
+    std::string option = compositor_option("upload_path");
+    if (!option.empty())
+    {
+        for (int i = 0; i < UploadPathCount; ++i)
+        {
+            if (option == PATH_NAMES[i])
+            {
+                were_message("Texture upload path %s, from the upload_path option.\n", PATH_NAMES[i]);
+                return static_cast<UploadPath>(i);
+            }
+        }
+
+        were_error("Unknown upload path %s.\n", option.c_str());
+    }
+
+    std::string driver = renderer + "\t" + version;
+
+    UploadPath path;
+    if (load(driver, &path))
+    {
+        were_message("Texture upload path %s, from %s.\n", PATH_NAMES[path], _path.c_str());
+        return path;
+    }
+
+    /* Rows is what every driver with BGRA textures takes, it stays when nothing measures better */
+    path = UploadRows;
+    uint64_t best = 0;
+
+    for (int i = 0; i < UploadPathCount; ++i)
+    {
+        uint64_t time = measure(static_cast<UploadPath>(i));
+        were_message("Texture upload path %s: %.2f ms.\n", PATH_NAMES[i], time / 1e6);
+
+        if (time != 0 && (best == 0 || time < best))
+        {
+            best = time;
+            path = static_cast<UploadPath>(i);
+        }
+    }
+
+    were_message("Texture upload path %s, measured.\n", PATH_NAMES[path]);
+    save(driver, path);
+
+    return path;
+}
+
+/* "rectangle\tRenderer\tVersion" */
+bool UploadTuner::load(const std::string &driver, UploadPath *path)
+{
+    std::ifstream file(_path);
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || line.substr(tab + 1) != driver)
+            continue;
+
+        std::string name = line.substr(0, tab);
+        for (int i = 0; i < UploadPathCount; ++i)
+        {
+            if (name == PATH_NAMES[i])
+            {
+                *path = static_cast<UploadPath>(i);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void UploadTuner::save(const std::string &driver, UploadPath path)
+{
+    if (_path.empty())
+        return;
+
+    std::vector<std::string> lines;
+
+    std::ifstream input(_path);
+    std::string line;
+    while (std::getline(input, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos && line.substr(tab + 1) != driver)
+            lines.push_back(line);
+    }
+    input.close();
+
+    lines.push_back(std::string(PATH_NAMES[path]) + "\t" + driver);
+
+    std::string temporary = _path + ".tmp";
+    std::ofstream output(temporary, std::ios::trunc);
+    for (auto it = lines.begin(); it != lines.end(); ++it)
+        output << *it << "\n";
+    output.close();
+
+    if (!output || rename(temporary.c_str(), _path.c_str()) != 0)
+    {
+        were_error("Failed to write upload path cache %s.\n", _path.c_str());
+        remove(temporary.c_str());
+    }
+}
+
+/* ================================================================================================================== */
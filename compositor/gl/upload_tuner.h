@@ -0,0 +1,48 @@
+#ifndef UPLOAD_TUNER_H
+#define UPLOAD_TUNER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/* ================================================================================================================== */
+
+enum UploadPath
+{
+    /* Whole rows of the damage, BGRA */
+    UploadRows,
+    /* Whole rows of the damage, swapped to RGBA on the CPU */
+    UploadSwizzled,
+    /* The whole image respecified with glTexImage2D */
+    UploadWhole,
+    /* Only the damaged rectangle, packed on the CPU when it is narrower than the image */
+    UploadRectangle,
+    UploadPathCount
+};
+
+/*
+ * Picks the texture upload path for a driver. The upload_path option names one, otherwise the choice is read from a
+ * file, one line per GL_RENDERER and GL_VERSION, or measured when the driver is not in it yet.
+ */
+class UploadTuner
+{
+public:
+    UploadTuner(const std::string &path);
+
+    static const char *name(UploadPath path);
+
+    /* measure returns the time of a test upload with the path current, 0 when the driver rejected it */
+    UploadPath choose(const std::string &renderer, const std::string &version,
+        const std::function<uint64_t (UploadPath)> &measure);
+
+private:
+    bool load(const std::string &driver, UploadPath *path);
+    void save(const std::string &driver, UploadPath path);
+
+private:
+    std::string _path;
+};
+
+/* ================================================================================================================== */
+
+#endif //UPLOAD_TUNER_H
@@ -0,0 +1,267 @@
+#include "uploader.h"
+#include "texture.h"
+#include "compositor/sw/blitter.h"
+#include "were/were.h"
+#include "were/were_timer.h"
+#include <EGL/egl.h>
+#include <cstring>
+
+/* Wait for the GPU to be done with an unpack buffer, in nanoseconds */
+const uint64_t UPLOAD_TIMEOUT = 100000000;
+
+/* Test image of the upload path measurement, and rounds of which the best counts */
+const int CALIBRATION_WIDTH = 1024;
+const int CALIBRATION_HEIGHT = 512;
+const int CALIBRATION_ROUNDS = 5;
+
+/* ================================================================================================================== */
+
+CompositorGLUploader::~CompositorGLUploader()
+{
+    if (!_asynchronous)
+        return;
+
+    for (int i = 0; i < UPLOAD_BUFFERS; ++i)
+    {
+        if (_fences[i] != nullptr)
+            _deleteSync(_fences[i]);
+    }
+
+    glDeleteBuffers(UPLOAD_BUFFERS, _buffers);
+}
+
+CompositorGLUploader::CompositorGLUploader(bool gles3)
+{
+    _mapBufferRange = nullptr;
+    _unmapBuffer = nullptr;
+    _fenceSync = nullptr;
+    _clientWaitSync = nullptr;
+    _deleteSync = nullptr;
+
+    if (gles3)
+    {
+        _mapBufferRange = reinterpret_cast<PFNGLMAPBUFFERRANGE_>(eglGetProcAddress("glMapBufferRange"));
+        _unmapBuffer = reinterpret_cast<PFNGLUNMAPBUFFER_>(eglGetProcAddress("glUnmapBuffer"));
+        _fenceSync = reinterpret_cast<PFNGLFENCESYNC_>(eglGetProcAddress("glFenceSync"));
+        _clientWaitSync = reinterpret_cast<PFNGLCLIENTWAITSYNC_>(eglGetProcAddress("glClientWaitSync"));
+        _deleteSync = reinterpret_cast<PFNGLDELETESYNC_>(eglGetProcAddress("glDeleteSync"));
+    }
+
+    _asynchronous = _mapBufferRange != nullptr && _unmapBuffer != nullptr && _fenceSync != nullptr &&
+        _clientWaitSync != nullptr && _deleteSync != nullptr;
+
+    for (int i = 0; i < UPLOAD_BUFFERS; ++i)
+    {
+        _buffers[i] = 0;
+        _sizes[i] = 0;
+        _fences[i] = nullptr;
+    }
+
+    if (_asynchronous)
+        glGenBuffers(UPLOAD_BUFFERS, _buffers);
+
+    _current = 0;
+    _offset = 0;
+    _waited = false;
+    _path = UploadRows;
+
+    were_message("Texture uploads: %s\n", _asynchronous ? "pixel unpack buffers" : "synchronous");
+}
+
+/* Makes room for size more bytes in the current buffer, which the GPU must be done with */
+bool CompositorGLUploader::beginBuffer(size_t size)
+{
+    if (!_waited)
+    {
+        _waited = true;
+
+        if (_fences[_current] != nullptr)
+        {
+            if (_clientWaitSync(_fences[_current], GL_SYNC_FLUSH_COMMANDS_BIT_, UPLOAD_TIMEOUT) == GL_WAIT_FAILED_)
+                were_message("glClientWaitSync failed.\n");
+
+            _deleteSync(_fences[_current]);
+            _fences[_current] = nullptr;
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER_, _buffers[_current]);
+
+    if (_offset + size <= _sizes[_current])
+        return true;
+
+    /* Only an untouched buffer can be reallocated, later uploads in a full one go the synchronous way */
+    if (_offset != 0)
+        return false;
+
+    _sizes[_current] = size;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER_, size, nullptr, GL_STREAM_DRAW);
+
+    return true;
+}
+
+GLenum CompositorGLUploader::textureFormat(GLenum format)
+{
+    return (_path == UploadSwizzled && format == GL_BGRA_EXT) ? GL_RGBA : format;
+}
+
+uint64_t CompositorGLUploader::update(GLuint texture, const PointA &origin, bool whole, int width, int height,
+    int stride, const RectangleA &damage, GLenum format, GLenum type, const unsigned char *pixels, int bytesPerPixel)
+{
+    if (whole && _path == UploadWhole)
+    {
+        transfer(texture, 0, 0, width, height, format, type, pixels, stride, bytesPerPixel, true);
+        return static_cast<uint64_t>(width) * height * bytesPerPixel;
+    }
+
+    RectangleA r = damage;
+    if (_path != UploadRectangle)
+    {
+        r.from.x = 0;
+        r.to.x = width;
+    }
+
+    transfer(texture, origin.x + r.from.x, origin.y + r.from.y, r.width(), r.height(), format, type,
+        &pixels[(static_cast<size_t>(r.from.y) * stride + r.from.x) * bytesPerPixel], stride, bytesPerPixel, false);
+
+    return static_cast<uint64_t>(r.width()) * r.height() * bytesPerPixel;
+}
+
+/* Tightly packed rows, swapped to RGBA when swizzle */
+static void pack_rows(unsigned char *destination, const unsigned char *source, int width, int height, int stride,
+    int bytesPerPixel, bool swizzle)
+{
+    size_t row = static_cast<size_t>(width) * bytesPerPixel;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char *from = &source[static_cast<size_t>(y) * stride * bytesPerPixel];
+        unsigned char *to = &destination[y * row];
+
+        if (swizzle)
+            Blitter::swapRB(reinterpret_cast<uint32_t *>(to), reinterpret_cast<const uint32_t *>(from), width);
+        else
+            memcpy(to, from, row);
+    }
+}
+
+void CompositorGLUploader::transfer(GLuint texture, int x, int y, int width, int height, GLenum format, GLenum type,
+    const unsigned char *pixels, int stride, int bytesPerPixel, bool specify)
+{
+    size_t size = static_cast<size_t>(width) * height * bytesPerPixel;
+    bool swizzle = _path == UploadSwizzled && format == GL_BGRA_EXT;
+    GLenum target = swizzle ? GL_RGBA : format;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, bytesPerPixel == 2 ? 2 : 4);
+
+    const void *data = pixels;
+
+    if (_asynchronous && beginBuffer(size))
+    {
+        void *mapped = _mapBufferRange(GL_PIXEL_UNPACK_BUFFER_, _offset, size,
+            GL_MAP_WRITE_BIT_ | GL_MAP_INVALIDATE_RANGE_BIT_ | GL_MAP_UNSYNCHRONIZED_BIT_);
+
+        if (mapped != nullptr)
+        {
+            pack_rows(reinterpret_cast<unsigned char *>(mapped), pixels, width, height, stride, bytesPerPixel, swizzle);
+            _unmapBuffer(GL_PIXEL_UNPACK_BUFFER_);
+
+            data = reinterpret_cast<void *>(_offset);
+            _offset = (_offset + size + 15) & ~static_cast<size_t>(15);
+        }
+        else
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER_, 0);
+    }
+    else if (_asynchronous)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER_, 0);
+
+    /* Client memory, packed first unless it already is */
+    if (data == pixels && (swizzle || stride != width))
+    {
+        if (_scratch.size() < size)
+            _scratch.resize(size);
+
+        pack_rows(_scratch.data(), pixels, width, height, stride, bytesPerPixel, swizzle);
+        data = _scratch.data();
+    }
+
+    if (specify)
+        glTexImage2D(GL_TEXTURE_2D, 0, target, width, height, 0, target, type, data);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, target, type, data);
+
+    if (_asynchronous)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER_, 0);
+}
+
+/*
+ * A full width band and a small rectangle into a test texture, the damage of a scrolling terminal and of a blinking
+ * cursor. Each round waits for the GPU so the copies the driver defers are counted.
+ */
+uint64_t CompositorGLUploader::measure(UploadPath path)
+{
+    UploadPath previous = _path;
+    _path = path;
+
+    std::vector<uint32_t> pixels(CALIBRATION_WIDTH * CALIBRATION_HEIGHT);
+    for (unsigned int i = 0; i < pixels.size(); ++i)
+        pixels[i] = 0xFF000000 | (i * 2654435761u);
+
+    const RectangleA damage[] = {
+        RectangleA(PointA(0, 0), PointA(CALIBRATION_WIDTH, CALIBRATION_HEIGHT / 4)),
+        RectangleA(PointA(CALIBRATION_WIDTH / 2, CALIBRATION_HEIGHT / 2),
+            PointA(CALIBRATION_WIDTH / 2 + 64, CALIBRATION_HEIGHT / 2 + 32))};
+
+    while (glGetError() != GL_NO_ERROR)
+        ;
+
+    uint64_t best = 0;
+
+    {
+        Texture texture;
+        texture.resize(CALIBRATION_WIDTH, CALIBRATION_HEIGHT, textureFormat(GL_BGRA_EXT), GL_UNSIGNED_BYTE);
+
+        /* The first round only warms the driver up */
+        for (int round = 0; round <= CALIBRATION_ROUNDS; ++round)
+        {
+            uint64_t start = WereTimer::now();
+
+            for (unsigned int i = 0; i < sizeof(damage) / sizeof(damage[0]); ++i)
+            {
+                update(texture.id(), PointA(0, 0), true, CALIBRATION_WIDTH, CALIBRATION_HEIGHT, CALIBRATION_WIDTH,
+                    damage[i], GL_BGRA_EXT, GL_UNSIGNED_BYTE, reinterpret_cast<const unsigned char *>(pixels.data()), 4);
+                finishFrame();
+            }
+
+            glFinish();
+
+            uint64_t time = WereTimer::now() - start;
+            if (round > 0 && (best == 0 || time < best))
+                best = time;
+        }
+    }
+
+    if (glGetError() != GL_NO_ERROR)
+        best = 0;
+
+    _path = previous;
+
+    return best;
+}
+
+/* Fences the uploads of this frame and moves on to the next buffer */
+void CompositorGLUploader::finishFrame()
+{
+    if (!_asynchronous || !_waited)
+        return;
+
+    _fences[_current] = _fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE_, 0);
+
+    _current = (_current + 1) % UPLOAD_BUFFERS;
+    _offset = 0;
+    _waited = false;
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,72 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include "gles3.h"
+#include "upload_tuner.h"
+#include "common/utility.h"
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <vector>
+#include <cstddef>
+
+/* ================================================================================================================== */
+
+/* Pixel unpack buffers in flight, uploads into one wait only for the frame that last used it */
+const int UPLOAD_BUFFERS = 3;
+
+/*
+ * Texture uploads of the GL compositor along the chosen upload path. With GLES3 the rows are staged in pixel unpack
+ * buffers that are fenced once per frame, otherwise they go from client memory.
+ */
+class CompositorGLUploader
+{
+public:
+    ~CompositorGLUploader();
+    CompositorGLUploader(bool gles3);
+
+    bool asynchronous() {return _asynchronous;}
+
+    UploadPath path() {return _path;}
+    void setPath(UploadPath path) {_path = path;}
+    /* Textures fed from the format, which the swizzled path turns to RGBA */
+    GLenum textureFormat(GLenum format);
+
+    /*
+     * The damage of an image of width x height pixels with rows stride pixels apart, into the texture at origin.
+     * whole when the image is all of the texture, not a cell of the atlas. Returns the bytes that went up.
+     */
+    uint64_t update(GLuint texture, const PointA &origin, bool whole, int width, int height, int stride,
+        const RectangleA &damage, GLenum format, GLenum type, const unsigned char *pixels, int bytesPerPixel);
+    void finishFrame();
+
+    /* Time of the test uploads with the path, 0 when the driver rejected it */
+    uint64_t measure(UploadPath path);
+
+private:
+    bool beginBuffer(size_t size);
+    /* Rows of stride pixels into the texture rectangle at x, y, respecifying the texture when specify */
+    void transfer(GLuint texture, int x, int y, int width, int height, GLenum format, GLenum type,
+        const unsigned char *pixels, int stride, int bytesPerPixel, bool specify);
+
+private:
+    bool _asynchronous;
+    UploadPath _path;
+    std::vector<unsigned char> _scratch;
+
+    PFNGLMAPBUFFERRANGE_ _mapBufferRange;
+    PFNGLUNMAPBUFFER_ _unmapBuffer;
+    PFNGLFENCESYNC_ _fenceSync;
+    PFNGLCLIENTWAITSYNC_ _clientWaitSync;
+    PFNGLDELETESYNC_ _deleteSync;
+
+    GLuint _buffers[UPLOAD_BUFFERS];
+    size_t _sizes[UPLOAD_BUFFERS];
+    GLsync_ _fences[UPLOAD_BUFFERS];
+    int _current;
+    size_t _offset;
+    bool _waited;
+};
+
+/* ================================================================================================================== */
+
+#endif //UPLOADER_H
@@ -0,0 +1,339 @@
+#include "compositor_passthrough.h"
+#include "compositor/gl/region.h"
+#include "compositor/surface_registry.h"
+#include "platform/platform_passthrough.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+
+#include "common/utility.h"
+#include "common/sparkle_server.h"
+#include "common/sparkle_protocol.h"
+#include "common/sparkle_connection.h"
+
+/* ================================================================================================================== */
+
+/* The memory stays with the platform's buffer, the compositor only keeps the fd open and the geometry */
+class CompositorPassthroughSurface : public CompositorSurface
+{
+public:
+    ~CompositorPassthroughSurface();
+    CompositorPassthroughSurface(const std::string &name, int fd, int width, int height, int stride, int format);
+
+    int fd() {return _fd;}
+    int width() {return _width;}
+    int height() {return _height;}
+    int stride() {return _stride;}
+    int format() {return _format;}
+
+    /* Of the platform, -1 when it does not show the surface */
+    int id() {return _id;}
+    void setId(int id) {_id = id;}
+
+private:
+    int _fd;
+    int _width;
+    int _height;
+    int _stride;
+    int _format;
+    int _id;
+};
+
+CompositorPassthroughSurface::~CompositorPassthroughSurface()
+{
+    if (_fd != -1)
+        close(_fd);
+}
+
+CompositorPassthroughSurface::CompositorPassthroughSurface(const std::string &name, int fd, int width, int height,
+    int stride, int format) :
+    CompositorSurface(name)
+{
+    _fd = fd;
+    _width = width;
+    _height = height;
+    _stride = stride;
+    _format = format;
+    _id = -1;
+}
+
+/* ================================================================================================================== */
+
+/*
+ * Hands the shared memory of each surface to the platform, which shows it as a buffer of its own: the pixels are
+ * never read here. Positions, stacking and damage are passed on and go out together once per batch of messages.
+ * Alpha between 0 and 1, scaling, in-band surfaces and capture need a compositor that draws, GL or SW.
+ */
+class CompositorPassthrough : public Compositor, public SurfaceRegistryBackend
+{
+public:
+    ~CompositorPassthrough();
+    CompositorPassthrough(WereEventLoop *loop, Platform *platform, const std::string &file);
+
+    int displayWidth();
+    int displayHeight();
+
+private:
+    void connection(std::shared_ptr <SparkleConnection> client);
+    void disconnection(std::shared_ptr <SparkleConnection> client);
+    void packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message);
+
+    std::shared_ptr<CompositorSurface> createSurface(const std::string &name, int fd, int width, int height,
+        int stride, int format);
+    void surfaceAdded(CompositorSurface *surface);
+    void surfaceRemoved(CompositorSurface *surface);
+    void surfaceMoved(CompositorSurface *surface, const RectangleA &previous);
+    void surfaceRestacked(CompositorSurface *surface);
+    void surfaceAlphaChanged(CompositorSurface *surface);
+    void surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2);
+    void surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec, const std::string &data);
+
+    void displaySizeChanged(int width, int height);
+    void presented(uint64_t time);
+    void changed();
+    void commit();
+
+private:
+    WereEventLoop *_loop;
+    Platform *_platform;
+    PlatformPassthrough *_passthrough;
+    SparkleServer *_server;
+    SurfaceRegistry *_registry;
+    uint32_t _frames;
+
+    bool _changed;
+    bool _stackingChanged;
+};
+
+/* ================================================================================================================== */
+
+CompositorPassthrough::~CompositorPassthrough()
+{
+    delete _server;
+
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+    for (auto it = surfaces.begin(); it != surfaces.end(); ++it)
+    {
+        CompositorPassthroughSurface *surface = static_cast<CompositorPassthroughSurface *>(it->get());
+        if (surface->id() != -1)
+            _passthrough->remove(surface->id());
+    }
+    delete _registry;
+}
+
+CompositorPassthrough::CompositorPassthrough(WereEventLoop *loop, Platform *platform, const std::string &file)
+{
+    _loop = loop;
+    _platform = platform;
+    _passthrough = platform->passthrough();
+
+    _registry = new SurfaceRegistry(this);
+    _frames = 0;
+    _changed = false;
+    _stackingChanged = false;
+
+    _passthrough->resized.connect(WereSimpleQueuer(loop, &CompositorPassthrough::displaySizeChanged, this));
+    _passthrough->presented.connect(WereSimpleQueuer(loop, &CompositorPassthrough::presented, this));
+
+    _platform->pointerDown.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerDown, _registry));
+    _platform->pointerUp.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerUp, _registry));
+    _platform->pointerMotion.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerMotion, _registry));
+    _platform->keyDown.connect(WereSimpleQueuer(loop, &SurfaceRegistry::keyDown, _registry));
+    _platform->keyUp.connect(WereSimpleQueuer(loop, &SurfaceRegistry::keyUp, _registry));
+    _platform->buttonPress.connect(WereSimpleQueuer(loop, &SurfaceRegistry::buttonPress, _registry));
+    _platform->buttonRelease.connect(WereSimpleQueuer(loop, &SurfaceRegistry::buttonRelease, _registry));
+    _platform->cursorMotion.connect(WereSimpleQueuer(loop, &SurfaceRegistry::cursorMotion, _registry));
+
+    _server = new SparkleServer(_loop, file);
+
+    _server->signal_connected.connect(WereSimpleQueuer(loop, &CompositorPassthrough::connection, this));
+    _server->signal_disconnected.connect(WereSimpleQueuer(loop, &CompositorPassthrough::disconnection, this));
+    _server->signal_packet.connect(WereSimpleQueuer(loop, &CompositorPassthrough::packet, this));
+
+    were_message("Passthrough compositor.\n");
+}
+
+int CompositorPassthrough::displayWidth()
+{
+    return _registry->displayWidth();
+}
+
+int CompositorPassthrough::displayHeight()
+{
+    return _registry->displayHeight();
+}
+
+/* ================================================================================================================== */
+
+/* Buffers are shown at their size, clients are asked for the size of the window */
+void CompositorPassthrough::displaySizeChanged(int width, int height)
+{
+    _registry->setDisplaySize(width, height, DisplayScaleUnit);
+}
+
+void CompositorPassthrough::presented(uint64_t)
+{
+    frame();
+    _registry->sendEvent(EventMaskFrame, FrameNotification({_frames++}));
+}
+
+/* Runs once after a batch of messages */
+void CompositorPassthrough::changed()
+{
+    if (_changed)
+        return;
+
+    _changed = true;
+    _loop->queue(std::bind(&CompositorPassthrough::commit, this));
+}
+
+void CompositorPassthrough::commit()
+{
+    _changed = false;
+
+    if (_stackingChanged)
+    {
+        _stackingChanged = false;
+
+        std::vector<int> ids;
+        const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+        for (auto it = surfaces.begin(); it != surfaces.end(); ++it)
+        {
+            CompositorPassthroughSurface *surface = static_cast<CompositorPassthroughSurface *>(it->get());
+            if (surface->id() != -1)
+                ids.push_back(surface->id());
+        }
+
+        _passthrough->setStacking(ids);
+    }
+
+    _passthrough->commit();
+}
+
+/* ================================================================================================================== */
+
+void CompositorPassthrough::connection(std::shared_ptr <SparkleConnection> client)
+{
+    _registry->connection(client);
+}
+
+void CompositorPassthrough::disconnection(std::shared_ptr <SparkleConnection> client)
+{
+    _registry->disconnection(client);
+}
+
+void CompositorPassthrough::packet(std::shared_ptr<SparkleConnection> client,
+    std::shared_ptr<WereSocketUnixMessage> message)
+{
+    uint32_t operation;
+
+    WereSocketUnixMessageStream stream(message.get());
+    stream >> operation;
+
+    if (_registry->packet(client, operation, stream))
+        return;
+
+    if (operation == StartCaptureRequestCode)
+        were_message("Capture needs a compositor that draws.\n");
+}
+
+std::shared_ptr<CompositorSurface> CompositorPassthrough::createSurface(const std::string &name, int fd, int width,
+    int height, int stride, int format)
+{
+    return std::make_shared<CompositorPassthroughSurface>(name, fd, width, height, stride, format);
+}
+
+/* Surfaces the platform cannot show still take input */
+void CompositorPassthrough::surfaceAdded(CompositorSurface *surface)
+{
+    CompositorPassthroughSurface *buffer = static_cast<CompositorPassthroughSurface *>(surface);
+
+    if (buffer->fd() == -1)
+        were_message("Surface [%s]: in-band surfaces need a compositor that draws.\n", buffer->name().c_str());
+    else if (!_passthrough->supported(buffer->format()))
+        were_message("Surface [%s]: format %d not supported by the host.\n", buffer->name().c_str(),
+            buffer->format());
+    else
+        buffer->setId(_passthrough->add(buffer->fd(), buffer->width(), buffer->height(), buffer->stride(),
+            buffer->format()));
+
+    _stackingChanged = true;
+    changed();
+}
+
+void CompositorPassthrough::surfaceRemoved(CompositorSurface *surface)
+{
+    CompositorPassthroughSurface *buffer = static_cast<CompositorPassthroughSurface *>(surface);
+
+    if (buffer->id() != -1)
+        _passthrough->remove(buffer->id());
+    changed();
+}
+
+/* Input follows what is shown, the buffer at its own size */
+void CompositorPassthrough::surfaceMoved(CompositorSurface *surface, const RectangleA &)
+{
+    CompositorPassthroughSurface *buffer = static_cast<CompositorPassthroughSurface *>(surface);
+    RectangleA position = buffer->position();
+    int x1 = position.from.x;
+    int y1 = position.from.y;
+
+    buffer->setPosition(x1, y1, x1 + buffer->width(), y1 + buffer->height());
+
+    if (position.width() != buffer->width() || position.height() != buffer->height())
+        were_debug("Surface [%s]: shown unscaled at %d %d.\n", buffer->name().c_str(), x1, y1);
+
+    if (buffer->id() != -1)
+    {
+        _passthrough->setPosition(buffer->id(), x1, y1);
+        changed();
+    }
+}
+
+void CompositorPassthrough::surfaceRestacked(CompositorSurface *)
+{
+    _stackingChanged = true;
+    changed();
+}
+
+/* Shown or not, the host has no alpha for a surface */
+void CompositorPassthrough::surfaceAlphaChanged(CompositorSurface *surface)
+{
+    CompositorPassthroughSurface *buffer = static_cast<CompositorPassthroughSurface *>(surface);
+
+    if (buffer->id() != -1)
+    {
+        _passthrough->setVisible(buffer->id(), buffer->alpha() > 0.0f);
+        changed();
+    }
+}
+
+void CompositorPassthrough::surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2)
+{
+    CompositorPassthroughSurface *buffer = static_cast<CompositorPassthroughSurface *>(surface);
+    if (buffer->id() == -1)
+        return;
+
+    _passthrough->damage(buffer->id(), x1, y1, x2, y2);
+    changed();
+}
+
+/* The pixels are never read here */
+void CompositorPassthrough::surfaceData(CompositorSurface *, int, int, int, int, int, const std::string &)
+{
+}
+
+/* ================================================================================================================== */
+
+Compositor *compositor_passthrough_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file)
+{
+    return new CompositorPassthrough(loop, platform, file);
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,12 @@
+#ifndef COMPOSITOR_PASSTHROUGH_H
+#define COMPOSITOR_PASSTHROUGH_H
+
+#include "compositor/compositor.h"
+#include "were/were_event_loop.h"
+#include "platform/platform.h"
+
+/* For platforms with PlatformPassthrough, the host composes the surfaces */
+Compositor *compositor_passthrough_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file);
+
+#endif //COMPOSITOR_PASSTHROUGH_H
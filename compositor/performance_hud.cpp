@@ -0,0 +1,198 @@
+#include "performance_hud.h"
+#include "were-graphics/were_surface.h"
+#include "were-graphics/font_default.h"
+#include <algorithm>
+#include <cstdio>
+
+const int MARGIN = 4;
+const int LINE = 16;
+const int GRAPH_TOP = MARGIN + 4 * LINE + MARGIN;
+const int GRAPH_HEIGHT = 64;
+const int CLIENTS_TOP = GRAPH_TOP + GRAPH_HEIGHT + MARGIN;
+const unsigned int MAX_CLIENTS = 6;
+
+const uint32_t COLOR_BACKGROUND = 0xFF202020;
+const uint32_t COLOR_TEXT = 0xFFE0E0E0;
+const uint32_t COLOR_GOOD = 0xFF40C040;
+const uint32_t COLOR_LATE = 0xFFE04040;
+const uint32_t COLOR_PERIOD = 0xFF707070;
+
+const int FONT_WIDTH = 9;
+const int FONT_HEIGHT = 16;
+
+/* ================================================================================================================== */
+
+/* Just enough drawing for the overlay, callers keep inside the surface */
+class HudCanvas
+{
+public:
+    HudCanvas(WereSurface *surface)
+    {
+        _buffer = reinterpret_cast<uint32_t *>(surface->data());
+        _stride = surface->stride();
+        _color = 0;
+    }
+
+    void setColor(uint32_t color) {_color = color;}
+
+    void fill(int x1, int y1, int x2, int y2)
+    {
+        for (int y = y1; y <= y2; ++y)
+            std::fill(&_buffer[y * _stride + x1], &_buffer[y * _stride + x2 + 1], _color);
+    }
+
+    void drawString(int x, int y, const char *s)
+    {
+        for (; *s != '\0'; ++s, x += FONT_WIDTH)
+        {
+            const unsigned char *glyph = &font_default[static_cast<unsigned char>(*s) * FONT_WIDTH * FONT_HEIGHT];
+
+            for (int gy = 0; gy < FONT_HEIGHT; ++gy)
+                for (int gx = 0; gx < FONT_WIDTH; ++gx)
+                    if (glyph[gy * FONT_WIDTH + gx] != 0x00)
+                        _buffer[(y + gy) * _stride + x + gx] = _color;
+        }
+    }
+
+private:
+    uint32_t *_buffer;
+    int _stride;
+    uint32_t _color;
+};
+
+/* ================================================================================================================== */
+
+PerformanceHud::PerformanceHud() :
+    _intervals(Width - 2 * MARGIN, 0)
+{
+    _next = 0;
+    _last = 0;
+
+    _paintTime = 0;
+    _frames = 0;
+    _intervalSum = 0;
+    _intervalMax = 0;
+    _costSum = 0;
+    _uploadBytes = 0;
+    _uploadRectangles = 0;
+    _latencySum = 0;
+    _latencies = 0;
+    _merged = 0;
+    _budget = 0;
+    _budgetHits = 0;
+    _carried = 0;
+}
+
+void PerformanceHud::frame(uint64_t time, uint64_t cost, uint64_t uploadBytes, unsigned int uploadRectangles,
+    uint64_t latency, uint64_t budget, uint64_t carried)
+{
+    if (_last != 0)
+    {
+        uint64_t interval = time - _last;
+
+        _intervals[_next] = std::min(interval, static_cast<uint64_t>(UINT32_MAX));
+        _next = (_next + 1) % _intervals.size();
+
+        _intervalSum += interval;
+        _intervalMax = std::max(_intervalMax, interval);
+    }
+    _last = time;
+
+    _frames += 1;
+    _costSum += cost;
+    _uploadBytes += uploadBytes;
+    _uploadRectangles += uploadRectangles;
+
+    if (latency != 0)
+    {
+        _latencySum += latency;
+        _latencies += 1;
+    }
+
+    _budget = budget;
+    _carried = carried;
+    if (carried != 0)
+        _budgetHits += 1;
+}
+
+void PerformanceHud::paint(WereSurface *surface, uint64_t now, uint64_t period,
+    const std::vector<PerformanceHudClient> &clients)
+{
+    if (surface->width() < Width || surface->height() < Height)
+        return;
+
+    double elapsed = (_paintTime != 0 && now > _paintTime) ? (now - _paintTime) / 1e9 : 0.0;
+    _paintTime = now;
+
+    HudCanvas painter(surface);
+
+    painter.setColor(COLOR_BACKGROUND);
+    painter.fill(0, 0, Width - 1, Height - 1);
+
+    char line[64];
+    double fps = elapsed > 0.0 ? _frames / elapsed : 0.0;
+    double interval = _frames > 1 ? _intervalSum / 1e6 / (_frames - 1) : 0.0;
+
+    painter.setColor(COLOR_TEXT);
+
+    snprintf(line, sizeof(line), "%5.1f fps %5.1f ms max %5.1f ms", fps, interval, _intervalMax / 1e6);
+    painter.drawString(MARGIN, MARGIN, line);
+
+    snprintf(line, sizeof(line), "upload %6.1f MB/s %4.1f rects/frame",
+        elapsed > 0.0 ? _uploadBytes / elapsed / (1024 * 1024) : 0.0,
+        _frames > 0 ? static_cast<double>(_uploadRectangles) / _frames : 0.0);
+    painter.drawString(MARGIN, MARGIN + LINE, line);
+
+    snprintf(line, sizeof(line), "input %5.1f ms draw %4.1f ms merged %u",
+        _latencies > 0 ? _latencySum / 1e6 / _latencies : 0.0, _frames > 0 ? _costSum / 1e6 / _frames : 0.0,
+        _merged);
+    painter.drawString(MARGIN, MARGIN + 2 * LINE, line);
+
+    /* Frames that left damage for later, and what the last one left */
+    if (_budget != 0)
+        snprintf(line, sizeof(line), "budget %5lluK hit %3.0f%% carried %5lluK",
+            static_cast<unsigned long long>(_budget / 1024), _frames > 0 ? 100.0 * _budgetHits / _frames : 0.0,
+            static_cast<unsigned long long>(_carried / 1024));
+    else
+        snprintf(line, sizeof(line), "budget unlimited");
+    painter.drawString(MARGIN, MARGIN + 3 * LINE, line);
+
+    /* Present intervals, oldest on the left, the refresh period at half height */
+    uint64_t scale = period > 0 ? 2 * period : 33333333;
+    int bottom = GRAPH_TOP + GRAPH_HEIGHT - 1;
+
+    for (unsigned int i = 0; i < _intervals.size(); ++i)
+    {
+        uint64_t value = _intervals[(_next + i) % _intervals.size()];
+        if (value == 0)
+            continue;
+
+        int height = std::min(static_cast<uint64_t>(GRAPH_HEIGHT), value * GRAPH_HEIGHT / scale);
+        painter.setColor(period > 0 && value > period + period / 2 ? COLOR_LATE : COLOR_GOOD);
+        painter.fill(MARGIN + i, bottom - height + 1, MARGIN + i, bottom);
+    }
+
+    painter.setColor(COLOR_PERIOD);
+    painter.fill(MARGIN, bottom - GRAPH_HEIGHT / 2, Width - MARGIN - 1, bottom - GRAPH_HEIGHT / 2);
+
+    painter.setColor(COLOR_TEXT);
+    for (unsigned int i = 0; i < clients.size() && i < MAX_CLIENTS; ++i)
+    {
+        snprintf(line, sizeof(line), "%-20.20s %5.0f/s %5uK", clients[i].name.c_str(),
+            elapsed > 0.0 ? clients[i].messages / elapsed : 0.0, clients[i].backlog / 1024);
+        painter.drawString(MARGIN, CLIENTS_TOP + i * LINE, line);
+    }
+
+    _frames = 0;
+    _intervalSum = 0;
+    _intervalMax = 0;
+    _costSum = 0;
+    _uploadBytes = 0;
+    _uploadRectangles = 0;
+    _latencySum = 0;
+    _latencies = 0;
+    _merged = 0;
+    _budgetHits = 0;
+}
+
+/* ================================================================================================================== */
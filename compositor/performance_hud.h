@@ -0,0 +1,65 @@
+#ifndef PERFORMANCE_HUD_H
+#define PERFORMANCE_HUD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class WereSurface;
+
+/* ================================================================================================================== */
+
+struct PerformanceHudClient
+{
+    std::string name;
+    unsigned int messages;
+    unsigned int backlog;
+};
+
+/*
+ * Frame statistics drawn into a small XRGB8888 surface. Frames are added as they are presented, the text and the
+ * graph of present intervals are drawn only when paint() is called, a few times per second. Times in nanoseconds.
+ */
+class PerformanceHud
+{
+public:
+    static const int Width = 360;
+    static const int Height = 244;
+
+    PerformanceHud();
+
+    /*
+     * latency is from the first input to the present that followed it, 0 when there was no input. budget is the upload
+     * budget of the frame, 0 when unlimited, carried the bytes of damage it left for the next frames.
+     */
+    void frame(uint64_t time, uint64_t cost, uint64_t uploadBytes, unsigned int uploadRectangles, uint64_t latency,
+        uint64_t budget, uint64_t carried);
+    /* A scene was replaced before the render thread took it */
+    void sceneMerged() {_merged += 1;}
+
+    /* Messages since the last paint and bytes waiting to be sent of each client */
+    void paint(WereSurface *surface, uint64_t now, uint64_t period, const std::vector<PerformanceHudClient> &clients);
+
+private:
+    std::vector<uint32_t> _intervals;
+    unsigned int _next;
+    uint64_t _last;
+
+    uint64_t _paintTime;
+    unsigned int _frames;
+    uint64_t _intervalSum;
+    uint64_t _intervalMax;
+    uint64_t _costSum;
+    uint64_t _uploadBytes;
+    unsigned int _uploadRectangles;
+    uint64_t _latencySum;
+    unsigned int _latencies;
+    unsigned int _merged;
+    uint64_t _budget;
+    unsigned int _budgetHits;
+    uint64_t _carried;
+};
+
+/* ================================================================================================================== */
+
+#endif //PERFORMANCE_HUD_H
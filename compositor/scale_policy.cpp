@@ -0,0 +1,114 @@
+#include "scale_policy.h"
+#include "compositor_backend.h"
+#include "common/sparkle_protocol.h"
+#include "were/were.h"
+#include <algorithm>
+#include <cstdlib>
+
+const int SCALE_STEP = 125;
+
+/* Frames per measurement, frames ignored after a change */
+const unsigned int WINDOW = 30;
+const unsigned int SETTLE = 60;
+
+/* Parts of the refresh period, in percent */
+const uint64_t HIGH = 75;
+const uint64_t LOW = 35;
+const unsigned int LOW_WINDOWS = 4;
+
+/* ================================================================================================================== */
+
+ScalePolicy::ScalePolicy()
+{
+    _min = parse(compositor_option("scale_min"), DisplayScaleUnit);
+    _max = parse(compositor_option("scale_max"), DisplayScaleUnit);
+
+    /* A fixed scale */
+    std::string fixed = compositor_option("scale");
+    if (!fixed.empty())
+        _min = _max = parse(fixed, DisplayScaleUnit);
+
+    _min = std::max(std::min(_min, DisplayScaleUnit), SCALE_STEP);
+    _max = std::max(std::min(_max, DisplayScaleUnit), _min);
+
+    _scale = _max;
+    _low = 0;
+    _settle = 0;
+    reset();
+
+    if (_min != _max)
+        were_message("Render scale %.3f, adapting down to %.3f.\n", _scale / 1000.0, _min / 1000.0);
+    else if (_scale != DisplayScaleUnit)
+        were_message("Render scale %.3f.\n", _scale / 1000.0);
+}
+
+/* "0.75" */
+int ScalePolicy::parse(const std::string &value, int fallback)
+{
+    if (value.empty())
+        return fallback;
+
+    return static_cast<int>(atof(value.c_str()) * DisplayScaleUnit + 0.5);
+}
+
+void ScalePolicy::reset()
+{
+    _upload = 0;
+    _total = 0;
+    _frames = 0;
+}
+
+bool ScalePolicy::frame(uint64_t upload, uint64_t total, uint64_t period)
+{
+    if (_min == _max || period == 0)
+        return false;
+
+    if (_settle > 0)
+    {
+        _settle -= 1;
+        return false;
+    }
+
+    _upload += upload;
+    _total += total;
+    _frames += 1;
+
+    if (_frames < WINDOW)
+        return false;
+
+    uint64_t cost = _total / _frames;
+    uint64_t uploads = _upload / _frames;
+    reset();
+
+    int scale = _scale;
+
+    if (cost * 100 > period * HIGH)
+    {
+        _low = 0;
+        scale = std::max(_scale - SCALE_STEP, _min);
+    }
+    else if (cost * 100 < period * LOW)
+    {
+        _low += 1;
+        if (_low >= LOW_WINDOWS)
+        {
+            _low = 0;
+            scale = std::min(_scale + SCALE_STEP, _max);
+        }
+    }
+    else
+        _low = 0;
+
+    if (scale == _scale)
+        return false;
+
+    were_message("Render scale %.3f: frames took %.1f ms (uploads %.1f ms) of %.1f ms.\n", scale / 1000.0,
+        cost / 1e6, uploads / 1e6, period / 1e6);
+
+    _scale = scale;
+    _settle = SETTLE;
+
+    return true;
+}
+
+/* ================================================================================================================== */
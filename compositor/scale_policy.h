@@ -0,0 +1,44 @@
+#ifndef SCALE_POLICY_H
+#define SCALE_POLICY_H
+
+#include <cstdint>
+#include <string>
+
+/* ================================================================================================================== */
+
+/*
+ * Render scale offered to the clients that follow it (the X server renders at that fraction of the display size and
+ * the compositor scales it up), in thousandths. Bounds come from the scale_min and scale_max options, a fixed scale
+ * from the scale option. Within the bounds the scale follows the cost of composed frames: a window of frames that
+ * takes more than HIGH of the refresh period steps it down, LOW_WINDOWS windows in a row under LOW step it up. The
+ * gap between the two covers the cost of one step, and no frames are measured while a client follows a change.
+ */
+class ScalePolicy
+{
+public:
+    ScalePolicy();
+
+    int scale() {return _scale;}
+
+    /* Upload time and whole time of a composed frame, refresh period, nanoseconds. True when the scale changed. */
+    bool frame(uint64_t upload, uint64_t total, uint64_t period);
+
+private:
+    static int parse(const std::string &value, int fallback);
+    void reset();
+
+private:
+    int _scale;
+    int _min;
+    int _max;
+
+    uint64_t _upload;
+    uint64_t _total;
+    unsigned int _frames;
+    unsigned int _low;
+    unsigned int _settle;
+};
+
+/* ================================================================================================================== */
+
+#endif //SCALE_POLICY_H
@@ -0,0 +1,471 @@
+#include "surface_registry.h"
+#include "were/were.h"
+#include <algorithm>
+#include <unistd.h>
+
+/* ================================================================================================================== */
+
+SurfaceRegistry::SurfaceRegistry(SurfaceRegistryBackend *backend)
+{
+    _backend = backend;
+    _frameClients = 0;
+    _sequence = 0;
+    _displayWidth = 0;
+    _displayHeight = 0;
+    _scale = DisplayScaleUnit;
+    _buttons = 0;
+}
+
+/* ================================================================================================================== */
+
+void SurfaceRegistry::connection(std::shared_ptr<SparkleConnection> client)
+{
+    _clients[client] = Client({EventMaskDefault, std::string(), 0});
+
+    if (_displayWidth > 0 && _displayHeight > 0)
+        client->send(DisplaySizeNotification({_displayWidth, _displayHeight, _scale}));
+}
+
+void SurfaceRegistry::disconnection(std::shared_ptr<SparkleConnection> client)
+{
+    setEventMask(client, std::string(), 0);
+    _clients.erase(client);
+}
+
+bool SurfaceRegistry::packet(std::shared_ptr<SparkleConnection> client, uint32_t operation,
+    WereSocketUnixMessageStream &stream)
+{
+    _clients[client].messages += 1;
+
+    if (operation == RegisterSurfaceAshmemRequestCode)
+    {
+        RegisterSurfaceAshmemRequest r1;
+        stream >> r1;
+        registerSurface(client, r1.name, r1.fd, r1.width, r1.height, r1.stride, r1.format);
+    }
+    else if (operation == RegisterSurfaceStreamRequestCode)
+    {
+        RegisterSurfaceStreamRequest r1;
+        stream >> r1;
+        registerSurface(client, r1.name, -1, r1.width, r1.height, r1.width, r1.format);
+    }
+    else if (operation == SurfaceDataRequestCode)
+    {
+        SurfaceDataRequest r1;
+        stream >> r1;
+        std::shared_ptr<CompositorSurface> surface = find(r1.name);
+        if (surface != nullptr)
+            _backend->surfaceData(surface.get(), r1.x1, r1.y1, r1.x2, r1.y2, r1.codec, r1.data);
+    }
+    else if (operation == UnregisterSurfaceRequestCode)
+    {
+        UnregisterSurfaceRequest r1;
+        stream >> r1;
+        remove(r1.name);
+    }
+    else if (operation == SetSurfacePositionRequestCode)
+    {
+        SetSurfacePositionRequest r1;
+        stream >> r1;
+        setPosition(r1.name, r1.x1, r1.y1, r1.x2, r1.y2);
+    }
+    else if (operation == SetSurfaceStrataRequestCode)
+    {
+        SetSurfaceStrataRequest r1;
+        stream >> r1;
+        setStrata(r1.name, r1.strata);
+    }
+    else if (operation == SetSurfaceAlphaRequestCode)
+    {
+        SetSurfaceAlphaRequest r1;
+        stream >> r1;
+        setAlpha(r1.name, r1.alpha);
+    }
+    else if (operation == AddSurfaceDamageRequestCode)
+    {
+        AddSurfaceDamageRequest r1;
+        stream >> r1;
+        std::shared_ptr<CompositorSurface> surface = find(r1.name);
+        if (surface != nullptr)
+            _backend->surfaceDamaged(surface.get(), r1.x1, r1.y1, r1.x2, r1.y2);
+    }
+    else if (operation == SetEventMaskRequestCode)
+    {
+        SetEventMaskRequest r1;
+        stream >> r1;
+        setEventMask(client, r1.surface, r1.mask);
+    }
+    else
+        return false;
+
+    return true;
+}
+
+void SurfaceRegistry::setDisplaySize(int width, int height, int scale)
+{
+    _displayWidth = width;
+    _displayHeight = height;
+    _scale = scale;
+
+    if (width > 0 && height > 0)
+    {
+        _hitGrid.resize(width, height);
+        sendEvent(EventMaskDisplaySize, DisplaySizeNotification({width, height, scale}));
+    }
+}
+
+/* ================================================================================================================== */
+
+std::vector< std::shared_ptr<SparkleConnection> > SurfaceRegistry::connections()
+{
+    std::vector< std::shared_ptr<SparkleConnection> > clients;
+    for (auto it = _clients.begin(); it != _clients.end(); ++it)
+        clients.push_back(it->first);
+
+    return clients;
+}
+
+bool SurfaceRegistry::connected(std::shared_ptr<SparkleConnection> client)
+{
+    return _clients.find(client) != _clients.end();
+}
+
+uint32_t SurfaceRegistry::eventMask(std::shared_ptr<SparkleConnection> client)
+{
+    auto it = _clients.find(client);
+    return it != _clients.end() ? it->second.mask : 0;
+}
+
+unsigned int SurfaceRegistry::takeMessages(std::shared_ptr<SparkleConnection> client)
+{
+    auto it = _clients.find(client);
+    if (it == _clients.end())
+        return 0;
+
+    unsigned int messages = it->second.messages;
+    it->second.messages = 0;
+    return messages;
+}
+
+void SurfaceRegistry::setEventMask(std::shared_ptr<SparkleConnection> client, const std::string &surface, uint32_t mask)
+{
+    Client &c = _clients[client];
+
+    if ((c.mask & EventMaskFrame) != (mask & EventMaskFrame))
+        _frameClients += (mask & EventMaskFrame) ? 1 : -1;
+
+    c.mask = mask;
+    c.surface = surface;
+}
+
+bool SurfaceRegistry::subscribed(const std::string &subscription, const std::string &name)
+{
+    if (subscription.empty())
+        return false;
+
+    return name == subscription ||
+        (name.size() > subscription.size() && name.compare(0, subscription.size(), subscription) == 0 &&
+        name[subscription.size()] == '.');
+}
+
+/* ================================================================================================================== */
+
+void SurfaceRegistry::registerSurface(std::shared_ptr<SparkleConnection> client, const std::string &name, int fd,
+    int width, int height, int stride, int format)
+{
+    if (!surfaceSizeValid(width, height, stride))
+    {
+        were_message("Surface [%s]: invalid size %dx%d (stride %d), ignored.\n", name.c_str(), width, height, stride);
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+
+    std::shared_ptr<CompositorSurface> surface = _backend->createSurface(name, fd, width, height, stride, format);
+    surface->setOwner(client);
+    add(surface, true);
+}
+
+void SurfaceRegistry::add(std::shared_ptr<CompositorSurface> surface, bool input)
+{
+    /*
+     * Registered again under the same name, e.g. resized: it takes the place of the previous one in the stacking
+     * order, grabs and focus are by name and stay with it.
+     */
+    std::shared_ptr<CompositorSurface> previous = find(surface->name());
+    if (previous != nullptr)
+    {
+        surface->setStrata(previous->strata());
+        surface->setAlpha(previous->alpha());
+        surface->setSequence(previous->sequence());
+
+        _hitGrid.remove(previous.get());
+        std::replace(_surfaces.begin(), _surfaces.end(), previous, surface);
+        _backend->surfaceRemoved(previous.get());
+    }
+    else
+    {
+        surface->setSequence(_sequence++);
+        _surfaces.push_back(surface);
+        sort();
+    }
+
+    if (input)
+        updateHitGrid(surface.get());
+
+    _backend->surfaceAdded(surface.get());
+    were_debug("Surface [%s] registered.\n", surface->name().c_str());
+}
+
+void SurfaceRegistry::remove(const std::string &name)
+{
+    auto it = _surfaces.begin();
+    while (it != _surfaces.end())
+    {
+        std::shared_ptr<CompositorSurface> surface = (*it);
+        if (surface->name() == name)
+        {
+            _hitGrid.remove(surface.get());
+            it = _surfaces.erase(it);
+            _backend->surfaceRemoved(surface.get());
+            were_debug("Surface [%s] unregistered.\n", name.c_str());
+        }
+        else
+            ++it;
+    }
+
+    for (auto grab = _pointerGrabs.begin(); grab != _pointerGrabs.end();)
+    {
+        if (grab->second == name)
+            grab = _pointerGrabs.erase(grab);
+        else
+            ++grab;
+    }
+
+    if (_keyboardFocus == name)
+        _keyboardFocus.clear();
+
+    if (_buttonGrab == name)
+    {
+        _buttonGrab.clear();
+        _buttons = 0;
+    }
+}
+
+std::shared_ptr<CompositorSurface> SurfaceRegistry::find(const std::string &name)
+{
+    for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
+    {
+        if ((*it)->name() == name)
+            return (*it);
+    }
+
+    were_debug("Surface [%s]: not registered.\n", name.c_str());
+
+    return nullptr;
+}
+
+void SurfaceRegistry::setPosition(const std::string &name, int x1, int y1, int x2, int y2)
+{
+    std::shared_ptr<CompositorSurface> surface = find(name);
+    if (surface == nullptr)
+        return;
+
+    RectangleA previous = surface->position();
+    surface->setPosition(x1, y1, x2, y2);
+    _backend->surfaceMoved(surface.get(), previous);
+    updateHitGrid(surface.get());
+    were_debug("Surface [%s]: position changed (%d %d %d %d).\n", name.c_str(), x1, y1, x2, y2);
+}
+
+void SurfaceRegistry::setStrata(const std::string &name, int strata)
+{
+    std::shared_ptr<CompositorSurface> surface = find(name);
+    if (surface == nullptr)
+        return;
+
+    surface->setStrata(strata);
+    updateHitGrid(surface.get());
+    sort();
+    _backend->surfaceRestacked(surface.get());
+    were_debug("Surface [%s]: strata changed.\n", name.c_str());
+}
+
+void SurfaceRegistry::setAlpha(const std::string &name, float alpha)
+{
+    std::shared_ptr<CompositorSurface> surface = find(name);
+    if (surface == nullptr)
+        return;
+
+    surface->setAlpha(alpha);
+    _backend->surfaceAlphaChanged(surface.get());
+    were_debug("Surface [%s]: alpha changed.\n", name.c_str());
+}
+
+/* ================================================================================================================== */
+
+void SurfaceRegistry::pointerDown(int slot, int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = inputTarget(std::string(), x, y, &_x, &_y);
+    if (surface == nullptr)
+        return;
+
+    /* The other events of the touch go to the same surface */
+    _pointerGrabs[slot] = surface->name();
+    _keyboardFocus = surface->name();
+    sendInput(surface, PointerDownNotification({surface->name(), slot, _x, _y}));
+}
+
+void SurfaceRegistry::pointerUp(int slot, int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = inputTarget(_pointerGrabs[slot], x, y, &_x, &_y);
+    _pointerGrabs.erase(slot);
+    if (surface == nullptr)
+        return;
+
+    sendInput(surface, PointerUpNotification({surface->name(), slot, _x, _y}));
+}
+
+/* Each sample is a batch of its own, backends that coalesce them per frame go through pointerTarget() */
+void SurfaceRegistry::pointerMotion(int slot, int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = pointerTarget(slot, x, y, &_x, &_y);
+    if (surface == nullptr)
+        return;
+
+    sendInput(surface, PointerMotionBatchNotification({surface->name(), slot, _x, _y,
+        std::vector<PointerMotionSample>()}));
+}
+
+/* Keys follow the surface touched or clicked last */
+void SurfaceRegistry::keyDown(int code)
+{
+    std::shared_ptr<CompositorSurface> surface = find(_keyboardFocus);
+    if (surface != nullptr)
+        sendInput(surface.get(), KeyDownNotification({code}));
+    else
+        sendEvent(EventMaskInput, KeyDownNotification({code}));
+}
+
+void SurfaceRegistry::keyUp(int code)
+{
+    std::shared_ptr<CompositorSurface> surface = find(_keyboardFocus);
+    if (surface != nullptr)
+        sendInput(surface.get(), KeyUpNotification({code}));
+    else
+        sendEvent(EventMaskInput, KeyUpNotification({code}));
+}
+
+void SurfaceRegistry::buttonPress(int button, int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = inputTarget(_buttonGrab, x, y, &_x, &_y);
+    if (surface == nullptr)
+        return;
+
+    /* Held buttons keep the pointer on the surface they were pressed on */
+    _buttonGrab = surface->name();
+    _buttons |= 1 << button;
+    _keyboardFocus = surface->name();
+    sendInput(surface, ButtonPressNotification({surface->name(), button, _x, _y}));
+}
+
+void SurfaceRegistry::buttonRelease(int button, int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = inputTarget(_buttonGrab, x, y, &_x, &_y);
+
+    _buttons &= ~(1 << button);
+    if (_buttons == 0)
+        _buttonGrab.clear();
+
+    if (surface == nullptr)
+        return;
+
+    sendInput(surface, ButtonReleaseNotification({surface->name(), button, _x, _y}));
+}
+
+void SurfaceRegistry::cursorMotion(int x, int y)
+{
+    int _x;
+    int _y;
+    CompositorSurface *surface = inputTarget(_buttonGrab, x, y, &_x, &_y);
+    if (surface == nullptr)
+        return;
+
+    sendInput(surface, CursorMotionNotification({surface->name(), _x, _y}));
+}
+
+CompositorSurface *SurfaceRegistry::pointerTarget(int slot, int x, int y, int *_x, int *_y)
+{
+    auto grab = _pointerGrabs.find(slot);
+    return inputTarget(grab != _pointerGrabs.end() ? grab->second : std::string(), x, y, _x, _y);
+}
+
+/* The grabbing surface if there is one, otherwise the topmost one under the point */
+CompositorSurface *SurfaceRegistry::inputTarget(const std::string &grab, int x, int y, int *_x, int *_y)
+{
+    CompositorSurface *surface;
+
+    if (!grab.empty())
+        surface = find(grab).get();
+    else
+        surface = static_cast<CompositorSurface *>(_hitGrid.find(x, y));
+
+    if (surface != nullptr)
+        transformCoordinates(x, y, surface, _x, _y);
+
+    return surface;
+}
+
+/* Scales screen coordinates into the surface, the result is outside of it for a grabbing surface the point left */
+void SurfaceRegistry::transformCoordinates(int x, int y, CompositorSurface *surface, int *_x, int *_y)
+{
+    const RectangleA &position = surface->position();
+    int pw = position.to.x - position.from.x;
+    int ph = position.to.y - position.from.y;
+
+    if (pw <= 0 || ph <= 0)
+    {
+        *_x = x - position.from.x;
+        *_y = y - position.from.y;
+        return;
+    }
+
+    *_x = (x - position.from.x) * surface->width() / pw;
+    *_y = (y - position.from.y) * surface->height() / ph;
+}
+
+/* ================================================================================================================== */
+
+/* Stacking order: strata first, then the order of registration */
+void SurfaceRegistry::updateHitGrid(CompositorSurface *surface)
+{
+    uint64_t order = static_cast<uint64_t>(static_cast<uint32_t>(surface->strata()) ^ 0x80000000) << 32;
+    order |= surface->sequence();
+
+    _hitGrid.insert(surface, surface->position(), order);
+}
+
+void SurfaceRegistry::sort()
+{
+    std::sort(_surfaces.begin(), _surfaces.end(), sortFunction);
+}
+
+bool SurfaceRegistry::sortFunction(std::shared_ptr<CompositorSurface> a1, std::shared_ptr<CompositorSurface> a2)
+{
+    if (a1->strata() != a2->strata())
+        return a1->strata() < a2->strata();
+
+    return a1->sequence() < a2->sequence();
+}
+
+/* ================================================================================================================== */
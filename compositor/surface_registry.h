@@ -0,0 +1,205 @@
+#ifndef SURFACE_REGISTRY_H
+#define SURFACE_REGISTRY_H
+
+#include "common/utility.h"
+#include "common/sparkle_connection.h"
+#include "common/sparkle_protocol.h"
+#include "compositor/gl/hit_grid.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+/* ================================================================================================================== */
+
+/* What every compositor keeps of a surface, the backends derive what they draw it from */
+class CompositorSurface
+{
+public:
+    virtual ~CompositorSurface() {}
+    CompositorSurface(const std::string &name) :
+        _name(name), _position(PointA(0, 0), PointA(0, 0)), _strata(0), _alpha(1.0f), _sequence(0) {}
+
+    const std::string &name() {return _name;}
+
+    /* Size of the contents, input is scaled from the position to it */
+    virtual int width() = 0;
+    virtual int height() = 0;
+
+    const RectangleA &position() {return _position;}
+    int strata() {return _strata;}
+    float alpha() {return _alpha;}
+    void setPosition(int x1, int y1, int x2, int y2) {_position = RectangleA(PointA(x1, y1), PointA(x2, y2));}
+    void setStrata(int strata) {_strata = strata;}
+    void setAlpha(float alpha) {_alpha = alpha;}
+
+    /* Order of registration, breaks ties between surfaces of the same strata */
+    uint32_t sequence() {return _sequence;}
+    void setSequence(uint32_t sequence) {_sequence = sequence;}
+
+    /* Connection that registered the surface */
+    std::shared_ptr<SparkleConnection> owner() {return _owner.lock();}
+    void setOwner(std::shared_ptr<SparkleConnection> owner) {_owner = owner;}
+
+private:
+    std::string _name;
+    RectangleA _position;
+    int _strata;
+    float _alpha;
+    uint32_t _sequence;
+    std::weak_ptr<SparkleConnection> _owner;
+};
+
+/* What a compositor does with the surfaces the registry keeps track of */
+class SurfaceRegistryBackend
+{
+public:
+    virtual ~SurfaceRegistryBackend() {}
+
+    /* fd is -1 for surfaces whose pixels come in-band, their stride is the width. The size is already checked. */
+    virtual std::shared_ptr<CompositorSurface> createSurface(const std::string &name, int fd, int width, int height,
+        int stride, int format) = 0;
+
+    virtual void surfaceAdded(CompositorSurface *surface) = 0;
+    virtual void surfaceRemoved(CompositorSurface *surface) = 0;
+    /* The new position is set, previous is the one before. The backend may still adjust it. */
+    virtual void surfaceMoved(CompositorSurface *surface, const RectangleA &previous) = 0;
+    virtual void surfaceRestacked(CompositorSurface *surface) = 0;
+    virtual void surfaceAlphaChanged(CompositorSurface *surface) = 0;
+    virtual void surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2) = 0;
+    virtual void surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec,
+        const std::string &data) = 0;
+};
+
+/*
+ * The protocol and input half every compositor shares: the connections and the events they subscribed to, the
+ * surfaces in stacking order with the hit grid over them, and where input goes, to the surface under the point or the
+ * one grabbing it, keys to the one touched or clicked last. The backend is told of every change and only draws.
+ */
+class SurfaceRegistry
+{
+public:
+    SurfaceRegistry(SurfaceRegistryBackend *backend);
+
+    void connection(std::shared_ptr<SparkleConnection> client);
+    void disconnection(std::shared_ptr<SparkleConnection> client);
+    /* Surface and event mask requests, false for the ones the backend handles itself */
+    bool packet(std::shared_ptr<SparkleConnection> client, uint32_t operation, WereSocketUnixMessageStream &stream);
+
+    /* 0 when the size is not known, the clients that subscribed are told of changes */
+    void setDisplaySize(int width, int height, int scale);
+    int displayWidth() {return _displayWidth;}
+    int displayHeight() {return _displayHeight;}
+
+    /* Bottom up */
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces() {return _surfaces;}
+    std::shared_ptr<CompositorSurface> find(const std::string &name);
+    /* Surfaces of the compositor's own are left out of the hit grid when they take no input */
+    void add(std::shared_ptr<CompositorSurface> surface, bool input);
+    void remove(const std::string &name);
+
+    void pointerDown(int slot, int x, int y);
+    void pointerUp(int slot, int x, int y);
+    void pointerMotion(int slot, int x, int y);
+    void keyDown(int code);
+    void keyUp(int code);
+    void buttonPress(int button, int x, int y);
+    void buttonRelease(int button, int x, int y);
+    void cursorMotion(int x, int y);
+
+    /* Where motion of the slot goes, for backends that batch it */
+    CompositorSurface *pointerTarget(int slot, int x, int y, int *_x, int *_y);
+    const std::string &keyboardFocus() {return _keyboardFocus;}
+
+    std::vector< std::shared_ptr<SparkleConnection> > connections();
+    bool connected(std::shared_ptr<SparkleConnection> client);
+    uint32_t eventMask(std::shared_ptr<SparkleConnection> client);
+    /* Connections with EventMaskFrame, also read by a render thread */
+    int frameClients() {return _frameClients;}
+    /* Messages of the connection since the last call */
+    unsigned int takeMessages(std::shared_ptr<SparkleConnection> client);
+
+    template <typename T>
+    void sendEvent(uint32_t mask, const T &data);
+    /* To the connections subscribed to the surface, otherwise to its owner */
+    template <typename T>
+    void sendInput(CompositorSurface *surface, const T &data);
+
+private:
+    void registerSurface(std::shared_ptr<SparkleConnection> client, const std::string &name, int fd, int width,
+        int height, int stride, int format);
+    void setEventMask(std::shared_ptr<SparkleConnection> client, const std::string &surface, uint32_t mask);
+    void setPosition(const std::string &name, int x1, int y1, int x2, int y2);
+    void setStrata(const std::string &name, int strata);
+    void setAlpha(const std::string &name, float alpha);
+
+    CompositorSurface *inputTarget(const std::string &grab, int x, int y, int *_x, int *_y);
+    void transformCoordinates(int x, int y, CompositorSurface *surface, int *_x, int *_y);
+    void updateHitGrid(CompositorSurface *surface);
+    void sort();
+    static bool subscribed(const std::string &subscription, const std::string &name);
+    static bool sortFunction(std::shared_ptr<CompositorSurface> a1, std::shared_ptr<CompositorSurface> a2);
+
+private:
+    SurfaceRegistryBackend *_backend;
+
+    /* Events each connection subscribed to */
+    struct Client
+    {
+        uint32_t mask;
+        std::string surface;
+        unsigned int messages;
+    };
+    std::map<std::shared_ptr<SparkleConnection>, Client> _clients;
+    std::atomic<int> _frameClients;
+
+    std::vector< std::shared_ptr<CompositorSurface> > _surfaces;
+    uint32_t _sequence;
+    int _displayWidth;
+    int _displayHeight;
+    int _scale;
+
+    HitGrid _hitGrid;
+    std::map<int, std::string> _pointerGrabs;
+    std::string _buttonGrab;
+    unsigned int _buttons;
+    std::string _keyboardFocus;
+};
+
+template <typename T>
+void SurfaceRegistry::sendEvent(uint32_t mask, const T &data)
+{
+    for (auto it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        if (it->second.mask & mask)
+            it->first->send(data);
+    }
+}
+
+template <typename T>
+void SurfaceRegistry::sendInput(CompositorSurface *surface, const T &data)
+{
+    bool delivered = false;
+
+    for (auto it = _clients.begin(); it != _clients.end(); ++it)
+    {
+        if ((it->second.mask & EventMaskInput) && subscribed(it->second.surface, surface->name()))
+        {
+            it->first->send(data);
+            delivered = true;
+        }
+    }
+
+    if (delivered)
+        return;
+
+    auto owner = _clients.find(surface->owner());
+    if (owner != _clients.end() && (owner->second.mask & EventMaskInput))
+        owner->first->send(data);
+}
+
+/* ================================================================================================================== */
+
+#endif //SURFACE_REGISTRY_H
@@ -0,0 +1,172 @@
+#include "blitter.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* ================================================================================================================== */
+
+void Blitter::fill(uint32_t *dst, uint32_t value, int n)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i v = _mm_set1_epi32(value);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32x4_t v = vdupq_n_u32(value);
+    for (; i + 4 <= n; i += 4)
+        vst1q_u32(dst + i, v);
+#endif
+
+    for (; i < n; ++i)
+        dst[i] = value;
+}
+
+void Blitter::copy(uint32_t *dst, const uint32_t *src, int n)
+{
+    memcpy(dst, src, n * sizeof(uint32_t));
+}
+
+void Blitter::swapRB(uint32_t *dst, const uint32_t *src, int n)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+    const __m128i low = _mm_set1_epi32(0x000000FF);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+        v = _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        uint8x16_t t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), v);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        uint32_t v = src[i];
+        dst[i] = (v & 0xFF00FF00) | ((v >> 16) & 0xFF) | ((v & 0xFF) << 16);
+    }
+}
+
+void Blitter::blend(uint32_t *dst, const uint32_t *src, int n, int alpha)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16(alpha);
+    const __m128i ia = _mm_set1_epi16(256 - alpha);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), a),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), a),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia));
+
+        __m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), r);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x8_t a = vdup_n_u8(alpha);
+    const uint8x8_t ia = vdup_n_u8(256 - alpha);
+    for (; i + 4 <= n; i += 4)
+    {
+        uint8x16_t s = vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        uint8x16_t d = vld1q_u8(reinterpret_cast<const uint8_t *>(dst + i));
+
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(s), a), vget_low_u8(d), ia);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(s), a), vget_high_u8(d), ia);
+
+        vst1q_u8(reinterpret_cast<uint8_t *>(dst + i), vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        uint32_t s = src[i];
+        uint32_t d = dst[i];
+        uint32_t rb = ((s & 0x00FF00FF) * alpha + (d & 0x00FF00FF) * (256 - alpha)) >> 8;
+        uint32_t ga = ((s >> 8) & 0x00FF00FF) * alpha + ((d >> 8) & 0x00FF00FF) * (256 - alpha);
+        dst[i] = (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+    }
+}
+
+void Blitter::scale(uint32_t *dst, const uint32_t *src, int n, uint32_t x, uint32_t step)
+{
+    int i = 0;
+
+    /* Gathers, unrolled rather than vectorized */
+    for (; i + 4 <= n; i += 4)
+    {
+        dst[i + 0] = src[x >> 16];
+        dst[i + 1] = src[(x + step) >> 16];
+        dst[i + 2] = src[(x + 2 * step) >> 16];
+        dst[i + 3] = src[(x + 3 * step) >> 16];
+        x += 4 * step;
+    }
+
+    for (; i < n; ++i, x += step)
+        dst[i] = src[x >> 16];
+}
+
+static inline uint32_t lerp(uint32_t a, uint32_t b, uint32_t w)
+{
+    uint32_t rb = ((a & 0x00FF00FF) * (256 - w) + (b & 0x00FF00FF) * w) >> 8;
+    uint32_t ga = ((a >> 8) & 0x00FF00FF) * (256 - w) + ((b >> 8) & 0x00FF00FF) * w;
+    return (rb & 0x00FF00FF) | (ga & 0xFF00FF00);
+}
+
+void Blitter::scaleBilinear(uint32_t *dst, const uint32_t *row0, const uint32_t *row1, int width, int n, int32_t x,
+    int32_t step, int fy)
+{
+    for (int i = 0; i < n; ++i, x += step)
+    {
+        int x0 = 0;
+        uint32_t fx = 0;
+
+        if (x > 0)
+        {
+            x0 = x >> 16;
+            fx = (x >> 8) & 0xFF;
+        }
+
+        int x1 = x0 + 1 < width ? x0 + 1 : width - 1;
+
+        dst[i] = lerp(lerp(row0[x0], row0[x1], fx), lerp(row1[x0], row1[x1], fx), fy);
+    }
+}
+
+void Blitter::fromRGB565(uint32_t *dst, const uint16_t *src, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        uint32_t p = src[i];
+        uint32_t r = (p >> 11) & 0x1F;
+        uint32_t g = (p >> 5) & 0x3F;
+        uint32_t b = p & 0x1F;
+
+        dst[i] = 0xFF000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
+}
+
+/* ================================================================================================================== */
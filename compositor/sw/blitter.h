@@ -0,0 +1,35 @@
+#ifndef BLITTER_H
+#define BLITTER_H
+
+#include <cstdint>
+
+/* ================================================================================================================== */
+
+/*
+ * Row kernels of the software compositor. Pixels are 32 bit with the same channel order as the destination unless
+ * noted, alpha weights are 0 to 256.
+ */
+class Blitter
+{
+public:
+    static void fill(uint32_t *dst, uint32_t value, int n);
+    static void copy(uint32_t *dst, const uint32_t *src, int n);
+    /* Exchanges the red and blue channels, dst may be src */
+    static void swapRB(uint32_t *dst, const uint32_t *src, int n);
+    /* dst = (src * alpha + dst * (256 - alpha)) / 256, alpha 1 to 255 */
+    static void blend(uint32_t *dst, const uint32_t *src, int n, int alpha);
+    /* Nearest neighbour, x and step are 16.16 fixed point positions in src */
+    static void scale(uint32_t *dst, const uint32_t *src, int n, uint32_t x, uint32_t step);
+    /*
+     * Bilinear between rows row0 and row1 of width pixels, x and step are 16.16 fixed point (x may be negative at the
+     * left edge), fy is the weight of row1, 0 to 256
+     */
+    static void scaleBilinear(uint32_t *dst, const uint32_t *row0, const uint32_t *row1, int width, int n, int32_t x,
+        int32_t step, int fy);
+    /* RGB565 to XRGB8888 */
+    static void fromRGB565(uint32_t *dst, const uint16_t *src, int n);
+};
+
+/* ================================================================================================================== */
+
+#endif /* BLITTER_H */
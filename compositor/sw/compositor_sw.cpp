@@ -0,0 +1,1002 @@
+#include "compositor_sw.h"
+#include "blitter.h"
+#include "compositor/gl/region.h"
+#include "compositor/gl/frame_scheduler.h"
+#include "compositor/frame_capture.h"
+#include "compositor/scale_policy.h"
+#include "compositor/surface_registry.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/native_window.h>
+#else
+/* Not Xutil.h, its Region clashes with ours: images are destroyed through their own function table */
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#include "common/utility.h"
+#include "common/sparkle_surface_ashmem.h"
+#include "common/sparkle_server.h"
+#include "common/sparkle_protocol.h"
+#include "common/sparkle_connection.h"
+#include "common/sparkle_codec.h"
+
+/* ================================================================================================================== */
+
+/* Where the compositor draws, 32 bit pixels */
+class CompositorSWWindow
+{
+public:
+    virtual ~CompositorSWWindow() {}
+
+    /* The destination is RGBX rather than BGRX */
+    virtual bool swapRB() = 0;
+    /* The window may have been resized */
+    virtual void invalidate() {}
+    /* Pixels of the buffer to draw, damage grows by what the buffer needs on top of it. Stride is in pixels. */
+    virtual uint32_t *lock(Region *damage, int *width, int *height, int *stride) = 0;
+    virtual void post(const Region &damage) = 0;
+};
+
+/* ================================================================================================================== */
+
+#ifdef __ANDROID__
+
+class CompositorSWWindowAndroid : public CompositorSWWindow
+{
+public:
+    ~CompositorSWWindowAndroid();
+    CompositorSWWindowAndroid(ANativeWindow *window);
+
+    bool swapRB() {return true;}
+    uint32_t *lock(Region *damage, int *width, int *height, int *stride);
+    void post(const Region &damage);
+
+private:
+    ANativeWindow *_window;
+};
+
+CompositorSWWindowAndroid::~CompositorSWWindowAndroid()
+{
+    ANativeWindow_release(_window);
+}
+
+CompositorSWWindowAndroid::CompositorSWWindowAndroid(ANativeWindow *window)
+{
+    _window = window;
+    ANativeWindow_acquire(_window);
+
+    if (ANativeWindow_setBuffersGeometry(_window, 0, 0, WINDOW_FORMAT_RGBX_8888) != 0)
+        throw std::runtime_error("[CompositorSWWindowAndroid::CompositorSWWindowAndroid] Failed: ANativeWindow_setBuffersGeometry.");
+}
+
+uint32_t *CompositorSWWindowAndroid::lock(Region *damage, int *width, int *height, int *stride)
+{
+    RectangleA bounds = damage->bounds();
+    ARect rect = {bounds.from.x, bounds.from.y, bounds.to.x, bounds.to.y};
+    ANativeWindow_Buffer buffer;
+
+    if (ANativeWindow_lock(_window, &buffer, &rect) != 0)
+        return nullptr;
+
+    /* What the buffer misses from the frames it skipped */
+    damage->add(RectangleA(PointA(rect.left, rect.top), PointA(rect.right, rect.bottom)));
+
+    *width = buffer.width;
+    *height = buffer.height;
+    *stride = buffer.stride;
+
+    return reinterpret_cast<uint32_t *>(buffer.bits);
+}
+
+void CompositorSWWindowAndroid::post(const Region &)
+{
+    ANativeWindow_unlockAndPost(_window);
+}
+
+#else
+
+/* The image is shared with the server and persists, only the damage is drawn and put */
+class CompositorSWWindowX11 : public CompositorSWWindow
+{
+public:
+    ~CompositorSWWindowX11();
+    CompositorSWWindowX11(Display *display, Window window);
+
+    bool swapRB() {return _swapRB;}
+    void invalidate() {_invalid = true;}
+    uint32_t *lock(Region *damage, int *width, int *height, int *stride);
+    void post(const Region &damage);
+
+private:
+    void createImage(int width, int height);
+    void destroyImage();
+
+private:
+    Display *_display;
+    Window _window;
+    GC _gc;
+    Visual *_visual;
+    int _depth;
+    bool _swapRB;
+    bool _invalid;
+
+    XImage *_image;
+    XShmSegmentInfo _shm;
+};
+
+CompositorSWWindowX11::~CompositorSWWindowX11()
+{
+    destroyImage();
+    XFreeGC(_display, _gc);
+}
+
+CompositorSWWindowX11::CompositorSWWindowX11(Display *display, Window window)
+{
+    _display = display;
+    _window = window;
+    _image = nullptr;
+    _invalid = false;
+
+    if (!XShmQueryExtension(_display))
+        throw std::runtime_error("[CompositorSWWindowX11::CompositorSWWindowX11] MIT-SHM is not available.");
+
+    XWindowAttributes attributes;
+    if (!XGetWindowAttributes(_display, _window, &attributes))
+        throw std::runtime_error("[CompositorSWWindowX11::CompositorSWWindowX11] Failed: XGetWindowAttributes.");
+
+    _visual = attributes.visual;
+    _depth = attributes.depth;
+    _swapRB = (_visual->red_mask != 0xFF0000);
+    _gc = XCreateGC(_display, _window, 0, nullptr);
+
+    createImage(attributes.width, attributes.height);
+}
+
+void CompositorSWWindowX11::createImage(int width, int height)
+{
+    _image = XShmCreateImage(_display, _visual, _depth, ZPixmap, nullptr, &_shm, width, height);
+    if (_image == nullptr)
+        throw std::runtime_error("[CompositorSWWindowX11::createImage] Failed: XShmCreateImage.");
+
+    if (_image->bits_per_pixel != 32)
+    {
+        _image->f.destroy_image(_image);
+        _image = nullptr;
+        throw std::runtime_error("[CompositorSWWindowX11::createImage] Unsupported visual.");
+    }
+
+    _shm.shmid = shmget(IPC_PRIVATE, _image->bytes_per_line * _image->height, IPC_CREAT | 0600);
+    if (_shm.shmid == -1)
+        throw std::runtime_error("[CompositorSWWindowX11::createImage] Failed: shmget.");
+
+    _shm.shmaddr = _image->data = reinterpret_cast<char *>(shmat(_shm.shmid, nullptr, 0));
+    _shm.readOnly = False;
+
+    XShmAttach(_display, &_shm);
+    XSync(_display, False);
+    shmctl(_shm.shmid, IPC_RMID, nullptr);
+}
+
+void CompositorSWWindowX11::destroyImage()
+{
+    if (_image == nullptr)
+        return;
+
+    XShmDetach(_display, &_shm);
+    _image->data = nullptr;
+    _image->f.destroy_image(_image);
+    shmdt(_shm.shmaddr);
+    _image = nullptr;
+}
+
+uint32_t *CompositorSWWindowX11::lock(Region *damage, int *width, int *height, int *stride)
+{
+    if (_invalid)
+    {
+        _invalid = false;
+
+        XWindowAttributes attributes;
+        if (XGetWindowAttributes(_display, _window, &attributes) &&
+            (attributes.width != _image->width || attributes.height != _image->height))
+        {
+            destroyImage();
+            createImage(attributes.width, attributes.height);
+
+            /* A new image starts blank */
+            damage->add(RectangleA(PointA(0, 0), PointA(attributes.width, attributes.height)));
+        }
+    }
+
+    *width = _image->width;
+    *height = _image->height;
+    *stride = _image->bytes_per_line / 4;
+
+    return reinterpret_cast<uint32_t *>(_image->data);
+}
+
+void CompositorSWWindowX11::post(const Region &damage)
+{
+    const std::vector<RectangleA> &rectangles = damage.rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+    {
+        XShmPutImage(_display, _window, _gc, _image, it->from.x, it->from.y, it->from.x, it->from.y,
+            it->to.x - it->from.x, it->to.y - it->from.y, False);
+    }
+
+    /* The server reads the image until the requests are processed */
+    XSync(_display, False);
+}
+
+#endif
+
+/* ================================================================================================================== */
+
+/* Offscreen, for platforms without a window */
+class CompositorSWWindowMemory : public CompositorSWWindow
+{
+public:
+    CompositorSWWindowMemory(int width, int height) : _pixels(width * height, 0), _width(width), _height(height) {}
+
+    bool swapRB() {return false;}
+    uint32_t *lock(Region *damage, int *width, int *height, int *stride);
+    void post(const Region &) {}
+
+private:
+    std::vector<uint32_t> _pixels;
+    int _width;
+    int _height;
+};
+
+uint32_t *CompositorSWWindowMemory::lock(Region *, int *width, int *height, int *stride)
+{
+    *width = _width;
+    *height = _height;
+    *stride = _width;
+
+    return _pixels.data();
+}
+
+/* ================================================================================================================== */
+
+class CompositorSWSurfaceMemory : public WereSurface
+{
+public:
+    CompositorSWSurfaceMemory(int width, int height, int bytesPerPixel) :
+        _data(static_cast<size_t>(width) * height * bytesPerPixel, 0), _width(width), _height(height), _bytesPerPixel(bytesPerPixel) {}
+
+    unsigned char *data() {return _data.data();}
+    int width() {return _width;}
+    int height() {return _height;}
+    int stride() {return _width;}
+    int bytesPerPixel() {return _bytesPerPixel;}
+
+private:
+    std::vector<unsigned char> _data;
+    int _width;
+    int _height;
+    int _bytesPerPixel;
+};
+
+class CompositorSWSurface : public CompositorSurface
+{
+public:
+    ~CompositorSWSurface();
+    CompositorSWSurface(const std::string &name, WereSurface *surface, int format);
+
+    WereSurface *surface() {return _surface;}
+    int format() {return _format;}
+    int width() {return _surface->width();}
+    int height() {return _surface->height();}
+
+    /* Covers everything under its position */
+    bool opaque() {return _format != SurfaceFormatBGRA8888 && alpha() >= 1.0f;}
+
+    /* Screen rectangle of a rectangle of the surface, rounded outwards */
+    RectangleA screenRectangle(const RectangleA &local);
+
+    /* In-band data of stream surfaces */
+    bool decode(int x1, int y1, int x2, int y2, int codec, const std::string &data);
+
+private:
+    WereSurface *_surface;
+    int _format;
+};
+
+CompositorSWSurface::~CompositorSWSurface()
+{
+    delete _surface;
+}
+
+CompositorSWSurface::CompositorSWSurface(const std::string &name, WereSurface *surface, int format) :
+    CompositorSurface(name)
+{
+    _surface = surface;
+    _format = format;
+}
+
+RectangleA CompositorSWSurface::screenRectangle(const RectangleA &local)
+{
+    const RectangleA &position = this->position();
+    int tw = _surface->width();
+    int th = _surface->height();
+
+    if (tw == 0 || th == 0)
+        return position;
+
+    int pw = position.to.x - position.from.x;
+    int ph = position.to.y - position.from.y;
+
+    int x1 = position.from.x + local.from.x * pw / tw;
+    int y1 = position.from.y + local.from.y * ph / th;
+    int x2 = position.from.x + (local.to.x * pw + tw - 1) / tw;
+    int y2 = position.from.y + (local.to.y * ph + th - 1) / th;
+
+    /* Filtered pixels reach into their neighbours, up to one source pixel away */
+    if (pw > tw || ph > th)
+    {
+        int mx = (pw + tw - 1) / tw;
+        int my = (ph + th - 1) / th;
+
+        x1 = std::max(x1 - mx, position.from.x);
+        y1 = std::max(y1 - my, position.from.y);
+        x2 = std::min(x2 + mx, position.to.x);
+        y2 = std::min(y2 + my, position.to.y);
+    }
+
+    return RectangleA(PointA(x1, y1), PointA(x2, y2));
+}
+
+bool CompositorSWSurface::decode(int x1, int y1, int x2, int y2, int codec, const std::string &data)
+{
+    if (x1 < 0 || y1 < 0 || x2 > _surface->width() || y2 > _surface->height() || x1 >= x2 || y1 >= y2)
+        return false;
+
+    int bpp = _surface->bytesPerPixel();
+    int stride = _surface->stride() * bpp;
+
+    if (codec == SurfaceCodecRaw)
+        return SparkleCodec::decodeRaw(data, _surface->data(), stride, x1, y1, x2, y2, bpp);
+    else if (codec == SurfaceCodecDelta)
+        return SparkleCodec::decodeDelta(data, _surface->data(), stride, x1, y1, x2, y2, bpp);
+
+    return false;
+}
+
+/* ================================================================================================================== */
+
+/*
+ * Composites on the CPU straight into the window buffer, for devices whose GLES drivers upload slowly or lose the
+ * context on pause. Everything runs on the protocol thread, only the damage is drawn.
+ */
+class CompositorSW : public Compositor, public SurfaceRegistryBackend
+{
+public:
+    ~CompositorSW();
+    CompositorSW(WereEventLoop *loop, Platform *platform, const std::string &file);
+
+    int displayWidth();
+    int displayHeight();
+
+private:
+    void initializeForNativeDisplay(NativeDisplayType nativeDisplay);
+    void finishForNativeDisplay();
+    void initializeForNativeWindow(NativeWindowType window);
+    void finishForNativeWindow();
+    void initializeForOffscreen(int width, int height);
+
+    void draw();
+    void vsync(uint64_t time);
+    void dumpFrame(const std::string &path);
+
+    void connection(std::shared_ptr <SparkleConnection> client);
+    void disconnection(std::shared_ptr <SparkleConnection> client);
+    void packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message);
+    void startCapture(std::shared_ptr<SparkleConnection> client, int slots, uint32_t flags);
+    void stopCapture(std::shared_ptr<SparkleConnection> client);
+
+    std::shared_ptr<CompositorSurface> createSurface(const std::string &name, int fd, int width, int height,
+        int stride, int format);
+    void surfaceAdded(CompositorSurface *surface);
+    void surfaceRemoved(CompositorSurface *surface);
+    void surfaceMoved(CompositorSurface *surface, const RectangleA &previous);
+    void surfaceRestacked(CompositorSurface *surface);
+    void surfaceAlphaChanged(CompositorSurface *surface);
+    void surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2);
+    void surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec, const std::string &data);
+
+    void damageScreen(const RectangleA &rectangle);
+    void setWindow(CompositorSWWindow *window);
+    void displaySizeChanged(int width, int height);
+
+    void render();
+    void drawRectangle(uint32_t *pixels, int stride, const RectangleA &clip);
+    void drawSurface(uint32_t *pixels, int stride, const RectangleA &clip, CompositorSWSurface *surface);
+    const uint32_t *sourceRow(WereSurface *source, int y, bool rgb565, std::vector<uint32_t> *buffer);
+    void writeDump(const uint32_t *pixels, int stride);
+    void capture(const uint32_t *pixels, int stride, const Region &damage);
+
+private:
+    WereEventLoop *_loop;
+    Platform *_platform;
+    SparkleServer *_server;
+    SurfaceRegistry *_registry;
+    uint32_t _frames;
+
+    void *_nativeDisplay;
+    CompositorSWWindow *_window;
+    int _displayWidth;
+    int _displayHeight;
+    FrameScheduler *_scheduler;
+    Region _damage;
+    std::string _dumpPath;
+
+    std::shared_ptr<SparkleConnection> _captureClient;
+    FrameCapture *_capture;
+    int _captureSlots;
+    bool _captureDrop;
+
+    std::vector<uint32_t> _row;
+    std::vector<uint32_t> _source;
+    std::vector<uint32_t> _source1;
+
+    int _scale;
+    ScalePolicy _scalePolicy;
+};
+
+/* ================================================================================================================== */
+
+CompositorSW::~CompositorSW()
+{
+    delete _server;
+    delete _registry;
+    delete _capture;
+    delete _window;
+    delete _scheduler;
+}
+
+CompositorSW::CompositorSW(WereEventLoop *loop, Platform *platform, const std::string &file)
+{
+    _loop = loop;
+    _platform = platform;
+
+    _registry = new SurfaceRegistry(this);
+    _frames = 0;
+
+    _nativeDisplay = nullptr;
+    _window = nullptr;
+    _displayWidth = 0;
+    _displayHeight = 0;
+
+    _capture = nullptr;
+    _captureSlots = 0;
+    _captureDrop = false;
+
+    _scale = _scalePolicy.scale();
+
+    _scheduler = new FrameScheduler(_loop, FrameScheduler::Latency);
+    _scheduler->frame.connect(std::bind(&CompositorSW::render, this));
+
+    _platform->initializeForNativeDisplay.connect(WereSimpleQueuer(loop, &CompositorSW::initializeForNativeDisplay, this));
+    _platform->initializeForNativeWindow.connect(WereSimpleQueuer(loop, &CompositorSW::initializeForNativeWindow, this));
+    _platform->finishForNativeDisplay.connect(WereSimpleQueuer(loop, &CompositorSW::finishForNativeDisplay, this));
+    _platform->finishForNativeWindow.connect(WereSimpleQueuer(loop, &CompositorSW::finishForNativeWindow, this));
+    _platform->initializeForOffscreen.connect(WereSimpleQueuer(loop, &CompositorSW::initializeForOffscreen, this));
+
+    _platform->draw.connect(WereSimpleQueuer(loop, &CompositorSW::draw, this));
+    _platform->vsync.connect(WereSimpleQueuer(loop, &CompositorSW::vsync, this));
+    _platform->dumpFrame.connect(WereSimpleQueuer(loop, &CompositorSW::dumpFrame, this));
+
+    _platform->pointerDown.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerDown, _registry));
+    _platform->pointerUp.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerUp, _registry));
+    _platform->pointerMotion.connect(WereSimpleQueuer(loop, &SurfaceRegistry::pointerMotion, _registry));
+    _platform->keyDown.connect(WereSimpleQueuer(loop, &SurfaceRegistry::keyDown, _registry));
+    _platform->keyUp.connect(WereSimpleQueuer(loop, &SurfaceRegistry::keyUp, _registry));
+    _platform->buttonPress.connect(WereSimpleQueuer(loop, &SurfaceRegistry::buttonPress, _registry));
+    _platform->buttonRelease.connect(WereSimpleQueuer(loop, &SurfaceRegistry::buttonRelease, _registry));
+    _platform->cursorMotion.connect(WereSimpleQueuer(loop, &SurfaceRegistry::cursorMotion, _registry));
+
+    _server = new SparkleServer(_loop, file);
+
+    _server->signal_connected.connect(WereSimpleQueuer(loop, &CompositorSW::connection, this));
+    _server->signal_disconnected.connect(WereSimpleQueuer(loop, &CompositorSW::disconnection, this));
+    _server->signal_packet.connect(WereSimpleQueuer(loop, &CompositorSW::packet, this));
+
+    were_message("Software compositor.\n");
+}
+
+int CompositorSW::displayWidth()
+{
+    return _displayWidth;
+}
+
+int CompositorSW::displayHeight()
+{
+    return _displayHeight;
+}
+
+/* ================================================================================================================== */
+
+void CompositorSW::initializeForNativeDisplay(NativeDisplayType nativeDisplay)
+{
+    _nativeDisplay = reinterpret_cast<void *>(nativeDisplay);
+}
+
+void CompositorSW::finishForNativeDisplay()
+{
+    _nativeDisplay = nullptr;
+}
+
+void CompositorSW::initializeForNativeWindow(NativeWindowType window)
+{
+    try
+    {
+#ifdef __ANDROID__
+        setWindow(new CompositorSWWindowAndroid(window));
+#else
+        setWindow(new CompositorSWWindowX11(reinterpret_cast<Display *>(_nativeDisplay), static_cast<Window>(window)));
+#endif
+    }
+    catch (const std::exception &e)
+    {
+        were_error("%s\n", e.what());
+    }
+}
+
+void CompositorSW::finishForNativeWindow()
+{
+    setWindow(nullptr);
+}
+
+void CompositorSW::initializeForOffscreen(int width, int height)
+{
+    setWindow(new CompositorSWWindowMemory(width, height));
+}
+
+void CompositorSW::setWindow(CompositorSWWindow *window)
+{
+    delete _window;
+    _window = window;
+
+    /* The size is learned when the first frame locks the buffer */
+    if (_window != nullptr)
+        damageScreen(RectangleA(PointA(0, 0), PointA(INT16_MAX, INT16_MAX)));
+    else
+        displaySizeChanged(0, 0);
+}
+
+void CompositorSW::draw()
+{
+    if (_window == nullptr)
+        return;
+
+    _window->invalidate();
+    damageScreen(RectangleA(PointA(0, 0), PointA(_displayWidth, _displayHeight)));
+}
+
+void CompositorSW::vsync(uint64_t time)
+{
+    _scheduler->vsync(time);
+}
+
+void CompositorSW::dumpFrame(const std::string &path)
+{
+    _dumpPath = path;
+    damageScreen(RectangleA(PointA(0, 0), PointA(_displayWidth, _displayHeight)));
+}
+
+void CompositorSW::damageScreen(const RectangleA &rectangle)
+{
+    _damage.add(rectangle);
+    _scheduler->request();
+}
+
+void CompositorSW::displaySizeChanged(int width, int height)
+{
+    _displayWidth = width;
+    _displayHeight = height;
+    _registry->setDisplaySize(width, height, _scale);
+}
+
+/* ================================================================================================================== */
+
+void CompositorSW::render()
+{
+    if (_window == nullptr || _damage.empty())
+        return;
+
+    _scheduler->begin();
+    uint64_t begin = WereTimer::now();
+
+    Region damage = _damage;
+    int width;
+    int height;
+    int stride;
+
+    uint32_t *pixels = _window->lock(&damage, &width, &height, &stride);
+    if (pixels == nullptr)
+        return;
+
+    if (width != _displayWidth || height != _displayHeight)
+    {
+        displaySizeChanged(width, height);
+        damage.add(RectangleA(PointA(0, 0), PointA(width, height)));
+    }
+
+    damage.clip(width, height);
+
+    const std::vector<RectangleA> &rectangles = damage.rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+        drawRectangle(pixels, stride, *it);
+
+    _scheduler->submitted();
+
+    if (_scalePolicy.frame(0, WereTimer::now() - begin, _scheduler->period()))
+    {
+        _scale = _scalePolicy.scale();
+        _registry->setDisplaySize(_displayWidth, _displayHeight, _scale);
+    }
+
+    if (!_dumpPath.empty())
+        writeDump(pixels, stride);
+
+    if (_captureSlots > 0)
+        capture(pixels, stride, damage);
+
+    _window->post(damage);
+
+    _scheduler->presented();
+    _damage.clear();
+
+    frame();
+    _registry->sendEvent(EventMaskFrame, FrameNotification({_frames++}));
+}
+
+void CompositorSW::drawRectangle(uint32_t *pixels, int stride, const RectangleA &clip)
+{
+    const std::vector< std::shared_ptr<CompositorSurface> > &surfaces = _registry->surfaces();
+
+    /* Drawing starts at the topmost opaque surface covering the whole rectangle, black when there is none */
+    int first = -1;
+    for (int i = surfaces.size() - 1; i >= 0 && first == -1; --i)
+    {
+        CompositorSWSurface *surface = static_cast<CompositorSWSurface *>(surfaces[i].get());
+        if (surface->opaque() && Region::covered(clip, std::vector<RectangleA>(1, surface->position())))
+            first = i;
+    }
+
+    if (first == -1)
+    {
+        int n = clip.to.x - clip.from.x;
+        for (int y = clip.from.y; y < clip.to.y; ++y)
+            Blitter::fill(&pixels[y * stride + clip.from.x], 0, n);
+
+        first = 0;
+    }
+
+    for (unsigned int i = first; i < surfaces.size(); ++i)
+        drawSurface(pixels, stride, clip, static_cast<CompositorSWSurface *>(surfaces[i].get()));
+}
+
+void CompositorSW::drawSurface(uint32_t *pixels, int stride, const RectangleA &clip, CompositorSWSurface *surface)
+{
+    if (!Region::intersects(clip, surface->position()))
+        return;
+
+    RectangleA area = Region::intersection(clip, surface->position());
+    int alpha = static_cast<int>(std::min(surface->alpha(), 1.0f) * 256.0f);
+    if (alpha <= 0)
+        return;
+
+    WereSurface *source = surface->surface();
+    const RectangleA &position = surface->position();
+    int sw = source->width();
+    int sh = source->height();
+    int pw = position.to.x - position.from.x;
+    int ph = position.to.y - position.from.y;
+    int n = area.to.x - area.from.x;
+    if (sw <= 0 || sh <= 0 || pw <= 0 || ph <= 0 || n <= 0)
+        return;
+
+    bool scaled = (sw != pw);
+    /* Upscaled surfaces (a scaled down X framebuffer) are filtered, downscaling stays nearest neighbour */
+    bool filtered = (pw > sw || ph > sh);
+    bool rgb565 = (surface->format() == SurfaceFormatRGB565);
+    uint32_t step = (static_cast<uint64_t>(sw) << 16) / pw;
+    uint32_t x = (area.from.x - position.from.x) * step;
+    int sx = (area.from.x - position.from.x) * sw / pw;
+    int32_t fx = ((2 * static_cast<int64_t>(area.from.x - position.from.x) + 1) * sw << 16) / (2 * pw) - 0x8000;
+
+    if (_row.size() < static_cast<size_t>(n))
+        _row.resize(n);
+    if (rgb565 && _source.size() < static_cast<size_t>(sw))
+        _source.resize(sw);
+    if (rgb565 && filtered && _source1.size() < static_cast<size_t>(sw))
+        _source1.resize(sw);
+
+    for (int y = area.from.y; y < area.to.y; ++y)
+    {
+        int sy = static_cast<int64_t>(y - position.from.y) * sh / ph;
+        const unsigned char *line = &source->data()[sy * source->stride() * source->bytesPerPixel()];
+        const uint32_t *row;
+
+        if (filtered)
+        {
+            int64_t fy = ((2 * static_cast<int64_t>(y - position.from.y) + 1) * sh << 16) / (2 * ph) - 0x8000;
+            int y0 = fy > 0 ? static_cast<int>(fy >> 16) : 0;
+            int y1 = std::min(y0 + 1, sh - 1);
+            int weight = fy > 0 ? static_cast<int>((fy >> 8) & 0xFF) : 0;
+
+            Blitter::scaleBilinear(_row.data(), sourceRow(source, y0, rgb565, &_source),
+                sourceRow(source, y1, rgb565, &_source1), sw, n, fx, step, weight);
+            row = _row.data();
+        }
+        else if (rgb565 && !scaled)
+        {
+            Blitter::fromRGB565(_row.data(), reinterpret_cast<const uint16_t *>(line) + sx, n);
+            row = _row.data();
+        }
+        else if (rgb565)
+        {
+            Blitter::fromRGB565(_source.data(), reinterpret_cast<const uint16_t *>(line), sw);
+            Blitter::scale(_row.data(), _source.data(), n, x, step);
+            row = _row.data();
+        }
+        else if (scaled)
+        {
+            Blitter::scale(_row.data(), reinterpret_cast<const uint32_t *>(line), n, x, step);
+            row = _row.data();
+        }
+        else
+            row = reinterpret_cast<const uint32_t *>(line) + sx;
+
+        if (_window->swapRB())
+        {
+            Blitter::swapRB(_row.data(), row, n);
+            row = _row.data();
+        }
+
+        uint32_t *target = &pixels[y * stride + area.from.x];
+
+        if (alpha >= 256)
+            Blitter::copy(target, row, n);
+        else
+            Blitter::blend(target, row, n, alpha);
+    }
+}
+
+const uint32_t *CompositorSW::sourceRow(WereSurface *source, int y, bool rgb565, std::vector<uint32_t> *buffer)
+{
+    const unsigned char *line = &source->data()[y * source->stride() * source->bytesPerPixel()];
+
+    if (!rgb565)
+        return reinterpret_cast<const uint32_t *>(line);
+
+    Blitter::fromRGB565(buffer->data(), reinterpret_cast<const uint16_t *>(line), source->width());
+    return buffer->data();
+}
+
+/* Binary PPM, top row first */
+void CompositorSW::writeDump(const uint32_t *pixels, int stride)
+{
+    FILE *file = fopen(_dumpPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        were_error("Failed to write frame to %s.\n", _dumpPath.c_str());
+        _dumpPath.clear();
+        return;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", _displayWidth, _displayHeight);
+
+    bool rgbx = _window->swapRB();
+    std::vector<unsigned char> row(_displayWidth * 3);
+    for (int y = 0; y < _displayHeight; ++y)
+    {
+        for (int x = 0; x < _displayWidth; ++x)
+        {
+            uint32_t p = pixels[y * stride + x];
+            unsigned char c0 = (p >> 16) & 0xFF;
+            unsigned char c2 = p & 0xFF;
+            row[x * 3 + 0] = rgbx ? c2 : c0;
+            row[x * 3 + 1] = (p >> 8) & 0xFF;
+            row[x * 3 + 2] = rgbx ? c0 : c2;
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    fclose(file);
+
+    were_message("Frame written to %s.\n", _dumpPath.c_str());
+    _dumpPath.clear();
+}
+
+/* A direct copy of the damage, the window buffer holds the whole frame when a new ring needs it */
+void CompositorSW::capture(const uint32_t *pixels, int stride, const Region &damage)
+{
+    Region region = damage;
+
+    if (_capture == nullptr || _capture->width() != _displayWidth || _capture->height() != _displayHeight)
+    {
+        delete _capture;
+        _capture = nullptr;
+
+        try
+        {
+            _capture = new FrameCapture(_displayWidth, _displayHeight, _captureSlots, _captureDrop);
+        }
+        catch (const std::exception &e)
+        {
+            were_error("%s\n", e.what());
+            _captureSlots = 0;
+            return;
+        }
+
+        _captureClient->send(CaptureStartedNotification({_capture->ring()->fd(), _displayWidth, _displayHeight,
+            static_cast<uint32_t>(_captureSlots)}));
+
+        region.clear();
+        region.add(RectangleA(PointA(0, 0), PointA(_displayWidth, _displayHeight)));
+    }
+
+    uint32_t *frame = _capture->frame();
+    const std::vector<RectangleA> &rectangles = region.rectangles();
+    for (auto it = rectangles.begin(); it != rectangles.end(); ++it)
+    {
+        int n = it->to.x - it->from.x;
+        for (int y = it->from.y; y < it->to.y; ++y)
+        {
+            if (_window->swapRB())
+                Blitter::swapRB(&frame[y * _displayWidth + it->from.x], &pixels[y * stride + it->from.x], n);
+            else
+                Blitter::copy(&frame[y * _displayWidth + it->from.x], &pixels[y * stride + it->from.x], n);
+        }
+    }
+
+    int slot = _capture->publish(region, WereTimer::now());
+    if (slot != -1)
+        _captureClient->send(CaptureFrameNotification({static_cast<uint32_t>(slot), _capture->sequence() - 1}));
+}
+
+/* ================================================================================================================== */
+
+void CompositorSW::connection(std::shared_ptr <SparkleConnection> client)
+{
+    _registry->connection(client);
+}
+
+void CompositorSW::disconnection(std::shared_ptr <SparkleConnection> client)
+{
+    stopCapture(client);
+    _registry->disconnection(client);
+}
+
+void CompositorSW::startCapture(std::shared_ptr<SparkleConnection> client, int slots, uint32_t flags)
+{
+    if (client->stream())
+    {
+        were_message("Capture needs a local connection.\n");
+        return;
+    }
+
+    delete _capture;
+    _capture = nullptr;
+
+    _captureClient = client;
+    _captureSlots = std::min(std::max(slots, 1), 16);
+    _captureDrop = (flags & CaptureDropFrames) != 0;
+
+    damageScreen(RectangleA(PointA(0, 0), PointA(_displayWidth, _displayHeight)));
+}
+
+void CompositorSW::stopCapture(std::shared_ptr<SparkleConnection> client)
+{
+    if (_captureClient == nullptr || _captureClient != client)
+        return;
+
+    delete _capture;
+    _capture = nullptr;
+
+    _captureClient.reset();
+    _captureSlots = 0;
+}
+
+void CompositorSW::packet(std::shared_ptr<SparkleConnection> client, std::shared_ptr<WereSocketUnixMessage> message)
+{
+    uint32_t operation;
+
+    WereSocketUnixMessageStream stream(message.get());
+    stream >> operation;
+
+    if (_registry->packet(client, operation, stream))
+        return;
+
+    if (operation == StartCaptureRequestCode)
+    {
+        StartCaptureRequest r1;
+        stream >> r1;
+        startCapture(client, r1.slots, r1.flags);
+    }
+    else if (operation == StopCaptureRequestCode)
+        stopCapture(client);
+}
+
+std::shared_ptr<CompositorSurface> CompositorSW::createSurface(const std::string &name, int fd, int width, int height,
+    int stride, int format)
+{
+    if (fd == -1)
+        return std::make_shared<CompositorSWSurface>(name,
+            new CompositorSWSurfaceMemory(width, height, surfaceFormatBytesPerPixel(format)), format);
+
+    return std::make_shared<CompositorSWSurface>(name,
+        new SparkleSurfaceAshmem(fd, width, height, stride, surfaceFormatBytesPerPixel(format)), format);
+}
+
+void CompositorSW::surfaceAdded(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+}
+
+void CompositorSW::surfaceRemoved(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+}
+
+void CompositorSW::surfaceMoved(CompositorSurface *surface, const RectangleA &previous)
+{
+    damageScreen(previous);
+    damageScreen(surface->position());
+}
+
+void CompositorSW::surfaceRestacked(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+}
+
+void CompositorSW::surfaceAlphaChanged(CompositorSurface *surface)
+{
+    damageScreen(surface->position());
+}
+
+void CompositorSW::surfaceDamaged(CompositorSurface *surface, int x1, int y1, int x2, int y2)
+{
+    damageScreen(static_cast<CompositorSWSurface *>(surface)->screenRectangle(RectangleA(PointA(x1, y1),
+        PointA(x2, y2))));
+}
+
+void CompositorSW::surfaceData(CompositorSurface *surface, int x1, int y1, int x2, int y2, int codec,
+    const std::string &data)
+{
+    CompositorSWSurface *stream = static_cast<CompositorSWSurface *>(surface);
+    if (dynamic_cast<CompositorSWSurfaceMemory *>(stream->surface()) == nullptr)
+        return;
+
+    if (!stream->decode(x1, y1, x2, y2, codec, data))
+        were_message("Surface [%s]: malformed data (%d %d %d %d, codec %d).\n", surface->name().c_str(), x1, y1, x2,
+            y2, codec);
+
+    damageScreen(stream->screenRectangle(RectangleA(PointA(x1, y1), PointA(x2, y2))));
+}
+
+/* ================================================================================================================== */
+
+Compositor *compositor_sw_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file)
+{
+    return new CompositorSW(loop, platform, file);
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,11 @@
+#ifndef COMPOSITOR_SW_H
+#define COMPOSITOR_SW_H
+
+#include "compositor/compositor.h"
+#include "were/were_event_loop.h"
+#include "platform/platform.h"
+
+Compositor *compositor_sw_create(WereEventLoop *loop, Platform *platform,
+    const std::string &file);
+
+#endif //COMPOSITOR_SW_H
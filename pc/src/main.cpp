@@ -1,8 +1,50 @@
 #include "were/were_event_loop.h"
 #include "were/were_signal_handler.h"
 #include "platform/x11/platform_x11.h"
-#include "compositor/gl/compositor_gl.h"
+#include "platform/headless/platform_headless.h"
+#ifdef SPARKLE_WAYLAND
+#include "platform/wayland/platform_wayland.h"
+#endif
+#include "compositor/compositor_backend.h"
 #include "common/were_benchmark.h"
+#include <cstdlib>
+#include <cstdio>
+
+/*
+ * SPARKLE_PLATFORM=headless, configured by SPARKLE_HEADLESS_SIZE (WxH), _REFRESH (Hz) and _SCRIPT (file).
+ * SPARKLE_PLATFORM=wayland shows the surfaces as subsurfaces, SPARKLE_COMPOSITOR=gl composes them with EGL. Only
+ * when configured with Wayland.
+ */
+static Platform *create_platform(WereEventLoop *loop)
+{
+    const char *name = getenv("SPARKLE_PLATFORM");
+#ifdef SPARKLE_WAYLAND
+    if (name != nullptr && std::string(name) == "wayland")
+    {
+        std::string compositor = compositor_option("compositor");
+        return platform_wayland_create(loop, compositor.empty() || compositor == "passthrough");
+    }
+#endif
+
+    if (name == nullptr || std::string(name) != "headless")
+        return platform_x11_create(loop);
+
+    int width = 1280;
+    int height = 720;
+    int refresh = 60;
+
+    const char *size = getenv("SPARKLE_HEADLESS_SIZE");
+    if (size != nullptr)
+        sscanf(size, "%dx%d", &width, &height);
+
+    const char *rate = getenv("SPARKLE_HEADLESS_REFRESH");
+    if (rate != nullptr)
+        refresh = atoi(rate);
+
+    const char *script = getenv("SPARKLE_HEADLESS_SCRIPT");
+
+    return platform_headless_create(loop, width, height, refresh, script != nullptr ? script : "");
+}
 
 int main(int argc, char *argv[])
 {
@@ -10,8 +52,12 @@ int main(int argc, char *argv[])
     WereSignalHandler *sig = new WereSignalHandler(loop);
     sig->terminate.connect(WereSimpleQueuer(loop, &WereEventLoop::exit, loop));
 
-    Platform *platform = platform_x11_create(loop);
-    Compositor *compositor = compositor_gl_create(loop, platform, "/tmp/sparkle.socket");
+    /* A "tcp:host:port" address accepts remote clients, "tcp::port" only local ones. There is no
+     * authentication, so give a host other than loopback only on a trusted network */
+    std::string address = (argc > 1) ? argv[1] : "/tmp/sparkle.socket";
+
+    Platform *platform = create_platform(loop);
+    Compositor *compositor = compositor_create(loop, platform, address);
 
     WereBenchmark *test = new WereBenchmark(loop);
     compositor->frame.connect(WereSimpleQueuer(loop, &WereBenchmark::event, test));
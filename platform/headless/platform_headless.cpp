@@ -0,0 +1,209 @@
+#include "platform_headless.h"
+#include "were/were_timer.h"
+#include "were/were_signal.h"
+#include <stdexcept>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+
+/* ================================================================================================================== */
+
+struct PlatformHeadlessCommand
+{
+    uint64_t time;
+    std::string name;
+    std::vector<int> arguments;
+    std::string path;
+};
+
+class PlatformHeadless : public Platform
+{
+public:
+    ~PlatformHeadless();
+    PlatformHeadless(WereEventLoop *loop, int width, int height, int refresh, const std::string &script);
+    int start();
+    int stop();
+
+private:
+    void loadScript(const std::string &script);
+    void tick();
+    void runScript();
+    void execute(const PlatformHeadlessCommand &command);
+
+private:
+    WereEventLoop *_loop;
+    int _width;
+    int _height;
+    uint64_t _period;
+
+    WereTimer *_vsyncTimer;
+    uint64_t _vsync;
+
+    WereTimer *_scriptTimer;
+    std::vector<PlatformHeadlessCommand> _script;
+    unsigned int _next;
+    uint64_t _start;
+};
+
+PlatformHeadless::~PlatformHeadless()
+{
+    delete _scriptTimer;
+    delete _vsyncTimer;
+}
+
+PlatformHeadless::PlatformHeadless(WereEventLoop *loop, int width, int height, int refresh, const std::string &script)
+{
+    _loop = loop;
+    _width = width;
+    _height = height;
+    _period = 1000000000ULL / (refresh > 0 ? refresh : 60);
+
+    _vsyncTimer = new WereTimer(_loop);
+    _vsyncTimer->timeout.connect(WereSimpleQueuer(loop, &PlatformHeadless::tick, this));
+    _vsync = 0;
+
+    _scriptTimer = new WereTimer(_loop);
+    _scriptTimer->timeout.connect(WereSimpleQueuer(loop, &PlatformHeadless::runScript, this));
+    _next = 0;
+    _start = 0;
+
+    if (!script.empty())
+        loadScript(script);
+
+    /* Mesa needs no display server for pbuffers on this platform */
+    setenv("EGL_PLATFORM", "surfaceless", 0);
+}
+
+int PlatformHeadless::start()
+{
+    initializeForNativeDisplay(EGL_DEFAULT_DISPLAY);
+    initializeForOffscreen(_width, _height);
+
+    _start = WereTimer::now();
+
+    _vsync = _start + _period;
+    _vsyncTimer->startAt(_vsync);
+
+    _next = 0;
+    if (!_script.empty())
+        _scriptTimer->startAt(_start + _script[0].time);
+
+    were_message("Headless %dx%d at %.2f Hz, %d scripted commands.\n", _width, _height, 1e9 / _period,
+        static_cast<int>(_script.size()));
+
+    return 0;
+}
+
+int PlatformHeadless::stop()
+{
+    _scriptTimer->stop();
+    _vsyncTimer->stop();
+
+    finishForNativeWindow();
+    finishForNativeDisplay();
+
+    return 0;
+}
+
+void PlatformHeadless::loadScript(const std::string &script)
+{
+    std::ifstream file(script);
+    if (!file.is_open())
+        throw std::runtime_error("[PlatformHeadless::loadScript] Failed to open script.");
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream stream(line);
+        PlatformHeadlessCommand command;
+        double time;
+
+        if (!(stream >> time >> command.name))
+            continue;
+
+        command.time = static_cast<uint64_t>(time * 1000000.0);
+
+        if (command.name == "dump")
+            stream >> command.path;
+        else
+        {
+            int argument;
+            while (stream >> argument)
+                command.arguments.push_back(argument);
+        }
+
+        _script.push_back(command);
+    }
+}
+
+/* The next vsync is computed from the previous one, late timeouts do not shift the phase */
+void PlatformHeadless::tick()
+{
+    uint64_t now = WereTimer::now();
+
+    while (_vsync + _period <= now)
+        _vsync += _period;
+
+    vsync(_vsync);
+
+    _vsync += _period;
+    _vsyncTimer->startAt(_vsync);
+}
+
+void PlatformHeadless::runScript()
+{
+    uint64_t now = WereTimer::now();
+
+    while (_next < _script.size() && _start + _script[_next].time <= now)
+    {
+        execute(_script[_next]);
+        _next += 1;
+    }
+
+    if (_next < _script.size())
+        _scriptTimer->startAt(_start + _script[_next].time);
+}
+
+void PlatformHeadless::execute(const PlatformHeadlessCommand &command)
+{
+    const std::vector<int> &a = command.arguments;
+
+    if (command.name == "down" && a.size() == 3)
+        pointerDown(a[0], a[1], a[2]);
+    else if (command.name == "up" && a.size() == 3)
+        pointerUp(a[0], a[1], a[2]);
+    else if (command.name == "motion" && a.size() == 3)
+        pointerMotion(a[0], a[1], a[2]);
+    else if (command.name == "press" && a.size() == 3)
+        buttonPress(a[0], a[1], a[2]);
+    else if (command.name == "release" && a.size() == 3)
+        buttonRelease(a[0], a[1], a[2]);
+    else if (command.name == "cursor" && a.size() == 2)
+        cursorMotion(a[0], a[1]);
+    else if (command.name == "keydown" && a.size() == 1)
+        keyDown(a[0]);
+    else if (command.name == "keyup" && a.size() == 1)
+        keyUp(a[0]);
+    else if (command.name == "dump" && !command.path.empty())
+        dumpFrame(command.path);
+    else if (command.name == "trim" && a.size() == 1)
+        trimMemory(a[0]);
+    else if (command.name == "quit")
+        _loop->exit();
+    else
+        were_message("Headless: unknown command \"%s\".\n", command.name.c_str());
+}
+
+/* ================================================================================================================== */
+
+Platform *platform_headless_create(WereEventLoop *loop, int width, int height, int refresh, const std::string &script)
+{
+    return new PlatformHeadless(loop, width, height, refresh, script);
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,24 @@
+#ifndef PLATFORM_HEADLESS_H
+#define PLATFORM_HEADLESS_H
+
+#include "platform/platform.h"
+#include "were/were_event_loop.h"
+#include <string>
+
+/*
+ * No display and no window, the compositor draws into a pbuffer of the given size. Vsync is simulated at the given
+ * refresh rate. The optional script injects input and takes frame dumps, one command per line:
+ *
+ *     <time ms> down|up|motion <slot> <x> <y>
+ *     <time ms> press|release <button> <x> <y>
+ *     <time ms> cursor <x> <y>
+ *     <time ms> keydown|keyup <code>
+ *     <time ms> dump <path>
+ *     <time ms> trim <level>
+ *     <time ms> quit
+ *
+ * Times are from the start, lines starting with # are comments.
+ */
+Platform *platform_headless_create(WereEventLoop *loop, int width, int height, int refresh, const std::string &script);
+
+#endif //PLATFORM_HEADLESS_H
@@ -1,6 +1,6 @@
 #include "platform_jni.h"
 #include "were/were_timer.h"
-#include "compositor/gl/compositor_gl.h"
+#include "compositor/compositor_backend.h"
 #include <stdexcept>
 #include <android/window.h>
 #include <android/native_window_jni.h>
@@ -32,8 +32,6 @@ public:
     int start() override;
     int stop() override;
 
-    bool _draw;
-
 private:
     void timeout();
 
@@ -52,7 +50,7 @@ PlatformJNI::~PlatformJNI()
 }
 
 PlatformJNI::PlatformJNI(WereEventLoop *loop, JNIEnv* env, jobject instance):
-_draw(false), env(env), instance(instance), _loop(loop)
+env(env), instance(instance), _loop(loop)
 {
 	cls = env->GetObjectClass(instance);
 	if (!cls) {
@@ -90,8 +88,6 @@ int PlatformJNI::stop()
 void PlatformJNI::timeout()
 {
 	env->CallVoidMethod(instance, processRunnablesID);
-    if (_draw)
-        draw();
 }
 
 //==================================================================================================
@@ -106,7 +102,7 @@ static void run(JNIEnv *env, jobject instance)
     {
         WereEventLoop *loop = new WereEventLoop();
         Platform *platform = new PlatformJNI(loop, env, instance);
-        Compositor *compositor = compositor_gl_create(loop, platform, "/data/data/com.termux/files/usr/tmp/sparkle.socket");
+        Compositor *compositor = compositor_create(loop, platform, "/data/data/com.termux/files/usr/tmp/sparkle.socket");
 
         platform->start();
         loop->run();
@@ -133,7 +129,6 @@ static void onNativeWindowCreated(JNIEnv *env, jobject instance, jlong jplatform
 	ANativeWindow* surface = ANativeWindow_fromSurface(env, jsurface);
     platform->initializeForNativeDisplay(EGL_DEFAULT_DISPLAY);
     platform->initializeForNativeWindow(surface);
-    platform->_draw = true;
 	
 }
 
@@ -144,7 +139,6 @@ static void onNativeWindowDestroyed(JNIEnv *env, jobject instance, jlong jplatfo
 		return;
 	}
 	
-    platform->_draw = false;
     platform->finishForNativeWindow();
     platform->finishForNativeDisplay();
 }
@@ -161,7 +155,8 @@ static void onWindowFocusChanged(JNIEnv *env, jobject instance, jlong jplatform,
 		return;
 	}
 	
-	platform->_draw = (hasFocus == JNI_TRUE) ? true : false;
+	if (hasFocus == JNI_TRUE)
+		platform->draw();
 }
 
 static void cursorMotion(JNIEnv *env, jobject instance, jlong jplatform, jint x, jint y) {
@@ -197,6 +192,17 @@ static void buttonRelease(JNIEnv *env, jobject instance, jlong jplatform, jint b
 	platform->buttonRelease(button, x, y);
 }
 
+static void onTrimMemory(JNIEnv *env, jobject instance, jlong jplatform, jint level) {
+	auto *platform = reinterpret_cast<PlatformJNI *>(jplatform);
+	if (platform == nullptr) {
+		LOGE("platform is null");
+		return;
+	}
+	
+	LOGI("Trim memory: %d", level);
+	platform->trimMemory(level);
+}
+
 //==================================================================================================
 
 static const char *className = "com/termux/app/SparkleActivity$SparkleThread";
@@ -206,6 +212,7 @@ static JNINativeMethod methods[] = {
   {"nativeOnSurfaceChanged", "(JLandroid/view/Surface;III)V", (void*)onNativeWindowChanged },
   {"nativeOnSurfaceDestroyed", "(JLandroid/view/Surface;)V", (void*)onNativeWindowDestroyed },
   {"nativeOnWindowFocusChanged", "(JZ)V", (void*)onWindowFocusChanged },
+  {"nativeOnTrimMemory", "(JI)V", (void*)onTrimMemory },
   
   {"nativeCursorMotion", "(JII)V", (void*)cursorMotion },
   {"nativeButtonPress", "(JIII)V", (void*)buttonPress },
@@ -4,6 +4,10 @@
 #include "were/were_function.h"
 #include "were/were_signal.h"
 #include <EGL/egl.h>
+#include <cstdint>
+#include <string>
+
+class PlatformPassthrough;
 
 class Platform
 {
@@ -11,14 +15,25 @@ public:
     virtual ~Platform() {}
     virtual int start() = 0;
     virtual int stop() = 0;
+    /* Optional, platforms that show client buffers themselves instead of a window to draw into */
+    virtual PlatformPassthrough *passthrough() {return nullptr;}
 
     WereFunction<int ()> getVID;
     WereSignal<void (NativeDisplayType)> initializeForNativeDisplay;
     WereSignal<void ()> finishForNativeDisplay;
     WereSignal<void (NativeWindowType)> initializeForNativeWindow;
     WereSignal<void ()> finishForNativeWindow;
+    /* Platforms without a window: the compositor draws offscreen, finishForNativeWindow ends it */
+    WereSignal<void (int, int)> initializeForOffscreen;
 
+    /* The window was exposed or resized and needs to be drawn again */
     WereSignal<void ()> draw;
+    /* Optional, platforms with a display vsync source report each vsync (monotonic clock, nanoseconds) */
+    WereSignal<void (uint64_t)> vsync;
+    /* Write the next frame to a file */
+    WereSignal<void (const std::string &)> dumpFrame;
+    /* Memory pressure, Android onTrimMemory() levels */
+    WereSignal<void (int)> trimMemory;
 
     WereSignal<void (int, int, int)> pointerDown;
     WereSignal<void (int, int, int)> pointerUp;
@@ -0,0 +1,39 @@
+#ifndef PLATFORM_PASSTHROUGH_H
+#define PLATFORM_PASSTHROUGH_H
+
+#include "were/were_signal.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * Client surfaces shown by the host without a copy: the platform hands the shared memory of each surface to the host
+ * compositor as a buffer of its own. Surfaces are known by the number add() returned, the changes show together at
+ * commit().
+ */
+class PlatformPassthrough
+{
+public:
+    virtual ~PlatformPassthrough() {}
+
+    /* SurfaceFormat* of the protocol the host can show */
+    virtual bool supported(int format) = 0;
+    /* Stride in pixels. The fd stays with the caller, -1 when the host does not take the memory */
+    virtual int add(int fd, int width, int height, int stride, int format) = 0;
+    virtual void remove(int id) = 0;
+    /* Window coordinates, the buffer is not scaled */
+    virtual void setPosition(int id, int x, int y) = 0;
+    virtual void setVisible(int id, bool visible) = 0;
+    /* Bottom to top */
+    virtual void setStacking(const std::vector<int> &ids) = 0;
+    /* Buffer coordinates */
+    virtual void damage(int id, int x1, int y1, int x2, int y2) = 0;
+    /* Held back until the host drew the previous commit */
+    virtual void commit() = 0;
+
+    /* Size of the window, 0 x 0 while there is none */
+    WereSignal<void (int, int)> resized;
+    /* The host drew the last commit (monotonic clock, nanoseconds) */
+    WereSignal<void (uint64_t)> presented;
+};
+
+#endif /* PLATFORM_PASSTHROUGH_H */
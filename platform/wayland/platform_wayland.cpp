@@ -0,0 +1,1017 @@
+#include "platform_wayland.h"
+#include "platform/platform_passthrough.h"
+#include "were/were_event_source.h"
+#include "were/were_signal.h"
+#include "were/were_timer.h"
+#include "common/sparkle_protocol.h"
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/input-event-codes.h>
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include "xdg-shell-client-protocol.h"
+
+/* ================================================================================================================== */
+
+const int w_width = 800;
+const int w_height = 600;
+const char *w_title = "Sparkle";
+
+/* damage_buffer */
+const uint32_t COMPOSITOR_VERSION = 4;
+
+/* Axis distance of one wheel step */
+const int SCROLL_STEP = 10;
+
+/* ================================================================================================================== */
+
+static int create_region(const char *name, size_t size)
+{
+    int fd = syscall(__NR_memfd_create, name, 0);
+    if (fd == -1)
+        return -1;
+
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* ================================================================================================================== */
+
+/* The connection to the Wayland compositor, readable when events arrive */
+class PlatformWaylandConnection : public WereEventSource
+{
+public:
+    ~PlatformWaylandConnection();
+    PlatformWaylandConnection(WereEventLoop *loop, int fd);
+
+    WereSignal<void ()> readable;
+
+private:
+    void event(uint32_t events);
+};
+
+PlatformWaylandConnection::~PlatformWaylandConnection()
+{
+    _loop->unregisterEventSource(this);
+}
+
+PlatformWaylandConnection::PlatformWaylandConnection(WereEventLoop *loop, int fd) :
+    WereEventSource(loop)
+{
+    _fd = fd;
+    _loop->registerEventSource(this, EPOLLIN);
+}
+
+void PlatformWaylandConnection::event(uint32_t events)
+{
+    if (events & EPOLLIN)
+        readable();
+    else
+        throw WereException("[%p][%s] Unknown event type.", this, __PRETTY_FUNCTION__);
+}
+
+/* ================================================================================================================== */
+
+/*
+ * Each surface is a subsurface of the window with a wl_shm buffer on the client's own memory. The same buffer is
+ * attached again on every commit that damages it, the host reads what the client drew last. ARGB8888 is premultiplied
+ * for the host, BGRA8888 surfaces with partial alpha blend differently than with GL.
+ */
+class PlatformWaylandPassthrough : public PlatformPassthrough
+{
+public:
+    ~PlatformWaylandPassthrough();
+    PlatformWaylandPassthrough(wl_display *display, wl_compositor *compositor, uint32_t compositorVersion,
+        wl_subcompositor *subcompositor, wl_shm *shm, const std::vector<uint32_t> &formats, wl_surface *parent);
+
+    bool supported(int format);
+    int add(int fd, int width, int height, int stride, int format);
+    void remove(int id);
+    void setPosition(int id, int x, int y);
+    void setVisible(int id, bool visible);
+    void setStacking(const std::vector<int> &ids);
+    void damage(int id, int x1, int y1, int x2, int y2);
+    void commit();
+
+    /* The window was configured, it gets a black background of its size */
+    void resize(int width, int height);
+
+private:
+    bool shmFormat(int format, uint32_t *shmFormat);
+    void flush();
+
+    static void frameDone(void *data, wl_callback *callback, uint32_t time);
+    static const wl_callback_listener _frameListener;
+
+private:
+    struct Surface
+    {
+        wl_surface *surface;
+        wl_subsurface *subsurface;
+        wl_buffer *buffer;
+        int width;
+        int height;
+        bool visible;
+        bool dirty;
+    };
+
+    wl_display *_display;
+    wl_compositor *_compositor;
+    uint32_t _compositorVersion;
+    wl_subcompositor *_subcompositor;
+    wl_shm *_shm;
+    std::vector<uint32_t> _formats;
+    wl_surface *_parent;
+
+    std::map<int, Surface> _surfaces;
+    int _next;
+
+    wl_buffer *_background;
+    std::vector<wl_buffer *> _retired;
+    int _width;
+    int _height;
+
+    wl_callback *_frame;
+    bool _pending;
+};
+
+const wl_callback_listener PlatformWaylandPassthrough::_frameListener =
+{
+    PlatformWaylandPassthrough::frameDone,
+};
+
+PlatformWaylandPassthrough::~PlatformWaylandPassthrough()
+{
+    for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
+    {
+        wl_subsurface_destroy(it->second.subsurface);
+        wl_surface_destroy(it->second.surface);
+        wl_buffer_destroy(it->second.buffer);
+    }
+
+    for (auto it = _retired.begin(); it != _retired.end(); ++it)
+        wl_buffer_destroy(*it);
+
+    if (_background != nullptr)
+        wl_buffer_destroy(_background);
+
+    if (_frame != nullptr)
+        wl_callback_destroy(_frame);
+}
+
+PlatformWaylandPassthrough::PlatformWaylandPassthrough(wl_display *display, wl_compositor *compositor,
+    uint32_t compositorVersion, wl_subcompositor *subcompositor, wl_shm *shm, const std::vector<uint32_t> &formats,
+    wl_surface *parent)
+{
+    _display = display;
+    _compositor = compositor;
+    _compositorVersion = compositorVersion;
+    _subcompositor = subcompositor;
+    _shm = shm;
+    _formats = formats;
+    _parent = parent;
+
+    _next = 0;
+
+    _background = nullptr;
+    _width = 0;
+    _height = 0;
+
+    _frame = nullptr;
+    _pending = false;
+}
+
+/* ARGB8888 and XRGB8888 are always there, anything else only when announced */
+bool PlatformWaylandPassthrough::shmFormat(int format, uint32_t *shmFormat)
+{
+    if (format == SurfaceFormatBGRA8888)
+        *shmFormat = WL_SHM_FORMAT_ARGB8888;
+    else if (format == SurfaceFormatXRGB8888)
+        *shmFormat = WL_SHM_FORMAT_XRGB8888;
+    else if (format == SurfaceFormatRGB565 &&
+        std::find(_formats.begin(), _formats.end(), WL_SHM_FORMAT_RGB565) != _formats.end())
+        *shmFormat = WL_SHM_FORMAT_RGB565;
+    else
+        return false;
+
+    return true;
+}
+
+bool PlatformWaylandPassthrough::supported(int format)
+{
+    uint32_t shmFormat;
+    return this->shmFormat(format, &shmFormat);
+}
+
+int PlatformWaylandPassthrough::add(int fd, int width, int height, int stride, int format)
+{
+    uint32_t wlFormat;
+    if (!shmFormat(format, &wlFormat) || width <= 0 || height <= 0 || stride < width)
+        return -1;
+
+    int bpp = surfaceFormatBytesPerPixel(format);
+
+    /* The buffer keeps the memory, the pool is not needed after */
+    wl_shm_pool *pool = wl_shm_create_pool(_shm, fd, stride * height * bpp);
+    wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride * bpp, wlFormat);
+    wl_shm_pool_destroy(pool);
+
+    Surface surface;
+    surface.surface = wl_compositor_create_surface(_compositor);
+    surface.subsurface = wl_subcompositor_get_subsurface(_subcompositor, surface.surface, _parent);
+    surface.buffer = buffer;
+    surface.width = width;
+    surface.height = height;
+    surface.visible = true;
+    surface.dirty = true;
+
+    /* Input goes to the window and is routed by the compositor */
+    wl_region *region = wl_compositor_create_region(_compositor);
+    wl_surface_set_input_region(surface.surface, region);
+    wl_region_destroy(region);
+
+    int id = _next++;
+    _surfaces[id] = surface;
+
+    damage(id, 0, 0, width, height);
+
+    return id;
+}
+
+void PlatformWaylandPassthrough::remove(int id)
+{
+    auto it = _surfaces.find(id);
+    if (it == _surfaces.end())
+        return;
+
+    wl_subsurface_destroy(it->second.subsurface);
+    wl_surface_destroy(it->second.surface);
+    wl_buffer_destroy(it->second.buffer);
+    _surfaces.erase(it);
+}
+
+void PlatformWaylandPassthrough::setPosition(int id, int x, int y)
+{
+    auto it = _surfaces.find(id);
+    if (it != _surfaces.end())
+        wl_subsurface_set_position(it->second.subsurface, x, y);
+}
+
+void PlatformWaylandPassthrough::setVisible(int id, bool visible)
+{
+    auto it = _surfaces.find(id);
+    if (it == _surfaces.end() || it->second.visible == visible)
+        return;
+
+    it->second.visible = visible;
+    damage(id, 0, 0, it->second.width, it->second.height);
+}
+
+void PlatformWaylandPassthrough::setStacking(const std::vector<int> &ids)
+{
+    wl_surface *below = _parent;
+
+    for (auto it = ids.begin(); it != ids.end(); ++it)
+    {
+        auto surface = _surfaces.find(*it);
+        if (surface == _surfaces.end())
+            continue;
+
+        wl_subsurface_place_above(surface->second.subsurface, below);
+        below = surface->second.surface;
+    }
+}
+
+void PlatformWaylandPassthrough::damage(int id, int x1, int y1, int x2, int y2)
+{
+    auto it = _surfaces.find(id);
+    if (it == _surfaces.end())
+        return;
+
+    /* The buffer is not scaled, surface and buffer coordinates are the same */
+    if (_compositorVersion >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+        wl_surface_damage_buffer(it->second.surface, x1, y1, x2 - x1, y2 - y1);
+    else
+        wl_surface_damage(it->second.surface, x1, y1, x2 - x1, y2 - y1);
+
+    it->second.dirty = true;
+}
+
+void PlatformWaylandPassthrough::commit()
+{
+    if (_frame != nullptr)
+    {
+        _pending = true;
+        return;
+    }
+
+    flush();
+}
+
+/* Subsurfaces are synchronized, everything shows with the commit of the window */
+void PlatformWaylandPassthrough::flush()
+{
+    _pending = false;
+
+    for (auto it = _surfaces.begin(); it != _surfaces.end(); ++it)
+    {
+        Surface &surface = it->second;
+        if (!surface.dirty)
+            continue;
+
+        wl_surface_attach(surface.surface, surface.visible ? surface.buffer : nullptr, 0, 0);
+        wl_surface_commit(surface.surface);
+        surface.dirty = false;
+    }
+
+    _frame = wl_surface_frame(_parent);
+    wl_callback_add_listener(_frame, &_frameListener, this);
+    wl_surface_commit(_parent);
+
+    wl_display_flush(_display);
+}
+
+void PlatformWaylandPassthrough::frameDone(void *data, wl_callback *callback, uint32_t)
+{
+    PlatformWaylandPassthrough *passthrough = static_cast<PlatformWaylandPassthrough *>(data);
+
+    wl_callback_destroy(callback);
+    passthrough->_frame = nullptr;
+
+    /* The host has drawn the commit that replaced them */
+    for (auto it = passthrough->_retired.begin(); it != passthrough->_retired.end(); ++it)
+        wl_buffer_destroy(*it);
+    passthrough->_retired.clear();
+
+    passthrough->presented(WereTimer::now());
+
+    if (passthrough->_pending)
+        passthrough->flush();
+}
+
+void PlatformWaylandPassthrough::resize(int width, int height)
+{
+    if (width != _width || height != _height)
+    {
+        int fd = create_region("sparkle-background", width * height * 4);
+        if (fd == -1)
+            throw std::runtime_error("[PlatformWaylandPassthrough::resize] Failed to create the background.");
+
+        /* Zeroes, black */
+        wl_shm_pool *pool = wl_shm_create_pool(_shm, fd, width * height * 4);
+        wl_buffer *background = wl_shm_pool_create_buffer(pool, 0, width, height, width * 4, WL_SHM_FORMAT_XRGB8888);
+        wl_shm_pool_destroy(pool);
+        close(fd);
+
+        if (_background != nullptr)
+            _retired.push_back(_background);
+        _background = background;
+
+        wl_surface_attach(_parent, _background, 0, 0);
+        if (_compositorVersion >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+            wl_surface_damage_buffer(_parent, 0, 0, width, height);
+        else
+            wl_surface_damage(_parent, 0, 0, width, height);
+
+        _width = width;
+        _height = height;
+        resized(width, height);
+    }
+
+    /* The configure is acknowledged with the next commit of the window */
+    commit();
+}
+
+/* ================================================================================================================== */
+
+class PlatformWayland : public Platform
+{
+public:
+    ~PlatformWayland();
+    PlatformWayland(WereEventLoop *loop, bool passthrough);
+    int start();
+    int stop();
+    PlatformPassthrough *passthrough() {return _passthrough;}
+
+private:
+    int processEvents();
+    void configured();
+    void scroll(int *accumulated, int value, int negative, int positive);
+
+    static void registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface,
+        uint32_t version);
+    static void registryGlobalRemove(void *data, wl_registry *registry, uint32_t name);
+    static void shmFormat(void *data, wl_shm *shm, uint32_t format);
+    static void wmBasePing(void *data, xdg_wm_base *wmBase, uint32_t serial);
+    static void xdgSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial);
+    static void toplevelConfigure(void *data, xdg_toplevel *toplevel, int32_t width, int32_t height,
+        wl_array *states);
+    static void toplevelClose(void *data, xdg_toplevel *toplevel);
+    static void seatCapabilities(void *data, wl_seat *seat, uint32_t capabilities);
+    static void pointerEnter(void *data, wl_pointer *pointer, uint32_t serial, wl_surface *surface, wl_fixed_t x,
+        wl_fixed_t y);
+    static void pointerLeave(void *data, wl_pointer *pointer, uint32_t serial, wl_surface *surface);
+    static void pointerMoved(void *data, wl_pointer *pointer, uint32_t time, wl_fixed_t x, wl_fixed_t y);
+    static void pointerButton(void *data, wl_pointer *pointer, uint32_t serial, uint32_t time, uint32_t button,
+        uint32_t state);
+    static void pointerAxis(void *data, wl_pointer *pointer, uint32_t time, uint32_t axis, wl_fixed_t value);
+    static void keyboardKeymap(void *data, wl_keyboard *keyboard, uint32_t format, int32_t fd, uint32_t size);
+    static void keyboardEnter(void *data, wl_keyboard *keyboard, uint32_t serial, wl_surface *surface,
+        wl_array *keys);
+    static void keyboardLeave(void *data, wl_keyboard *keyboard, uint32_t serial, wl_surface *surface);
+    static void keyboardKey(void *data, wl_keyboard *keyboard, uint32_t serial, uint32_t time, uint32_t key,
+        uint32_t state);
+    static void keyboardModifiers(void *data, wl_keyboard *keyboard, uint32_t serial, uint32_t depressed,
+        uint32_t latched, uint32_t locked, uint32_t group);
+    static void touchDown(void *data, wl_touch *touch, uint32_t serial, uint32_t time, wl_surface *surface,
+        int32_t id, wl_fixed_t x, wl_fixed_t y);
+    static void touchUp(void *data, wl_touch *touch, uint32_t serial, uint32_t time, int32_t id);
+    static void touchMotion(void *data, wl_touch *touch, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y);
+    static void touchFrame(void *data, wl_touch *touch);
+    static void touchCancel(void *data, wl_touch *touch);
+
+    static const wl_registry_listener _registryListener;
+    static const wl_shm_listener _shmListener;
+    static const xdg_wm_base_listener _wmBaseListener;
+    static const xdg_surface_listener _xdgSurfaceListener;
+    static const xdg_toplevel_listener _toplevelListener;
+    static const wl_seat_listener _seatListener;
+    static const wl_pointer_listener _pointerListener;
+    static const wl_keyboard_listener _keyboardListener;
+    static const wl_touch_listener _touchListener;
+
+private:
+    WereEventLoop *_loop;
+    PlatformWaylandConnection *_connection;
+
+    wl_display *_display;
+    wl_registry *_registry;
+    wl_compositor *_compositor;
+    uint32_t _compositorVersion;
+    wl_subcompositor *_subcompositor;
+    wl_shm *_shm;
+    std::vector<uint32_t> _formats;
+    xdg_wm_base *_wmBase;
+    wl_seat *_seat;
+    wl_pointer *_pointer;
+    wl_keyboard *_keyboard;
+    wl_touch *_touch;
+
+    wl_surface *_surface;
+    xdg_surface *_xdgSurface;
+    xdg_toplevel *_toplevel;
+    wl_egl_window *_egl;
+    PlatformWaylandPassthrough *_passthrough;
+
+    int _width;
+    int _height;
+    int _configureWidth;
+    int _configureHeight;
+
+    int _pointerX;
+    int _pointerY;
+    int _scrollV;
+    int _scrollH;
+    std::map<int, std::pair<int, int> > _touches;
+};
+
+const wl_registry_listener PlatformWayland::_registryListener =
+{
+    PlatformWayland::registryGlobal,
+    PlatformWayland::registryGlobalRemove,
+};
+
+const wl_shm_listener PlatformWayland::_shmListener =
+{
+    PlatformWayland::shmFormat,
+};
+
+const xdg_wm_base_listener PlatformWayland::_wmBaseListener =
+{
+    PlatformWayland::wmBasePing,
+};
+
+const xdg_surface_listener PlatformWayland::_xdgSurfaceListener =
+{
+    PlatformWayland::xdgSurfaceConfigure,
+};
+
+/* Later versions of these interfaces add events, left null: they are bound at a version without them */
+const xdg_toplevel_listener PlatformWayland::_toplevelListener = []()
+{
+    xdg_toplevel_listener listener = {};
+    listener.configure = PlatformWayland::toplevelConfigure;
+    listener.close = PlatformWayland::toplevelClose;
+    return listener;
+}();
+
+const wl_seat_listener PlatformWayland::_seatListener = []()
+{
+    wl_seat_listener listener = {};
+    listener.capabilities = PlatformWayland::seatCapabilities;
+    return listener;
+}();
+
+const wl_pointer_listener PlatformWayland::_pointerListener = []()
+{
+    wl_pointer_listener listener = {};
+    listener.enter = PlatformWayland::pointerEnter;
+    listener.leave = PlatformWayland::pointerLeave;
+    listener.motion = PlatformWayland::pointerMoved;
+    listener.button = PlatformWayland::pointerButton;
+    listener.axis = PlatformWayland::pointerAxis;
+    return listener;
+}();
+
+const wl_keyboard_listener PlatformWayland::_keyboardListener = []()
+{
+    wl_keyboard_listener listener = {};
+    listener.keymap = PlatformWayland::keyboardKeymap;
+    listener.enter = PlatformWayland::keyboardEnter;
+    listener.leave = PlatformWayland::keyboardLeave;
+    listener.key = PlatformWayland::keyboardKey;
+    listener.modifiers = PlatformWayland::keyboardModifiers;
+    return listener;
+}();
+
+const wl_touch_listener PlatformWayland::_touchListener = []()
+{
+    wl_touch_listener listener = {};
+    listener.down = PlatformWayland::touchDown;
+    listener.up = PlatformWayland::touchUp;
+    listener.motion = PlatformWayland::touchMotion;
+    listener.frame = PlatformWayland::touchFrame;
+    listener.cancel = PlatformWayland::touchCancel;
+    return listener;
+}();
+
+PlatformWayland::~PlatformWayland()
+{
+    delete _connection;
+    delete _passthrough;
+
+    if (_egl != nullptr)
+        wl_egl_window_destroy(_egl);
+    if (_toplevel != nullptr)
+        xdg_toplevel_destroy(_toplevel);
+    if (_xdgSurface != nullptr)
+        xdg_surface_destroy(_xdgSurface);
+    if (_surface != nullptr)
+        wl_surface_destroy(_surface);
+
+    if (_pointer != nullptr)
+        wl_pointer_destroy(_pointer);
+    if (_keyboard != nullptr)
+        wl_keyboard_destroy(_keyboard);
+    if (_touch != nullptr)
+        wl_touch_destroy(_touch);
+    if (_seat != nullptr)
+        wl_seat_destroy(_seat);
+    if (_wmBase != nullptr)
+        xdg_wm_base_destroy(_wmBase);
+    if (_shm != nullptr)
+        wl_shm_destroy(_shm);
+    if (_subcompositor != nullptr)
+        wl_subcompositor_destroy(_subcompositor);
+    if (_compositor != nullptr)
+        wl_compositor_destroy(_compositor);
+    if (_registry != nullptr)
+        wl_registry_destroy(_registry);
+
+    if (_display != nullptr)
+        wl_display_disconnect(_display);
+}
+
+/* Connects right away, the compositor is chosen by what the host has */
+PlatformWayland::PlatformWayland(WereEventLoop *loop, bool passthrough)
+{
+    _loop = loop;
+    _connection = nullptr;
+
+    _registry = nullptr;
+    _compositor = nullptr;
+    _compositorVersion = 0;
+    _subcompositor = nullptr;
+    _shm = nullptr;
+    _wmBase = nullptr;
+    _seat = nullptr;
+    _pointer = nullptr;
+    _keyboard = nullptr;
+    _touch = nullptr;
+
+    _surface = nullptr;
+    _xdgSurface = nullptr;
+    _toplevel = nullptr;
+    _egl = nullptr;
+    _passthrough = nullptr;
+
+    _width = 0;
+    _height = 0;
+    _configureWidth = 0;
+    _configureHeight = 0;
+
+    _pointerX = 0;
+    _pointerY = 0;
+    _scrollV = 0;
+    _scrollH = 0;
+
+    _display = wl_display_connect(nullptr);
+    if (_display == nullptr)
+        throw std::runtime_error("[PlatformWayland::PlatformWayland] Failed to connect to the display.");
+
+    _registry = wl_display_get_registry(_display);
+    wl_registry_add_listener(_registry, &_registryListener, this);
+
+    /* Globals, then their first events: shm formats and seat capabilities */
+    wl_display_roundtrip(_display);
+    wl_display_roundtrip(_display);
+
+    if (_compositor == nullptr || _wmBase == nullptr)
+        throw std::runtime_error("[PlatformWayland::PlatformWayland] No wl_compositor or xdg_wm_base.");
+
+    _surface = wl_compositor_create_surface(_compositor);
+
+    if (passthrough)
+    {
+        if (_subcompositor != nullptr && _shm != nullptr)
+            _passthrough = new PlatformWaylandPassthrough(_display, _compositor, _compositorVersion, _subcompositor,
+                _shm, _formats, _surface);
+        else
+            were_message("No wl_subcompositor, composing with EGL.\n");
+    }
+}
+
+int PlatformWayland::start()
+{
+    if (_passthrough == nullptr)
+        initializeForNativeDisplay(reinterpret_cast<NativeDisplayType>(_display));
+
+    _xdgSurface = xdg_wm_base_get_xdg_surface(_wmBase, _surface);
+    xdg_surface_add_listener(_xdgSurface, &_xdgSurfaceListener, this);
+
+    _toplevel = xdg_surface_get_toplevel(_xdgSurface);
+    xdg_toplevel_add_listener(_toplevel, &_toplevelListener, this);
+    xdg_toplevel_set_title(_toplevel, w_title);
+
+    /* Without a buffer, asks for the first configure */
+    wl_surface_commit(_surface);
+
+    _connection = new PlatformWaylandConnection(_loop, wl_display_get_fd(_display));
+    _connection->readable.connect(std::bind(&PlatformWayland::processEvents, this));
+
+    wl_display_flush(_display);
+
+    return 0;
+}
+
+int PlatformWayland::stop()
+{
+    delete _connection;
+    _connection = nullptr;
+
+    if (_passthrough == nullptr)
+    {
+        finishForNativeWindow();
+        finishForNativeDisplay();
+    }
+
+    return 0;
+}
+
+/* EGL reads the same connection from the render thread, reads are prepared so that neither loses events */
+int PlatformWayland::processEvents()
+{
+    while (wl_display_prepare_read(_display) != 0)
+        wl_display_dispatch_pending(_display);
+
+    wl_display_flush(_display);
+
+    if (wl_display_read_events(_display) == -1 || wl_display_dispatch_pending(_display) == -1)
+    {
+        were_error("Lost the connection to the Wayland display.\n");
+        _loop->exit();
+        return -1;
+    }
+
+    wl_display_flush(_display);
+
+    return 0;
+}
+
+void PlatformWayland::configured()
+{
+    int width = _configureWidth > 0 ? _configureWidth : (_width > 0 ? _width : w_width);
+    int height = _configureHeight > 0 ? _configureHeight : (_height > 0 ? _height : w_height);
+    bool changed = (width != _width || height != _height);
+
+    _width = width;
+    _height = height;
+
+    if (_passthrough != nullptr)
+        _passthrough->resize(width, height);
+    else if (_egl == nullptr)
+    {
+        _egl = wl_egl_window_create(_surface, width, height);
+        if (_egl == nullptr)
+            throw std::runtime_error("[PlatformWayland::configured] Failed: wl_egl_window_create.");
+
+        initializeForNativeWindow(reinterpret_cast<NativeWindowType>(_egl));
+    }
+    else
+    {
+        /* Takes effect with the next swap, which also acknowledges the configure */
+        if (changed)
+            wl_egl_window_resize(_egl, width, height, 0, 0);
+        draw();
+    }
+}
+
+/* Smooth scrolling adds up to wheel steps */
+void PlatformWayland::scroll(int *accumulated, int value, int negative, int positive)
+{
+    *accumulated += value;
+
+    while (*accumulated >= SCROLL_STEP || *accumulated <= -SCROLL_STEP)
+    {
+        int button = (*accumulated > 0) ? positive : negative;
+        *accumulated += (*accumulated > 0) ? -SCROLL_STEP : SCROLL_STEP;
+
+        buttonPress(button, _pointerX, _pointerY);
+        buttonRelease(button, _pointerX, _pointerY);
+    }
+}
+
+/* ================================================================================================================== */
+
+void PlatformWayland::registryGlobal(void *data, wl_registry *registry, uint32_t name, const char *interface,
+    uint32_t version)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0)
+    {
+        platform->_compositorVersion = std::min(version, COMPOSITOR_VERSION);
+        platform->_compositor = static_cast<wl_compositor *>(wl_registry_bind(registry, name,
+            &wl_compositor_interface, platform->_compositorVersion));
+    }
+    else if (strcmp(interface, wl_subcompositor_interface.name) == 0)
+        platform->_subcompositor = static_cast<wl_subcompositor *>(wl_registry_bind(registry, name,
+            &wl_subcompositor_interface, 1));
+    else if (strcmp(interface, wl_shm_interface.name) == 0)
+    {
+        platform->_shm = static_cast<wl_shm *>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+        wl_shm_add_listener(platform->_shm, &_shmListener, platform);
+    }
+    else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
+    {
+        platform->_wmBase = static_cast<xdg_wm_base *>(wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+        xdg_wm_base_add_listener(platform->_wmBase, &_wmBaseListener, platform);
+    }
+    else if (strcmp(interface, wl_seat_interface.name) == 0 && platform->_seat == nullptr)
+    {
+        platform->_seat = static_cast<wl_seat *>(wl_registry_bind(registry, name, &wl_seat_interface, 1));
+        wl_seat_add_listener(platform->_seat, &_seatListener, platform);
+    }
+}
+
+void PlatformWayland::registryGlobalRemove(void *, wl_registry *, uint32_t)
+{
+}
+
+void PlatformWayland::shmFormat(void *data, wl_shm *, uint32_t format)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+    platform->_formats.push_back(format);
+}
+
+void PlatformWayland::wmBasePing(void *, xdg_wm_base *wmBase, uint32_t serial)
+{
+    xdg_wm_base_pong(wmBase, serial);
+}
+
+void PlatformWayland::xdgSurfaceConfigure(void *data, xdg_surface *xdgSurface, uint32_t serial)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    xdg_surface_ack_configure(xdgSurface, serial);
+    platform->configured();
+}
+
+/* 0 x 0 leaves the size to us */
+void PlatformWayland::toplevelConfigure(void *data, xdg_toplevel *, int32_t width, int32_t height,
+    wl_array *)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    platform->_configureWidth = width;
+    platform->_configureHeight = height;
+}
+
+void PlatformWayland::toplevelClose(void *data, xdg_toplevel *)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+    platform->_loop->exit();
+}
+
+void PlatformWayland::seatCapabilities(void *data, wl_seat *seat, uint32_t capabilities)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && platform->_pointer == nullptr)
+    {
+        platform->_pointer = wl_seat_get_pointer(seat);
+        wl_pointer_add_listener(platform->_pointer, &_pointerListener, platform);
+    }
+    else if (!(capabilities & WL_SEAT_CAPABILITY_POINTER) && platform->_pointer != nullptr)
+    {
+        wl_pointer_destroy(platform->_pointer);
+        platform->_pointer = nullptr;
+    }
+
+    if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && platform->_keyboard == nullptr)
+    {
+        platform->_keyboard = wl_seat_get_keyboard(seat);
+        wl_keyboard_add_listener(platform->_keyboard, &_keyboardListener, platform);
+    }
+    else if (!(capabilities & WL_SEAT_CAPABILITY_KEYBOARD) && platform->_keyboard != nullptr)
+    {
+        wl_keyboard_destroy(platform->_keyboard);
+        platform->_keyboard = nullptr;
+    }
+
+    if ((capabilities & WL_SEAT_CAPABILITY_TOUCH) && platform->_touch == nullptr)
+    {
+        platform->_touch = wl_seat_get_touch(seat);
+        wl_touch_add_listener(platform->_touch, &_touchListener, platform);
+    }
+    else if (!(capabilities & WL_SEAT_CAPABILITY_TOUCH) && platform->_touch != nullptr)
+    {
+        wl_touch_destroy(platform->_touch);
+        platform->_touch = nullptr;
+    }
+}
+
+/* ================================================================================================================== */
+
+/* The clients draw their own cursor */
+void PlatformWayland::pointerEnter(void *data, wl_pointer *pointer, uint32_t serial, wl_surface *,
+    wl_fixed_t x, wl_fixed_t y)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    wl_pointer_set_cursor(pointer, serial, nullptr, 0, 0);
+
+    platform->_pointerX = wl_fixed_to_int(x);
+    platform->_pointerY = wl_fixed_to_int(y);
+    platform->cursorMotion(platform->_pointerX, platform->_pointerY);
+}
+
+void PlatformWayland::pointerLeave(void *, wl_pointer *, uint32_t, wl_surface *)
+{
+}
+
+void PlatformWayland::pointerMoved(void *data, wl_pointer *, uint32_t, wl_fixed_t x, wl_fixed_t y)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    platform->_pointerX = wl_fixed_to_int(x);
+    platform->_pointerY = wl_fixed_to_int(y);
+    platform->cursorMotion(platform->_pointerX, platform->_pointerY);
+}
+
+/* Numbered as with X11: left, right, middle */
+void PlatformWayland::pointerButton(void *data, wl_pointer *, uint32_t, uint32_t,
+    uint32_t button, uint32_t state)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    int b;
+    if (button == BTN_LEFT)
+        b = 1;
+    else if (button == BTN_RIGHT)
+        b = 2;
+    else if (button == BTN_MIDDLE)
+        b = 3;
+    else
+        return;
+
+    if (state == WL_POINTER_BUTTON_STATE_PRESSED)
+        platform->buttonPress(b, platform->_pointerX, platform->_pointerY);
+    else
+        platform->buttonRelease(b, platform->_pointerX, platform->_pointerY);
+}
+
+/* Wheel buttons as with X11: 4 up, 5 down, 6 left, 7 right */
+void PlatformWayland::pointerAxis(void *data, wl_pointer *, uint32_t, uint32_t axis, wl_fixed_t value)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    if (axis == WL_POINTER_AXIS_VERTICAL_SCROLL)
+        platform->scroll(&platform->_scrollV, wl_fixed_to_int(value), 4, 5);
+    else if (axis == WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+        platform->scroll(&platform->_scrollH, wl_fixed_to_int(value), 6, 7);
+}
+
+/* ================================================================================================================== */
+
+/* Keycodes are sent raw, the clients have their own keymap */
+void PlatformWayland::keyboardKeymap(void *, wl_keyboard *, uint32_t, int32_t fd, uint32_t)
+{
+    close(fd);
+}
+
+void PlatformWayland::keyboardEnter(void *, wl_keyboard *, uint32_t, wl_surface *,
+    wl_array *)
+{
+}
+
+void PlatformWayland::keyboardLeave(void *, wl_keyboard *, uint32_t, wl_surface *)
+{
+}
+
+/* Evdev codes, X11 keycodes are 8 higher */
+void PlatformWayland::keyboardKey(void *data, wl_keyboard *, uint32_t, uint32_t, uint32_t key,
+    uint32_t state)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
+        platform->keyDown(key + 8);
+    else
+        platform->keyUp(key + 8);
+}
+
+void PlatformWayland::keyboardModifiers(void *, wl_keyboard *, uint32_t, uint32_t,
+    uint32_t, uint32_t, uint32_t)
+{
+}
+
+/* ================================================================================================================== */
+
+void PlatformWayland::touchDown(void *data, wl_touch *, uint32_t, uint32_t, wl_surface *,
+    int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    std::pair<int, int> &position = platform->_touches[id];
+    position.first = wl_fixed_to_int(x);
+    position.second = wl_fixed_to_int(y);
+    platform->pointerDown(id, position.first, position.second);
+}
+
+/* Up has no position, the last one is used */
+void PlatformWayland::touchUp(void *data, wl_touch *, uint32_t, uint32_t, int32_t id)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    auto it = platform->_touches.find(id);
+    if (it == platform->_touches.end())
+        return;
+
+    platform->pointerUp(id, it->second.first, it->second.second);
+    platform->_touches.erase(it);
+}
+
+void PlatformWayland::touchMotion(void *data, wl_touch *, uint32_t, int32_t id, wl_fixed_t x,
+    wl_fixed_t y)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    std::pair<int, int> &position = platform->_touches[id];
+    position.first = wl_fixed_to_int(x);
+    position.second = wl_fixed_to_int(y);
+    platform->pointerMotion(id, position.first, position.second);
+}
+
+void PlatformWayland::touchFrame(void *, wl_touch *)
+{
+}
+
+void PlatformWayland::touchCancel(void *data, wl_touch *)
+{
+    PlatformWayland *platform = static_cast<PlatformWayland *>(data);
+
+    for (auto it = platform->_touches.begin(); it != platform->_touches.end(); ++it)
+        platform->pointerUp(it->first, it->second.first, it->second.second);
+    platform->_touches.clear();
+}
+
+/* ================================================================================================================== */
+
+Platform *platform_wayland_create(WereEventLoop *loop, bool passthrough)
+{
+    return new PlatformWayland(loop, passthrough);
+}
+
+/* ================================================================================================================== */
@@ -0,0 +1,13 @@
+#ifndef PLATFORM_WAYLAND_H
+#define PLATFORM_WAYLAND_H
+
+#include "platform/platform.h"
+#include "were/were_event_loop.h"
+
+/*
+ * A window of a Wayland compositor. With passthrough the surfaces are shown as subsurfaces of the window, without it
+ * or when the host has no wl_subcompositor the window is drawn with EGL.
+ */
+Platform *platform_wayland_create(WereEventLoop *loop, bool passthrough);
+
+#endif //PLATFORM_WAYLAND_H
@@ -1,6 +1,8 @@
 #include "platform_x11.h"
-#include "were/were_timer.h"
+#include "were/were_event_source.h"
+#include "were/were_signal.h"
 #include <stdexcept>
+#include <functional>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
@@ -14,6 +16,41 @@ const char *w_title = "Sparkle";
 
 /* ================================================================================================================== */
 
+/* The connection to the X server, readable when events arrive */
+class PlatformX11Connection : public WereEventSource
+{
+public:
+    ~PlatformX11Connection();
+    PlatformX11Connection(WereEventLoop *loop, int fd);
+
+    WereSignal<void ()> readable;
+
+private:
+    void event(uint32_t events);
+};
+
+PlatformX11Connection::~PlatformX11Connection()
+{
+    _loop->unregisterEventSource(this);
+}
+
+PlatformX11Connection::PlatformX11Connection(WereEventLoop *loop, int fd) :
+    WereEventSource(loop)
+{
+    _fd = fd;
+    _loop->registerEventSource(this, EPOLLIN);
+}
+
+void PlatformX11Connection::event(uint32_t events)
+{
+    if (events & EPOLLIN)
+        readable();
+    else
+        throw WereException("[%p][%s] Unknown event type.", this, __PRETTY_FUNCTION__);
+}
+
+/* ================================================================================================================== */
+
 class PlatformX11 : public Platform
 {
 public:
@@ -23,7 +60,6 @@ public:
     int stop();
 
 private:
-    void timeout();
     int openDisplay();
     int closeDisplay();
     int createWindow();
@@ -32,14 +68,14 @@ private:
 
 private:
     WereEventLoop *_loop;
-    WereTimer *_timer;
+    PlatformX11Connection *_connection;
     Display *_display;
     Window _window;
 };
 
 PlatformX11::~PlatformX11()
 {
-    delete _timer;
+    delete _connection;
     destroyWindow();
     closeDisplay();
 }
@@ -47,9 +83,7 @@ PlatformX11::~PlatformX11()
 PlatformX11::PlatformX11(WereEventLoop *loop)
 {
     _loop = loop;
-
-    _timer = new WereTimer(_loop);
-    _timer->timeout.connect(WereSimpleQueuer(loop, &PlatformX11::timeout, this));
+    _connection = nullptr;
 
     _display = 0;
     _window = 0;
@@ -68,14 +102,20 @@ int PlatformX11::start()
 
     initializeForNativeWindow(_window);
 
-    _timer->start(1000/60, false);
+    /* Nothing is polled, the loop wakes up only when the server sends something */
+    _connection = new PlatformX11Connection(_loop, ConnectionNumber(_display));
+    _connection->readable.connect(std::bind(&PlatformX11::processEvents, this));
+
+    /* Events Xlib has already read never make the socket readable again */
+    processEvents();
 
     return 0;
 }
 
 int PlatformX11::stop()
 {
-    _timer->stop();
+    delete _connection;
+    _connection = nullptr;
 
     finishForNativeWindow();
     finishForNativeDisplay();
@@ -83,15 +123,11 @@ int PlatformX11::stop()
     return 0;
 }
 
-void PlatformX11::timeout()
-{
-    processEvents();
-
-    draw();
-}
-
 int PlatformX11::openDisplay()
 {
+    /* EGL draws from the render thread on the same connection */
+    XInitThreads();
+
     _display = XOpenDisplay(0);
 
     if (_display == 0)
@@ -234,6 +270,12 @@ int PlatformX11::processEvents()
                 keyUp(event.xkey.keycode);
                 break;
             }
+            case Expose:
+            case ConfigureNotify:
+            {
+                draw();
+                break;
+            }
             default:
             {
                 break;
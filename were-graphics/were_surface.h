@@ -13,6 +13,7 @@ public:
     virtual int width() = 0;
     virtual int height() = 0;
     virtual int stride() = 0;
+    virtual int bytesPerPixel() = 0;
     
 werethings:
     WereSignal<void (int x1, int y1, int x2, int y2)> damage;
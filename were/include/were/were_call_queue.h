@@ -6,6 +6,7 @@
 #include <functional>
 #include <vector>
 #include <queue>
+#include <mutex>
 
 /* ================================================================================================================== */
 
@@ -21,6 +22,8 @@ private:
     void event(uint32_t events);
 
 private:
+    /* Other threads queue calls too */
+    std::mutex _mutex;
     std::queue< std::function<void ()> > _functions;
 };
 
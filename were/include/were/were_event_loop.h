@@ -8,6 +8,7 @@
 #include <functional>
 #include <vector>
 #include <thread>
+#include <atomic>
 
 class WereEventSource;
 class WereCallQueue;
@@ -31,11 +32,15 @@ public:
 
     void queue(const std::function<void ()> &f);
 
+    /* Returns from epoll so far, an idle loop should not add any */
+    uint64_t wakeups();
+
 private:
 
 private:
     int _epoll;
-    bool _exit;
+    std::atomic<bool> _exit;
+    std::atomic<uint64_t> _wakeups;
 
     WereCallQueue *_queue;
 
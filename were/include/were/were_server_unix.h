@@ -23,8 +23,11 @@ werethings:
 private:
     void event(uint32_t events);
 
+    void listenStream(const std::string &host, const std::string &port);
+
 private:
     std::string path_;
+    bool stream_;
 };
 
 /* ================================================================================================================== */
@@ -25,6 +25,12 @@ private:
 
 /* ================================================================================================================== */
 
+/* Addresses of the form "tcp:host:port" select a TCP stream instead of a unix socket. An empty host ("tcp::port")
+ * means loopback; a server given any other host accepts anyone who can reach it, unauthenticated */
+bool were_socket_tcp_address(const std::string &path, std::string *host, std::string *port);
+
+/* ================================================================================================================== */
+
 class WereSocketUnix : public WereEventSource
 {
 public:
@@ -36,12 +42,13 @@ public:
 public:
     ~WereSocketUnix();
     WereSocketUnix(WereEventLoop *loop);
-    WereSocketUnix(WereEventLoop *loop, int fd);
+    WereSocketUnix(WereEventLoop *loop, int fd, bool stream = false);
 
     void connect(const std::string &path);
     void disconnect();
 
     WereSocketUnix::SocketState state();
+    bool stream() const {return stream_;}
 
 #if 0
     int send(const unsigned char *data, unsigned int size);
@@ -50,6 +57,7 @@ public:
 #endif
 
     unsigned int bytesAvailable() const;
+    unsigned int bytesPending();
 
     int sendMessage(WereSocketUnixMessage *message);
     int receiveMessage(WereSocketUnixMessage *message);
@@ -65,9 +73,20 @@ werethings:
 private:
     void event(uint32_t events);
 
+    void connectStream(const std::string &host, const std::string &port);
+    int sendStream(WereSocketUnixMessage *message);
+    bool flushStream();
+    void receiveStream();
+
 private:
     SocketState state_;
     pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+    /* Stream sockets carry length-prefixed messages and cannot pass fds */
+    bool stream_;
+    std::vector<unsigned char> input_;
+    std::vector<unsigned char> output_;
+    unsigned int outputPosition_;
 };
 
 /* ================================================================================================================== */
@@ -14,8 +14,12 @@ public:
     WereTimer(WereEventLoop *loop);
 
     void start(int interval, bool singleShot);
+    /* Single shot at an absolute time of the monotonic clock, in nanoseconds */
+    void startAt(uint64_t time);
     void stop();
 
+    static uint64_t now();
+
     WereSignal<void ()> timeout;
 
 private:
@@ -33,13 +33,19 @@ void WereCallQueue::event(uint32_t events)
         if (read(_fd, &counter, sizeof(uint64_t)) != sizeof(uint64_t))
             throw WereException("[%p][%s] Failed to read event fd.", this, __PRETTY_FUNCTION__);
 
-        /* FIXME lock */
+        /* Called without the lock, the functions may queue more */
         for (unsigned int i = 0; i < counter; ++i)
         {
-            _functions.front()();
-            _functions.pop();
+            std::function<void ()> f;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                f = std::move(_functions.front());
+                _functions.pop();
+            }
+
+            f();
         }
-        /* FIXME unlock */
     }
     else
         throw WereException("[%p][%s] Unknown event type.", this, __PRETTY_FUNCTION__);
@@ -49,9 +55,10 @@ void WereCallQueue::event(uint32_t events)
 
 void WereCallQueue::queue(const std::function<void ()> &f)
 {
-    /* FIXME lock */
-    _functions.push(f);
-    /* FIXME unlock */
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _functions.push(f);
+    }
 
     uint64_t add = 1;
     if (write(_fd, &add, sizeof(uint64_t)) != sizeof(uint64_t))
@@ -24,6 +24,7 @@ WereEventLoop::WereEventLoop()
         throw WereException("[%p][%s] Failed to create epoll device.", this, __PRETTY_FUNCTION__);
 
     _exit = false;
+    _wakeups = 0;
 
     _queue = new WereCallQueue(this);
 }
@@ -67,6 +68,8 @@ void WereEventLoop::run()
         if (n == -1)
             throw WereException("[%p][%s] epoll_wait returned -1.", this, __PRETTY_FUNCTION__);
 
+        _wakeups += 1;
+
         for (int i = 0; i < n; ++i)
         {
             WereEventSource *source = static_cast<WereEventSource *>(events[i].data.ptr);
@@ -112,4 +115,9 @@ void WereEventLoop::queue(const std::function<void ()> &f)
     _queue->queue(f);
 }
 
+uint64_t WereEventLoop::wakeups()
+{
+    return _wakeups;
+}
+
 /* ================================================================================================================== */
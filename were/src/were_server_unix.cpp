@@ -5,6 +5,7 @@
 #include <sys/un.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <netdb.h>
 
 /* ================================================================================================================== */
 
@@ -17,13 +18,24 @@ WereServerUnix::~WereServerUnix()
     shutdown(_fd, SHUT_RDWR);
     close(_fd);
 
-    unlink(path_.c_str());
+    if (!stream_)
+        unlink(path_.c_str());
 }
 
 WereServerUnix::WereServerUnix(WereEventLoop *loop, const std::string &path) :
     WereEventSource(loop)
 {
     path_ = path;
+    stream_ = false;
+
+    std::string host;
+    std::string port;
+
+    if (were_socket_tcp_address(path_, &host, &port))
+    {
+        listenStream(host, port);
+        return;
+    }
 
     unlink(path_.c_str());
 
@@ -46,6 +58,43 @@ WereServerUnix::WereServerUnix(WereEventLoop *loop, const std::string &path) :
     _loop->registerEventSource(this, EPOLLIN | EPOLLET);
 }
 
+void WereServerUnix::listenStream(const std::string &host, const std::string &port)
+{
+    stream_ = true;
+
+    /* Without a host only loopback is bound, the protocol has no authentication */
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr)
+        throw WereException("[%p][%s] Failed to resolve address.", this, __PRETTY_FUNCTION__);
+
+    _fd = socket(result->ai_family, SOCK_STREAM, 0);
+    if (_fd == -1)
+    {
+        freeaddrinfo(result);
+        throw WereException("[%p][%s] Failed to create socket.", this, __PRETTY_FUNCTION__);
+    }
+
+    setBlocking(false);
+
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int ret = bind(_fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+
+    if (ret == -1)
+        throw WereException("[%p][%s] Failed to bind socket (%s).", this, __PRETTY_FUNCTION__, strerror(errno));
+
+    if (listen(_fd, 4) == -1)
+        throw WereException("[%p][%s] Failed to listen socket.", this, __PRETTY_FUNCTION__);
+
+    _loop->registerEventSource(this, EPOLLIN | EPOLLET);
+}
+
 /* ================================================================================================================== */
 
 void WereServerUnix::event(uint32_t events)
@@ -64,7 +113,7 @@ WereSocketUnix *WereServerUnix::accept()
     if (fd == -1)
         return nullptr;
 
-    WereSocketUnix *socket = new WereSocketUnix(_loop, fd);
+    WereSocketUnix *socket = new WereSocketUnix(_loop, fd, stream_);
 
     return socket;
 }
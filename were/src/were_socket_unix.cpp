@@ -4,6 +4,36 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/ioctl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* ================================================================================================================== */
+
+const unsigned int MAX_STREAM_MESSAGE = 64 * 1024 * 1024;
+/* A peer that leaves this much unread is dropped rather than buffered without bound */
+const unsigned int MAX_STREAM_BACKLOG = 2 * MAX_STREAM_MESSAGE;
+
+bool were_socket_tcp_address(const std::string &path, std::string *host, std::string *port)
+{
+    if (path.compare(0, 4, "tcp:") != 0)
+        return false;
+
+    std::string address = path.substr(4);
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+
+    *host = address.substr(0, colon);
+    *port = address.substr(colon + 1);
+
+    /* [::1]:port */
+    if (host->size() >= 2 && (*host)[0] == '[' && (*host)[host->size() - 1] == ']')
+        *host = host->substr(1, host->size() - 2);
+
+    return true;
+}
 
 /* ================================================================================================================== */
 
@@ -27,17 +57,29 @@ WereSocketUnix::WereSocketUnix(WereEventLoop *loop) :
 {
     _fd = -1;
     state_ = UnconnectedState;
+    stream_ = false;
+    outputPosition_ = 0;
 }
 
-WereSocketUnix::WereSocketUnix(WereEventLoop *loop, int fd) :
+WereSocketUnix::WereSocketUnix(WereEventLoop *loop, int fd, bool stream) :
     WereEventSource(loop)
 {
     _fd = fd;
-    _loop->registerEventSource(this, EPOLLIN | EPOLLET);
     state_ = ConnectedState;
+    stream_ = stream;
+    outputPosition_ = 0;
 
     setBlocking(false);
 
+    if (stream_)
+    {
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        _loop->registerEventSource(this, EPOLLIN | EPOLLOUT | EPOLLET);
+    }
+    else
+        _loop->registerEventSource(this, EPOLLIN | EPOLLET);
+
     were_debug("[%p][%s] Connected (accept).\n", this, __PRETTY_FUNCTION__);
 }
 
@@ -48,6 +90,17 @@ void WereSocketUnix::connect(const std::string &path)
     if (state_ != UnconnectedState)
         return;
 
+    std::string host;
+    std::string port;
+
+    if (were_socket_tcp_address(path, &host, &port))
+    {
+        connectStream(host, port);
+        return;
+    }
+
+    stream_ = false;
+
     _fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
     if (_fd == -1)
         throw WereException("[%p][%s] Failed to create socket.", this, __PRETTY_FUNCTION__);
@@ -70,6 +123,49 @@ void WereSocketUnix::connect(const std::string &path)
     state_ = ConnectingState;
 }
 
+void WereSocketUnix::connectStream(const std::string &host, const std::string &port)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr)
+    {
+        were_debug("[%p][%s] Failed to resolve %s:%s.\n", this, __PRETTY_FUNCTION__, host.c_str(), port.c_str());
+        return;
+    }
+
+    stream_ = true;
+    input_.clear();
+    output_.clear();
+    outputPosition_ = 0;
+
+    _fd = socket(result->ai_family, SOCK_STREAM, 0);
+    if (_fd == -1)
+    {
+        freeaddrinfo(result);
+        throw WereException("[%p][%s] Failed to create socket.", this, __PRETTY_FUNCTION__);
+    }
+
+    setBlocking(false);
+
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int ret = ::connect(_fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+
+    if (ret == -1 && errno != EINPROGRESS)
+    {
+        disconnect();
+        return;
+    }
+
+    _loop->registerEventSource(this, EPOLLIN | EPOLLOUT | EPOLLET);
+    state_ = ConnectingState;
+}
+
 void WereSocketUnix::disconnect()
 {
     if (state_ != UnconnectedState)
@@ -82,6 +178,10 @@ void WereSocketUnix::disconnect()
         _fd = -1;
     }
 
+    input_.clear();
+    output_.clear();
+    outputPosition_ = 0;
+
     if (state_ == ConnectedState)
     {
         state_ = UnconnectedState;
@@ -108,7 +208,33 @@ void WereSocketUnix::event(uint32_t events)
         return;
     }
 
-    if (events & EPOLLIN)
+    /* Edge-triggered: data can arrive in the event that completes the connect, finish it before reading */
+    if ((events & EPOLLOUT) && state_ == ConnectingState)
+    {
+        int result;
+        socklen_t resultLength = sizeof(result);
+
+        if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &result, &resultLength) == -1)
+            throw WereException("[%p][%s] Failed to get connection result.", this, __PRETTY_FUNCTION__);
+
+        if (result != 0)
+        {
+            disconnect();
+            were_debug("[%p][%s] Connection failed (%d, %s).\n", this, __PRETTY_FUNCTION__, result, strerror(result));
+            return;
+        }
+
+        state_ = ConnectedState;
+        signal_connected();
+        were_debug("[%p][%s] Connected (connect).\n", this, __PRETTY_FUNCTION__);
+    }
+
+    if (stream_)
+    {
+        if ((events & EPOLLIN) && state_ == ConnectedState)
+            receiveStream();
+    }
+    else if (events & EPOLLIN)
     {
 #if 0
         if (receiveMessage(message.get()) != -1)
@@ -124,28 +250,14 @@ void WereSocketUnix::event(uint32_t events)
 #endif
     }
 
-    if (events & EPOLLOUT)
+    if ((events & EPOLLOUT) && stream_ && state_ == ConnectedState)
     {
-        if (state_ == ConnectingState)
-        {
-            int result;
-            socklen_t resultLength = sizeof(result);
-
-            if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &result, &resultLength) == -1)
-                throw WereException("[%p][%s] Failed to get connection result.", this, __PRETTY_FUNCTION__);
+        pthread_mutex_lock(&lock);
+        bool ok = flushStream();
+        pthread_mutex_unlock(&lock);
 
-            if (result == 0)
-            {
-                state_ = ConnectedState;
-                signal_connected();
-                were_debug("[%p][%s] Connected (connect).\n", this, __PRETTY_FUNCTION__);
-            }
-            else
-            {
-                disconnect();
-                were_debug("[%p][%s] Connection failed (%d, %s).\n", this, __PRETTY_FUNCTION__, result, strerror(result));
-            }
-        }
+        if (!ok)
+            disconnect();
     }
 }
 
@@ -200,6 +312,15 @@ unsigned int WereSocketUnix::bytesAvailable() const
     return bytes;
 }
 
+unsigned int WereSocketUnix::bytesPending()
+{
+    pthread_mutex_lock(&lock);
+    unsigned int bytes = output_.size() - outputPosition_;
+    pthread_mutex_unlock(&lock);
+
+    return bytes;
+}
+
 int WereSocketUnix::sendMessage(WereSocketUnixMessage *message)
 {
     if (state_ != ConnectedState)
@@ -208,6 +329,9 @@ int WereSocketUnix::sendMessage(WereSocketUnixMessage *message)
         return -1;
     }
 
+    if (stream_)
+        return sendStream(message);
+
     struct iovec iov[1];
     iov[0].iov_base = message->data()->data();
     iov[0].iov_len = message->data()->size();
@@ -301,3 +425,131 @@ int WereSocketUnix::receiveMessage(WereSocketUnixMessage *message)
 }
 
 /* ================================================================================================================== */
+
+int WereSocketUnix::sendStream(WereSocketUnixMessage *message)
+{
+    if (message->fds()->size() > 0)
+    {
+        were_debug("[%p][%s] File descriptors cannot be sent over a stream.\n", this, __PRETTY_FUNCTION__);
+        return -1;
+    }
+
+    uint32_t size = message->data()->size();
+
+    pthread_mutex_lock(&lock);
+
+    const unsigned char *header = reinterpret_cast<const unsigned char *>(&size);
+    output_.insert(output_.end(), header, header + sizeof(uint32_t));
+    output_.insert(output_.end(), message->data()->begin(), message->data()->end());
+
+    bool ok = flushStream();
+
+    if (ok && output_.size() - outputPosition_ > MAX_STREAM_BACKLOG)
+    {
+        were_debug("[%p][%s] Peer is not reading, DISCONNECTING.\n", this, __PRETTY_FUNCTION__);
+        ok = false;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    if (!ok)
+    {
+        disconnect();
+        return -1;
+    }
+
+    return size;
+}
+
+bool WereSocketUnix::flushStream()
+{
+    while (outputPosition_ < output_.size())
+    {
+        ssize_t ret = ::send(_fd, &output_[outputPosition_], output_.size() - outputPosition_, MSG_NOSIGNAL);
+        if (ret == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                /* Drop what was sent so a lagging peer does not grow the buffer */
+                if (outputPosition_ > output_.size() / 2)
+                {
+                    output_.erase(output_.begin(), output_.begin() + outputPosition_);
+                    outputPosition_ = 0;
+                }
+                return true;
+            }
+
+            if (errno == EINTR)
+                continue;
+
+            were_debug("[%p][%s] Failed to send data, DISCONNECTING.\n", this, __PRETTY_FUNCTION__);
+            return false;
+        }
+
+        outputPosition_ += ret;
+    }
+
+    output_.clear();
+    outputPosition_ = 0;
+
+    return true;
+}
+
+void WereSocketUnix::receiveStream()
+{
+    unsigned char buffer[64 * 1024];
+
+    while (true)
+    {
+        ssize_t ret = read(_fd, buffer, sizeof(buffer));
+        if (ret == 0)
+        {
+            disconnect();
+            return;
+        }
+
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            were_debug("[%p][%s] Failed to receive data, DISCONNECTING.\n", this, __PRETTY_FUNCTION__);
+            disconnect();
+            return;
+        }
+
+        input_.insert(input_.end(), buffer, buffer + ret);
+    }
+
+    unsigned int position = 0;
+
+    while (input_.size() - position >= sizeof(uint32_t))
+    {
+        uint32_t size;
+        memcpy(&size, &input_[position], sizeof(uint32_t));
+
+        if (size > MAX_STREAM_MESSAGE)
+        {
+            were_debug("[%p][%s] Message too large (%u), DISCONNECTING.\n", this, __PRETTY_FUNCTION__, size);
+            disconnect();
+            return;
+        }
+
+        if (input_.size() - position - sizeof(uint32_t) < size)
+            break;
+
+        std::shared_ptr<WereSocketUnixMessage> message(new WereSocketUnixMessage());
+        unsigned char *start = &input_[position + sizeof(uint32_t)];
+        message->data()->assign(start, start + size);
+        position += sizeof(uint32_t) + size;
+
+        signal_message(message);
+    }
+
+    input_.erase(input_.begin(), input_.begin() + position);
+}
+
+/* ================================================================================================================== */
@@ -1,6 +1,8 @@
 #include "were_timer.h"
 #include <sys/timerfd.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
 /* ================================================================================================================== */
 
@@ -14,7 +16,7 @@ WereTimer::~WereTimer()
 WereTimer::WereTimer(WereEventLoop *loop) :
     WereEventSource(loop)
 {
-    _fd = timerfd_create(CLOCK_REALTIME, 0);
+    _fd = timerfd_create(CLOCK_MONOTONIC, 0);
     if (_fd == -1)
         throw WereException("[%p][%s] Failed to create timer fd.", this, __PRETTY_FUNCTION__);
 
@@ -32,7 +34,12 @@ void WereTimer::event(uint32_t events)
         uint64_t expirations;
 
         if (read(_fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+        {
+            /* Started again between the wakeup and the read */
+            if (errno == EAGAIN)
+                return;
             throw WereException("[%p][%s] Failed to read timer fd.", this, __PRETTY_FUNCTION__);
+        }
 
         timeout();
     }
@@ -67,6 +74,23 @@ void WereTimer::start(int interval, bool singleShot)
         throw WereException("[%p][%s] Failed to start timer.", this, __PRETTY_FUNCTION__);
 }
 
+void WereTimer::startAt(uint64_t time)
+{
+    struct itimerspec new_value;
+
+    /* Zero would disarm, a time in the past fires at once */
+    if (time == 0)
+        time = 1;
+
+    new_value.it_value.tv_sec = time / 1000000000;
+    new_value.it_value.tv_nsec = time % 1000000000;
+    new_value.it_interval.tv_sec = 0;
+    new_value.it_interval.tv_nsec = 0;
+
+    if (timerfd_settime(_fd, TFD_TIMER_ABSTIME, &new_value, NULL) == -1)
+        throw WereException("[%p][%s] Failed to start timer.", this, __PRETTY_FUNCTION__);
+}
+
 void WereTimer::stop()
 {
     struct itimerspec new_value;
@@ -81,3 +105,13 @@ void WereTimer::stop()
 }
 
 /* ================================================================================================================== */
+
+uint64_t WereTimer::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/* ================================================================================================================== */
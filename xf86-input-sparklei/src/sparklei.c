@@ -21,6 +21,7 @@
 
 #include <X11/Xatom.h>
 #include <xserver-properties.h>
+#include <windowstr.h>
 
 
 #ifndef XI_PROP_PRODUCT_ID
@@ -347,6 +348,28 @@ static void SparkleiPointerMotion(void *user, int slot, int x, int y)
     valuator_mask_zero(pEvdev->mt_mask);
 }
 
+static void SparkleiPointerMotionBatch(void *user, int slot, int count, const int *xy)
+{
+    InputInfoPtr      pInfo    = (InputInfoPtr)user;
+    EvdevPtr          pEvdev   = pInfo->private;
+    int               i;
+
+    if (pEvdev->slot_state[slot] != 1)
+        return;
+
+    /* Queued together, the server processes the batch in one go */
+    input_lock();
+    for (i = 0; i < count; ++i)
+    {
+        valuator_mask_set(pEvdev->mt_mask, 0, xy[i * 2]);
+        valuator_mask_set(pEvdev->mt_mask, 1, xy[i * 2 + 1]);
+        xf86PostTouchEvent(pInfo->dev, slot + 1, 19, 0, pEvdev->mt_mask);
+    }
+    input_unlock();
+
+    valuator_mask_zero(pEvdev->mt_mask);
+}
+
 static void SparkleiRMB(void *user, int state)
 {
     InputInfoPtr      pInfo    = (InputInfoPtr)user;
@@ -418,6 +441,19 @@ static void SparkleiButtonRelease(void *user, int button, int x, int y)
     //valuator_mask_zero(pEvdev->mt_mask);
 }
 
+static int SparkleiWindowOrigin(void *user, unsigned int window, int *x, int *y)
+{
+    WindowPtr pWin;
+
+    if (dixLookupWindow(&pWin, window, serverClient, DixGetAttrAccess) != Success)
+        return -1;
+
+    *x = pWin->drawable.x - wBorderWidth(pWin);
+    *y = pWin->drawable.y - wBorderWidth(pWin);
+
+    return 0;
+}
+
 static void SparkleiCursorMotion(void *user, int x, int y)
 {
     InputInfoPtr      pInfo    = (InputInfoPtr)user;
@@ -442,11 +478,13 @@ EvdevOpenDevice(InputInfoPtr pInfo)
         sparklei_c_set_pointer_down_cb(pEvdev->sparkle, SparkleiPointerDown, pInfo);
         sparklei_c_set_pointer_up_cb(pEvdev->sparkle, SparkleiPointerUp, pInfo);
         sparklei_c_set_pointer_motion_cb(pEvdev->sparkle, SparkleiPointerMotion, pInfo);
+        sparklei_c_set_pointer_motion_batch_cb(pEvdev->sparkle, SparkleiPointerMotionBatch, pInfo);
         sparklei_c_set_key_down_cb(pEvdev->sparkle, SparkleiKeyDown, pInfo);
         sparklei_c_set_key_up_cb(pEvdev->sparkle, SparkleiKeyUp, pInfo);
         sparklei_c_set_button_press_cb(pEvdev->sparkle, SparkleiButtonPress, pInfo);
         sparklei_c_set_button_release_cb(pEvdev->sparkle, SparkleiButtonRelease, pInfo);
         sparklei_c_set_cursor_motion_cb(pEvdev->sparkle, SparkleiCursorMotion, pInfo);
+        sparklei_c_set_window_origin_cb(pEvdev->sparkle, SparkleiWindowOrigin, pInfo);
     }
 
     return Success;
@@ -3,6 +3,7 @@
 #include "common/sparkle_connection.h"
 #include "common/sparkle_protocol.h"
 #include <cstring>
+#include <cstdlib>
 
 
 /* ================================================================================================================== */
@@ -25,6 +26,9 @@ public:
     void (*pointer_motion_callback)(void *user, int slot, int x, int y);
     void *pointer_motion_user;
 
+    void (*pointer_motion_batch_callback)(void *user, int slot, int count, const int *xy);
+    void *pointer_motion_batch_user;
+
     void (*key_down_callback)(void *user, int code);
     void *key_down_user;
 
@@ -40,8 +44,13 @@ public:
     void (*cursor_motion_callback)(void *user, int x, int y);
     void *cursor_motion_user;
 
+    int (*window_origin_callback)(void *user, unsigned int window, int *x, int *y);
+    void *window_origin_user;
+
 private:
+    void handleConnection();
     void handleMessage(std::shared_ptr<WereSocketUnixMessage> message);
+    bool screenCoordinates(const std::string &surface, int *x, int *y);
 
 private:
     WereEventLoop *loop_;
@@ -61,11 +70,54 @@ SparkleiC::SparkleiC(const std::string &compositor, const std::string &surfaceNa
     connection_ = new SparkleConnection(loop_, compositor);
     surfaceName_ = surfaceName;
 
+    pointer_motion_batch_callback = nullptr;
+    pointer_motion_batch_user = nullptr;
+    window_origin_callback = nullptr;
+    window_origin_user = nullptr;
+
+    connection_->signal_connected.connect(WereSimpleQueuer(loop_, &SparkleiC::handleConnection, this));
     connection_->signal_message.connect(WereSimpleQueuer(loop_, &SparkleiC::handleMessage, this));
 }
 
 /* ================================================================================================================== */
 
+/* The screen surface and the window surfaces belong to the video driver, input for them comes here */
+void SparkleiC::handleConnection()
+{
+    connection_->send(SetEventMaskRequest({surfaceName_, EventMaskInput}));
+}
+
+/* ================================================================================================================== */
+
+/*
+ * Events come in the coordinates of the surface they hit. That is the screen for the screen surface, top-level
+ * windows of the rootless mode are surfaces named after their window and are moved to its origin.
+ */
+bool SparkleiC::screenCoordinates(const std::string &surface, int *x, int *y)
+{
+    if (surface == surfaceName_)
+        return true;
+
+    std::string prefix = surfaceName_ + ".";
+    if (surface.compare(0, prefix.size(), prefix) != 0 || window_origin_callback == nullptr)
+        return false;
+
+    char *end;
+    unsigned long window = strtoul(surface.c_str() + prefix.size(), &end, 10);
+    if (*end != '\0')
+        return false;
+
+    int wx;
+    int wy;
+    if (window_origin_callback(window_origin_user, window, &wx, &wy) != 0)
+        return false;
+
+    *x += wx;
+    *y += wy;
+
+    return true;
+}
+
 void SparkleiC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
 {
     uint32_t operation;
@@ -79,7 +131,7 @@ void SparkleiC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
         PointerDownNotification r1;
         stream >> r1;
 
-        if (r1.surface == surfaceName_)
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
             pointer_down_callback(pointer_down_user, r1.slot, r1.x, r1.y);
     }
     else if (operation == PointerUpNotificationCode)
@@ -87,7 +139,7 @@ void SparkleiC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
         PointerUpNotification r1;
         stream >> r1;
 
-        if (r1.surface == surfaceName_)
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
             pointer_up_callback(pointer_up_user, r1.slot);
     }
     else if (operation == PointerMotionNotificationCode)
@@ -95,11 +147,43 @@ void SparkleiC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
         PointerMotionNotification r1;
         stream >> r1;
 
-        if (r1.surface == surfaceName_)
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
         {
             pointer_motion_callback(pointer_motion_user, r1.slot, r1.x, r1.y);
         }
     }
+    else if (operation == PointerMotionBatchNotificationCode)
+    {
+        PointerMotionBatchNotification r1;
+        stream >> r1;
+
+        int x = r1.x;
+        int y = r1.y;
+        if (!screenCoordinates(r1.surface, &x, &y))
+            return;
+
+        /* The whole batch is on the same surface */
+        int dx = x - r1.x;
+        int dy = y - r1.y;
+
+        std::vector<int> xy;
+        xy.reserve((r1.history.size() + 1) * 2);
+        for (auto it = r1.history.begin(); it != r1.history.end(); ++it)
+        {
+            xy.push_back(it->x + dx);
+            xy.push_back(it->y + dy);
+        }
+        xy.push_back(x);
+        xy.push_back(y);
+
+        if (pointer_motion_batch_callback != nullptr)
+            pointer_motion_batch_callback(pointer_motion_batch_user, r1.slot, xy.size() / 2, xy.data());
+        else
+        {
+            for (unsigned int i = 0; i < xy.size(); i += 2)
+                pointer_motion_callback(pointer_motion_user, r1.slot, xy[i], xy[i + 1]);
+        }
+    }
     else if (operation == KeyDownNotificationCode)
     {
         KeyDownNotification r1;
@@ -116,19 +200,25 @@ void SparkleiC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
     {
         ButtonPressNotification r1;
         stream >> r1;
-        button_press_callback(button_press_user, r1.button, r1.x, r1.y);
+
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
+            button_press_callback(button_press_user, r1.button, r1.x, r1.y);
     }
     else if (operation == ButtonReleaseNotificationCode)
     {
         ButtonReleaseNotification r1;
         stream >> r1;
-        button_release_callback(button_release_user, r1.button, r1.x, r1.y);
+
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
+            button_release_callback(button_release_user, r1.button, r1.x, r1.y);
     }
     else if (operation == CursorMotionNotificationCode)
     {
         CursorMotionNotification r1;
         stream >> r1;
-        cursor_motion_callback(cursor_motion_user, r1.x, r1.y);
+
+        if (screenCoordinates(r1.surface, &r1.x, &r1.y))
+            cursor_motion_callback(cursor_motion_user, r1.x, r1.y);
     }
 }
 
@@ -172,6 +262,13 @@ void sparklei_c_set_pointer_motion_cb(SparkleiC *c, void (*f)(void *user, int sl
     c->pointer_motion_user = user;
 }
 
+void sparklei_c_set_pointer_motion_batch_cb(SparkleiC *c, void (*f)(void *user, int slot, int count, const int *xy),
+    void *user)
+{
+    c->pointer_motion_batch_callback = f;
+    c->pointer_motion_batch_user = user;
+}
+
 void sparklei_c_set_key_down_cb(SparkleiC *c, void (*f)(void *user, int code), void *user)
 {
     c->key_down_callback = f;
@@ -202,4 +299,10 @@ void sparklei_c_set_cursor_motion_cb(SparkleiC *c, void (*f)(void *user, int x,
     c->cursor_motion_user = user;
 }
 
+void sparklei_c_set_window_origin_cb(SparkleiC *c, int (*f)(void *user, unsigned int window, int *x, int *y), void *user)
+{
+    c->window_origin_callback = f;
+    c->window_origin_user = user;
+}
+
 /* ================================================================================================================== */
@@ -29,6 +29,9 @@ void sparklei_c_process(SparkleiC *c);
 void sparklei_c_set_pointer_down_cb(SparkleiC *c, void (*f)(void *user, int slot, int x, int y), void *user);
 void sparklei_c_set_pointer_up_cb(SparkleiC *c, void (*f)(void *user, int slot), void *user);
 void sparklei_c_set_pointer_motion_cb(SparkleiC *c, void (*f)(void *user, int slot, int x, int y), void *user);
+/* Positions of a frame's motion as x, y pairs, oldest first. Without it each one goes to the motion callback */
+void sparklei_c_set_pointer_motion_batch_cb(SparkleiC *c, void (*f)(void *user, int slot, int count, const int *xy),
+    void *user);
 void sparklei_c_set_key_down_cb(SparkleiC *c, void (*f)(void *user, int code), void *user);
 void sparklei_c_set_key_up_cb(SparkleiC *c, void (*f)(void *user, int code), void *user);
 
@@ -36,6 +39,9 @@ void sparklei_c_set_button_press_cb(SparkleiC *c, void (*f)(void *user, int butt
 void sparklei_c_set_button_release_cb(SparkleiC *c, void (*f)(void *user, int button, int x, int y), void *user);
 void sparklei_c_set_cursor_motion_cb(SparkleiC *c, void (*f)(void *user, int x, int y), void *user);
 
+/* Origin of a top-level window on the screen, 0 on success */
+void sparklei_c_set_window_origin_cb(SparkleiC *c, int (*f)(void *user, unsigned int window, int *x, int *y), void *user);
+
 #ifdef __cplusplus
 }
 #endif
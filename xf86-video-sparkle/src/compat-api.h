@@ -103,4 +103,12 @@
 
 #endif
 
+#if ABI_VIDEODRV_VERSION >= SET_ABI_VERSION(19, 0)
+#define WINDOW_EXPOSURES_ARGS_DECL WindowPtr pWin, RegionPtr prgn
+#define WINDOW_EXPOSURES_ARGS pWin, prgn
+#else
+#define WINDOW_EXPOSURES_ARGS_DECL WindowPtr pWin, RegionPtr prgn, RegionPtr other_exposed
+#define WINDOW_EXPOSURES_ARGS pWin, prgn, other_exposed
+#endif
+
 #endif
@@ -82,9 +82,33 @@ typedef struct dummyRec
     char *compositor;
     char *surface_name;
     char *surface_file;
+    Bool shadow_damage;
+
+    /* rootless */
+    Bool rootless;
+    CreateWindowProcPtr CreateWindow;
+    RealizeWindowProcPtr RealizeWindow;
+    UnrealizeWindowProcPtr UnrealizeWindow;
+    PositionWindowProcPtr PositionWindow;
+    CopyWindowProcPtr CopyWindow;
+    RestackWindowProcPtr RestackWindow;
+    ClipNotifyProcPtr ClipNotify;
+    WindowExposuresProcPtr WindowExposures;
+    struct _sparkleWindow *windows;
 #endif
 } DUMMYRec, *DUMMYPtr;
 
+#ifdef SPARKLE_MODE
+/* A top-level window redirected into its own compositor surface */
+typedef struct _sparkleWindow
+{
+    WindowPtr window;
+    PixmapPtr pixmap;
+    DamagePtr damage;
+    struct _sparkleWindow *next;
+} SparkleWindowRec, *SparkleWindowPtr;
+#endif
+
 /* The privates of the DUMMY driver */
 #define DUMMYPTR(p)	((DUMMYPtr)((p)->driverPrivate))
 
@@ -81,6 +81,9 @@ static Bool DUMMYCreateScreenResources(ScreenPtr pScreen);
 static void DUMMYBlockHandler(BLOCKHANDLER_ARGS_DECL);
 static Bool DUMMYCrtc_set_mode_major(xf86CrtcPtr crtc, DisplayModePtr mode, Rotation rotation, int x, int y);
 static Bool DUMMYUpdateModes(ScrnInfoPtr pScrn, int width, int height);
+static Bool SparkleRootlessInit(ScreenPtr pScreen);
+static void SparkleRootlessFini(ScreenPtr pScreen);
+static void SparkleRootlessDamage(ScreenPtr pScreen);
 #endif
 
 #define DUMMY_VERSION 4000
@@ -356,6 +359,17 @@ static void handle_display_size(void *user, int width, int height)
     }
 }
 
+/* Shared memory was purged while hidden, everything is exposed and drawn again */
+static void handle_purged(void *user)
+{
+    ScrnInfoPtr pScrn = (ScrnInfoPtr)user;
+
+    xf86DrvMsg(pScrn->scrnIndex, X_INFO, "Framebuffer purged, redrawing\n");
+
+    xf86EnableDisableFBAccess(XF86_ENABLEDISABLEFB_ARG(pScrn), FALSE);
+    xf86EnableDisableFBAccess(XF86_ENABLEDISABLEFB_ARG(pScrn), TRUE);
+}
+
 //==================================================================================================
 
 Bool DUMMYCrtc_resize(ScrnInfoPtr pScrn, int width, int height)
@@ -377,14 +391,17 @@ Bool DUMMYCrtc_resize(ScrnInfoPtr pScrn, int width, int height)
     }
 #endif
 
-    sparkle_c_resize_surface(dPtr->sparkle, width, height);
+    /* fb needs 32-bit aligned scanlines, odd widths get padded at 16bpp */
+    int cpp = (pScrn->bitsPerPixel + 7) / 8;
+    int pitch = (width * cpp + 3) & ~3;
+
+    sparkle_c_resize_surface(dPtr->sparkle, width, height, pitch / cpp);
 
     pScrn->virtualX = width;
     pScrn->virtualY = height;
-    pScrn->displayWidth = width; //XXX
+    pScrn->displayWidth = pitch / cpp; //XXX
 
-    int cpp = (pScrn->bitsPerPixel + 7) / 8;
-    pScreen->ModifyPixmapHeader(pPixmap, width, height, -1, -1, pScrn->displayWidth * cpp, sparkle_c_surface_data(dPtr->sparkle));
+    pScreen->ModifyPixmapHeader(pPixmap, width, height, -1, -1, pitch, sparkle_c_surface_data(dPtr->sparkle));
 
 
     //XXX
@@ -556,11 +573,17 @@ DUMMYPreInit(ScrnInfoPtr pScrn, int flags)
     else {
 	/* Check that the returned depth is one we support */
 	switch (pScrn->depth) {
+#ifndef SPARKLE_MODE
 	case 8:
 	case 15:
 	case 16:
 	case 24:
 	case 30:
+#else
+	/* Compositor surfaces are either RGB565 or XRGB8888 */
+	case 16:
+	case 24:
+#endif
 	    break;
 	default:
 	    xf86DrvMsg(pScrn->scrnIndex, X_ERROR,
@@ -718,6 +741,14 @@ DUMMYPreInit(ScrnInfoPtr pScrn, int flags)
 
     xf86DrvMsg(pScrn->scrnIndex, X_INFO, "DPI: %d\n", monitorResolution);
 
+    dPtr->shadow_damage = xf86SetBoolOption(pScrn->options, "ShadowDamage", FALSE);
+    if (dPtr->shadow_damage)
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG, "Shadow damage refinement enabled.\n");
+
+    dPtr->rootless = xf86SetBoolOption(pScrn->options, "Rootless", FALSE);
+    if (dPtr->rootless)
+        xf86DrvMsg(pScrn->scrnIndex, X_CONFIG, "Rootless mode enabled.\n");
+
     //dPtr->desiredWidth = xf86SetIntOption(pScrn->options, "Width", 800);
     //dPtr->desiredHeight = xf86SetIntOption(pScrn->options, "Height", 600);
     dPtr->displayWidth = 800;
@@ -836,9 +867,11 @@ DUMMYScreenInit(SCREEN_INIT_ARGS_DECL)
 	return FALSE;
 #else
 
-    dPtr->sparkle = sparkle_c_create(dPtr->compositor, dPtr->surface_name, dPtr->surface_file);
+    dPtr->sparkle = sparkle_c_create(dPtr->compositor, dPtr->surface_name, dPtr->surface_file, pScrn->depth);
     SetNotifyFd(sparkle_c_fd(dPtr->sparkle), handle_event, X_NOTIFY_READ, pScrn);
     sparkle_c_set_display_size_cb(dPtr->sparkle, handle_display_size, pScrn);
+    sparkle_c_set_purged_cb(dPtr->sparkle, handle_purged, pScrn);
+    sparkle_c_set_shadow_damage(dPtr->sparkle, dPtr->shadow_damage);
 
 #endif
 
@@ -952,6 +985,9 @@ DUMMYScreenInit(SCREEN_INIT_ARGS_DECL)
 #ifdef SPARKLE_MODE
     dPtr->BlockHandler = pScreen->BlockHandler;
     pScreen->BlockHandler = DUMMYBlockHandler;
+
+    if (dPtr->rootless && !SparkleRootlessInit(pScreen))
+        return FALSE;
 #endif
 
 #ifdef SPARKLE_MODE
@@ -1001,6 +1037,9 @@ DUMMYCloseScreen(CLOSE_SCREEN_ARGS_DECL)
     //TimerFree(dPtr->timer);
     //dPtr->timer = NULL;
 
+    if (dPtr->rootless)
+        SparkleRootlessFini(pScreen);
+
     RemoveNotifyFd(sparkle_c_fd(dPtr->sparkle));
     sparkle_c_destroy(dPtr->sparkle);
 
@@ -1169,6 +1208,9 @@ static void DUMMYBlockHandler(BLOCKHANDLER_ARGS_DECL)
 
         DamageEmpty(dPtr->damage);
     }
+
+    if (dPtr->rootless)
+        SparkleRootlessDamage(pScreen);
 }
 
 static Bool
@@ -1201,5 +1243,496 @@ DUMMYUpdateModes(ScrnInfoPtr pScrn, int width, int height)
     return TRUE;
 }
 
-#endif
+//==================================================================================================
+//
+// Rootless mode.
+//
+// Every mapped top-level window is drawn into its own pixmap backed by a shared compositor surface,
+// the same way Composite redirects windows. Moving or restacking a window then only changes the
+// surface position and strata on the compositor side, nothing is re-rendered or uploaded.
+//
+//==================================================================================================
+
+static DevPrivateKeyRec sparkleWindowPrivateKeyRec;
+#define sparkleWindowPrivateKey (&sparkleWindowPrivateKeyRec)
+
+/* Set while a newly realized window in a redirected pixmap waits for its first exposure */
+static DevPrivateKeyRec sparkleExposePrivateKeyRec;
+#define sparkleExposePrivateKey (&sparkleExposePrivateKeyRec)
+
+typedef struct _sparklePixmapVisit
+{
+    PixmapPtr oldPixmap;
+    PixmapPtr newPixmap;
+} SparklePixmapVisitRec, *SparklePixmapVisitPtr;
+
+static SparkleWindowPtr SparkleGetWindow(WindowPtr pWin)
+{
+    return dixLookupPrivate(&pWin->devPrivates, sparkleWindowPrivateKey);
+}
+
+/* The redirected top-level whose pixmap pWin draws into, NULL when it draws into the screen or another pixmap */
+static SparkleWindowPtr SparkleGetTopLevel(ScreenPtr pScreen, WindowPtr pWin)
+{
+    SparkleWindowPtr sWin;
+    WindowPtr pTop = pWin;
+
+    if (pWin->parent == NULL)
+        return NULL;
+
+    while (pTop->parent->parent != NULL)
+        pTop = pTop->parent;
+
+    sWin = SparkleGetWindow(pTop);
+    if (sWin == NULL || (*pScreen->GetWindowPixmap)(pWin) != sWin->pixmap)
+        return NULL;
+
+    return sWin;
+}
+
+static Bool SparkleIsRedirectable(ScrnInfoPtr pScrn, WindowPtr pWin)
+{
+    if (pWin->parent == NULL || pWin->parent->parent != NULL)
+        return FALSE;
+
+    if (pWin->drawable.class != InputOutput)
+        return FALSE;
+
+    /* ARGB windows and other foreign depths stay in the screen pixmap */
+    if (pWin->drawable.depth != pScrn->depth)
+        return FALSE;
+
+    return TRUE;
+}
+
+static int SparkleSetPixmapVisit(WindowPtr pWin, void *data)
+{
+    SparklePixmapVisitPtr visit = (SparklePixmapVisitPtr)data;
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+
+    if ((*pScreen->GetWindowPixmap)(pWin) != visit->oldPixmap)
+        return WT_DONTWALKCHILDREN;
+
+    (*pScreen->SetWindowPixmap)(pWin, visit->newPixmap);
+    pWin->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+
+    return WT_WALKCHILDREN;
+}
+
+static void SparkleUpdateStrata(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    WindowPtr pWin;
+    int strata = 1;
+
+    /* Root surface stays at 0, windows follow the X stacking order from the bottom up */
+    for (pWin = pScreen->root->lastChild; pWin != NULL; pWin = pWin->prevSib)
+    {
+        if (SparkleGetWindow(pWin) != NULL)
+            sparkle_c_window_strata(dPtr->sparkle, pWin->drawable.id, strata++);
+    }
+}
+
+static SparkleWindowPtr SparkleRedirectWindow(ScreenPtr pScreen, WindowPtr pWin)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    SparkleWindowPtr sWin;
+    SparklePixmapVisitRec visit;
+    PixmapPtr pPixmap;
+    void *data;
+    int bw = wBorderWidth(pWin);
+    int x = pWin->drawable.x - bw;
+    int y = pWin->drawable.y - bw;
+    int width = pWin->drawable.width + 2 * bw;
+    int height = pWin->drawable.height + 2 * bw;
+    int cpp = (pScrn->bitsPerPixel + 7) / 8;
+    int pitch = (width * cpp + 3) & ~3;
+
+    sWin = calloc(1, sizeof(SparkleWindowRec));
+    if (sWin == NULL)
+        return NULL;
+
+    /* The surface is as wide as the window, its rows are the padded scanlines */
+    data = sparkle_c_window_create(dPtr->sparkle, pWin->drawable.id, width, height, pitch / cpp);
+
+    pPixmap = (*pScreen->CreatePixmap)(pScreen, 0, 0, pWin->drawable.depth, 0);
+    if (pPixmap == NULL)
+    {
+        sparkle_c_window_destroy(dPtr->sparkle, pWin->drawable.id);
+        free(sWin);
+        return NULL;
+    }
+
+    (*pScreen->ModifyPixmapHeader)(pPixmap, width, height, pWin->drawable.depth, pScrn->bitsPerPixel, pitch, data);
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+
+    visit.oldPixmap = (*pScreen->GetWindowPixmap)(pWin);
+    visit.newPixmap = pPixmap;
+    TraverseTree(pWin, SparkleSetPixmapVisit, &visit);
+
+    sWin->damage = DamageCreate(NULL, NULL, DamageReportNone, TRUE, pScreen, pPixmap);
+    if (sWin->damage != NULL)
+        DamageRegister(&pPixmap->drawable, sWin->damage);
+
+    sWin->window = pWin;
+    sWin->pixmap = pPixmap;
+    sWin->next = dPtr->windows;
+    dPtr->windows = sWin;
+
+    dixSetPrivate(&pWin->devPrivates, sparkleWindowPrivateKey, sWin);
+
+    sparkle_c_window_position(dPtr->sparkle, pWin->drawable.id, x, y, x + width, y + height);
+
+    return sWin;
+}
+
+static void SparkleUnredirectWindow(ScreenPtr pScreen, SparkleWindowPtr sWin)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    SparkleWindowPtr *link;
+    SparklePixmapVisitRec visit;
+    WindowPtr pWin = sWin->window;
+
+    visit.oldPixmap = sWin->pixmap;
+    visit.newPixmap = (*pScreen->GetScreenPixmap)(pScreen);
+    TraverseTree(pWin, SparkleSetPixmapVisit, &visit);
+
+    if (sWin->damage != NULL)
+    {
+        DamageUnregister(sWin->damage);
+        DamageDestroy(sWin->damage);
+    }
+
+    (*pScreen->DestroyPixmap)(sWin->pixmap);
 
+    sparkle_c_window_destroy(dPtr->sparkle, pWin->drawable.id);
+
+    for (link = &dPtr->windows; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == sWin)
+        {
+            *link = sWin->next;
+            break;
+        }
+    }
+
+    dixSetPrivate(&pWin->devPrivates, sparkleWindowPrivateKey, NULL);
+    free(sWin);
+}
+
+static void SparkleResizeWindow(ScreenPtr pScreen, SparkleWindowPtr sWin)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    SparklePixmapVisitRec visit;
+    WindowPtr pWin = sWin->window;
+    PixmapPtr pPixmap = sWin->pixmap;
+    void *data;
+    int bw = wBorderWidth(pWin);
+    int x = pWin->drawable.x - bw;
+    int y = pWin->drawable.y - bw;
+    int width = pWin->drawable.width + 2 * bw;
+    int height = pWin->drawable.height + 2 * bw;
+    int cpp = (pScrn->bitsPerPixel + 7) / 8;
+    int pitch = (width * cpp + 3) & ~3;
+
+    /* The surface keeps its name and strata and starts with the old contents, the client only repaints what the
+     * resize exposed, so the pixmap is only pointed at the new memory */
+    data = sparkle_c_window_resize(dPtr->sparkle, pWin->drawable.id, width, height, pitch / cpp);
+
+    (*pScreen->ModifyPixmapHeader)(pPixmap, width, height, pWin->drawable.depth, pScrn->bitsPerPixel, pitch, data);
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+    pPixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+
+    /* Same pixmap, new serial numbers so GCs are validated against the new memory */
+    visit.oldPixmap = pPixmap;
+    visit.newPixmap = pPixmap;
+    TraverseTree(pWin, SparkleSetPixmapVisit, &visit);
+
+    /* The compositor takes the new surface whole */
+    if (sWin->damage != NULL)
+        DamageEmpty(sWin->damage);
+
+    sparkle_c_window_position(dPtr->sparkle, pWin->drawable.id, x, y, x + width, y + height);
+}
+
+static Bool SparkleCreateWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+    PixmapPtr pPixmap;
+    Bool ret;
+
+    pScreen->CreateWindow = dPtr->CreateWindow;
+    ret = (*pScreen->CreateWindow)(pWin);
+    dPtr->CreateWindow = pScreen->CreateWindow;
+    pScreen->CreateWindow = SparkleCreateWindow;
+
+    /* Children of a redirected window draw into the pixmap of their top-level */
+    if (ret && pWin->parent != NULL)
+    {
+        pPixmap = (*pScreen->GetWindowPixmap)(pWin->parent);
+        if (pPixmap != (*pScreen->GetScreenPixmap)(pScreen) && pPixmap->drawable.depth == pWin->drawable.depth)
+            (*pScreen->SetWindowPixmap)(pWin, pPixmap);
+    }
+
+    return ret;
+}
+
+static Bool SparkleRealizeWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    Bool ret;
+
+    if (SparkleIsRedirectable(pScrn, pWin) && SparkleGetWindow(pWin) == NULL)
+    {
+        if (SparkleRedirectWindow(pScreen, pWin) != NULL)
+            SparkleUpdateStrata(pScreen);
+    }
+
+    pScreen->RealizeWindow = dPtr->RealizeWindow;
+    ret = (*pScreen->RealizeWindow)(pWin);
+    dPtr->RealizeWindow = pScreen->RealizeWindow;
+    pScreen->RealizeWindow = SparkleRealizeWindow;
+
+    if (SparkleGetTopLevel(pScreen, pWin) != NULL)
+        dixSetPrivate(&pWin->devPrivates, sparkleExposePrivateKey, pWin);
+
+    return ret;
+}
+
+static Bool SparkleUnrealizeWindow(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+    SparkleWindowPtr sWin;
+    Bool ret;
+
+    pScreen->UnrealizeWindow = dPtr->UnrealizeWindow;
+    ret = (*pScreen->UnrealizeWindow)(pWin);
+    dPtr->UnrealizeWindow = pScreen->UnrealizeWindow;
+    pScreen->UnrealizeWindow = SparkleUnrealizeWindow;
+
+    sWin = SparkleGetWindow(pWin);
+    if (sWin != NULL)
+        SparkleUnredirectWindow(pScreen, sWin);
+
+    return ret;
+}
+
+static Bool SparklePositionWindow(WindowPtr pWin, int x, int y)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+    SparkleWindowPtr sWin;
+    PixmapPtr pPixmap;
+    Bool ret;
+    int bw;
+    int nx;
+    int ny;
+
+    pScreen->PositionWindow = dPtr->PositionWindow;
+    ret = (*pScreen->PositionWindow)(pWin, x, y);
+    dPtr->PositionWindow = pScreen->PositionWindow;
+    pScreen->PositionWindow = SparklePositionWindow;
+
+    sWin = SparkleGetWindow(pWin);
+    if (sWin == NULL)
+        return ret;
+
+    bw = wBorderWidth(pWin);
+
+    if (sWin->pixmap->drawable.width != pWin->drawable.width + 2 * bw ||
+        sWin->pixmap->drawable.height != pWin->drawable.height + 2 * bw)
+    {
+        SparkleResizeWindow(pScreen, sWin);
+        return ret;
+    }
+
+    pPixmap = sWin->pixmap;
+    nx = pWin->drawable.x - bw;
+    ny = pWin->drawable.y - bw;
+
+    if (pPixmap->screen_x != nx || pPixmap->screen_y != ny)
+    {
+        pPixmap->screen_x = nx;
+        pPixmap->screen_y = ny;
+        pPixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+
+        sparkle_c_window_position(dPtr->sparkle, pWin->drawable.id,
+            nx, ny, nx + pPixmap->drawable.width, ny + pPixmap->drawable.height);
+    }
+
+    return ret;
+}
+
+/*
+ * A window in a redirected pixmap is only clipped by its own children: the siblings above it draw into their own
+ * surfaces, what they cover is still there when they go away. Clips are left alone for the screen pixmap and for
+ * anything Composite redirected.
+ */
+static void SparkleClipNotify(WindowPtr pWin, int dx, int dy)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+    WindowPtr pChild;
+
+    if (dPtr->ClipNotify != NULL)
+    {
+        pScreen->ClipNotify = dPtr->ClipNotify;
+        (*pScreen->ClipNotify)(pWin, dx, dy);
+        dPtr->ClipNotify = pScreen->ClipNotify;
+        pScreen->ClipNotify = SparkleClipNotify;
+    }
+
+    if (!pWin->viewable || SparkleGetTopLevel(pScreen, pWin) == NULL)
+        return;
+
+    RegionCopy(&pWin->borderClip, &pWin->borderSize);
+    RegionCopy(&pWin->clipList, &pWin->winSize);
+
+    for (pChild = pWin->firstChild; pChild != NULL; pChild = pChild->nextSib)
+    {
+        if (pChild->viewable)
+            RegionSubtract(&pWin->clipList, &pWin->clipList, &pChild->borderSize);
+    }
+
+    pWin->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+}
+
+/* Parts covered by siblings when the window was mapped are never exposed later, the first exposure takes it all */
+static void SparkleWindowExposures(WINDOW_EXPOSURES_ARGS_DECL)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+
+    if (dixLookupPrivate(&pWin->devPrivates, sparkleExposePrivateKey) != NULL)
+    {
+        dixSetPrivate(&pWin->devPrivates, sparkleExposePrivateKey, NULL);
+
+        if (SparkleGetTopLevel(pScreen, pWin) != NULL)
+            RegionCopy(prgn, &pWin->clipList);
+    }
+
+    pScreen->WindowExposures = dPtr->WindowExposures;
+    (*pScreen->WindowExposures)(WINDOW_EXPOSURES_ARGS);
+    dPtr->WindowExposures = pScreen->WindowExposures;
+    pScreen->WindowExposures = SparkleWindowExposures;
+}
+
+static void SparkleCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr prgnSrc)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+
+    /* The contents of a redirected top-level do not move inside its own pixmap */
+    if (SparkleGetWindow(pWin) != NULL)
+        return;
+
+    pScreen->CopyWindow = dPtr->CopyWindow;
+    (*pScreen->CopyWindow)(pWin, ptOldOrg, prgnSrc);
+    dPtr->CopyWindow = pScreen->CopyWindow;
+    pScreen->CopyWindow = SparkleCopyWindow;
+}
+
+static void SparkleRestackWindow(WindowPtr pWin, WindowPtr pOldNextSib)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    DUMMYPtr dPtr = DUMMYPTR(xf86ScreenToScrn(pScreen));
+
+    if (dPtr->RestackWindow != NULL)
+    {
+        pScreen->RestackWindow = dPtr->RestackWindow;
+        (*pScreen->RestackWindow)(pWin, pOldNextSib);
+        dPtr->RestackWindow = pScreen->RestackWindow;
+        pScreen->RestackWindow = SparkleRestackWindow;
+    }
+
+    if (pWin->parent != NULL && pWin->parent->parent == NULL)
+        SparkleUpdateStrata(pScreen);
+}
+
+static Bool SparkleRootlessInit(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+
+    if (!dixRegisterPrivateKey(sparkleWindowPrivateKey, PRIVATE_WINDOW, 0) ||
+        !dixRegisterPrivateKey(sparkleExposePrivateKey, PRIVATE_WINDOW, 0))
+    {
+        xf86DrvMsg(pScrn->scrnIndex, X_ERROR, "Failed to register rootless window private\n");
+        return FALSE;
+    }
+
+    dPtr->windows = NULL;
+
+    dPtr->CreateWindow = pScreen->CreateWindow;
+    pScreen->CreateWindow = SparkleCreateWindow;
+    dPtr->RealizeWindow = pScreen->RealizeWindow;
+    pScreen->RealizeWindow = SparkleRealizeWindow;
+    dPtr->UnrealizeWindow = pScreen->UnrealizeWindow;
+    pScreen->UnrealizeWindow = SparkleUnrealizeWindow;
+    dPtr->PositionWindow = pScreen->PositionWindow;
+    pScreen->PositionWindow = SparklePositionWindow;
+    dPtr->CopyWindow = pScreen->CopyWindow;
+    pScreen->CopyWindow = SparkleCopyWindow;
+    dPtr->RestackWindow = pScreen->RestackWindow;
+    pScreen->RestackWindow = SparkleRestackWindow;
+    dPtr->ClipNotify = pScreen->ClipNotify;
+    pScreen->ClipNotify = SparkleClipNotify;
+    dPtr->WindowExposures = pScreen->WindowExposures;
+    pScreen->WindowExposures = SparkleWindowExposures;
+
+    return TRUE;
+}
+
+static void SparkleRootlessFini(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+
+    while (dPtr->windows != NULL)
+        SparkleUnredirectWindow(pScreen, dPtr->windows);
+
+    pScreen->CreateWindow = dPtr->CreateWindow;
+    pScreen->RealizeWindow = dPtr->RealizeWindow;
+    pScreen->UnrealizeWindow = dPtr->UnrealizeWindow;
+    pScreen->PositionWindow = dPtr->PositionWindow;
+    pScreen->CopyWindow = dPtr->CopyWindow;
+    pScreen->RestackWindow = dPtr->RestackWindow;
+    pScreen->ClipNotify = dPtr->ClipNotify;
+    pScreen->WindowExposures = dPtr->WindowExposures;
+}
+
+static void SparkleRootlessDamage(ScreenPtr pScreen)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+    DUMMYPtr dPtr = DUMMYPTR(pScrn);
+    SparkleWindowPtr sWin;
+    RegionPtr pRegion;
+
+    for (sWin = dPtr->windows; sWin != NULL; sWin = sWin->next)
+    {
+        if (sWin->damage == NULL)
+            continue;
+
+        pRegion = DamageRegion(sWin->damage);
+
+        if (RegionNotEmpty(pRegion))
+        {
+            sparkle_c_window_damage(dPtr->sparkle, sWin->window->drawable.id,
+                pRegion->extents.x1, pRegion->extents.y1, pRegion->extents.x2, pRegion->extents.y2);
+
+            DamageEmpty(sWin->damage);
+        }
+    }
+}
+
+#endif
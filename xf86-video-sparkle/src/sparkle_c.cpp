@@ -3,9 +3,293 @@
 #include "common/sparkle_connection.h"
 #include "common/sparkle_protocol.h"
 #include "common/sparkle_surface_ashmem.h"
+#include "common/sparkle_codec.h"
+#include "were/were_timer.h"
 #include <unistd.h>
 #include <cstring>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPARKLE_C_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SPARKLE_C_NEON
+#endif
+
+/* ================================================================================================================== */
+
+typedef bool (*SparkleCRowDiffer)(const unsigned char *a, const unsigned char *b, int n);
+
+static bool row_differs_scalar(const unsigned char *a, const unsigned char *b, int n)
+{
+    return memcmp(a, b, n) != 0;
+}
+
+#ifdef SPARKLE_C_X86
+
+__attribute__((target("sse2")))
+static bool row_differs_sse2(const unsigned char *a, const unsigned char *b, int n)
+{
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16));
+        __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a0, b0), _mm_cmpeq_epi8(a1, b1));
+
+        if (_mm_movemask_epi8(eq) != 0xFFFF)
+            return true;
+    }
+
+    return row_differs_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static bool row_differs_avx2(const unsigned char *a, const unsigned char *b, int n)
+{
+    int i = 0;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 32));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 32));
+        __m256i x = _mm256_or_si256(_mm256_xor_si256(a0, b0), _mm256_xor_si256(a1, b1));
+
+        if (!_mm256_testz_si256(x, x))
+            return true;
+    }
+
+    return row_differs_sse2(a + i, b + i, n - i);
+}
+
+#endif
+
+#ifdef SPARKLE_C_NEON
+
+static bool row_differs_neon(const unsigned char *a, const unsigned char *b, int n)
+{
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        uint8x16_t x0 = veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        uint8x16_t x1 = veorq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16));
+        uint32x4_t x = vreinterpretq_u32_u8(vorrq_u8(x0, x1));
+        uint32x2_t r = vorr_u32(vget_low_u32(x), vget_high_u32(x));
+
+        if (vget_lane_u32(vpmax_u32(r, r), 0) != 0)
+            return true;
+    }
+
+    return row_differs_scalar(a + i, b + i, n - i);
+}
+
+#endif
+
+static SparkleCRowDiffer row_differs_select(const char **name)
+{
+#ifdef SPARKLE_C_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = "AVX2";
+        return row_differs_avx2;
+    }
+
+    if (__builtin_cpu_supports("sse2"))
+    {
+        *name = "SSE2";
+        return row_differs_sse2;
+    }
+#endif
+
+#ifdef SPARKLE_C_NEON
+    *name = "NEON";
+    return row_differs_neon;
+#endif
+
+    *name = "scalar";
+    return row_differs_scalar;
+}
+
+/* ================================================================================================================== */
+
+struct SparkleCRect
+{
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+};
+
+/* Copy of what the compositor has seen, used to drop damage that did not change any pixels */
+class SparkleCShadow
+{
+public:
+    explicit SparkleCShadow(WereSurface *surface);
+
+    void refine(const unsigned char *data, int x1, int y1, int x2, int y2, std::vector<SparkleCRect> *out);
+
+    unsigned char *data() {return pixels_.data();}
+    void reset() {std::fill(pixels_.begin(), pixels_.end(), 0);}
+
+private:
+    static const int tileWidth = 64;
+    static const int tileHeight = 16;
+
+    static SparkleCRowDiffer differ_;
+
+    int width_;
+    int height_;
+    int stride_;
+    int bytesPerPixel_;
+    std::vector<unsigned char> pixels_;
+};
+
+SparkleCRowDiffer SparkleCShadow::differ_ = nullptr;
+
+/* Laid out like the surface, padding included, so either can be indexed with the surface's stride */
+SparkleCShadow::SparkleCShadow(WereSurface *surface) :
+    width_(surface->width()), height_(surface->height()), stride_(surface->stride()),
+    bytesPerPixel_(surface->bytesPerPixel()),
+    pixels_(static_cast<size_t>(surface->stride()) * surface->height() * surface->bytesPerPixel())
+{
+    if (differ_ == nullptr)
+    {
+        const char *name;
+        differ_ = row_differs_select(&name);
+        were_debug("Shadow damage: using %s kernel.\n", name);
+    }
+
+    memcpy(pixels_.data(), surface->data(), pixels_.size());
+}
+
+void SparkleCShadow::refine(const unsigned char *data, int x1, int y1, int x2, int y2, std::vector<SparkleCRect> *out)
+{
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, width_);
+    y2 = std::min(y2, height_);
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    for (int ty = y1 / tileHeight; ty <= (y2 - 1) / tileHeight; ++ty)
+    {
+        int ry1 = std::max(y1, ty * tileHeight);
+        int ry2 = std::min(y2, (ty + 1) * tileHeight);
+        int runStart = -1;
+        int runEnd = -1;
+
+        for (int tx = x1 / tileWidth; tx <= (x2 - 1) / tileWidth + 1; ++tx)
+        {
+            bool changed = false;
+            int rx1 = std::max(x1, tx * tileWidth);
+            int rx2 = std::min(x2, (tx + 1) * tileWidth);
+
+            if (rx1 < rx2)
+            {
+                int length = (rx2 - rx1) * bytesPerPixel_;
+
+                for (int y = ry1; y < ry2; ++y)
+                {
+                    unsigned char *s = &pixels_[(static_cast<size_t>(y) * stride_ + rx1) * bytesPerPixel_];
+                    const unsigned char *d = &data[(static_cast<size_t>(y) * stride_ + rx1) * bytesPerPixel_];
+
+                    if (changed || differ_(s, d, length))
+                    {
+                        memcpy(s, d, length);
+                        changed = true;
+                    }
+                }
+            }
+
+            if (changed)
+            {
+                if (runStart < 0)
+                    runStart = rx1;
+                runEnd = rx2;
+            }
+            else if (runStart >= 0)
+            {
+                /* Extend the rectangle from the previous tile row when the run spans the same columns */
+                if (!out->empty() && out->back().x1 == runStart && out->back().x2 == runEnd && out->back().y2 == ry1)
+                    out->back().y2 = ry2;
+                else
+                    out->push_back({runStart, ry1, runEnd, ry2});
+
+                runStart = -1;
+            }
+        }
+    }
+}
+
+
+/* ================================================================================================================== */
+
+/* Stream mode sends the pixels in-band, plain process memory does without /dev/ashmem */
+class SparkleCSurfaceMemory : public WereSurface
+{
+public:
+    SparkleCSurfaceMemory(int width, int height, int stride, int bytesPerPixel) :
+        data_(static_cast<size_t>(stride) * height * bytesPerPixel, 0), width_(width), height_(height),
+        stride_(stride), bytesPerPixel_(bytesPerPixel) {}
+
+    unsigned char *data() {return data_.data();}
+    int width() {return width_;}
+    int height() {return height_;}
+    int stride() {return stride_;}
+    int bytesPerPixel() {return bytesPerPixel_;}
+
+private:
+    std::vector<unsigned char> data_;
+    int width_;
+    int height_;
+    int stride_;
+    int bytesPerPixel_;
+};
+
+/* ================================================================================================================== */
+
+class SparkleCWindow
+{
+public:
+    ~SparkleCWindow();
+    SparkleCWindow(const std::string &name, WereSurface *surface);
+
+    std::string name;
+    WereSurface *surface;
+    SparkleCShadow *shadow;
+    SparkleCRect pending;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int strata;
+};
+
+SparkleCWindow::~SparkleCWindow()
+{
+    delete shadow;
+    delete surface;
+}
+
+SparkleCWindow::SparkleCWindow(const std::string &name, WereSurface *surface) :
+    name(name), surface(surface), shadow(nullptr), pending({0, 0, 0, 0}), x1(0), y1(0), x2(surface->width()),
+    y2(surface->height()), strata(0)
+{
+}
 
 /* ================================================================================================================== */
 
@@ -13,7 +297,7 @@ class SparkleC
 {
 public:
     ~SparkleC();
-    SparkleC(const std::string &compositor, const std::string &surfaceName, const std::string &surfaceFile);
+    SparkleC(const std::string &compositor, const std::string &surfaceName, const std::string &surfaceFile, int depth);
 
     int fd() {return loop_->fd();}
     void process() {loop_->processEvents();}
@@ -21,44 +305,139 @@ public:
     void registerSurface();
     void unregisterSurface();
 
-    void resizeSurface(int width, int height);
+    void resizeSurface(int width, int height, int stride);
 
     void *surfaceData() {return surface_->data();}
     void damage(int x1, int y1, int x2, int y2);
 
+    void *createWindow(unsigned int id, int width, int height, int stride);
+    void *resizeWindow(unsigned int id, int width, int height, int stride);
+    void destroyWindow(unsigned int id);
+    void setWindowPosition(unsigned int id, int x1, int y1, int x2, int y2);
+    void setWindowStrata(unsigned int id, int strata);
+    void damageWindow(unsigned int id, int x1, int y1, int x2, int y2);
+
+    void setShadowDamage(bool enable);
+
     void (*display_size_callback)(void *user, int width, int height);
     void *display_size_user;
+    void (*purged_callback)(void *user);
+    void *purged_user;
 
 private:
     void handleConnection();
     void handleDisconnection();
     void handleMessage(std::shared_ptr<WereSocketUnixMessage> message);
+    void surfacePurgeable(const std::string &name, bool purgeable);
+
+    WereSurface *createSurface(int width, int height, int stride);
+    void registerWindow(SparkleCWindow *window);
+    SparkleCWindow *findWindow(unsigned int id);
+    void sendPosition(const std::string &name, int x1, int y1, int x2, int y2);
+
+    void sendDamage(const std::string &name, WereSurface *surface, SparkleCShadow *shadow,
+        SparkleCRect *pending, int x1, int y1, int x2, int y2);
+    void streamDamage(const std::string &name, WereSurface *surface, SparkleCShadow *shadow,
+        SparkleCRect *pending, int x1, int y1, int x2, int y2);
+    void streamPending();
+    void updateBandwidth();
+    void reportStatistics();
 
 private:
     WereEventLoop *loop_;
     SparkleConnection *connection_;
-    SparkleSurfaceAshmem *surface_;
+    WereSurface *surface_;
     std::string surfaceName_;
     std::string surfaceFile_;
+    int32_t format_;
+    int bytesPerPixel_;
     bool registered_;
+    std::map<unsigned int, SparkleCWindow *> windows_;
+    int displayWidth_;
+    int displayHeight_;
+
+    bool shadowDamage_;
+    SparkleCShadow *shadow_;
+    WereTimer *statisticsTimer_;
+    std::vector<SparkleCRect> rects_;
+    uint64_t reportedPixels_;
+    uint64_t forwardedPixels_;
+
+    /* TCP connections, pixels are sent in-band */
+    bool stream_;
+    SparkleCRect pending_;
+    WereTimer *streamTimer_;
+    bool streamScheduled_;
+    std::string encoded_;
+    int tileSize_;
+    uint64_t streamBytes_;
+    uint64_t streamBytesReported_;
+    uint64_t bandwidthBytes_;
+    double bandwidth_;
+    std::chrono::steady_clock::time_point bandwidthTime_;
 };
 
 SparkleC::~SparkleC()
 {
+    for (auto it = windows_.begin(); it != windows_.end(); ++it)
+    {
+        connection_->send(UnregisterSurfaceRequest({it->second->name}));
+        delete it->second;
+    }
+    windows_.clear();
+
     unregisterSurface();
 
+    delete streamTimer_;
+    delete statisticsTimer_;
+    delete shadow_;
     delete surface_;
     delete connection_;
     delete loop_;
 }
 
-SparkleC::SparkleC(const std::string &compositor, const std::string &surfaceName, const std::string &surfaceFile)
+SparkleC::SparkleC(const std::string &compositor, const std::string &surfaceName, const std::string &surfaceFile, int depth)
 {
+    format_ = (depth == 16) ? SurfaceFormatRGB565 : SurfaceFormatXRGB8888;
+    bytesPerPixel_ = surfaceFormatBytesPerPixel(format_);
+
     loop_ = new WereEventLoop();
     connection_ = new SparkleConnection(loop_, compositor);
-    surface_ = new SparkleSurfaceAshmem(800, 600);
     surfaceName_ = surfaceName;
     surfaceFile_ = surfaceFile;
+    registered_ = false;
+    displayWidth_ = 0;
+    displayHeight_ = 0;
+    purged_callback = nullptr;
+    purged_user = nullptr;
+
+    shadowDamage_ = false;
+    shadow_ = nullptr;
+    reportedPixels_ = 0;
+    forwardedPixels_ = 0;
+
+    statisticsTimer_ = new WereTimer(loop_);
+    statisticsTimer_->timeout.connect(WereSimpleQueuer(loop_, &SparkleC::reportStatistics, this));
+
+    std::string host;
+    std::string port;
+    stream_ = were_socket_tcp_address(compositor, &host, &port);
+    surface_ = createSurface(800, 600, 800);
+    pending_ = {0, 0, 0, 0};
+    tileSize_ = 64;
+    streamBytes_ = 0;
+    streamBytesReported_ = 0;
+    bandwidthBytes_ = 0;
+    bandwidth_ = 0.0;
+    bandwidthTime_ = std::chrono::steady_clock::now();
+
+    streamScheduled_ = false;
+    streamTimer_ = new WereTimer(loop_);
+    streamTimer_->timeout.connect(WereSimpleQueuer(loop_, &SparkleC::streamPending, this));
+
+    /* The shadow copies double as the reference of what the compositor has */
+    if (stream_)
+        setShadowDamage(true);
 
     connection_->signal_connected.connect(WereSimpleQueuer(loop_, &SparkleC::handleConnection, this));
     connection_->signal_disconnected.connect(WereSimpleQueuer(loop_, &SparkleC::handleDisconnection, this));
@@ -69,9 +448,20 @@ SparkleC::SparkleC(const std::string &compositor, const std::string &surfaceName
 
 void SparkleC::registerSurface()
 {
-    connection_->send(RegisterSurfaceAshmemRequest({surfaceName_, surface_->fd(), surface_->width(), surface_->height()}));
-    connection_->send(SetSurfacePositionRequest({surfaceName_, 0, 0, surface_->width(), surface_->height()}));
+    if (stream_)
+        connection_->send(RegisterSurfaceStreamRequest({surfaceName_, surface_->width(), surface_->height(), format_}));
+    else
+        connection_->send(RegisterSurfaceAshmemRequest({surfaceName_, static_cast<SparkleSurfaceAshmem *>(surface_)->fd(),
+            surface_->width(), surface_->height(), surface_->stride(), format_}));
+    sendPosition(surfaceName_, 0, 0, surface_->width(), surface_->height());
     registered_ = true;
+
+    if (stream_)
+    {
+        shadow_->reset();
+        pending_ = {0, 0, 0, 0};
+        streamDamage(surfaceName_, surface_, shadow_, &pending_, 0, 0, surface_->width(), surface_->height());
+    }
 }
 
 void SparkleC::unregisterSurface()
@@ -81,25 +471,36 @@ void SparkleC::unregisterSurface()
     registered_ = false;
 }
 
-void SparkleC::resizeSurface(int width, int height)
+void SparkleC::resizeSurface(int width, int height, int stride)
 {
-    if (registered_)
-    {
+    bool registered = registered_;
+
+    if (registered)
         unregisterSurface();
-        delete surface_;
-        surface_ = new SparkleSurfaceAshmem(width, height);
+
+    delete shadow_;
+    shadow_ = nullptr;
+    delete surface_;
+    surface_ = createSurface(width, height, stride);
+
+    if (shadowDamage_)
+        shadow_ = new SparkleCShadow(surface_);
+
+    if (registered)
         registerSurface();
-    }
-    else
-    {
-        delete surface_;
-        surface_ = new SparkleSurfaceAshmem(width, height);
-    }
 }
 
 void SparkleC::handleConnection()
 {
+    /* Input is handled by the input driver, surfaces in shared memory can be unpinned while hidden */
+    uint32_t mask = EventMaskDisplaySize;
+    if (!stream_)
+        mask |= EventMaskSurfacePurgeable;
+    connection_->send(SetEventMaskRequest({std::string(), mask}));
     registerSurface();
+
+    for (auto it = windows_.begin(); it != windows_.end(); ++it)
+        registerWindow(it->second);
 }
 
 void SparkleC::handleDisconnection()
@@ -119,20 +520,454 @@ void SparkleC::handleMessage(std::shared_ptr<WereSocketUnixMessage> message)
         DisplaySizeNotification r1;
         stream >> r1;
 
-        display_size_callback(display_size_user, r1.width, r1.height);
+        displayWidth_ = r1.width;
+        displayHeight_ = r1.height;
+
+        /* The framebuffer is rendered at the scale the compositor asks for and stretched over the display */
+        int width = r1.width;
+        int height = r1.height;
+        if (r1.scale > 0 && r1.scale < DisplayScaleUnit)
+        {
+            width = std::max(static_cast<int64_t>(r1.width) * r1.scale / DisplayScaleUnit & ~7, int64_t(8));
+            height = std::max(static_cast<int64_t>(r1.height) * r1.scale / DisplayScaleUnit & ~1, int64_t(2));
+        }
+
+        if (registered_)
+        {
+            sendPosition(surfaceName_, 0, 0, surface_->width(), surface_->height());
+
+            for (auto it = windows_.begin(); it != windows_.end(); ++it)
+            {
+                SparkleCWindow *window = it->second;
+                sendPosition(window->name, window->x1, window->y1, window->x2, window->y2);
+            }
+        }
+
+        display_size_callback(display_size_user, width, height);
+    }
+    else if (operation == SurfacePurgeableNotificationCode)
+    {
+        SurfacePurgeableNotification r1;
+        stream >> r1;
+        surfacePurgeable(r1.name, r1.purgeable != 0);
+    }
+}
+
+/* Pinned again the memory is damaged whole, what the kernel purged is redrawn by the server first */
+void SparkleC::surfacePurgeable(const std::string &name, bool purgeable)
+{
+    WereSurface *surface = nullptr;
+    SparkleCShadow *shadow = nullptr;
+
+    if (name == surfaceName_)
+    {
+        surface = surface_;
+        shadow = shadow_;
+    }
+    else
+    {
+        for (auto it = windows_.begin(); it != windows_.end(); ++it)
+        {
+            if (it->second->name == name)
+            {
+                surface = it->second->surface;
+                shadow = it->second->shadow;
+            }
+        }
+    }
+
+    /* Only shared memory surfaces are purgeable, stream mode does not subscribe */
+    SparkleSurfaceAshmem *ashmem = dynamic_cast<SparkleSurfaceAshmem *>(surface);
+    if (ashmem == nullptr)
+        return;
+
+    if (purgeable)
+    {
+        ashmem->unpin();
+        return;
+    }
+
+    if (!ashmem->pin())
+    {
+        were_message("Surface [%s] was purged.\n", name.c_str());
+
+        if (shadow != nullptr)
+            shadow->reset();
+        if (purged_callback != nullptr)
+            purged_callback(purged_user);
     }
+
+    connection_->send(AddSurfaceDamageRequest({name, 0, 0, surface->width(), surface->height()}));
 }
 
 void SparkleC::damage(int x1, int y1, int x2, int y2)
 {
-    connection_->send(AddSurfaceDamageRequest({surfaceName_, x1, y1, x2, y2}));
+    sendDamage(surfaceName_, surface_, shadow_, &pending_, x1, y1, x2, y2);
+}
+
+void SparkleC::sendDamage(const std::string &name, WereSurface *surface, SparkleCShadow *shadow,
+    SparkleCRect *pending, int x1, int y1, int x2, int y2)
+{
+    if (stream_)
+    {
+        streamDamage(name, surface, shadow, pending, x1, y1, x2, y2);
+        return;
+    }
+
+    if (shadow == nullptr)
+    {
+        connection_->send(AddSurfaceDamageRequest({name, x1, y1, x2, y2}));
+        return;
+    }
+
+    rects_.clear();
+    shadow->refine(surface->data(), x1, y1, x2, y2, &rects_);
+
+    reportedPixels_ += static_cast<uint64_t>(x2 - x1) * (y2 - y1);
+
+    for (auto &r : rects_)
+    {
+        connection_->send(AddSurfaceDamageRequest({name, r.x1, r.y1, r.x2, r.y2}));
+        forwardedPixels_ += static_cast<uint64_t>(r.x2 - r.x1) * (r.y2 - r.y1);
+    }
+}
+
+void SparkleC::setShadowDamage(bool enable)
+{
+    enable = enable || stream_;
+
+    if (shadowDamage_ == enable)
+        return;
+
+    shadowDamage_ = enable;
+
+    delete shadow_;
+    shadow_ = nullptr;
+
+    for (auto it = windows_.begin(); it != windows_.end(); ++it)
+    {
+        delete it->second->shadow;
+        it->second->shadow = nullptr;
+    }
+
+    if (enable)
+    {
+        shadow_ = new SparkleCShadow(surface_);
+
+        for (auto it = windows_.begin(); it != windows_.end(); ++it)
+            it->second->shadow = new SparkleCShadow(it->second->surface);
+
+        statisticsTimer_->start(10000, false);
+    }
+    else
+        statisticsTimer_->stop();
+}
+
+void SparkleC::reportStatistics()
+{
+    if (reportedPixels_ == 0)
+        return;
+
+    were_debug("Shadow damage: reported %llu px, forwarded %llu px (%.1f%%).\n",
+        static_cast<unsigned long long>(reportedPixels_), static_cast<unsigned long long>(forwardedPixels_),
+        100.0 * forwardedPixels_ / reportedPixels_);
+
+    if (stream_)
+    {
+        were_debug("Stream: %llu bytes sent, %.1f KB/s estimated, %d px tiles.\n",
+            static_cast<unsigned long long>(streamBytes_ - streamBytesReported_), bandwidth_ / 1024.0, tileSize_);
+        streamBytesReported_ = streamBytes_;
+    }
+
+    reportedPixels_ = 0;
+    forwardedPixels_ = 0;
+}
+
+/* ================================================================================================================== */
+
+const unsigned int STREAM_BACKLOG = 2 * 1024 * 1024;
+
+void SparkleC::streamDamage(const std::string &name, WereSurface *surface, SparkleCShadow *shadow,
+    SparkleCRect *pending, int x1, int y1, int x2, int y2)
+{
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, surface->width());
+    y2 = std::min(y2, surface->height());
+
+    if (x1 < x2 && y1 < y2)
+    {
+        reportedPixels_ += static_cast<uint64_t>(x2 - x1) * (y2 - y1);
+
+        if (pending->x1 < pending->x2 && pending->y1 < pending->y2)
+        {
+            pending->x1 = std::min(pending->x1, x1);
+            pending->y1 = std::min(pending->y1, y1);
+            pending->x2 = std::max(pending->x2, x2);
+            pending->y2 = std::max(pending->y2, y2);
+        }
+        else
+            *pending = {x1, y1, x2, y2};
+    }
+
+    if (pending->x1 >= pending->x2 || pending->y1 >= pending->y2 || !connection_->connected())
+        return;
+
+    updateBandwidth();
+
+    /* Let the socket drain, the damage stays pending and is merged with whatever comes next */
+    if (connection_->bytesPending() > STREAM_BACKLOG)
+    {
+        if (!streamScheduled_)
+        {
+            streamScheduled_ = true;
+            streamTimer_->start(10, true);
+        }
+        return;
+    }
+
+    SparkleCRect r = *pending;
+    *pending = {0, 0, 0, 0};
+
+    int bpp = surface->bytesPerPixel();
+    int stride = surface->stride() * bpp;
+
+    for (int ty = r.y1 / tileSize_; ty <= (r.y2 - 1) / tileSize_; ++ty)
+    {
+        for (int tx = r.x1 / tileSize_; tx <= (r.x2 - 1) / tileSize_; ++tx)
+        {
+            int tx1 = std::max(r.x1, tx * tileSize_);
+            int ty1 = std::max(r.y1, ty * tileSize_);
+            int tx2 = std::min(r.x2, (tx + 1) * tileSize_);
+            int ty2 = std::min(r.y2, (ty + 1) * tileSize_);
+
+            SparkleCodec::encodeDelta(surface->data(), shadow->data(), stride, tx1, ty1, tx2, ty2, bpp, &encoded_);
+            if (encoded_.empty())
+                continue;
+
+            int32_t codec = SurfaceCodecDelta;
+            if (encoded_.size() >= static_cast<size_t>((tx2 - tx1) * (ty2 - ty1) * bpp))
+            {
+                SparkleCodec::encodeRaw(surface->data(), stride, tx1, ty1, tx2, ty2, bpp, &encoded_);
+                codec = SurfaceCodecRaw;
+            }
+
+            connection_->send(SurfaceDataRequest({name, tx1, ty1, tx2, ty2, codec, encoded_}));
+
+            streamBytes_ += encoded_.size();
+            forwardedPixels_ += static_cast<uint64_t>(tx2 - tx1) * (ty2 - ty1);
+        }
+    }
+}
+
+void SparkleC::streamPending()
+{
+    streamScheduled_ = false;
+
+    streamDamage(surfaceName_, surface_, shadow_, &pending_, 0, 0, 0, 0);
+
+    for (auto it = windows_.begin(); it != windows_.end(); ++it)
+    {
+        SparkleCWindow *window = it->second;
+        streamDamage(window->name, window->surface, window->shadow, &window->pending, 0, 0, 0, 0);
+    }
+}
+
+void SparkleC::updateBandwidth()
+{
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - bandwidthTime_).count();
+
+    if (elapsed < 0.5)
+        return;
+
+    uint64_t drained = streamBytes_ - connection_->bytesPending();
+    double sample = (drained - bandwidthBytes_) / elapsed;
+
+    bandwidth_ = (bandwidth_ == 0.0) ? sample : bandwidth_ * 0.75 + sample * 0.25;
+    bandwidthBytes_ = drained;
+    bandwidthTime_ = now;
+
+    /* Small tiles keep slow links from resending unchanged pixels, large ones cut per-message overhead */
+    int tileSize;
+    if (bandwidth_ < 2.0 * 1024 * 1024)
+        tileSize = 32;
+    else if (bandwidth_ < 16.0 * 1024 * 1024)
+        tileSize = 64;
+    else if (bandwidth_ < 64.0 * 1024 * 1024)
+        tileSize = 128;
+    else
+        tileSize = 256;
+
+    if (tileSize != tileSize_)
+    {
+        were_debug("Stream: %.1f KB/s, switching to %d px tiles.\n", bandwidth_ / 1024.0, tileSize);
+        tileSize_ = tileSize;
+    }
+}
+
+/* ================================================================================================================== */
+
+WereSurface *SparkleC::createSurface(int width, int height, int stride)
+{
+    if (stream_)
+        return new SparkleCSurfaceMemory(width, height, stride, bytesPerPixel_);
+
+    return new SparkleSurfaceAshmem(width, height, stride, bytesPerPixel_);
+}
+
+void SparkleC::registerWindow(SparkleCWindow *window)
+{
+    WereSurface *surface = window->surface;
+
+    if (stream_)
+        connection_->send(RegisterSurfaceStreamRequest({window->name, surface->width(), surface->height(), format_}));
+    else
+        connection_->send(RegisterSurfaceAshmemRequest({window->name, static_cast<SparkleSurfaceAshmem *>(surface)->fd(),
+            surface->width(), surface->height(), surface->stride(), format_}));
+    sendPosition(window->name, window->x1, window->y1, window->x2, window->y2);
+    connection_->send(SetSurfaceStrataRequest({window->name, window->strata}));
+
+    if (stream_)
+    {
+        window->shadow->reset();
+        window->pending = {0, 0, 0, 0};
+        streamDamage(window->name, surface, window->shadow, &window->pending, 0, 0, surface->width(), surface->height());
+    }
+}
+
+/* Positions are in framebuffer coordinates, the compositor wants display coordinates */
+void SparkleC::sendPosition(const std::string &name, int x1, int y1, int x2, int y2)
+{
+    int width = surface_->width();
+    int height = surface_->height();
+
+    if (displayWidth_ > 0 && displayHeight_ > 0 && (width != displayWidth_ || height != displayHeight_))
+    {
+        x1 = static_cast<int64_t>(x1) * displayWidth_ / width;
+        y1 = static_cast<int64_t>(y1) * displayHeight_ / height;
+        x2 = static_cast<int64_t>(x2) * displayWidth_ / width;
+        y2 = static_cast<int64_t>(y2) * displayHeight_ / height;
+    }
+
+    connection_->send(SetSurfacePositionRequest({name, x1, y1, x2, y2}));
+}
+
+SparkleCWindow *SparkleC::findWindow(unsigned int id)
+{
+    auto it = windows_.find(id);
+    if (it == windows_.end())
+        return nullptr;
+
+    return it->second;
+}
+
+void *SparkleC::createWindow(unsigned int id, int width, int height, int stride)
+{
+    destroyWindow(id);
+
+    SparkleCWindow *window = new SparkleCWindow(surfaceName_ + "." + std::to_string(id),
+        createSurface(width, height, stride));
+    windows_[id] = window;
+
+    if (shadowDamage_)
+        window->shadow = new SparkleCShadow(window->surface);
+
+    if (connection_->connected())
+        registerWindow(window);
+
+    return window->surface->data();
+}
+
+/* Registered again under the same name, the compositor keeps its place and the old contents carry over */
+void *SparkleC::resizeWindow(unsigned int id, int width, int height, int stride)
+{
+    SparkleCWindow *window = findWindow(id);
+    if (window == nullptr)
+        return createWindow(id, width, height, stride);
+
+    WereSurface *surface = createSurface(width, height, stride);
+    WereSurface *old = window->surface;
+
+    size_t row = static_cast<size_t>(std::min(width, old->width())) * bytesPerPixel_;
+    for (int y = 0; y < std::min(height, old->height()); ++y)
+    {
+        memcpy(&surface->data()[static_cast<size_t>(y) * surface->stride() * bytesPerPixel_],
+            &old->data()[static_cast<size_t>(y) * old->stride() * bytesPerPixel_], row);
+    }
+
+    delete window->shadow;
+    window->shadow = nullptr;
+    delete old;
+    window->surface = surface;
+    window->pending = {0, 0, 0, 0};
+
+    if (shadowDamage_)
+        window->shadow = new SparkleCShadow(surface);
+
+    if (connection_->connected())
+        registerWindow(window);
+
+    return surface->data();
+}
+
+void SparkleC::destroyWindow(unsigned int id)
+{
+    SparkleCWindow *window = findWindow(id);
+    if (window == nullptr)
+        return;
+
+    connection_->send(UnregisterSurfaceRequest({window->name}));
+
+    windows_.erase(id);
+    delete window;
+}
+
+void SparkleC::setWindowPosition(unsigned int id, int x1, int y1, int x2, int y2)
+{
+    SparkleCWindow *window = findWindow(id);
+    if (window == nullptr)
+        return;
+
+    if (window->x1 == x1 && window->y1 == y1 && window->x2 == x2 && window->y2 == y2)
+        return;
+
+    window->x1 = x1;
+    window->y1 = y1;
+    window->x2 = x2;
+    window->y2 = y2;
+
+    sendPosition(window->name, x1, y1, x2, y2);
+}
+
+void SparkleC::setWindowStrata(unsigned int id, int strata)
+{
+    SparkleCWindow *window = findWindow(id);
+    if (window == nullptr)
+        return;
+
+    if (window->strata == strata)
+        return;
+
+    window->strata = strata;
+
+    connection_->send(SetSurfaceStrataRequest({window->name, strata}));
+}
+
+void SparkleC::damageWindow(unsigned int id, int x1, int y1, int x2, int y2)
+{
+    SparkleCWindow *window = findWindow(id);
+    if (window == nullptr)
+        return;
+
+    sendDamage(window->name, window->surface, window->shadow, &window->pending, x1, y1, x2, y2);
 }
 
 /* ================================================================================================================== */
 
-SparkleC *sparkle_c_create(const char *compositor, const char *surface_name, const char *surface_file)
+SparkleC *sparkle_c_create(const char *compositor, const char *surface_name, const char *surface_file, int depth)
 {
-    return new SparkleC(compositor, surface_name, surface_file);
+    return new SparkleC(compositor, surface_name, surface_file, depth);
 }
 
 void sparkle_c_destroy(SparkleC *c)
@@ -160,9 +995,44 @@ void sparkle_c_damage(SparkleC *c, int x1, int y1, int x2, int y2)
     c->damage(x1, y1, x2, y2);
 }
 
-void sparkle_c_resize_surface(SparkleC *c, int width, int height)
+void sparkle_c_resize_surface(SparkleC *c, int width, int height, int stride)
+{
+    c->resizeSurface(width, height, stride);
+}
+
+void *sparkle_c_window_create(SparkleC *c, unsigned int id, int width, int height, int stride)
+{
+    return c->createWindow(id, width, height, stride);
+}
+
+void *sparkle_c_window_resize(SparkleC *c, unsigned int id, int width, int height, int stride)
+{
+    return c->resizeWindow(id, width, height, stride);
+}
+
+void sparkle_c_window_destroy(SparkleC *c, unsigned int id)
+{
+    c->destroyWindow(id);
+}
+
+void sparkle_c_window_position(SparkleC *c, unsigned int id, int x1, int y1, int x2, int y2)
+{
+    c->setWindowPosition(id, x1, y1, x2, y2);
+}
+
+void sparkle_c_window_strata(SparkleC *c, unsigned int id, int strata)
+{
+    c->setWindowStrata(id, strata);
+}
+
+void sparkle_c_window_damage(SparkleC *c, unsigned int id, int x1, int y1, int x2, int y2)
+{
+    c->damageWindow(id, x1, y1, x2, y2);
+}
+
+void sparkle_c_set_shadow_damage(SparkleC *c, int enable)
 {
-    c->resizeSurface(width, height);
+    c->setShadowDamage(enable != 0);
 }
 
 void sparkle_c_set_display_size_cb(SparkleC *c, void (*f)(void *user, int width, int height), void *user)
@@ -171,4 +1041,10 @@ void sparkle_c_set_display_size_cb(SparkleC *c, void (*f)(void *user, int width,
     c->display_size_user = user;
 }
 
+void sparkle_c_set_purged_cb(SparkleC *c, void (*f)(void *user), void *user)
+{
+    c->purged_callback = f;
+    c->purged_user = user;
+}
+
 /* ================================================================================================================== */
@@ -20,7 +20,7 @@ typedef struct SparkleC SparkleC;
 extern "C" {
 #endif
 
-SparkleC *sparkle_c_create(const char *compositor, const char *surface_name, const char *surface_file);
+SparkleC *sparkle_c_create(const char *compositor, const char *surface_name, const char *surface_file, int depth);
 void sparkle_c_destroy(SparkleC *c);
 
 int sparkle_c_fd(SparkleC *c);
@@ -28,9 +28,22 @@ void sparkle_c_process(SparkleC *c);
 
 void *sparkle_c_surface_data(SparkleC *c);
 void sparkle_c_damage(SparkleC *c, int x1, int y1, int x2, int y2);
-void sparkle_c_resize_surface(SparkleC *c, int width, int height);
+/* Stride is in pixels, at least the width: the rows of the memory may be padded */
+void sparkle_c_resize_surface(SparkleC *c, int width, int height, int stride);
+
+void *sparkle_c_window_create(SparkleC *c, unsigned int id, int width, int height, int stride);
+/* Keeps the name, position and strata, the returned memory starts with the old contents */
+void *sparkle_c_window_resize(SparkleC *c, unsigned int id, int width, int height, int stride);
+void sparkle_c_window_destroy(SparkleC *c, unsigned int id);
+void sparkle_c_window_position(SparkleC *c, unsigned int id, int x1, int y1, int x2, int y2);
+void sparkle_c_window_strata(SparkleC *c, unsigned int id, int strata);
+void sparkle_c_window_damage(SparkleC *c, unsigned int id, int x1, int y1, int x2, int y2);
+
+void sparkle_c_set_shadow_damage(SparkleC *c, int enable);
 
 void sparkle_c_set_display_size_cb(SparkleC *c, void (*f)(void *user, int width, int height), void *user);
+/* Shared memory of the framebuffer or a window was lost while the compositor did not show it */
+void sparkle_c_set_purged_cb(SparkleC *c, void (*f)(void *user), void *user);
 
 #ifdef __cplusplus
 }